@@ -2,10 +2,14 @@
 
 #include <iostream> //cout
 #include <cstring> //memcpy
+#include <vector>
 #include "vulkanDefinitions.h"
 
 extern VkDevice logicalDevice;
 extern VkPhysicalDeviceMemoryProperties memoryProperties;
+extern uint32_t presentQueueId;
+extern uint32_t computeQueueId;
+extern uint32_t transferQueueId;
 
 void MemoryBuffer::destroy()
 {
@@ -32,13 +36,21 @@ uint32_t getMemoryTypeIndex(uint32_t inMemType, VkMemoryPropertyFlags desiredFla
     return 0;
 }
 
-bool createBuffer(VkDeviceSize memSize, VkBufferUsageFlagBits usageFlags, const void* data, MemoryBuffer *buffer)
+bool createBuffer(VkDeviceSize memSize, VkBufferUsageFlagBits usageFlags, const void* data, MemoryBuffer *buffer,
+                  bool sharedWithCompute)
 {
     VkBufferCreateInfo bufferInfo = {};
     bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
     bufferInfo.size = memSize;
     bufferInfo.usage = usageFlags;
     bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    uint32_t families[] = {presentQueueId, computeQueueId};
+    if(sharedWithCompute && computeQueueId != presentQueueId)
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = 2;
+        bufferInfo.pQueueFamilyIndices = families;
+    }
 
     VkResult result = vkCreateBuffer(logicalDevice, &bufferInfo, NULL,
                              &buffer->buffer);
@@ -72,7 +84,8 @@ bool createBuffer(VkDeviceSize memSize, VkBufferUsageFlagBits usageFlags, const
         return false;
     }
 
-    memcpy(mapped, data, memSize);
+    if(data != NULL)
+        memcpy(mapped, data, memSize);
     vkUnmapMemory(logicalDevice, buffer->bufferMemory);
 
     result = vkBindBufferMemory(logicalDevice, buffer->buffer, buffer->bufferMemory, 0);
@@ -86,6 +99,60 @@ bool createBuffer(VkDeviceSize memSize, VkBufferUsageFlagBits usageFlags, const
 }
 
 //Taken from VulkanTools
+bool createDeviceLocalBuffer(VkDeviceSize memSize, VkBufferUsageFlags usageFlags, MemoryBuffer *buffer,
+                             bool sharedWithCompute)
+{
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = memSize;
+    bufferInfo.usage = usageFlags | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    //The copy writes it from the transfer family, so that has to be listed too
+    std::vector<uint32_t> families;
+    families.push_back(presentQueueId);
+    if(computeQueueId != presentQueueId)
+        families.push_back(computeQueueId);
+    if(transferQueueId != presentQueueId && transferQueueId != computeQueueId)
+        families.push_back(transferQueueId);
+    if(sharedWithCompute && families.size() > 1)
+    {
+        bufferInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+        bufferInfo.queueFamilyIndexCount = families.size();
+        bufferInfo.pQueueFamilyIndices = families.data();
+    }
+
+    VkResult result = vkCreateBuffer(logicalDevice, &bufferInfo, NULL, &buffer->buffer);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Buffer creation failed (" << result << ")" << std::endl;
+        return false;
+    }
+
+    VkMemoryRequirements bufferMemoryRequirements = {};
+    vkGetBufferMemoryRequirements(logicalDevice, buffer->buffer, &bufferMemoryRequirements);
+
+    VkMemoryAllocateInfo bufferAllocateInfo = {};
+    bufferAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    bufferAllocateInfo.allocationSize = bufferMemoryRequirements.size;
+    bufferAllocateInfo.memoryTypeIndex = getMemoryTypeIndex(bufferMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+    result = vkAllocateMemory(logicalDevice, &bufferAllocateInfo, NULL, &buffer->bufferMemory);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Buffer memory allocation failed (" << result << ")" << std::endl;
+        return false;
+    }
+
+    result = vkBindBufferMemory(logicalDevice, buffer->buffer, buffer->bufferMemory, 0);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Memory buffer bind failed (" << result << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
 void setImageLayout(
 		VkCommandBuffer cmdbuffer,
 		VkImage image,
@@ -13,7 +13,13 @@ struct MemoryBuffer
 };
 
 uint32_t getMemoryTypeIndex(uint32_t inMemType, VkMemoryPropertyFlags desiredFlags);
-bool createBuffer(VkDeviceSize memSize, VkBufferUsageFlagBits usageFlags, const void* data, MemoryBuffer *buffer);
+//sharedWithCompute makes the buffer concurrent between the graphics and async compute families
+bool createBuffer(VkDeviceSize memSize, VkBufferUsageFlagBits usageFlags, const void* data, MemoryBuffer *buffer,
+                  bool sharedWithCompute = false);
+//No host access, filled through the upload service
+//sharedWithCompute makes it concurrent between the graphics, async compute and transfer families
+bool createDeviceLocalBuffer(VkDeviceSize memSize, VkBufferUsageFlags usageFlags, MemoryBuffer *buffer,
+                             bool sharedWithCompute = false);
 void setImageLayout(
 		VkCommandBuffer cmdbuffer,
 		VkImage image,
@@ -0,0 +1,182 @@
+#include "bindless.h"
+
+#include <iostream>
+#include <cstring>
+#include "vulkanDefinitions.h"
+
+extern VkDevice logicalDevice;
+extern VkPhysicalDevice mainPhysicalDevice;
+
+bool BindlessScene::supported(const VkPhysicalDeviceFeatures &features, const std::vector<Mesh> &meshes)
+{
+    if(!features.shaderSampledImageArrayDynamicIndexing)
+    {
+        std::cout << "Bindless: no dynamic sampler array indexing" << std::endl;
+        return false;
+    }
+
+    VkPhysicalDeviceProperties properties;
+    vkGetPhysicalDeviceProperties(mainPhysicalDevice, &properties);
+    if(properties.limits.maxPerStageDescriptorSampledImages < MAX_BINDLESS_TEXTURES ||
+       properties.limits.maxPerStageDescriptorSamplers < MAX_BINDLESS_TEXTURES)
+    {
+        std::cout << "Bindless: texture array larger than per-stage limits" << std::endl;
+        return false;
+    }
+
+    uint32_t textureCount = 0;
+    for(uint32_t i = 0; i < meshes.size(); i++)
+    {
+        if(meshes[i].textured)
+            textureCount++;
+    }
+    if(textureCount == 0 || textureCount > MAX_BINDLESS_TEXTURES)
+    {
+        std::cout << "Bindless: " << textureCount << " textures, needs 1-" << MAX_BINDLESS_TEXTURES << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool BindlessScene::create(const std::vector<Mesh> &meshes, uint32_t objectDataSize, uint32_t frameSlots,
+                           const ShaderReflection &reflection, DescriptorLayoutCache &layoutCache, DescriptorAllocator &allocator)
+{
+    if(reflection.sets.size() != 2 || reflection.sets[1].size() != 3 ||
+       reflection.sets[1][1].descriptorCount != MAX_BINDLESS_TEXTURES ||
+       reflection.pushConstantRange.size != sizeof(BindlessDrawConstants))
+    {
+        std::cout << "Bindless shaders do not match the scene tables" << std::endl;
+        return false;
+    }
+
+    objectSize = objectDataSize;
+    objectCount = meshes.size();
+
+    //Tables
+    uint32_t textureCount = 0;
+    std::vector<BindlessMaterial> materials;
+    //Entry 0 is for meshes without materials
+    BindlessMaterial defaultMaterial;
+    defaultMaterial.diffuseColour = glm::vec4(1,1,1,1);
+    defaultMaterial.specularColour = glm::vec4(0,0,0,0);
+    materials.push_back(defaultMaterial);
+
+    draws.resize(meshes.size());
+    for(uint32_t i = 0; i < meshes.size(); i++)
+    {
+        draws[i].objectIndex = i;
+        draws[i].textureIndex = -1;
+        draws[i].materialBase = 0;
+
+        if(meshes[i].textured)
+            draws[i].textureIndex = textureCount++;
+
+        if(!meshes[i].materials.empty())
+        {
+            draws[i].materialBase = materials.size();
+            for(uint32_t j = 0; j < meshes[i].materials.size(); j++)
+            {
+                const MaterialBuffer &source = meshes[i].materials[j].materialBuffer;
+                BindlessMaterial material;
+                material.diffuseColour = glm::vec4(source.diffuseColour, 1);
+                material.specularColour = glm::vec4(source.specularColour, source.shininess);
+                materials.push_back(material);
+            }
+        }
+    }
+    if(!createBuffer(objectSize * objectCount * frameSlots, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, NULL, &objectBuffer))
+        return false;
+    if(!createBuffer(sizeof(BindlessMaterial) * materials.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                     materials.data(), &materialBuffer))
+        return false;
+
+    //Layout and set
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    if(!reflection.createSetLayouts(layoutCache, &setLayouts))
+        return false;
+    layout = setLayouts[1];
+    if(!allocator.allocate(layout, &set))
+        return false;
+
+    VkDescriptorBufferInfo objectInfo = {objectBuffer.buffer, 0, VK_WHOLE_SIZE};
+    VkDescriptorBufferInfo materialInfo = {materialBuffer.buffer, 0, VK_WHOLE_SIZE};
+
+    VkWriteDescriptorSet writes[2] = {};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = set;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[0].pBufferInfo = &objectInfo;
+
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = set;
+    writes[1].dstBinding = 2;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    writes[1].pBufferInfo = &materialInfo;
+    vkUpdateDescriptorSets(logicalDevice, 2, writes, 0, NULL);
+    writeTextures(meshes);
+
+    if(!reflection.createPipelineLayout(setLayouts, &pipelineLayout))
+        return false;
+    pushStages = reflection.pushConstantRange.stageFlags;
+
+    enabled = true;
+    std::cout << "Bindless scene: " << meshes.size() << " objects, " << materials.size() << " materials" << std::endl;
+
+    return true;
+}
+
+//Whole texture table in one write, again whenever residency swaps a mesh's texture
+void BindlessScene::writeTextures(const std::vector<Mesh> &meshes)
+{
+    std::vector<VkDescriptorImageInfo> imageInfos;
+    for(uint32_t i = 0; i < meshes.size(); i++)
+    {
+        if(draws[i].textureIndex < 0)
+            continue;
+        VkDescriptorImageInfo imageInfo;
+        imageInfo.sampler = meshes[i].tex->sampler;
+        imageInfo.imageView = meshes[i].tex->textureView;
+        imageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+        imageInfos.push_back(imageInfo);
+    }
+    //No partially bound descriptors in core, unused slots repeat the first texture
+    while(imageInfos.size() < MAX_BINDLESS_TEXTURES)
+    {
+        imageInfos.push_back(imageInfos[0]);
+    }
+
+    VkWriteDescriptorSet write = {};
+    write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    write.dstSet = set;
+    write.dstBinding = 1;
+    write.descriptorCount = MAX_BINDLESS_TEXTURES;
+    write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    write.pImageInfo = imageInfos.data();
+    vkUpdateDescriptorSets(logicalDevice, 1, &write, 0, NULL);
+}
+
+//Every object for one frame slot
+void BindlessScene::writeObjects(uint32_t slot, const void *data)
+{
+    VkDeviceSize slotSize = objectSize * objectCount;
+    void *mapped;
+    vkMapMemory(logicalDevice, objectBuffer.bufferMemory, slot * slotSize, slotSize, 0, &mapped);
+    memcpy(mapped, data, slotSize);
+    vkUnmapMemory(logicalDevice, objectBuffer.bufferMemory);
+}
+
+//Also cleans up after a partial create, the set layout belongs to the cache
+void BindlessScene::destroy()
+{
+    vkDestroyPipelineLayout(logicalDevice, pipelineLayout, NULL);
+    objectBuffer.destroy();
+    materialBuffer.destroy();
+    pipelineLayout = VK_NULL_HANDLE;
+    objectBuffer = {};
+    materialBuffer = {};
+    enabled = false;
+}
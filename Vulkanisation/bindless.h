@@ -0,0 +1,57 @@
+#ifndef BINDLESS_H_INCLUDED
+#define BINDLESS_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+
+#include "mesh.h"
+#include "assorted.h" //MemoryBuffer
+#include "descriptors.h"
+#include "shaderReflection.h"
+
+//Must match MAX_TEXTURES in bindless.frag
+const uint32_t MAX_BINDLESS_TEXTURES = 16;
+
+//Pushed per draw, indexes the scene tables
+struct BindlessDrawConstants
+{
+    int32_t objectIndex;
+    int32_t textureIndex; //-1 uses the material colour
+    int32_t materialBase;
+};
+
+//std430 layout of MaterialBuffer
+struct BindlessMaterial
+{
+    glm::vec4 diffuseColour;
+    glm::vec4 specularColour; //w is shininess
+};
+
+//Set 1 of a scene pass: object transforms, mesh textures and materials, the camera is set 0
+//Sticks to core 1.0 (no descriptor indexing), so the texture array has a fixed size
+//and every slot must hold a valid image
+struct BindlessScene
+{
+    bool enabled = false;
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkDescriptorSet set = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    VkShaderStageFlags pushStages = 0;
+    MemoryBuffer objectBuffer = {};
+    MemoryBuffer materialBuffer = {};
+    uint32_t objectSize = 0;
+    uint32_t objectCount = 0; //Per frame slot, each slot has its own range of the object buffer
+    std::vector<BindlessDrawConstants> draws; //One per mesh, object indices are relative to the slot
+
+    static bool supported(const VkPhysicalDeviceFeatures &features, const std::vector<Mesh> &meshes);
+    //Layouts come from the reflected bindless shaders: set 0 camera, set 1 the scene tables
+    bool create(const std::vector<Mesh> &meshes, uint32_t objectDataSize, uint32_t frameSlots,
+                const ShaderReflection &reflection, DescriptorLayoutCache &layoutCache, DescriptorAllocator &allocator);
+    //Again whenever a mesh's texture is replaced, only while the set is not in use
+    void writeTextures(const std::vector<Mesh> &meshes);
+    void writeObjects(uint32_t slot, const void *data);
+    void destroy();
+};
+
+#endif // BINDLESS_H_INCLUDED
@@ -0,0 +1,135 @@
+#include "cpuProfiler.h"
+
+#include <iostream>
+#include <fstream>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+struct ProfileEvent
+{
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+};
+
+//Only the owning thread writes, count is published after the event so a dump sees whole events
+struct ProfileThreadBuffer
+{
+    std::vector<ProfileEvent> events;
+    std::atomic<uint32_t> count;
+    uint32_t threadId;
+    std::string threadName;
+};
+
+static const uint32_t EVENTS_PER_THREAD = 1 << 16;
+
+static std::atomic<bool> recording(false);
+static std::mutex registryMutex; //Only taken the first time a thread records
+static std::vector<ProfileThreadBuffer*> threadBuffers;
+static thread_local ProfileThreadBuffer* localBuffer = NULL;
+static std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+static uint64_t nowNs()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+static ProfileThreadBuffer* getThreadBuffer()
+{
+    if(localBuffer == NULL)
+    {
+        localBuffer = new ProfileThreadBuffer();
+        localBuffer->events.resize(EVENTS_PER_THREAD);
+        localBuffer->count = 0;
+
+        std::lock_guard<std::mutex> lock(registryMutex);
+        localBuffer->threadId = threadBuffers.size();
+        localBuffer->threadName = "thread " + std::to_string(localBuffer->threadId);
+        threadBuffers.push_back(localBuffer);
+    }
+    return localBuffer;
+}
+
+void profilerEnable(bool enable)
+{
+    recording.store(enable, std::memory_order_relaxed);
+}
+
+bool profilerEnabled()
+{
+    return recording.load(std::memory_order_relaxed);
+}
+
+void profilerSetThreadName(const char* name)
+{
+    ProfileThreadBuffer* buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(registryMutex);
+    buffer->threadName = name;
+}
+
+ProfileZone::ProfileZone(const char* zoneName)
+{
+    name = NULL;
+    if(!recording.load(std::memory_order_relaxed))
+        return;
+    name = zoneName;
+    start = nowNs();
+}
+
+ProfileZone::~ProfileZone()
+{
+    if(name == NULL)
+        return;
+
+    ProfileThreadBuffer* buffer = getThreadBuffer();
+    uint32_t index = buffer->count.load(std::memory_order_relaxed);
+    if(index >= buffer->events.size())
+        return; //Full, later zones are dropped
+
+    ProfileEvent& event = buffer->events[index];
+    event.name = name;
+    event.start = start;
+    event.duration = nowNs() - start;
+    buffer->count.store(index + 1, std::memory_order_release);
+}
+
+bool profilerWriteTrace(std::string filename)
+{
+    std::ofstream file(filename.c_str());
+    if(!file.is_open())
+    {
+        std::cout << "Trace file could not be opened: " << filename << std::endl;
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    file << "{\"traceEvents\":[\n";
+    bool first = true;
+    uint64_t total = 0;
+    for(uint32_t i = 0; i < threadBuffers.size(); i++)
+    {
+        ProfileThreadBuffer* buffer = threadBuffers[i];
+
+        if(!first)
+            file << ",\n";
+        first = false;
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":" << buffer->threadId
+             << ",\"args\":{\"name\":\"" << buffer->threadName << "\"}}";
+
+        uint32_t count = buffer->count.load(std::memory_order_acquire);
+        for(uint32_t j = 0; j < count; j++)
+        {
+            const ProfileEvent& event = buffer->events[j];
+            //Timestamps in microseconds
+            file << ",\n{\"name\":\"" << event.name << "\",\"ph\":\"X\",\"pid\":0,\"tid\":" << buffer->threadId
+                 << ",\"ts\":" << event.start / 1000.0 << ",\"dur\":" << event.duration / 1000.0 << "}";
+        }
+        total += count;
+    }
+    file << "\n]}\n";
+
+    std::cout << "Trace written: " << filename << " (" << total << " zones)" << std::endl;
+    return true;
+}
@@ -0,0 +1,35 @@
+#ifndef CPUPROFILER_H_INCLUDED
+#define CPUPROFILER_H_INCLUDED
+
+#include <string>
+#include <cstdint>
+
+//Scoped CPU zones, written to Chrome trace_event JSON (chrome://tracing, ui.perfetto.dev)
+//Each thread appends to its own buffer, nothing is locked while recording
+//Recording is off until profilerEnable, define DISABLE_PROFILER to compile zones out
+
+void profilerEnable(bool enable);
+bool profilerEnabled();
+void profilerSetThreadName(const char* name);
+bool profilerWriteTrace(std::string filename);
+
+struct ProfileZone
+{
+    const char* name;
+    uint64_t start;
+
+    ProfileZone(const char* zoneName);
+    ~ProfileZone();
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a ## b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef DISABLE_PROFILER
+#define PROFILE_ZONE(name)
+#else
+//Name must be a string literal, only the pointer is stored
+#define PROFILE_ZONE(name) ProfileZone PROFILE_CONCAT(profileZone, __LINE__)(name)
+#endif // DISABLE_PROFILER
+
+#endif // CPUPROFILER_H_INCLUDED
@@ -0,0 +1,218 @@
+#include "descriptors.h"
+
+#include <iostream>
+#include <algorithm> //sort, max
+#include "vulkanDefinitions.h"
+
+extern VkDevice logicalDevice;
+
+static bool bindingOrder(const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b)
+{
+    return a.binding < b.binding;
+}
+
+bool DescriptorLayoutCache::BindingsLess::operator()(const std::vector<VkDescriptorSetLayoutBinding> &a,
+                                                     const std::vector<VkDescriptorSetLayoutBinding> &b) const
+{
+    if(a.size() != b.size())
+        return a.size() < b.size();
+    for(uint32_t i = 0; i < a.size(); i++)
+    {
+        if(a[i].binding != b[i].binding)
+            return a[i].binding < b[i].binding;
+        if(a[i].descriptorType != b[i].descriptorType)
+            return a[i].descriptorType < b[i].descriptorType;
+        if(a[i].descriptorCount != b[i].descriptorCount)
+            return a[i].descriptorCount < b[i].descriptorCount;
+        if(a[i].stageFlags != b[i].stageFlags)
+            return a[i].stageFlags < b[i].stageFlags;
+        //Same samplers in different arrays are the same layout
+        if((a[i].pImmutableSamplers == NULL) != (b[i].pImmutableSamplers == NULL))
+            return a[i].pImmutableSamplers == NULL;
+        if(a[i].pImmutableSamplers == NULL)
+            continue;
+        for(uint32_t j = 0; j < a[i].descriptorCount; j++)
+        {
+            if(a[i].pImmutableSamplers[j] != b[i].pImmutableSamplers[j])
+                return a[i].pImmutableSamplers[j] < b[i].pImmutableSamplers[j];
+        }
+    }
+    return false;
+}
+
+bool DescriptorLayoutCache::get(std::vector<VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayout *layout)
+{
+    //Binding order in the create info doesn't change the layout
+    std::sort(bindings.begin(), bindings.end(), bindingOrder);
+
+    std::map<std::vector<VkDescriptorSetLayoutBinding>, VkDescriptorSetLayout, BindingsLess>::iterator found = layouts.find(bindings);
+    if(found != layouts.end())
+    {
+        hits++;
+        *layout = found->second;
+        return true;
+    }
+
+    VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.bindingCount = bindings.size();
+    layoutCreateInfo.pBindings = bindings.data();
+
+    VkResult result = vkCreateDescriptorSetLayout(logicalDevice, &layoutCreateInfo, NULL, layout);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Descriptor set layout creation failed (" << result << ")" << std::endl;
+        return false;
+    }
+    layouts[bindings] = *layout;
+
+    return true;
+}
+
+void DescriptorLayoutCache::destroy()
+{
+    std::map<std::vector<VkDescriptorSetLayoutBinding>, VkDescriptorSetLayout, BindingsLess>::iterator it;
+    for(it = layouts.begin(); it != layouts.end(); it++)
+    {
+        vkDestroyDescriptorSetLayout(logicalDevice, it->second, NULL);
+    }
+    layouts.clear();
+}
+
+bool DescriptorLayoutCache::bindings(VkDescriptorSetLayout layout, std::vector<VkDescriptorSetLayoutBinding> *bindings)
+{
+    std::map<std::vector<VkDescriptorSetLayoutBinding>, VkDescriptorSetLayout, BindingsLess>::iterator it;
+    for(it = layouts.begin(); it != layouts.end(); it++)
+    {
+        if(it->second == layout)
+        {
+            *bindings = it->first;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool DescriptorAllocator::nextPool(VkDescriptorSetLayout layout)
+{
+    if(currentPool != VK_NULL_HANDLE)
+        usedPools.push_back(currentPool);
+
+    if(!freePools.empty())
+    {
+        currentPool = freePools.back();
+        freePools.pop_back();
+        return true;
+    }
+
+    //Rough mix of what the scene's sets use, per set
+    std::map<VkDescriptorType, uint32_t> typeCounts;
+    typeCounts[VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER] = setsPerPool * 2;
+    typeCounts[VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER] = setsPerPool * 2;
+    typeCounts[VK_DESCRIPTOR_TYPE_STORAGE_BUFFER] = setsPerPool;
+
+    //The set being allocated has to fit even when it is bigger than the whole mix
+    std::vector<VkDescriptorSetLayoutBinding> bindings;
+    if(layoutCache != NULL && layoutCache->bindings(layout, &bindings))
+    {
+        std::map<VkDescriptorType, uint32_t> layoutCounts;
+        for(uint32_t i = 0; i < bindings.size(); i++)
+        {
+            layoutCounts[bindings[i].descriptorType] += bindings[i].descriptorCount;
+        }
+        std::map<VkDescriptorType, uint32_t>::iterator it;
+        for(it = layoutCounts.begin(); it != layoutCounts.end(); it++)
+        {
+            typeCounts[it->first] = std::max(typeCounts[it->first], it->second);
+        }
+    }
+
+    std::vector<VkDescriptorPoolSize> poolSizes;
+    std::map<VkDescriptorType, uint32_t>::iterator it;
+    for(it = typeCounts.begin(); it != typeCounts.end(); it++)
+    {
+        VkDescriptorPoolSize poolSize;
+        poolSize.type = it->first;
+        poolSize.descriptorCount = it->second;
+        poolSizes.push_back(poolSize);
+    }
+
+    VkDescriptorPoolCreateInfo poolCreateInfo = {};
+    poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+    poolCreateInfo.poolSizeCount = poolSizes.size();
+    poolCreateInfo.pPoolSizes = poolSizes.data();
+    poolCreateInfo.maxSets = setsPerPool;
+
+    VkResult result = vkCreateDescriptorPool(logicalDevice, &poolCreateInfo, NULL, &currentPool);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Descriptor pool creation failed (" << result << ")" << std::endl;
+        currentPool = VK_NULL_HANDLE;
+        return false;
+    }
+
+    return true;
+}
+
+bool DescriptorAllocator::allocate(VkDescriptorSetLayout layout, VkDescriptorSet *set)
+{
+    if(currentPool == VK_NULL_HANDLE && !nextPool(layout))
+        return false;
+
+    VkDescriptorSetAllocateInfo allocInfo = {};
+    allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+    allocInfo.descriptorPool = currentPool;
+    allocInfo.descriptorSetCount = 1;
+    allocInfo.pSetLayouts = &layout;
+
+    VkResult result = vkAllocateDescriptorSets(logicalDevice, &allocInfo, set);
+    if(result == VK_SUCCESS)
+        return true;
+    if(result == VK_ERROR_OUT_OF_HOST_MEMORY)
+    {
+        std::cout << "Descriptor set allocation failed (" << result << ")" << std::endl;
+        return false;
+    }
+
+    //Anything else means this pool is exhausted or fragmented, move on to the next one
+    //Recycled pools were sized for other sets, only a freshly made pool is the last try
+    while(true)
+    {
+        bool freshPool = freePools.empty();
+        if(!nextPool(layout))
+            return false;
+        allocInfo.descriptorPool = currentPool;
+        result = vkAllocateDescriptorSets(logicalDevice, &allocInfo, set);
+        if(result == VK_SUCCESS)
+            return true;
+        if(freshPool || result == VK_ERROR_OUT_OF_HOST_MEMORY)
+        {
+            std::cout << "Descriptor set allocation failed (" << result << ")" << std::endl;
+            return false;
+        }
+    }
+}
+
+void DescriptorAllocator::reset()
+{
+    if(currentPool != VK_NULL_HANDLE)
+        usedPools.push_back(currentPool);
+    currentPool = VK_NULL_HANDLE;
+
+    for(uint32_t i = 0; i < usedPools.size(); i++)
+    {
+        vkResetDescriptorPool(logicalDevice, usedPools[i], 0);
+        freePools.push_back(usedPools[i]);
+    }
+    usedPools.clear();
+}
+
+void DescriptorAllocator::destroy()
+{
+    reset();
+    for(uint32_t i = 0; i < freePools.size(); i++)
+    {
+        vkDestroyDescriptorPool(logicalDevice, freePools[i], NULL);
+    }
+    freePools.clear();
+}
@@ -0,0 +1,43 @@
+#ifndef DESCRIPTORS_H_INCLUDED
+#define DESCRIPTORS_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <map>
+
+//Set layouts keyed by their bindings, every caller asking for the same signature shares one layout
+//Keys keep the caller's pImmutableSamplers pointers, those arrays have to outlive the cache
+struct DescriptorLayoutCache
+{
+    struct BindingsLess
+    {
+        bool operator()(const std::vector<VkDescriptorSetLayoutBinding> &a,
+                        const std::vector<VkDescriptorSetLayoutBinding> &b) const;
+    };
+    std::map<std::vector<VkDescriptorSetLayoutBinding>, VkDescriptorSetLayout, BindingsLess> layouts;
+    uint32_t hits = 0;
+
+    bool get(std::vector<VkDescriptorSetLayoutBinding> bindings, VkDescriptorSetLayout *layout);
+    bool bindings(VkDescriptorSetLayout layout, std::vector<VkDescriptorSetLayoutBinding> *bindings);
+    void destroy();
+};
+
+//Hands out sets from a chain of pools, a new pool is added whenever the current one runs out
+//reset() returns every pool at once, so sets from a per-frame allocator only live for that frame
+struct DescriptorAllocator
+{
+    uint32_t setsPerPool = 64;
+    DescriptorLayoutCache *layoutCache = NULL; //Where to look up a set's bindings when sizing a new pool
+    VkDescriptorPool currentPool = VK_NULL_HANDLE;
+    std::vector<VkDescriptorPool> usedPools;
+    std::vector<VkDescriptorPool> freePools;
+
+    bool allocate(VkDescriptorSetLayout layout, VkDescriptorSet *set);
+    void reset();
+    void destroy();
+
+    bool nextPool(VkDescriptorSetLayout layout);
+};
+
+#endif // DESCRIPTORS_H_INCLUDED
@@ -0,0 +1,166 @@
+#include "deviceSelection.h"
+
+#include <iostream>
+#include "vulkanDefinitions.h"
+
+std::string deviceTypeName(VkPhysicalDeviceType type)
+{
+    std::string deviceTypes[5] = {"VK_PHYSICAL_DEVICE_TYPE_OTHER",
+                                  "VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU",
+                                  "VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU",
+                                  "VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU",
+                                  "VK_PHYSICAL_DEVICE_TYPE_CPU",};
+    if(type > VK_PHYSICAL_DEVICE_TYPE_CPU)
+        return "Unknown";
+    return deviceTypes[type];
+}
+
+//First family with every wanted flag and none of the avoided ones
+static uint32_t findFamily(const std::vector<VkQueueFamilyProperties> &families, VkQueueFlags want, VkQueueFlags avoid)
+{
+    for(uint32_t i = 0; i < families.size(); i++)
+    {
+        if(families[i].queueCount > 0 && (families[i].queueFlags & want) == want && (families[i].queueFlags & avoid) == 0)
+            return i;
+    }
+    return NO_QUEUE_FAMILY;
+}
+
+bool inspectDevice(VkPhysicalDevice device, VkSurfaceKHR surface, DeviceCandidate *candidate)
+{
+    candidate->device = device;
+    vkGetPhysicalDeviceProperties(device, &candidate->properties);
+    vkGetPhysicalDeviceFeatures(device, &candidate->features);
+    vkGetPhysicalDeviceMemoryProperties(device, &candidate->memory);
+
+    uint32_t familyCount = 0;
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, NULL);
+    candidate->queueFamilies.resize(familyCount);
+    vkGetPhysicalDeviceQueueFamilyProperties(device, &familyCount, candidate->queueFamilies.data());
+
+    for(uint32_t i = 0; i < familyCount; i++)
+    {
+        if(candidate->queueFamilies[i].queueCount == 0 || (candidate->queueFamilies[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) == 0)
+            continue;
+
+        VkBool32 supportsPresent = VK_TRUE;
+        if(surface != VK_NULL_HANDLE)
+            vkGetPhysicalDeviceSurfaceSupportKHR(device, i, surface, &supportsPresent);
+        if(supportsPresent == VK_TRUE)
+        {
+            candidate->graphicsFamily = i;
+            break;
+        }
+    }
+    if(candidate->graphicsFamily == NO_QUEUE_FAMILY)
+    {
+        candidate->score = -1;
+        return false;
+    }
+
+    //Copy only families are the DMA engines. Texture layers are copied as sub-regions,
+    //so one that can't copy at texel granularity is left alone
+    candidate->transferFamily = findFamily(candidate->queueFamilies, VK_QUEUE_TRANSFER_BIT,
+                                           VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT);
+    if(candidate->transferFamily != NO_QUEUE_FAMILY)
+    {
+        VkExtent3D granularity = candidate->queueFamilies[candidate->transferFamily].minImageTransferGranularity;
+        if(granularity.width != 1 || granularity.height != 1 || granularity.depth != 1)
+            candidate->transferFamily = NO_QUEUE_FAMILY;
+    }
+    if(candidate->transferFamily == NO_QUEUE_FAMILY)
+        candidate->transferFamily = candidate->graphicsFamily;
+
+    candidate->computeFamily = findFamily(candidate->queueFamilies, VK_QUEUE_COMPUTE_BIT, VK_QUEUE_GRAPHICS_BIT);
+    if(candidate->computeFamily == NO_QUEUE_FAMILY)
+        candidate->computeFamily = candidate->graphicsFamily;
+
+    candidate->deviceLocalBytes = 0;
+    for(uint32_t i = 0; i < candidate->memory.memoryHeapCount; i++)
+    {
+        const VkMemoryHeap &heap = candidate->memory.memoryHeaps[i];
+        if((heap.flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) && heap.size > candidate->deviceLocalBytes)
+            candidate->deviceLocalBytes = heap.size;
+    }
+
+    //Type outweighs everything else, then memory in MiB, then what this renderer can make use of
+    int64_t typeScores[5] = {0, 3, 4, 2, 1};
+    int64_t typeScore = candidate->properties.deviceType <= VK_PHYSICAL_DEVICE_TYPE_CPU ?
+                            typeScores[candidate->properties.deviceType] : 0;
+    candidate->score = typeScore * 1000000000LL;
+    candidate->score += candidate->deviceLocalBytes / (1024 * 1024);
+    if(candidate->features.shaderSampledImageArrayDynamicIndexing)
+        candidate->score += 100000; //Bindless texture table
+    if(candidate->properties.limits.timestampComputeAndGraphics)
+        candidate->score += 10000; //GPU timings and render scale
+    if(candidate->dedicatedTransfer())
+        candidate->score += 5000;
+    if(candidate->asyncCompute())
+        candidate->score += 5000;
+
+    return true;
+}
+
+bool selectDevice(VkInstance instance, VkSurfaceKHR surface, int forcedIndex, DeviceCandidate *chosen)
+{
+    //Count number of Vulkan Supported GPUs
+    uint32_t deviceCount = 0;
+    VkResult result = vkEnumeratePhysicalDevices(instance, &deviceCount, NULL);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Device count failed (" << result << ")" << std::endl;
+        return false;
+    }
+    else if(deviceCount < 1)
+    {
+        std::cout << "No GPU installed?" << std::endl;
+        return false;
+    }
+    else
+    {
+        std::cout << "Device count: " << deviceCount << std::endl;
+    }
+    //Get actual devices after checking for existence
+    std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
+    result = vkEnumeratePhysicalDevices(instance, &deviceCount, physicalDevices.data());
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Device retrieval failed (" << result << ")" << std::endl;
+        return false;
+    }
+
+    int best = -1;
+    std::vector<DeviceCandidate> candidates(deviceCount);
+    for(uint32_t i = 0; i < deviceCount; i++)
+    {
+        bool usable = inspectDevice(physicalDevices[i], surface, &candidates[i]);
+        std::cout << "Device " << i << ": " << candidates[i].properties.deviceName
+                  << " (" << deviceTypeName(candidates[i].properties.deviceType) << ", "
+                  << candidates[i].deviceLocalBytes / (1024 * 1024) << " MiB) ";
+        if(!usable)
+        {
+            std::cout << "unusable, no graphics queue that can present" << std::endl;
+            continue;
+        }
+        std::cout << "score " << candidates[i].score << std::endl;
+
+        if(best < 0 || candidates[i].score > candidates[best].score)
+            best = i;
+    }
+
+    if(forcedIndex >= 0)
+    {
+        if((uint32_t)forcedIndex < deviceCount && candidates[forcedIndex].score >= 0)
+            best = forcedIndex;
+        else
+            std::cout << "Device " << forcedIndex << " can't be used, picking by score" << std::endl;
+    }
+    if(best < 0)
+    {
+        std::cout << "No usable device" << std::endl;
+        return false;
+    }
+
+    *chosen = candidates[best];
+    return true;
+}
@@ -0,0 +1,36 @@
+#ifndef DEVICESELECTION_H_INCLUDED
+#define DEVICESELECTION_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+
+const uint32_t NO_QUEUE_FAMILY = 0xFFFFFFFF;
+
+//Everything device selection looked at for one physical device
+//Transfer and compute families are the graphics family when the hardware has nothing separate for them
+struct DeviceCandidate
+{
+    VkPhysicalDevice device = VK_NULL_HANDLE;
+    VkPhysicalDeviceProperties properties = {};
+    VkPhysicalDeviceFeatures features = {};
+    VkPhysicalDeviceMemoryProperties memory = {};
+    std::vector<VkQueueFamilyProperties> queueFamilies;
+    uint32_t graphicsFamily = NO_QUEUE_FAMILY; //Also presents when there is a surface
+    uint32_t transferFamily = NO_QUEUE_FAMILY;
+    uint32_t computeFamily = NO_QUEUE_FAMILY;
+    VkDeviceSize deviceLocalBytes = 0; //Largest device local heap
+    int64_t score = -1; //Negative when the device can't be used
+
+    bool dedicatedTransfer() const { return transferFamily != graphicsFamily; }
+    bool asyncCompute() const { return computeFamily != graphicsFamily; }
+};
+
+//Fills and scores a candidate, surface is VK_NULL_HANDLE when nothing is presented
+bool inspectDevice(VkPhysicalDevice device, VkSurfaceKHR surface, DeviceCandidate *candidate);
+//Highest score wins, forcedIndex picks a device by enumeration order instead when it is usable
+bool selectDevice(VkInstance instance, VkSurfaceKHR surface, int forcedIndex, DeviceCandidate *chosen);
+std::string deviceTypeName(VkPhysicalDeviceType type);
+
+#endif // DEVICESELECTION_H_INCLUDED
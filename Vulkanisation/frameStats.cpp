@@ -0,0 +1,103 @@
+#include "frameStats.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip> //setprecision
+
+void FrameStats::create(uint32_t windowSize, uint32_t bucketCount, float bucketWidthMs)
+{
+    window.resize(windowSize);
+    histogram.assign(bucketCount, 0);
+    bucketMs = bucketWidthMs;
+    totalFrames = 0;
+    totalMs = 0;
+    worstMs = 0;
+}
+
+void FrameStats::add(float frameMs)
+{
+    window.add(frameMs);
+
+    if(!histogram.empty())
+    {
+        uint32_t bucket = (uint32_t)(frameMs / bucketMs);
+        if(bucket >= histogram.size())
+            bucket = histogram.size() - 1;
+        histogram[bucket]++;
+    }
+
+    totalFrames++;
+    totalMs += frameMs;
+    if(frameMs > worstMs)
+        worstMs = frameMs;
+}
+
+float FrameStats::onePercentLowFps() const
+{
+    if(window.count == 0)
+        return 0;
+    std::vector<float> ordered = window.sorted();
+    uint32_t slowest = ordered.size() / 100;
+    if(slowest < 1)
+        slowest = 1;
+
+    double total = 0;
+    for(uint32_t i = ordered.size() - slowest; i < ordered.size(); i++)
+    {
+        total += ordered[i];
+    }
+    double averageMs = total / slowest;
+    if(averageMs <= 0)
+        return 0;
+    return (float)(1000.0 / averageMs);
+}
+
+std::string FrameStats::overlayText() const
+{
+    if(window.count == 0)
+        return "";
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    ss << " | frame p50 " << window.percentile(50) << "ms p99 " << window.percentile(99)
+       << "ms 1% low " << std::setprecision(0) << onePercentLowFps() << "fps";
+    return ss.str();
+}
+
+bool FrameStats::writeSummary(std::string filename) const
+{
+    std::ofstream file(filename.c_str());
+    if(!file.is_open())
+    {
+        std::cout << "Frame stats summary could not be opened: " << filename << std::endl;
+        return false;
+    }
+
+    file << std::fixed << std::setprecision(3);
+    file << "frames " << totalFrames << std::endl;
+    file << "duration_s " << totalMs / 1000.0 << std::endl;
+    file << "average_fps " << (totalMs > 0 ? totalFrames * 1000.0 / totalMs : 0) << std::endl;
+    file << "worst_ms " << worstMs << std::endl;
+    file << "window_frames " << window.count << std::endl;
+    file << "p50_ms " << window.percentile(50) << std::endl;
+    file << "p95_ms " << window.percentile(95) << std::endl;
+    file << "p99_ms " << window.percentile(99) << std::endl;
+    file << "max_ms " << window.max() << std::endl;
+    file << "one_percent_low_fps " << onePercentLowFps() << std::endl;
+
+    file << std::endl << "histogram_ms count" << std::endl;
+    for(uint32_t i = 0; i < histogram.size(); i++)
+    {
+        if(histogram[i] == 0)
+            continue;
+        file << std::setprecision(1) << i * bucketMs;
+        if(i + 1 == histogram.size())
+            file << "+";
+        else
+            file << "-" << (i + 1) * bucketMs;
+        file << " " << histogram[i] << std::endl;
+    }
+
+    std::cout << "Frame stats written: " << filename << std::endl;
+    return true;
+}
@@ -0,0 +1,31 @@
+#ifndef FRAMESTATS_H_INCLUDED
+#define FRAMESTATS_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <cstdint>
+
+#include "rollingStats.h"
+
+//CPU frame-to-frame times
+//Percentiles come from the most recent window, the histogram and totals cover the whole run
+struct FrameStats
+{
+    RollingStats window;
+    std::vector<uint64_t> histogram; //Last bucket collects everything past the end
+    float bucketMs = 1.0f;
+
+    uint64_t totalFrames = 0;
+    double totalMs = 0;
+    float worstMs = 0;
+
+    void create(uint32_t windowSize, uint32_t bucketCount, float bucketWidthMs);
+    void add(float frameMs);
+
+    //Average fps over the slowest 1% of frames in the window
+    float onePercentLowFps() const;
+    std::string overlayText() const;
+    bool writeSummary(std::string filename) const;
+};
+
+#endif // FRAMESTATS_H_INCLUDED
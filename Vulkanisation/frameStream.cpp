@@ -0,0 +1,240 @@
+#include "frameStream.h"
+
+#include <iostream>
+#include <thread>
+#include <cstring>
+#include <algorithm> //max
+#include <new>
+#include <csignal>
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#include <fcntl.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "cpuProfiler.h"
+
+const uint32_t FRAME_STREAM_VERSION = 1;
+const uint32_t FRAME_STREAM_ALIGNMENT = 64;
+
+static uint64_t alignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+bool FrameStream::configure(std::string streamTarget, uint32_t slots, float framesPerSecond)
+{
+    target = streamTarget;
+    slotCount = std::max(1u, slots);
+    fps = framesPerSecond;
+    if(target == "-")
+    {
+        //Frames own stdout, everything printed goes to stderr instead
+        std::cout.rdbuf(std::cerr.rdbuf());
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+    }
+#ifndef _WIN32
+    //A consumer going away should fail the write, not end the process
+    signal(SIGPIPE, SIG_IGN);
+#endif
+    return true;
+}
+
+bool FrameStream::open(VkExtent2D frameExtent)
+{
+    extent = frameExtent;
+    start = std::chrono::steady_clock::now();
+    opened = true;
+    if(target.compare(0, 4, "shm:") == 0)
+        return openShared(target.substr(4));
+
+    //Blocks until something opens the other end of a FIFO
+    pipe = target == "-" ? stdout : fopen(target.c_str(), "wb");
+    if(pipe == NULL)
+    {
+        std::cout << "Frame stream could not be opened: " << target << std::endl;
+        return false;
+    }
+    std::cout << "Streaming " << extent.width << "x" << extent.height << " BGRA frames to "
+              << (target == "-" ? "stdout" : target) << std::endl;
+    return true;
+}
+
+bool FrameStream::openShared(std::string name)
+{
+    uint32_t headerSize = alignUp(sizeof(FrameStreamHeader), FRAME_STREAM_ALIGNMENT);
+    uint64_t slotStride = alignUp(sizeof(FrameStreamSlot) + (uint64_t)extent.width * extent.height * 4, FRAME_STREAM_ALIGNMENT);
+    sharedBytes = headerSize + slotStride * slotCount;
+#ifdef _WIN32
+    HANDLE handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE, (DWORD)(sharedBytes >> 32),
+                                       (DWORD)sharedBytes, name.c_str());
+    if(handle == NULL)
+    {
+        std::cout << "Frame stream shared memory could not be created (" << GetLastError() << ")" << std::endl;
+        return false;
+    }
+    mapping = handle;
+    shared = (unsigned char*)MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, sharedBytes);
+#else
+    std::string path = "/" + name;
+    sharedFd = shm_open(path.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0600);
+    if(sharedFd < 0 || ftruncate(sharedFd, sharedBytes) != 0)
+    {
+        std::cout << "Frame stream shared memory could not be created: " << path << std::endl;
+        return false;
+    }
+    void *mapped = mmap(NULL, sharedBytes, PROT_READ | PROT_WRITE, MAP_SHARED, sharedFd, 0);
+    shared = mapped == MAP_FAILED ? NULL : (unsigned char*)mapped;
+#endif
+    if(shared == NULL)
+    {
+        std::cout << "Frame stream shared memory could not be mapped" << std::endl;
+        return false;
+    }
+
+    //Lock free across processes only if the atomics are plain memory
+    static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "Frame stream needs lock free atomics");
+    header = new(shared) FrameStreamHeader();
+    header->version = FRAME_STREAM_VERSION;
+    header->slotCount = slotCount;
+    header->width = extent.width;
+    header->height = extent.height;
+    header->headerSize = headerSize;
+    header->slotStride = slotStride;
+    header->written.store(0);
+    header->read.store(0);
+    header->closed.store(0);
+    std::atomic_thread_fence(std::memory_order_release);
+    memcpy(header->magic, "VKFS", 4);
+
+    std::cout << "Streaming " << extent.width << "x" << extent.height << " BGRA frames to shared memory "
+              << name << ", " << slotCount << " slots of " << slotStride / 1024 << " KiB" << std::endl;
+    return true;
+}
+
+bool FrameStream::write(const unsigned char *pixels, VkExtent2D frameExtent)
+{
+    PROFILE_ZONE("FrameStream::write");
+    if(failed)
+        return false;
+    if(!opened && !open(frameExtent))
+    {
+        failed = true;
+        return false;
+    }
+    //Counted here rather than as a failed capture
+    if(frameExtent.width != extent.width || frameExtent.height != extent.height)
+    {
+        skipped++;
+        return true;
+    }
+
+    //Held back until its time comes round
+    if(fps > 0)
+        std::this_thread::sleep_until(start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                                                  std::chrono::duration<double>(frames / fps)));
+    uint64_t timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+    size_t frameBytes = (size_t)extent.width * extent.height * 4;
+
+    if(pipe != NULL)
+    {
+        //The pipe filling up is the back-pressure
+        std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+        if(fwrite(pixels, 1, frameBytes, pipe) != frameBytes || fflush(pipe) != 0)
+        {
+            std::cout << "Frame stream closed by the consumer after " << frames << " frames" << std::endl;
+            failed = true;
+            return false;
+        }
+        writeSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+        frames++;
+        return true;
+    }
+
+    //Wait for the consumer to free a slot
+    uint64_t written = header->written.load(std::memory_order_relaxed);
+    if(written - header->read.load(std::memory_order_acquire) >= slotCount)
+    {
+        stalls++;
+        std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+        while(written - header->read.load(std::memory_order_acquire) >= slotCount)
+        {
+            double waited = std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+            if(waited > stallSeconds)
+            {
+                std::cout << "Frame stream consumer stopped reading after " << frames << " frames" << std::endl;
+                failed = true;
+                return false;
+            }
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+        }
+        stalledSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count();
+    }
+
+    unsigned char *slot = shared + header->headerSize + (written % slotCount) * header->slotStride;
+    FrameStreamSlot slotHeader = {written, timeNs};
+    memcpy(slot, &slotHeader, sizeof(slotHeader));
+    memcpy(slot + sizeof(FrameStreamSlot), pixels, frameBytes);
+    header->written.store(written + 1, std::memory_order_release);
+    frames++;
+    return true;
+}
+
+void FrameStream::close()
+{
+    if(pipe != NULL)
+    {
+        fflush(pipe);
+        if(pipe != stdout)
+            fclose(pipe);
+        pipe = NULL;
+    }
+    if(shared != NULL)
+    {
+        //Give the consumer the chance to take what is left
+        std::chrono::steady_clock::time_point before = std::chrono::steady_clock::now();
+        while(!failed && header->read.load(std::memory_order_acquire) < header->written.load(std::memory_order_relaxed) &&
+              std::chrono::duration<double>(std::chrono::steady_clock::now() - before).count() < stallSeconds)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        header->closed.store(1, std::memory_order_release);
+#ifdef _WIN32
+        UnmapViewOfFile(shared);
+#else
+        munmap(shared, sharedBytes);
+        //Gone once the consumer unmaps it too
+        shm_unlink(("/" + target.substr(4)).c_str());
+#endif
+        shared = NULL;
+        header = NULL;
+    }
+#ifdef _WIN32
+    if(mapping != NULL)
+        CloseHandle((HANDLE)mapping);
+    mapping = NULL;
+#else
+    if(sharedFd >= 0)
+        ::close(sharedFd);
+    sharedFd = -1;
+#endif
+}
+
+void FrameStream::printStats() const
+{
+    if(!opened)
+        return;
+    std::cout << "Frame stream: " << frames << " frames, " << skipped << " skipped for size, ";
+    if(target.compare(0, 4, "shm:") == 0)
+        std::cout << stalledSeconds * 1000.0 << "ms waiting on the consumer (" << stalls << " frames found the ring full)";
+    else
+        std::cout << writeSeconds * 1000.0 << "ms writing";
+    std::cout << std::endl;
+}
@@ -0,0 +1,75 @@
+#ifndef FRAMESTREAM_H_INCLUDED
+#define FRAMESTREAM_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <cstdio>
+
+//Start of the shared memory ring, native byte order. Frame n is in slot n % slotCount, each slot a
+//FrameStreamSlot then height rows of width BGRA8 texels, slotStride apart after the header.
+//One producer and one consumer: the consumer reads frames below written and then moves read past them,
+//the producer waits while slotCount frames are unread. closed is set after the last frame
+struct FrameStreamHeader
+{
+    char magic[4]; //VKFS, written last
+    uint32_t version;
+    uint32_t slotCount;
+    uint32_t width;
+    uint32_t height;
+    uint32_t headerSize; //Where slot 0 starts
+    uint64_t slotStride;
+    std::atomic<uint64_t> written; //Producer only
+    std::atomic<uint64_t> read; //Consumer only
+    std::atomic<uint32_t> closed;
+};
+
+struct FrameStreamSlot
+{
+    uint64_t frame;
+    uint64_t timeNs; //Since the stream opened
+};
+
+//Raw frames handed to another process as they are read back, either through a named shared memory
+//ring or written to stdout, a FIFO or a file. Both block once the consumer falls behind, which backs
+//up through the readback queue to the render loop when that is set to wait
+//The extent is fixed by the first frame, later frames of another size are skipped
+//tools/frameStreamConsumer.cpp reads the shared memory ring
+struct FrameStream
+{
+    std::string target; //- for stdout, shm:name for shared memory, otherwise a path
+    uint32_t slotCount = 4;
+    float fps = 0; //Frames are held back to this rate, 0 sends them as fast as they come
+    double stallSeconds = 10; //How long the consumer can stop reading before the stream gives up
+
+    bool opened = false;
+    bool failed = false;
+    VkExtent2D extent = {0, 0};
+    FILE *pipe = NULL;
+    unsigned char *shared = NULL;
+    FrameStreamHeader *header = NULL;
+    uint64_t sharedBytes = 0;
+    void *mapping = NULL; //Windows file mapping handle
+    int sharedFd = -1;
+    std::chrono::steady_clock::time_point start;
+
+    uint64_t frames = 0;
+    uint64_t skipped = 0;
+    uint64_t stalls = 0; //Shared memory only, frames that had to wait for the consumer
+    double stalledSeconds = 0;
+    double writeSeconds = 0; //Pipe only, everything spent in fwrite, a full pipe shows up here
+
+    //Before anything is written to std::cout, which is moved to stderr when streaming to stdout
+    bool configure(std::string streamTarget, uint32_t slots, float framesPerSecond);
+    //Readback encoder thread only
+    bool write(const unsigned char *pixels, VkExtent2D frameExtent);
+    void close();
+    void printStats() const;
+
+    bool open(VkExtent2D frameExtent);
+    bool openShared(std::string name);
+};
+
+#endif // FRAMESTREAM_H_INCLUDED
@@ -0,0 +1,166 @@
+#include "gpuTimer.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip> //setprecision
+#include "vulkanDefinitions.h"
+
+extern VkDevice logicalDevice;
+extern VkPhysicalDevice mainPhysicalDevice;
+extern uint32_t presentQueueId;
+extern std::vector<VkQueueFamilyProperties> queueProperties;
+
+bool GpuTimer::create(uint32_t slots, std::vector<std::string> names, uint32_t historySize)
+{
+    uint32_t validBits = queueProperties[presentQueueId].timestampValidBits;
+    if(validBits == 0)
+    {
+        std::cout << "Queue does not support timestamps" << std::endl;
+        return false;
+    }
+    timestampMask = validBits >= 64 ? ~0ULL : (1ULL << validBits) - 1;
+
+    VkPhysicalDeviceProperties physicalProperties = {};
+    vkGetPhysicalDeviceProperties(mainPhysicalDevice, &physicalProperties);
+    timestampPeriod = physicalProperties.limits.timestampPeriod;
+
+    slotCount = slots;
+    sectionNames = names;
+    sectionStats.resize(sectionNames.size());
+    for(uint32_t i = 0; i < sectionStats.size(); i++)
+    {
+        sectionStats[i].resize(historySize);
+    }
+    latestMs.assign(sectionNames.size(), -1);
+
+    VkQueryPoolCreateInfo queryPoolCreateInfo = {};
+    queryPoolCreateInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+    queryPoolCreateInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+    queryPoolCreateInfo.queryCount = slotCount * sectionNames.size() * 2;
+
+    VkResult result = vkCreateQueryPool(logicalDevice, &queryPoolCreateInfo, NULL, &queryPool);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Timestamp query pool creation failed (" << result << ")" << std::endl;
+        queryPool = VK_NULL_HANDLE;
+        return false;
+    }
+
+    return true;
+}
+
+void GpuTimer::destroy()
+{
+    if(queryPool != VK_NULL_HANDLE)
+        vkDestroyQueryPool(logicalDevice, queryPool, NULL);
+    queryPool = VK_NULL_HANDLE;
+    if(reportFile.is_open())
+        reportFile.close();
+}
+
+//Must be recorded outside of a render pass, before any section of the slot is written
+void GpuTimer::cmdReset(VkCommandBuffer cmd, uint32_t slot)
+{
+    if(queryPool == VK_NULL_HANDLE)
+        return;
+    uint32_t slotQueries = sectionNames.size() * 2;
+    vkCmdResetQueryPool(cmd, queryPool, slot * slotQueries, slotQueries);
+}
+
+void GpuTimer::cmdBegin(VkCommandBuffer cmd, uint32_t slot, uint32_t section)
+{
+    if(queryPool == VK_NULL_HANDLE)
+        return;
+    uint32_t query = (slot * sectionNames.size() + section) * 2;
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, queryPool, query);
+}
+
+void GpuTimer::cmdEnd(VkCommandBuffer cmd, uint32_t slot, uint32_t section)
+{
+    if(queryPool == VK_NULL_HANDLE)
+        return;
+    uint32_t query = (slot * sectionNames.size() + section) * 2 + 1;
+    vkCmdWriteTimestamp(cmd, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, queryPool, query);
+}
+
+//Never waits, sections that were not written in the slot's last frame are skipped
+bool GpuTimer::collect(uint32_t slot)
+{
+    if(queryPool == VK_NULL_HANDLE)
+        return false;
+
+    bool any = false;
+    for(uint32_t i = 0; i < sectionNames.size(); i++)
+    {
+        //Only sections read by this call count as latest
+        latestMs[i] = -1;
+
+        uint64_t timestamps[2];
+        uint32_t query = (slot * sectionNames.size() + i) * 2;
+        VkResult result = vkGetQueryPoolResults(logicalDevice, queryPool, query, 2,
+                                                sizeof(timestamps), timestamps, sizeof(uint64_t),
+                                                VK_QUERY_RESULT_64_BIT);
+        if(result != VK_SUCCESS)
+            continue;
+
+        uint64_t ticks = (timestamps[1] - timestamps[0]) & timestampMask;
+        latestMs[i] = (float)((double)ticks * timestampPeriod / 1000000.0);
+        sectionStats[i].add(latestMs[i]);
+        any = true;
+    }
+
+    return any;
+}
+
+//False unless the last collect read the section
+bool GpuTimer::latest(uint32_t section, float *milliseconds)
+{
+    if(queryPool == VK_NULL_HANDLE || latestMs[section] < 0)
+        return false;
+    *milliseconds = latestMs[section];
+    return true;
+}
+
+//Short per pass summary, shown in the window title
+std::string GpuTimer::overlayText()
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(2);
+    for(uint32_t i = 0; i < sectionNames.size(); i++)
+    {
+        if(sectionStats[i].count == 0)
+            continue;
+        ss << " | " << sectionNames[i] << " " << sectionStats[i].mean()
+           << "ms (p95 " << sectionStats[i].percentile(95) << ")";
+    }
+    return ss.str();
+}
+
+bool GpuTimer::openReport(std::string filename)
+{
+    reportFile.open(filename.c_str());
+    if(!reportFile.is_open())
+    {
+        std::cout << "GPU timing report could not be opened: " << filename << std::endl;
+        return false;
+    }
+    reportFile << "time,pass,samples,min_ms,mean_ms,p95_ms,max_ms" << std::endl;
+    return true;
+}
+
+//One row per pass over the rolling window
+void GpuTimer::writeReport(double time)
+{
+    if(!reportFile.is_open())
+        return;
+    for(uint32_t i = 0; i < sectionNames.size(); i++)
+    {
+        const RollingStats& stats = sectionStats[i];
+        if(stats.count == 0)
+            continue;
+        reportFile << time << "," << sectionNames[i] << "," << stats.count << ","
+                   << stats.min() << "," << stats.mean() << ","
+                   << stats.percentile(95) << "," << stats.max() << "\n";
+    }
+    reportFile.flush();
+}
@@ -0,0 +1,40 @@
+#ifndef GPUTIMER_H_INCLUDED
+#define GPUTIMER_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <fstream>
+
+#include "rollingStats.h"
+
+//Timestamp pair per named section per frame slot
+//Results are read once the slot's fence has signalled, so reading never stalls
+struct GpuTimer
+{
+    VkQueryPool queryPool = VK_NULL_HANDLE;
+    uint32_t slotCount = 0;
+    float timestampPeriod = 0; //Nanoseconds per tick
+    uint64_t timestampMask = 0;
+
+    std::vector<std::string> sectionNames;
+    std::vector<RollingStats> sectionStats;
+    std::vector<float> latestMs;
+    std::ofstream reportFile;
+
+    bool create(uint32_t slots, std::vector<std::string> names, uint32_t historySize);
+    void destroy();
+
+    void cmdReset(VkCommandBuffer cmd, uint32_t slot);
+    void cmdBegin(VkCommandBuffer cmd, uint32_t slot, uint32_t section);
+    void cmdEnd(VkCommandBuffer cmd, uint32_t slot, uint32_t section);
+    bool collect(uint32_t slot);
+    bool latest(uint32_t section, float *milliseconds);
+
+    std::string overlayText();
+    bool openReport(std::string filename);
+    void writeReport(double time);
+};
+
+#endif // GPUTIMER_H_INCLUDED
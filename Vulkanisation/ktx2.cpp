@@ -0,0 +1,279 @@
+#include "ktx2.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+
+static const unsigned char ktx2Identifier[12] = {0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n'};
+
+//Khronos data format descriptor values for the formats written here
+static const uint8_t KHR_DF_MODEL_BC1A = 128;
+static const uint8_t KHR_DF_MODEL_BC3 = 130;
+static const uint8_t KHR_DF_CHANNEL_BC1A_COLOR = 0;
+static const uint8_t KHR_DF_CHANNEL_BC3_COLOR = 0;
+static const uint8_t KHR_DF_CHANNEL_BC3_ALPHA = 15;
+static const uint8_t KHR_DF_PRIMARIES_BT709 = 1;
+static const uint8_t KHR_DF_TRANSFER_LINEAR = 1;
+
+static void put32(std::vector<unsigned char> &out, uint32_t value)
+{
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        out.push_back((value >> (i * 8)) & 0xFF);
+    }
+}
+
+static void put64(std::vector<unsigned char> &out, uint64_t value)
+{
+    put32(out, (uint32_t)value);
+    put32(out, (uint32_t)(value >> 32));
+}
+
+static void set32(std::vector<unsigned char> &out, size_t at, uint32_t value)
+{
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        out[at + i] = (value >> (i * 8)) & 0xFF;
+    }
+}
+
+static void set64(std::vector<unsigned char> &out, size_t at, uint64_t value)
+{
+    set32(out, at, (uint32_t)value);
+    set32(out, at + 4, (uint32_t)(value >> 32));
+}
+
+static uint32_t get32(const std::string &data, size_t at)
+{
+    uint32_t value = 0;
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        value |= (uint32_t)(unsigned char)data[at + i] << (i * 8);
+    }
+    return value;
+}
+
+static uint64_t get64(const std::string &data, size_t at)
+{
+    return get32(data, at) | ((uint64_t)get32(data, at + 4) << 32);
+}
+
+static void padTo(std::vector<unsigned char> &out, size_t alignment)
+{
+    while(out.size() % alignment != 0)
+    {
+        out.push_back(0);
+    }
+}
+
+//Bytes per 4x4 block, 0 for anything not handled
+static uint32_t blockSize(VkFormat format)
+{
+    switch(format)
+    {
+    case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+    case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+        return 8;
+    case VK_FORMAT_BC3_UNORM_BLOCK:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+static void putSample(std::vector<unsigned char> &out, uint16_t bitOffset, uint8_t bitLength, uint8_t channel)
+{
+    out.push_back(bitOffset & 0xFF);
+    out.push_back(bitOffset >> 8);
+    out.push_back(bitLength - 1);
+    out.push_back(channel);
+    put32(out, 0); //Sample position
+    put32(out, 0); //Lower
+    put32(out, 0xFFFFFFFF); //Upper
+}
+
+bool writeKtx2(std::string path, const Ktx2Image &image)
+{
+    uint32_t block = blockSize(image.format);
+    if(block == 0 || image.levels.empty())
+    {
+        std::cout << "KTX2 format " << image.format << " can't be written" << std::endl;
+        return false;
+    }
+    uint32_t levelCount = image.levels.size();
+
+    std::vector<unsigned char> out(ktx2Identifier, ktx2Identifier + 12);
+    put32(out, image.format);
+    put32(out, 1); //typeSize
+    put32(out, image.width);
+    put32(out, image.height);
+    put32(out, 0); //pixelDepth
+    put32(out, 0); //layerCount, not an array
+    put32(out, 1); //faceCount
+    put32(out, levelCount);
+    put32(out, 0); //supercompressionScheme
+
+    size_t indexAt = out.size();
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        put32(out, 0);
+    }
+    put64(out, 0); //No supercompression global data
+    put64(out, 0);
+    size_t levelIndexAt = out.size();
+    for(uint32_t i = 0; i < levelCount * 3; i++)
+    {
+        put64(out, 0);
+    }
+
+    //One basic descriptor block
+    size_t dfdAt = out.size();
+    bool bc3 = image.format == VK_FORMAT_BC3_UNORM_BLOCK;
+    uint32_t samples = bc3 ? 2 : 1;
+    put32(out, 0); //dfdTotalSize, filled below
+    put32(out, 0); //Khronos vendor, basic descriptor type
+    put32(out, 2 | ((24 + 16 * samples) << 16)); //Version, block size
+    out.push_back(bc3 ? KHR_DF_MODEL_BC3 : KHR_DF_MODEL_BC1A);
+    out.push_back(KHR_DF_PRIMARIES_BT709);
+    out.push_back(KHR_DF_TRANSFER_LINEAR);
+    out.push_back(0); //Straight alpha
+    out.push_back(3); //4x4 texel blocks
+    out.push_back(3);
+    out.push_back(0);
+    out.push_back(0);
+    out.push_back(block); //bytesPlane0
+    for(uint32_t i = 1; i < 8; i++)
+    {
+        out.push_back(0);
+    }
+    if(bc3)
+    {
+        putSample(out, 0, 64, KHR_DF_CHANNEL_BC3_ALPHA);
+        putSample(out, 64, 64, KHR_DF_CHANNEL_BC3_COLOR);
+    }
+    else
+        putSample(out, 0, 64, KHR_DF_CHANNEL_BC1A_COLOR);
+    set32(out, dfdAt, out.size() - dfdAt);
+    set32(out, indexAt, dfdAt);
+    set32(out, indexAt + 4, out.size() - dfdAt);
+
+    //Key/value pairs, std::map already has them sorted by key
+    std::map<std::string, std::string> keyValues = image.keyValues;
+    keyValues["KTXwriter"] = "Vulkanisation";
+    size_t kvdAt = out.size();
+    for(std::map<std::string, std::string>::iterator it = keyValues.begin(); it != keyValues.end(); ++it)
+    {
+        put32(out, it->first.size() + 1 + it->second.size() + 1);
+        out.insert(out.end(), it->first.begin(), it->first.end());
+        out.push_back(0);
+        out.insert(out.end(), it->second.begin(), it->second.end());
+        out.push_back(0);
+        padTo(out, 4);
+    }
+    set32(out, indexAt + 8, kvdAt);
+    set32(out, indexAt + 12, out.size() - kvdAt);
+
+    //Smallest level first, each aligned to its block size
+    for(int i = levelCount - 1; i >= 0; i--)
+    {
+        padTo(out, block);
+        set64(out, levelIndexAt + i * 24, out.size());
+        set64(out, levelIndexAt + i * 24 + 8, image.levels[i].size());
+        set64(out, levelIndexAt + i * 24 + 16, image.levels[i].size());
+        out.insert(out.end(), image.levels[i].begin(), image.levels[i].end());
+    }
+
+    //Written aside and renamed, so a reader never sees half a file
+    std::string partial = path + ".partial";
+    {
+        std::ofstream file(partial.c_str(), std::ios::binary);
+        if(!file.is_open())
+        {
+            std::cout << "KTX2 file could not be opened: " << partial << std::endl;
+            return false;
+        }
+        file.write((const char*)out.data(), out.size());
+        if(!file.good())
+        {
+            std::cout << "KTX2 file could not be written: " << partial << std::endl;
+            return false;
+        }
+    }
+    std::remove(path.c_str());
+    if(std::rename(partial.c_str(), path.c_str()) != 0)
+    {
+        std::cout << "KTX2 file could not be renamed: " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool readKtx2(std::string path, Ktx2Image *image)
+{
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if(!file.is_open())
+        return false;
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    std::string data = buffer.str();
+
+    if(data.size() < 80 || memcmp(data.data(), ktx2Identifier, 12) != 0)
+    {
+        std::cout << "Not a KTX2 file: " << path << std::endl;
+        return false;
+    }
+    image->format = (VkFormat)get32(data, 12);
+    image->width = get32(data, 20);
+    image->height = get32(data, 24);
+    uint32_t layerCount = get32(data, 32);
+    uint32_t faceCount = get32(data, 36);
+    uint32_t levelCount = get32(data, 40);
+    uint32_t supercompression = get32(data, 44);
+    uint32_t kvdOffset = get32(data, 56);
+    uint32_t kvdLength = get32(data, 60);
+    if(blockSize(image->format) == 0 || layerCount > 1 || faceCount != 1 || supercompression != 0 || levelCount == 0)
+    {
+        std::cout << "Unsupported KTX2 file: " << path << std::endl;
+        return false;
+    }
+    if(80 + (size_t)levelCount * 24 > data.size() || (size_t)kvdOffset + kvdLength > data.size())
+    {
+        std::cout << "Truncated KTX2 file: " << path << std::endl;
+        return false;
+    }
+
+    image->levels.resize(levelCount);
+    for(uint32_t i = 0; i < levelCount; i++)
+    {
+        uint64_t offset = get64(data, 80 + i * 24);
+        uint64_t length = get64(data, 80 + i * 24 + 8);
+        if(offset + length > data.size())
+        {
+            std::cout << "Truncated KTX2 file: " << path << std::endl;
+            return false;
+        }
+        image->levels[i].assign(data.begin() + offset, data.begin() + offset + length);
+    }
+
+    image->keyValues.clear();
+    size_t at = kvdOffset;
+    while(at + 4 <= (size_t)kvdOffset + kvdLength)
+    {
+        uint32_t length = get32(data, at);
+        if(at + 4 + length > data.size())
+            break;
+        std::string pair = data.substr(at + 4, length);
+        size_t split = pair.find('\0');
+        if(split != std::string::npos)
+        {
+            std::string value = pair.substr(split + 1);
+            if(!value.empty() && value[value.size() - 1] == '\0')
+                value.erase(value.size() - 1);
+            image->keyValues[pair.substr(0, split)] = value;
+        }
+        at += 4 + (length + 3) / 4 * 4;
+    }
+    return true;
+}
@@ -0,0 +1,24 @@
+#ifndef KTX2_H_INCLUDED
+#define KTX2_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <map>
+
+//Single 2D image with a mip chain, no supercompression
+//Only the block compressed formats textureCompression writes are understood
+struct Ktx2Image
+{
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    std::vector<std::vector<unsigned char> > levels; //Level 0 is full size
+    std::map<std::string, std::string> keyValues;
+};
+
+bool writeKtx2(std::string path, const Ktx2Image &image);
+bool readKtx2(std::string path, Ktx2Image *image);
+
+#endif // KTX2_H_INCLUDED
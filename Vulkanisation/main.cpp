@@ -9,14 +9,40 @@
 #include <fstream>
 #include <sstream>
 #include <cstring>
+#include <chrono>
+#include <cstdlib> //atoi, atof
+#include <algorithm>
 
 #include "mesh.h"
 #include "assorted.h"
 #include "texture.h"
+#include "gpuTimer.h"
+#include "renderScale.h"
+#include "cpuProfiler.h"
+#include "frameStats.h"
+#include "descriptors.h"
+#include "bindless.h"
+#include "shaderReflection.h"
+#include "pipelineManager.h"
+#include "shaderVariants.h"
+#include "shaderHotReload.h"
+#include "normalOverlay.h"
+#include "deviceSelection.h"
+#include "uploadService.h"
+#include "textureCompression.h"
+#include "textureCache.h"
+#include "workerPool.h"
+#include "virtualTexture.h"
+#include "samplerCache.h"
+#include "textureResidency.h"
+#include "readback.h"
+#include "frameStream.h"
 
 //#define VULKAN_DEBUGGING
 
 GLFWwindow* window;
+//No window, surface or swapchain, frames are only rendered offscreen and read back
+bool headless = false;
 
 VkResult result; //Global error variable
 VkInstance vulkanInstance;
@@ -27,14 +53,33 @@ VkFormat colourFormat;
 VkColorSpaceKHR colourSpace;
 VkSwapchainKHR swapchain;
 VkPhysicalDeviceMemoryProperties memoryProperties;
+VkPhysicalDeviceFeatures physicalFeatures;
 VkCommandPool commandPool;
 VkQueue presentQueue;
+//Same handles as the graphics ones when the device has no separate family
+VkQueue transferQueue;
+VkQueue computeQueue;
+VkCommandPool transferCommandPool;
+VkCommandPool computeCommandPool;
 
 std::vector<const char*> layers;
 std::vector<const char*> extensions;
-VkDeviceQueueCreateInfo queueInfo;
+std::vector<VkDeviceQueueCreateInfo> queueInfos;
 uint32_t queueCount = 0;
 uint32_t presentQueueId;
+uint32_t transferQueueId;
+uint32_t computeQueueId;
+bool asyncCompute = false; //Normal overlay generation runs on computeQueue
+UploadService uploadService;
+TextureCache textureCache;
+TextureResidency textureResidency; //Windowed only, headless frames should match between runs
+ReadbackService readbackService; //Screenshots and captured sequences of the offscreen target
+FrameStream frameStream; //Raw frames for another process
+WorkerPool workerPool; //Loading work, texture decode and encode
+bool singleQueue = false;
+int forcedDevice = -1;
+bool compressTextures = false; //Texture arrays load as BC1/BC3 with mips
+std::string textureCacheDirectory = "models/cache";
 std::vector<VkQueueFamilyProperties> queueProperties;
 std::vector<const char*> deviceLayers;
 std::vector<const char *> deviceExtensions;
@@ -46,12 +91,40 @@ VkPresentModeKHR presentMode;
 std::vector<Mesh> meshes;
 std::vector<VkDescriptorSet> descriptorSets;
 VkRenderPass renderPass;
-VkPipeline simplepipeline;
-VkPipeline normalpipeline;
+PipelineManager pipelineManager;
+//Pipeline manager ids, simple and screen are compiled before the first frame, the rest in the background
+//simplepipeline is the flat variant of sceneVariants, every other variant falls back to it
+uint32_t simplepipeline = NO_PIPELINE;
+ShaderVariants sceneVariants;
+bool normalDebug = false;
+uint32_t normalpipeline = NO_PIPELINE;
 VkPipelineLayout pipelineLayout;
 std::vector<VkFramebuffer> frameBuffers;
 std::vector<VkCommandBuffer> commandBuffers;
 
+//Frames the CPU may queue ahead of the GPU, each slot has its own command buffer and sync objects
+const uint32_t FRAMES_IN_FLIGHT = 3;
+std::vector<VkCommandBuffer> offscreenCommandBuffers;
+//Async compute only, normal line generation each slot's offscreen submit waits on
+std::vector<VkCommandBuffer> computeCommandBuffers;
+std::vector<VkSemaphore> computeCompleteSemaphores;
+std::vector<bool> computePending;
+//Timestamp writes around the composite, submitted either side of the swapchain image's command buffer
+std::vector<VkCommandBuffer> compositeTimerBeginCommandBuffers;
+std::vector<VkCommandBuffer> compositeTimerEndCommandBuffers;
+
+enum GpuTimerSection
+{
+    GPU_OFFSCREEN,
+    GPU_SCENE,
+    GPU_NORMALS,
+    GPU_COMPOSITE,
+    GPU_SECTION_COUNT
+};
+GpuTimer gpuTimer;
+RenderScale renderScale;
+FrameStats frameStats;
+
 //Uniform buffer
 struct UniformData
 {
@@ -60,19 +133,65 @@ struct UniformData
     glm::mat4 modelMatrix;
 };
 
+//Written once per frame, shared by every scene draw
+struct CameraData
+{
+    glm::mat4 projectionMatrix;
+    glm::mat4 viewMatrix;
+};
+
+//Per draw, pushed on the per-mesh path and read from the object buffer on the bindless path
+//Normal matrix is the inverse transpose of the model's upper 3x3, stored as a mat4 to keep the layout simple
+struct ObjectData
+{
+    glm::mat4 modelMatrix;
+    glm::mat4 normalMatrix;
+};
+
 struct ShaderParts
 {
+    std::vector<std::string> files; //SPIR-V per stage, for reloading
+    std::vector<VertexField> fields; //Vertex members the inputs read, Vertex when empty
+    uint32_t vertexStride = sizeof(Vertex);
     std::vector<VkShaderModule> shaderModules;
     std::vector<VkPipelineShaderStageCreateInfo> stageCreateInfo;
+    ShaderReflection reflection; //Every stage merged
 
+    VkVertexInputBindingDescription vertexBinding;
+    std::vector<VkVertexInputAttributeDescription> vertexAttributes;
     VkPipelineVertexInputStateCreateInfo vertexInputStateCreateInfo;
 };
 
 ShaderParts shader1;
-ShaderParts shader2;
-std::vector<MemoryBuffer> uniformBuffers;
-VkDescriptorPool descriptorPool;
-std::vector<VkDescriptorSetLayout> descriptorSetLayouts;
+//Normal debug lines, drawn from a buffer the overlay's compute pass fills
+NormalOverlay normalOverlay;
+ShaderParts normalLineShader;
+VkShaderModule normalLinesModule = VK_NULL_HANDLE;
+ShaderReflection normalLinesReflection;
+VkPipelineLayout normalLinePipelineLayout = VK_NULL_HANDLE;
+//Scene drawn from one descriptor set when the device and shaders allow it, otherwise per-mesh sets
+BindlessScene bindlessScene;
+ShaderParts bindlessShader;
+bool bindlessShadersLoaded = false;
+uint32_t bindlessPipeline = NO_PIPELINE;
+//Ground plane sampled through the virtual texture, only with --virtual-texture
+VirtualTexture virtualTexture;
+ShaderParts virtualShader;
+bool virtualShadersLoaded = false;
+uint32_t virtualPipeline = NO_PIPELINE;
+std::string virtualTextureImage;
+Mesh virtualPlane;
+CameraData cameraData;
+std::vector<MemoryBuffer> cameraBuffers; //One per frame slot
+std::vector<VkDescriptorSet> cameraDescriptorSets;
+VkDescriptorSetLayout cameraDescriptorSetLayout;
+std::vector<ObjectData> objectData; //One per mesh
+DescriptorLayoutCache descriptorLayoutCache;
+SamplerCache samplerCache; //Every sampler handle, shared by matching settings
+DescriptorAllocator descriptorAllocator; //Sets that live as long as the scene
+VkDescriptorSetLayout meshDescriptorSetLayout;
+ShaderReflection sceneReflection; //Simple and normals shaders, they share a pipeline layout
+std::vector<VkDescriptorSetLayout> sceneSetLayouts;
 
 std::vector<VkImage> swapchainImages;
 std::vector<VkImageView> imageViews;
@@ -82,7 +201,7 @@ VkDeviceMemory depthImageMemory;
 
 Mesh screenMesh;
 ShaderParts screenShader;
-VkPipeline screenpipeline;
+uint32_t screenpipeline = NO_PIPELINE;
 VkPipelineLayout screenpipelineLayout;
 UniformData screenQuadUniformData;
 MemoryBuffer screenQuadUniformMemory;
@@ -104,6 +223,12 @@ struct FramebufferParts
     VkSampler colourSampler;
 } renderToFramebuffer;
 
+struct ScreenPushConstants
+{
+    glm::vec2 uvScale;
+    glm::vec2 uvMax;
+};
+
 VkDebugReportCallbackEXT debugcallback;
 
 std::string FloattoStr(float a)
@@ -139,12 +264,19 @@ VKAPI_ATTR VkBool32 VKAPI_CALL MyDebugReportCallback(
     return VK_FALSE;
 }
 
-VkResult loadShader(std::string shaderFilename, VkShaderModule * shaderModule)
+VkResult loadShader(std::string shaderFilename, VkShaderModule * shaderModule, ShaderReflection *reflection = NULL)
 {
+    PROFILE_ZONE("loadShader");
     std::ifstream shaderStream(shaderFilename.c_str(), std::ios::binary);
     std::string shaderCode((std::istreambuf_iterator<char>(shaderStream)),
                            (std::istreambuf_iterator<char>()));
 
+    if(reflection != NULL && !reflection->parse((const uint32_t *)shaderCode.c_str(), shaderCode.size() / 4))
+    {
+        std::cout << "Shader could not be reflected: " << shaderFilename << std::endl;
+        return VK_ERROR_INITIALIZATION_FAILED;
+    }
+
     VkShaderModuleCreateInfo shaderCreationInfo = {};
     shaderCreationInfo.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO;
     shaderCreationInfo.codeSize = shaderCode.size();
@@ -155,6 +287,7 @@ VkResult loadShader(std::string shaderFilename, VkShaderModule * shaderModule)
 
 bool validationLayers()
 {
+    PROFILE_ZONE("validationLayers");
     //Count validation layers to make sure they exist
     uint32_t layerCount = 0;
     result = vkEnumerateInstanceLayerProperties(&layerCount, NULL);
@@ -224,6 +357,7 @@ bool validationLayers()
 
 bool checkAndAddExtensions()
 {
+    PROFILE_ZONE("checkAndAddExtensions");
     uint32_t extensionCount = 0;
     uint32_t layerextensionCount = 0;
     result = vkEnumerateInstanceExtensionProperties(NULL, &extensionCount, NULL);
@@ -269,11 +403,14 @@ bool checkAndAddExtensions()
 #ifdef VULKAN_DEBUGGING
     extensions.push_back(VK_EXT_DEBUG_REPORT_EXTENSION_NAME); // = "VK_EXT_debug_report"
 #endif // VULKAN_DEBUGGING
-    uint32_t glfwExtensionCount;
-    const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
-    for(int i = 0; i < glfwExtensionCount; i++)
+    if(!headless)
     {
-        extensions.push_back(glfwExtensions[i]);
+        uint32_t glfwExtensionCount;
+        const char** glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        for(uint32_t i = 0; i < glfwExtensionCount; i++)
+        {
+            extensions.push_back(glfwExtensions[i]);
+        }
     }
 
     bool missingEx = false;
@@ -349,104 +486,72 @@ bool destroyDebugging()
 
 bool deviceQueue()
 {
-    //Count device queues
-    //uint32_t queueCount = 0;
-    vkGetPhysicalDeviceQueueFamilyProperties(mainPhysicalDevice, &queueCount, NULL);
-    if(queueCount < 1)
-    {
-        std::cout << "No device queues" << std::endl;
-        return false;
-    }
-    else
+    queueCount = queueProperties.size();
+    std::cout << "Physical device queue count: " << queueCount << std::endl;
+
+    //Without separate families everything goes to the one graphics queue
+    if(singleQueue)
     {
-        std::cout << "Physical device queue count: " << queueCount << std::endl;
+        transferQueueId = presentQueueId;
+        computeQueueId = presentQueueId;
     }
+    asyncCompute = computeQueueId != presentQueueId;
+    std::cout << "Graphics queue family: " << presentQueueId << std::endl;
+    std::cout << "Transfer queue family: " << transferQueueId << (transferQueueId != presentQueueId ? " (dedicated)" : "") << std::endl;
+    std::cout << "Compute queue family: " << computeQueueId << (asyncCompute ? " (async)" : "") << std::endl;
 
-    //Get device queues after counting
-    bool found = false;
-    //uint32_t presentQueueId;
-    queueProperties.resize(queueCount);
-    //std::vector<VkQueueFamilyProperties> queueProperties(queueCount);
-    vkGetPhysicalDeviceQueueFamilyProperties(mainPhysicalDevice, &queueCount, queueProperties.data());
-    for(uint32_t i = 0; i < queueCount; ++i)
+    //One queue from each distinct family
+    static float priorities[] = { 1.0f }; //0.0-1.0 weighting
+    uint32_t families[] = {presentQueueId, transferQueueId, computeQueueId};
+    queueInfos.clear();
+    for(uint32_t i = 0; i < 3; i++)
     {
-        VkBool32 supportsPresent;
-        vkGetPhysicalDeviceSurfaceSupportKHR(mainPhysicalDevice, i, vulkanSurface, &supportsPresent);
-
-        if((queueProperties[i].queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0)
+        bool seen = false;
+        for(uint32_t j = 0; j < queueInfos.size(); j++)
         {
-            if(supportsPresent == VK_TRUE)
-            {
-                presentQueueId = i;
-                found = true;
-                break;
-            }
+            if(queueInfos[j].queueFamilyIndex == families[i])
+                seen = true;
         }
-    }
-    if(found == false)
-    {
-        std::cout << "Physical device does not support presenting" << std::endl;
-        return false;
-    }
+        if(seen)
+            continue;
 
-    vkGetPhysicalDeviceMemoryProperties(mainPhysicalDevice, &memoryProperties);
-    static float priorities[] = { 1.0f }; //0.0-1.0 weighting
-    queueInfo = {};
-    queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO; //VkStructureType
-    queueInfo.pNext = NULL;                                       //const void
-    queueInfo.flags = 0;                                          //VKDeviceQueueCreateFlags
-    queueInfo.queueFamilyIndex = presentQueueId;                               //uint32_t
-    queueInfo.queueCount = 1;                                     //uint32_t
-    queueInfo.pQueuePriorities = priorities;                  //const float*
+        VkDeviceQueueCreateInfo queueInfo = {};
+        queueInfo.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO; //VkStructureType
+        queueInfo.pNext = NULL;                                       //const void
+        queueInfo.flags = 0;                                          //VKDeviceQueueCreateFlags
+        queueInfo.queueFamilyIndex = families[i];                     //uint32_t
+        queueInfo.queueCount = 1;                                     //uint32_t
+        queueInfo.pQueuePriorities = priorities;                  //const float*
+        queueInfos.push_back(queueInfo);
+    }
 
     return true;
 }
 
 bool physicalDevice()
 {
-    //Count number of Vulkan Supported GPUs
-    uint32_t deviceCount = 0;
-    result = vkEnumeratePhysicalDevices(vulkanInstance, &deviceCount, NULL);
-    if(result != VK_SUCCESS)
-    {
-        std::cout << "Device count failed (" << result << ")" << std::endl;
+    PROFILE_ZONE("physicalDevice");
+    //Scored on type, memory and features rather than taking whatever enumerates first
+    DeviceCandidate chosen;
+    if(!selectDevice(vulkanInstance, headless ? VK_NULL_HANDLE : vulkanSurface, forcedDevice, &chosen))
         return false;
-    }
-    else if(deviceCount < 1)
-    {
-        std::cout << "No GPU installed?" << std::endl;
-        return false;
-    }
-    else
-    {
-        std::cout << "Device count: " << deviceCount << std::endl;
-    }
-    //Get actual devices after checking for existence
-    std::vector<VkPhysicalDevice> physicalDevices(deviceCount);
-    result = vkEnumeratePhysicalDevices(vulkanInstance, &deviceCount, physicalDevices.data());
-    if(result != VK_SUCCESS)
-    {
-        std::cout << "Device retrieval failed (" << result << ")" << std::endl;
-        return false;
-    }
-    std::string deviceTypes[5] = {"VK_PHYSICAL_DEVICE_TYPE_OTHER",
-                                  "VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU",
-                                  "VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU",
-                                  "VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU",
-                                  "VK_PHYSICAL_DEVICE_TYPE_CPU",};
-    mainPhysicalDevice = physicalDevices[0];
-    VkPhysicalDeviceProperties physicalProperties = {};
-    vkGetPhysicalDeviceProperties(mainPhysicalDevice, &physicalProperties);
+
+    mainPhysicalDevice = chosen.device;
+    physicalFeatures = chosen.features;
+    memoryProperties = chosen.memory;
+    queueProperties = chosen.queueFamilies;
+    presentQueueId = chosen.graphicsFamily;
+    transferQueueId = chosen.transferFamily;
+    computeQueueId = chosen.computeFamily;
+
+    VkPhysicalDeviceProperties physicalProperties = chosen.properties;
     std::cout <<    "Device Name: " << physicalProperties.deviceName << std::endl;
-    std::cout <<    "Device Type: " << deviceTypes[physicalProperties.deviceType] << std::endl;
+    std::cout <<    "Device Type: " << deviceTypeName(physicalProperties.deviceType) << std::endl;
     std::cout << "Driver Version: " << physicalProperties.driverVersion << std::endl;
     std::cout <<    "API Version: " << VK_VERSION_MAJOR(physicalProperties.apiVersion) << "."
                                     << VK_VERSION_MINOR(physicalProperties.apiVersion) << "."
                                     << VK_VERSION_PATCH(physicalProperties.apiVersion) << std::endl;
 
-    VkPhysicalDeviceFeatures physicalFeatures = {};
-    vkGetPhysicalDeviceFeatures(mainPhysicalDevice, &physicalFeatures);
-
     if(!deviceQueue())
         return false;
 
@@ -518,6 +623,7 @@ bool deviceValidationLayers()
 
 bool doDeviceExtensions()
 {
+    PROFILE_ZONE("doDeviceExtensions");
     uint32_t deviceextensionCount = 0;
     uint32_t layerdeviceextensionCount = 0;
     result = vkEnumerateDeviceExtensionProperties(mainPhysicalDevice, NULL, &deviceextensionCount, NULL);
@@ -560,7 +666,8 @@ bool doDeviceExtensions()
 #endif // VULKAN_DEBUGGING
 
     //std::vector<const char *> deviceExtensions;
-    deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    if(!headless)
+        deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
     bool missingDeEx = false;
     uint32_t missingDeExId;
     for(int i = 0; i < deviceExtensions.size(); i++)
@@ -596,6 +703,7 @@ bool doDeviceExtensions()
 
 bool surfaceFormats()
 {
+    PROFILE_ZONE("surfaceFormats");
     //Count number of supported colour formats
     uint32_t formatCount = 0;
     result = vkGetPhysicalDeviceSurfaceFormatsKHR(mainPhysicalDevice, vulkanSurface, &formatCount, NULL);
@@ -719,29 +827,49 @@ bool surfaceFormats()
     return true;
 }
 
-VkCommandBuffer offscreenCommandBuffer;
-bool createOffscreenCommandBuffer()
+uint32_t meshFeatures(const Mesh &mesh)
 {
-    VkCommandBufferAllocateInfo commandBufferAllocationInfo = {};
-    commandBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferAllocationInfo.commandPool = commandPool;
-    commandBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferAllocationInfo.commandBufferCount = 1;
+    //Normal debug ignores everything else, so it is one variant for all meshes
+    if(normalDebug)
+        return FEATURE_NORMAL_DEBUG;
+
+    uint32_t features = 0;
+    if(mesh.textured)
+        features |= FEATURE_TEXTURED;
+    if(mesh.vertexColoured)
+        features |= FEATURE_VERTEX_COLOUR;
+    if(mesh.lit)
+        features |= FEATURE_LIT;
+    return features;
+}
 
-    result = vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocationInfo, &offscreenCommandBuffer);
-    if(result != VK_SUCCESS)
+//Adds any variant the meshes need that has not been seen yet and compiles it in the background
+void requestSceneVariants()
+{
+    for(uint32_t i = 0; i < meshes.size(); i++)
     {
-        std::cout << "Offscreen command buffer could not be allocated" << std::endl;
-        return false;
+        sceneVariants.get(pipelineManager, meshFeatures(meshes[i]));
     }
-    else
-        std::cout << "Offscreen command buffer allocated" << std::endl;
+    pipelineManager.compileAsync(0);
+}
+
+//CPU time spent recording the offscreen pass, to compare device and loader dispatch
+bool loaderDispatch = false;
+double recordSeconds = 0;
+uint64_t recordedDraws = 0;
+
+bool recordOffscreenCommandBuffer(uint32_t slot)
+{
+    PROFILE_ZONE("recordOffscreen");
+    std::chrono::steady_clock::time_point recordStart = std::chrono::steady_clock::now();
+    VkCommandBuffer cmd = offscreenCommandBuffers[slot];
+    VkExtent2D renderExtent = renderScale.scaledExtent(swapchainExtent);
 
     VkClearValue clearValue[] = {{0.25f,0.35f,0.5f,1.0f}, {1.0, 0.0}};
     VkRenderPassBeginInfo renderPassBeginInfo = {};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
     renderPassBeginInfo.renderPass = renderPass;
-    renderPassBeginInfo.renderArea = {0, 0, renderToFramebuffer.width, renderToFramebuffer.height};
+    renderPassBeginInfo.renderArea = {0, 0, renderExtent.width, renderExtent.height};
     renderPassBeginInfo.clearValueCount = 2;
     renderPassBeginInfo.pClearValues = clearValue;
     renderPassBeginInfo.framebuffer = renderToFramebuffer.framebuffer;
@@ -750,68 +878,282 @@ bool createOffscreenCommandBuffer()
 
     VkCommandBufferBeginInfo beginInfo = {};
     beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+    //Only the scaled region of the offscreen target is rendered to
+    VkViewport viewport = {0, 0, (float)renderExtent.width, (float)renderExtent.height, 0, 1};
+    VkRect2D scissor = {0, 0, renderExtent.width, renderExtent.height};
+
+    vkResetCommandBuffer(cmd, 0);
+    vkBeginCommandBuffer(cmd, &beginInfo);
+    gpuTimer.cmdReset(cmd, slot);
+    gpuTimer.cmdBegin(cmd, slot, GPU_OFFSCREEN);
+    if(virtualTexture.enabled)
+        virtualTexture.cmdUpload(cmd, slot);
+    //Lines of meshes that moved since this slot last built them
+    //With async compute they go in their own buffer, the semaphore replaces the barrier
+    VkCommandBuffer generateCmd = cmd;
+    if(asyncCompute)
+    {
+        generateCmd = computeCommandBuffers[slot];
+        vkResetCommandBuffer(generateCmd, 0);
+        vkBeginCommandBuffer(generateCmd, &beginInfo);
+    }
+    bool linesGenerated = false;
+    for(uint32_t j = 0; j < meshes.size() && normalOverlay.enabled; j++)
+    {
+        if(normalOverlay.cmdGenerate(generateCmd, slot, j, objectData[j].modelMatrix, objectData[j].normalMatrix))
+            linesGenerated = true;
+    }
+    if(asyncCompute)
+    {
+        vkEndCommandBuffer(generateCmd);
+        computePending[slot] = linesGenerated;
+    }
+    else if(linesGenerated)
+        normalOverlay.cmdFinishGenerate(cmd);
+    vkCmdBeginRenderPass(cmd, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
+        vkCmdSetViewport(cmd, 0, 1, &viewport);
+        vkCmdSetScissor(cmd, 0, 1, &scissor);
+
+        //Until the background pipelines are ready the scene goes through the per-mesh path
+        //and the normals overlay is left out
+        //Bindless has no variants, normal debug goes through the per-mesh path
+        if(bindlessScene.enabled && pipelineManager.ready(bindlessPipeline) && !normalDebug)
+        {
+            //Both pipelines share the layout, so the sets stay bound across the pass
+            VkDescriptorSet sets[] = {cameraDescriptorSets[slot], bindlessScene.set};
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, bindlessScene.pipelineLayout, 0, 2, sets, 0, NULL);
+            VkShaderStageFlags pushStages = bindlessScene.pushStages;
+            //Each slot has its own range of the object buffer
+            std::vector<BindlessDrawConstants> draws = bindlessScene.draws;
+            for(uint32_t j = 0; j < draws.size(); j++)
+            {
+                draws[j].objectIndex += slot * bindlessScene.objectCount;
+            }
 
-    VkViewport viewport = {0, 0, swapchainExtent.width, swapchainExtent.height, 0, 1};
-    VkRect2D scissor = {0, 0, swapchainExtent.width, swapchainExtent.height};
+            gpuTimer.cmdBegin(cmd, slot, GPU_SCENE);
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineManager.get(bindlessPipeline));
 
-    vkBeginCommandBuffer(offscreenCommandBuffer, &beginInfo);
-    vkCmdBeginRenderPass(offscreenCommandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE );
-        vkCmdSetViewport(offscreenCommandBuffer, 0, 1, &viewport);
-        vkCmdSetScissor(offscreenCommandBuffer, 0, 1, &scissor);
+            for(uint32_t j = 0; j < meshes.size(); j++)
+            {
+                vkCmdPushConstants(cmd, bindlessScene.pipelineLayout, pushStages, 0, sizeof(BindlessDrawConstants), &draws[j]);
+                vkCmdBindVertexBuffers(cmd, 0, 1, &meshes[j].vertexBuffer.buffer, &offsets);
+                vkCmdBindIndexBuffer(cmd, meshes[j].indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+                vkCmdDrawIndexed(cmd, meshes[j].indices.size(), 1,0,0,1);
+            }
+            gpuTimer.cmdEnd(cmd, slot, GPU_SCENE);
+        }
+        else
+        {
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &cameraDescriptorSets[slot], 0, NULL);
+            VkShaderStageFlags pushStages = sceneReflection.pushConstantRange.stageFlags;
 
-        vkCmdBindPipeline(offscreenCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, simplepipeline);
+            gpuTimer.cmdBegin(cmd, slot, GPU_SCENE);
+            VkPipeline bound = VK_NULL_HANDLE;
 
-        for(int j = 0; j < meshes.size(); j++)
-        {
-            vkCmdBindDescriptorSets(offscreenCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[j], 0, NULL);
-            vkCmdBindVertexBuffers(offscreenCommandBuffer, 0, 1, &meshes[j].vertexBuffer.buffer, &offsets);
-            vkCmdBindIndexBuffer(offscreenCommandBuffer, meshes[j].indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(offscreenCommandBuffer, meshes[j].indices.size(), 1,0,0,1);
+            for(uint32_t j = 0; j < meshes.size(); j++)
+            {
+                VkPipeline variant = pipelineManager.get(sceneVariants.get(pipelineManager, meshFeatures(meshes[j])));
+                if(variant != bound)
+                {
+                    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, variant);
+                    bound = variant;
+                }
+                vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 1, 1, &descriptorSets[j], 0, NULL);
+                vkCmdPushConstants(cmd, pipelineLayout, pushStages, 0, sizeof(ObjectData), &objectData[j]);
+                vkCmdBindVertexBuffers(cmd, 0, 1, &meshes[j].vertexBuffer.buffer, &offsets);
+                vkCmdBindIndexBuffer(cmd, meshes[j].indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+                vkCmdDrawIndexed(cmd, meshes[j].indices.size(), 1,0,0,1);
+            }
+            gpuTimer.cmdEnd(cmd, slot, GPU_SCENE);
         }
 
-        vkCmdBindPipeline(offscreenCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, normalpipeline);
+        //Also writes which pages it wanted into the slot's feedback
+        VkPipeline virtualPlanePipeline = pipelineManager.get(virtualPipeline);
+        if(virtualTexture.enabled && virtualPlanePipeline != VK_NULL_HANDLE)
+        {
+            VkDescriptorSet sets[] = {cameraDescriptorSets[slot], virtualTexture.sets[slot]};
+            ObjectData identity = {glm::mat4(), glm::mat4()};
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, virtualPlanePipeline);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, virtualTexture.pipelineLayout, 0, 2, sets, 0, NULL);
+            vkCmdPushConstants(cmd, virtualTexture.pipelineLayout, virtualShader.reflection.pushConstantRange.stageFlags,
+                               0, sizeof(ObjectData), &identity);
+            vkCmdBindVertexBuffers(cmd, 0, 1, &virtualPlane.vertexBuffer.buffer, &offsets);
+            vkCmdBindIndexBuffer(cmd, virtualPlane.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
+            vkCmdDrawIndexed(cmd, virtualPlane.indices.size(), 1,0,0,1);
+            recordedDraws++;
+        }
 
-        for(int j = 0; j < meshes.size(); j++)
+        //One line list for every mesh, already in world space
+        gpuTimer.cmdBegin(cmd, slot, GPU_NORMALS);
+        VkPipeline normals = pipelineManager.get(normalpipeline);
+        if(normalOverlay.enabled && normals != VK_NULL_HANDLE)
         {
-            vkCmdBindDescriptorSets(offscreenCommandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout, 0, 1, &descriptorSets[j], 0, NULL);
-            vkCmdBindVertexBuffers(offscreenCommandBuffer, 0, 1, &meshes[j].vertexBuffer.buffer, &offsets);
-            vkCmdBindIndexBuffer(offscreenCommandBuffer, meshes[j].indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-            vkCmdDrawIndexed(offscreenCommandBuffer, meshes[j].indices.size(), 1,0,0,1);
+            vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, normals);
+            vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_GRAPHICS, normalLinePipelineLayout, 0, 1, &cameraDescriptorSets[slot], 0, NULL);
+            normalOverlay.cmdDraw(cmd, slot);
+            recordedDraws++;
         }
+        gpuTimer.cmdEnd(cmd, slot, GPU_NORMALS);
+
+    vkCmdEndRenderPass(cmd);
+    if(virtualTexture.enabled)
+        virtualTexture.cmdFinishFeedback(cmd);
+    gpuTimer.cmdEnd(cmd, slot, GPU_OFFSCREEN);
+    //Outside the timed section so captures do not move the render scale
+    readbackService.cmdCapture(cmd, slot, renderToFramebuffer.colour.image,
+                               headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR, renderExtent);
+    result = vkEndCommandBuffer(cmd);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Offscreen command buffer could not be filled: " << slot << std::endl;
+        return false;
+    }
+    recordedDraws += meshes.size();
+    recordSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - recordStart).count();
+
+    return true;
+}
+
+bool createOffscreenCommandBuffers()
+{
+    PROFILE_ZONE("createOffscreenCommandBuffers");
+    offscreenCommandBuffers.resize(FRAMES_IN_FLIGHT);
+
+    VkCommandBufferAllocateInfo commandBufferAllocationInfo = {};
+    commandBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocationInfo.commandPool = commandPool;
+    commandBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocationInfo.commandBufferCount = offscreenCommandBuffers.size();
 
-    vkCmdEndRenderPass(offscreenCommandBuffer);
-    result = vkEndCommandBuffer(offscreenCommandBuffer);
+    result = vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocationInfo, offscreenCommandBuffers.data());
     if(result != VK_SUCCESS)
     {
-        std::cout << "Command buffer could not be created and filled" << std::endl;
+        std::cout << "Offscreen command buffers could not be allocated" << std::endl;
         return false;
     }
     else
-        std::cout << "Command buffer created and filled" << std::endl;
+        std::cout << "Offscreen command buffers allocated" << std::endl;
+    //Filled each frame, once the slot's transforms are known
+
+    if(!asyncCompute)
+        return true;
+
+    computeCommandBuffers.resize(FRAMES_IN_FLIGHT);
+    computeCompleteSemaphores.resize(FRAMES_IN_FLIGHT);
+    computePending.assign(FRAMES_IN_FLIGHT, false);
+    commandBufferAllocationInfo.commandPool = computeCommandPool;
+    commandBufferAllocationInfo.commandBufferCount = computeCommandBuffers.size();
+    result = vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocationInfo, computeCommandBuffers.data());
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Compute command buffers could not be allocated (" << result << ")" << std::endl;
+        return false;
+    }
+    VkSemaphoreCreateInfo semaphoreCreateInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, 0, 0};
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        result = vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, NULL, &computeCompleteSemaphores[i]);
+        if(result != VK_SUCCESS)
+        {
+            std::cout << "Compute semaphore creation failed (" << result << ")" << std::endl;
+            return false;
+        }
+    }
 
     return true;
 }
 
-bool createCommandBuffers()
+//Async compute work for the slot goes first, the offscreen pass then waits on it before reading vertices
+bool submitOffscreen(uint32_t slot, VkSemaphore waitSemaphore, VkSemaphore signalSemaphore, VkFence fence)
 {
-    commandBuffers.resize(frameBuffers.size());
+    std::vector<VkSemaphore> waits;
+    std::vector<VkPipelineStageFlags> waitStages;
+    if(waitSemaphore != VK_NULL_HANDLE)
+    {
+        waits.push_back(waitSemaphore);
+        waitStages.push_back(VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT);
+    }
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    if(asyncCompute && computePending[slot])
+    {
+        submitInfo.commandBufferCount = 1;
+        submitInfo.pCommandBuffers = &computeCommandBuffers[slot];
+        submitInfo.signalSemaphoreCount = 1;
+        submitInfo.pSignalSemaphores = &computeCompleteSemaphores[slot];
+        result = vkQueueSubmit(computeQueue, 1, &submitInfo, VK_NULL_HANDLE);
+        if(result != VK_SUCCESS)
+        {
+            std::cout << "Compute queue could not be submitted (" << result << ")" << std::endl;
+            return false;
+        }
+        computePending[slot] = false;
+        waits.push_back(computeCompleteSemaphores[slot]);
+        waitStages.push_back(VK_PIPELINE_STAGE_VERTEX_INPUT_BIT);
+    }
+
+    submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = waits.size();
+    submitInfo.pWaitSemaphores = waits.data();
+    submitInfo.pWaitDstStageMask = waitStages.data();
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &offscreenCommandBuffers[slot];
+    submitInfo.signalSemaphoreCount = signalSemaphore != VK_NULL_HANDLE ? 1 : 0;
+    submitInfo.pSignalSemaphores = &signalSemaphore;
+    result = vkQueueSubmit(presentQueue, 1, &submitInfo, fence);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Draw queue could not be submitted (" << result << ")" << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+bool createCompositeTimerCommandBuffers()
+{
+    PROFILE_ZONE("createCompositeTimerCommandBuffers");
+    compositeTimerBeginCommandBuffers.resize(FRAMES_IN_FLIGHT);
+    compositeTimerEndCommandBuffers.resize(FRAMES_IN_FLIGHT);
 
     VkCommandBufferAllocateInfo commandBufferAllocationInfo = {};
     commandBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
     commandBufferAllocationInfo.commandPool = commandPool;
     commandBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferAllocationInfo.commandBufferCount = commandBuffers.size();
+    commandBufferAllocationInfo.commandBufferCount = FRAMES_IN_FLIGHT;
 
-    result = vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocationInfo, commandBuffers.data());
+    result = vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocationInfo, compositeTimerBeginCommandBuffers.data());
+    if(result == VK_SUCCESS)
+        result = vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocationInfo, compositeTimerEndCommandBuffers.data());
     if(result != VK_SUCCESS)
     {
-        std::cout << "Command buffers could not be allocated" << std::endl;
+        std::cout << "Composite timer command buffers could not be allocated" << std::endl;
         return false;
     }
-    else
-        std::cout << "Command buffers allocated" << std::endl;
 
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        vkBeginCommandBuffer(compositeTimerBeginCommandBuffers[i], &beginInfo);
+        gpuTimer.cmdBegin(compositeTimerBeginCommandBuffers[i], i, GPU_COMPOSITE);
+        vkEndCommandBuffer(compositeTimerBeginCommandBuffers[i]);
+
+        vkBeginCommandBuffer(compositeTimerEndCommandBuffers[i], &beginInfo);
+        gpuTimer.cmdEnd(compositeTimerEndCommandBuffers[i], i, GPU_COMPOSITE);
+        vkEndCommandBuffer(compositeTimerEndCommandBuffers[i]);
+    }
+
+    return true;
+}
+
+bool recordCommandBuffers()
+{
     VkClearValue clearValue[] = {{0.25f,0.35f,0.25f,1.0f}, {1.0, 0.0}};
     VkRenderPassBeginInfo renderPassBeginInfo = {};
     renderPassBeginInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
@@ -829,8 +1171,17 @@ bool createCommandBuffers()
     VkViewport viewport = {0, 0, swapchainExtent.width, swapchainExtent.height, 0, 1};
     VkRect2D scissor = {0, 0, swapchainExtent.width, swapchainExtent.height};
 
+    //Upscale the rendered region of the offscreen target to the whole screen
+    //Keep the filter footprint half a texel inside it so the unrendered edge doesn't bleed in
+    VkExtent2D renderExtent = renderScale.scaledExtent(swapchainExtent);
+    glm::vec2 targetSize = glm::vec2(renderToFramebuffer.width, renderToFramebuffer.height);
+    ScreenPushConstants screenPushConstants;
+    screenPushConstants.uvScale = glm::vec2(renderExtent.width, renderExtent.height) / targetSize;
+    screenPushConstants.uvMax = (glm::vec2(renderExtent.width, renderExtent.height) - 0.5f) / targetSize;
+
     for(int i = 0; i < commandBuffers.size(); i++)
     {
+        vkResetCommandBuffer(commandBuffers[i], 0);
         vkBeginCommandBuffer(commandBuffers[i], &beginInfo);
 
         renderPassBeginInfo.framebuffer = frameBuffers[i];
@@ -839,9 +1190,10 @@ bool createCommandBuffers()
             vkCmdSetViewport(commandBuffers[i], 0, 1, &viewport);
             vkCmdSetScissor(commandBuffers[i], 0, 1, &scissor);
 
-            vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, screenpipeline);
+            vkCmdBindPipeline(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineManager.get(screenpipeline));
 
             vkCmdBindDescriptorSets(commandBuffers[i], VK_PIPELINE_BIND_POINT_GRAPHICS, screenpipelineLayout, 0, 1, &screenQuadDescriptorSet, 0, NULL);
+            vkCmdPushConstants(commandBuffers[i], screenpipelineLayout, screenShader.reflection.pushConstantRange.stageFlags, 0, sizeof(ScreenPushConstants), &screenPushConstants);
             vkCmdBindVertexBuffers(commandBuffers[i], 0, 1, &screenMesh.vertexBuffer.buffer, &offsets);
             vkCmdBindIndexBuffer(commandBuffers[i], screenMesh.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
             vkCmdDrawIndexed(commandBuffers[i], screenMesh.indices.size(), 1,0,0,1);
@@ -853,15 +1205,41 @@ bool createCommandBuffers()
             std::cout << "Command buffer could not be created and filled: " << i << std::endl;
             return false;
         }
-        else
-            std::cout << "Command buffer created and filled: " << i << std::endl;
     }
 
     return true;
 }
 
+bool createCommandBuffers()
+{
+    PROFILE_ZONE("createCommandBuffers");
+    commandBuffers.resize(frameBuffers.size());
+
+    VkCommandBufferAllocateInfo commandBufferAllocationInfo = {};
+    commandBufferAllocationInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocationInfo.commandPool = commandPool;
+    commandBufferAllocationInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocationInfo.commandBufferCount = commandBuffers.size();
+
+    result = vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocationInfo, commandBuffers.data());
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Command buffers could not be allocated" << std::endl;
+        return false;
+    }
+    else
+        std::cout << "Command buffers allocated" << std::endl;
+
+    if(!recordCommandBuffers())
+        return false;
+    std::cout << "Command buffers created and filled" << std::endl;
+
+    return true;
+}
+
 bool createSwapchain()
 {
+    PROFILE_ZONE("createSwapchain");
     //Swapchain parameters
     VkSwapchainCreateInfoKHR swapchainCreateInfo = {};
     swapchainCreateInfo.sType = VK_STRUCTURE_TYPE_SWAPCHAIN_CREATE_INFO_KHR;  //VkStructureType
@@ -889,6 +1267,7 @@ bool createSwapchain()
 
 bool createCommandPool()
 {
+    PROFILE_ZONE("createCommandPool");
     VkCommandPoolCreateInfo commandPoolCreateInfo = {};
     commandPoolCreateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;      //VkStructureType
     commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
@@ -901,11 +1280,38 @@ bool createCommandPool()
         return false;
     }
 
+    //Pools belong to a family, other families get their own
+    transferCommandPool = commandPool;
+    if(transferQueueId != presentQueueId)
+    {
+        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
+        commandPoolCreateInfo.queueFamilyIndex = transferQueueId;
+        result = vkCreateCommandPool(logicalDevice, &commandPoolCreateInfo, NULL, &transferCommandPool);
+        if(result != VK_SUCCESS)
+        {
+            std::cout << "Transfer command pool creation failed (" << result << ")" << std::endl;
+            return false;
+        }
+    }
+    computeCommandPool = commandPool;
+    if(asyncCompute)
+    {
+        commandPoolCreateInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+        commandPoolCreateInfo.queueFamilyIndex = computeQueueId;
+        result = vkCreateCommandPool(logicalDevice, &commandPoolCreateInfo, NULL, &computeCommandPool);
+        if(result != VK_SUCCESS)
+        {
+            std::cout << "Compute command pool creation failed (" << result << ")" << std::endl;
+            return false;
+        }
+    }
+
     return true;
 }
 
 bool doSwapchainImages()
 {
+    PROFILE_ZONE("doSwapchainImages");
     //Get images from swapchain
     //Count images
     uint32_t swapchainImageCount;
@@ -977,6 +1383,7 @@ bool doSwapchainImages()
 
 bool doDepthImage()
 {
+    PROFILE_ZONE("doDepthImage");
     VkImageCreateInfo depthImageCreateInfo = {};
     depthImageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     depthImageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1048,6 +1455,7 @@ bool doDepthImage()
 
 bool createRenderPass()
 {
+    PROFILE_ZONE("createRenderPass");
     VkAttachmentDescription passAttachments[2] = { };
     passAttachments[0].format = colourFormat;
     passAttachments[0].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -1056,7 +1464,8 @@ bool createRenderPass()
     passAttachments[0].stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
     passAttachments[0].stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
     passAttachments[0].initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-    passAttachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+    //Headless frames are only ever copied out
+    passAttachments[0].finalLayout = headless ? VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
 
     passAttachments[1].format = VK_FORMAT_D32_SFLOAT_S8_UINT;
     passAttachments[1].samples = VK_SAMPLE_COUNT_1_BIT;
@@ -1081,13 +1490,24 @@ bool createRenderPass()
     subpass.pColorAttachments = &colourAttachmentReference;
     subpass.pDepthStencilAttachment = &depthAttachmentReference;
 
-    VkSubpassDependency dependency = {};
-    dependency.srcSubpass = VK_SUBPASS_EXTERNAL;
-    dependency.dstSubpass = 0;
-    dependency.srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
-    dependency.srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
-    dependency.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-    dependency.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    VkSubpassDependency dependencies[2] = {};
+    dependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[0].dstSubpass = 0;
+    dependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT;
+    dependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+    dependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+    dependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+
+    //Every frame slot renders into the same offscreen target, so the previous frame's composite
+    //and capture have to be done reading it, and its depth written, before this pass clears them
+    dependencies[1].srcSubpass = VK_SUBPASS_EXTERNAL;
+    dependencies[1].dstSubpass = 0;
+    dependencies[1].srcStageMask = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+                                   VK_PIPELINE_STAGE_TRANSFER_BIT;
+    dependencies[1].srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+    dependencies[1].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+    dependencies[1].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+                                    VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 
     VkRenderPassCreateInfo renderPassCreateInfo = {};
     renderPassCreateInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO;
@@ -1095,8 +1515,8 @@ bool createRenderPass()
     renderPassCreateInfo.pAttachments = passAttachments;
     renderPassCreateInfo.subpassCount = 1;
     renderPassCreateInfo.pSubpasses = &subpass;
-    renderPassCreateInfo.dependencyCount = 1;
-    renderPassCreateInfo.pDependencies = &dependency;
+    renderPassCreateInfo.dependencyCount = 2;
+    renderPassCreateInfo.pDependencies = dependencies;
 
     result = vkCreateRenderPass(logicalDevice, &renderPassCreateInfo, NULL, &renderPass);
     if(result != VK_SUCCESS)
@@ -1110,6 +1530,7 @@ bool createRenderPass()
 
 bool createFramebuffers()
 {
+    PROFILE_ZONE("createFramebuffers");
     VkImageView frameBufferAttachments[2];
     frameBufferAttachments[1] = depthImageView;
 
@@ -1142,6 +1563,7 @@ bool createFramebuffers()
 
 bool loadModels()
 {
+    PROFILE_ZONE("loadModels");
     //LOAD MESH HERE
     Mesh testMesh;
     Mesh testMesh2;
@@ -1196,325 +1618,323 @@ bool loadModels()
     return true;
 }
 
-bool loadShaders()
+//Loads a stage, its type and interface come from the SPIR-V
+bool addShaderStage(ShaderParts &parts, std::string filename)
 {
-    static VkVertexInputBindingDescription vertexBindingDescription = {};
-    vertexBindingDescription.binding = 0;
-    vertexBindingDescription.stride = sizeof(Vertex);
-    vertexBindingDescription.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
-
-    //Simple model shader
+    VkShaderModule module;
+    ShaderReflection reflection;
+    result = loadShader(filename, &module, &reflection);
+    if(result != VK_SUCCESS)
     {
-        shader1.shaderModules.resize(2);
-        result = loadShader("./shaders/simple.vert.spv", &shader1.shaderModules[0]);
-        if(result != VK_SUCCESS)
-        {
-            std::cout << "Vertex shader creation failed (" << result << ")" << std::endl;
-            return false;
-        }
-        result = loadShader("./shaders/simple.frag.spv", &shader1.shaderModules[1]);
-        if(result != VK_SUCCESS)
-        {
-            std::cout << "Fragment shader creation failed (" << result << ")" << std::endl;
-            return false;
-        }
-
-        shader1.stageCreateInfo.resize(2);
-        shader1.stageCreateInfo[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shader1.stageCreateInfo[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-        shader1.stageCreateInfo[0].module = shader1.shaderModules[0];
-        shader1.stageCreateInfo[0].pName = "main";        // shader entry point function name
-        shader1.stageCreateInfo[0].pSpecializationInfo = NULL;
+        std::cout << "Shader creation failed: " << filename << " (" << result << ")" << std::endl;
+        return false;
+    }
+    parts.files.push_back(filename);
+    parts.shaderModules.push_back(module);
 
-        shader1.stageCreateInfo[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shader1.stageCreateInfo[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        shader1.stageCreateInfo[1].module = shader1.shaderModules[1];
-        shader1.stageCreateInfo[1].pName = "main";        // shader entry point function name
-        shader1.stageCreateInfo[1].pSpecializationInfo = NULL;
+    VkPipelineShaderStageCreateInfo stageInfo = {};
+    stageInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    stageInfo.stage = (VkShaderStageFlagBits)reflection.stages;
+    stageInfo.module = module;
+    stageInfo.pName = "main";        // shader entry point function name
+    stageInfo.pSpecializationInfo = NULL;
+    parts.stageCreateInfo.push_back(stageInfo);
 
+    return parts.reflection.merge(reflection);
+}
 
-        static std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptionSimple(4);
-        vertexAttributeDescriptionSimple[0].location = 0;
-        vertexAttributeDescriptionSimple[0].binding = 0;
-        vertexAttributeDescriptionSimple[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        vertexAttributeDescriptionSimple[0].offset = 0;
+//Every mesh keeps Vertex in binding 0, each shader only reads the inputs it declares
+bool buildVertexInput(ShaderParts &parts)
+{
+    parts.vertexBinding.binding = 0;
+    parts.vertexBinding.stride = parts.vertexStride;
+    parts.vertexBinding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
 
-        vertexAttributeDescriptionSimple[1].location = 1;
-        vertexAttributeDescriptionSimple[1].binding = 0;
-        vertexAttributeDescriptionSimple[1].format = VK_FORMAT_R32G32_SFLOAT;
-        vertexAttributeDescriptionSimple[1].offset = sizeof(glm::vec3);
+    if(!parts.reflection.vertexAttributes(parts.fields.empty() ? vertexFields() : parts.fields, 0, &parts.vertexAttributes))
+        return false;
 
-        vertexAttributeDescriptionSimple[2].location = 2;
-        vertexAttributeDescriptionSimple[2].binding = 0;
-        vertexAttributeDescriptionSimple[2].format = VK_FORMAT_R32G32B32_SFLOAT;
-        vertexAttributeDescriptionSimple[2].offset = sizeof(glm::vec3) + sizeof(glm::vec2);
+    parts.vertexInputStateCreateInfo = {};
+    parts.vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
+    parts.vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
+    parts.vertexInputStateCreateInfo.pVertexBindingDescriptions = &parts.vertexBinding;
+    parts.vertexInputStateCreateInfo.vertexAttributeDescriptionCount = parts.vertexAttributes.size();
+    parts.vertexInputStateCreateInfo.pVertexAttributeDescriptions = parts.vertexAttributes.data();
 
-        vertexAttributeDescriptionSimple[3].location = 3;
-        vertexAttributeDescriptionSimple[3].binding = 0;
-        vertexAttributeDescriptionSimple[3].format = VK_FORMAT_R32_SINT;
-        vertexAttributeDescriptionSimple[3].offset = sizeof(glm::vec3)*2 + sizeof(glm::vec2);
+    return true;
+}
 
-        shader1.vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        shader1.vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
-        shader1.vertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexBindingDescription;
-        shader1.vertexInputStateCreateInfo.vertexAttributeDescriptionCount = vertexAttributeDescriptionSimple.size();
-        shader1.vertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexAttributeDescriptionSimple.data();
+bool loadShaders()
+{
+    PROFILE_ZONE("loadShaders");
+    //Simple model shader
+    if(!addShaderStage(shader1, "./shaders/simple.vert.spv") ||
+       !addShaderStage(shader1, "./shaders/simple.frag.spv") ||
+       !buildVertexInput(shader1))
+        return false;
+    std::cout << "Simple shader parts created" << std::endl;
+
+    //Normals overlay, optional
+    normalLineShader.fields = NormalOverlay::vertexFields();
+    normalLineShader.vertexStride = sizeof(NormalLineVertex);
+    if(addShaderStage(normalLineShader, "./shaders/normalLine.vert.spv") &&
+       addShaderStage(normalLineShader, "./shaders/normal.frag.spv") &&
+       buildVertexInput(normalLineShader) &&
+       loadShader("./shaders/normalLines.comp.spv", &normalLinesModule, &normalLinesReflection) == VK_SUCCESS)
+        std::cout << "Normals shader parts created" << std::endl;
+    else
+        std::cout << "Normals shaders missing, overlay disabled" << std::endl;
 
-        std::cout << "Simple shader parts created" << std::endl;
+    //Bindless scene shaders, optional since the per-mesh path covers everything
+    if(addShaderStage(bindlessShader, "./shaders/bindless.vert.spv") &&
+       addShaderStage(bindlessShader, "./shaders/bindless.frag.spv") &&
+       buildVertexInput(bindlessShader))
+    {
+        bindlessShadersLoaded = true;
+        std::cout << "Bindless shader parts created" << std::endl;
     }
+    else
+        std::cout << "Bindless shaders missing, using per-mesh descriptor sets" << std::endl;
 
-    //Normals line view shader
+    //Virtual texture shaders, optional
+    if(!virtualTextureImage.empty())
     {
-        shader2.shaderModules.resize(3);
-        result = loadShader("./shaders/normal.vert.spv", &shader2.shaderModules[0]);
-        if(result != VK_SUCCESS)
+        if(addShaderStage(virtualShader, "./shaders/virtual.vert.spv") &&
+           addShaderStage(virtualShader, "./shaders/virtual.frag.spv") &&
+           buildVertexInput(virtualShader))
         {
-            std::cout << "Vertex shader creation failed (" << result << ")" << std::endl;
-            return false;
-        }
-        result = loadShader("./shaders/normal.geom.spv", &shader2.shaderModules[1]);
-        if(result != VK_SUCCESS)
-        {
-            std::cout << "Geometry shader creation failed (" << result << ")" << std::endl;
-            return false;
-        }
-        result = loadShader("./shaders/normal.frag.spv", &shader2.shaderModules[2]);
-        if(result != VK_SUCCESS)
-        {
-            std::cout << "Fragment shader creation failed (" << result << ")" << std::endl;
-            return false;
+            virtualShadersLoaded = true;
+            std::cout << "Virtual texture shader parts created" << std::endl;
         }
+        else
+            std::cout << "Virtual texture shaders missing, virtual texture disabled" << std::endl;
+    }
 
-        shader2.stageCreateInfo.resize(3);
-        shader2.stageCreateInfo[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shader2.stageCreateInfo[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-        shader2.stageCreateInfo[0].module = shader2.shaderModules[0];
-        shader2.stageCreateInfo[0].pName = "main";        // shader entry point function name
-        shader2.stageCreateInfo[0].pSpecializationInfo = NULL;
-
-        shader2.stageCreateInfo[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shader2.stageCreateInfo[1].stage = VK_SHADER_STAGE_GEOMETRY_BIT;
-        shader2.stageCreateInfo[1].module = shader2.shaderModules[1];
-        shader2.stageCreateInfo[1].pName = "main";        // shader entry point function name
-        shader2.stageCreateInfo[1].pSpecializationInfo = NULL;
-
-        shader2.stageCreateInfo[2].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        shader2.stageCreateInfo[2].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        shader2.stageCreateInfo[2].module = shader2.shaderModules[2];
-        shader2.stageCreateInfo[2].pName = "main";        // shader entry point function name
-        shader2.stageCreateInfo[2].pSpecializationInfo = NULL;
-
-
-        static std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptionNormal(2);
-        vertexAttributeDescriptionNormal[0].location = 0;
-        vertexAttributeDescriptionNormal[0].binding = 0;
-        vertexAttributeDescriptionNormal[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        vertexAttributeDescriptionNormal[0].offset = 0;
-
-        vertexAttributeDescriptionNormal[1].location = 1;
-        vertexAttributeDescriptionNormal[1].binding = 0;
-        vertexAttributeDescriptionNormal[1].format = VK_FORMAT_R32G32B32_SFLOAT;
-        vertexAttributeDescriptionNormal[1].offset = sizeof(glm::vec3) + sizeof(glm::vec2);
-
-        shader2.vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        shader2.vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
-        shader2.vertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexBindingDescription;
-        shader2.vertexInputStateCreateInfo.vertexAttributeDescriptionCount = vertexAttributeDescriptionNormal.size();
-        shader2.vertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexAttributeDescriptionNormal.data();
+    //Screen quad shader
+    if(!addShaderStage(screenShader, "./shaders/screen.vert.spv") ||
+       !addShaderStage(screenShader, "./shaders/screen.frag.spv") ||
+       !buildVertexInput(screenShader))
+        return false;
+    std::cout << "Screen shader parts created" << std::endl;
 
-        std::cout << "Normals shader parts created" << std::endl;
+    return true;
+}
+
+//Shaders rebuilt by the watcher, held until no pipeline is compiling
+ShaderHotReload shaderHotReload;
+std::vector<std::string> changedShaders;
+std::map<std::string, std::string> reloadedShaders; //Checked in SPIR-V path to the cached build replacing it
+
+bool usesShader(const ShaderParts &parts, const std::vector<std::string> &files)
+{
+    for(uint32_t i = 0; i < files.size(); i++)
+    {
+        if(std::find(parts.files.begin(), parts.files.end(), files[i]) != parts.files.end())
+            return true;
     }
+    return false;
+}
 
-    //Screen quad shader
+//Loads every stage again and swaps the modules in place, so pipeline requests pointing at the parts stay valid
+//Anything that would need a different pipeline layout is left for a restart
+bool reloadShaderParts(ShaderParts &parts, std::string name)
+{
+    ShaderParts fresh;
+    fresh.fields = parts.fields;
+    fresh.vertexStride = parts.vertexStride;
+    bool loaded = true;
+    for(uint32_t i = 0; i < parts.files.size() && loaded; i++)
     {
-        screenShader.shaderModules.resize(2);
-        result = loadShader("./shaders/screen.vert.spv", &screenShader.shaderModules[0]);
-        if(result != VK_SUCCESS)
-        {
-            std::cout << "Vertex shader creation failed (" << result << ")" << std::endl;
-            return false;
-        }
-        result = loadShader("./shaders/screen.frag.spv", &screenShader.shaderModules[1]);
-        if(result != VK_SUCCESS)
+        std::map<std::string, std::string>::iterator reloaded = reloadedShaders.find(parts.files[i]);
+        loaded = addShaderStage(fresh, reloaded != reloadedShaders.end() ? reloaded->second : parts.files[i]);
+    }
+    if(loaded && !fresh.reflection.fitsLayout(parts.reflection))
+    {
+        std::cout << name << " shader interface changed, restart to pick it up" << std::endl;
+        loaded = false;
+    }
+    if(loaded && !buildVertexInput(fresh))
+        loaded = false;
+    if(!loaded || fresh.stageCreateInfo.size() != parts.stageCreateInfo.size())
+    {
+        for(uint32_t i = 0; i < fresh.shaderModules.size(); i++)
         {
-            std::cout << "Fragment shader creation failed (" << result << ")" << std::endl;
-            return false;
+            vkDestroyShaderModule(logicalDevice, fresh.shaderModules[i], NULL);
         }
+        return false;
+    }
 
-        screenShader.stageCreateInfo.resize(2);
-        screenShader.stageCreateInfo[0].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        screenShader.stageCreateInfo[0].stage = VK_SHADER_STAGE_VERTEX_BIT;
-        screenShader.stageCreateInfo[0].module = screenShader.shaderModules[0];
-        screenShader.stageCreateInfo[0].pName = "main";        // shader entry point function name
-        screenShader.stageCreateInfo[0].pSpecializationInfo = NULL;
-
-        screenShader.stageCreateInfo[1].sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
-        screenShader.stageCreateInfo[1].stage = VK_SHADER_STAGE_FRAGMENT_BIT;
-        screenShader.stageCreateInfo[1].module = screenShader.shaderModules[1];
-        screenShader.stageCreateInfo[1].pName = "main";        // shader entry point function name
-        screenShader.stageCreateInfo[1].pSpecializationInfo = NULL;
-
-        static std::vector<VkVertexInputAttributeDescription> vertexAttributeDescriptionScreen(2);
-        vertexAttributeDescriptionScreen[0].location = 0;
-        vertexAttributeDescriptionScreen[0].binding = 0;
-        vertexAttributeDescriptionScreen[0].format = VK_FORMAT_R32G32B32_SFLOAT;
-        vertexAttributeDescriptionScreen[0].offset = 0;
-
-        vertexAttributeDescriptionScreen[1].location = 1;
-        vertexAttributeDescriptionScreen[1].binding = 0;
-        vertexAttributeDescriptionScreen[1].format = VK_FORMAT_R32G32_SFLOAT;
-        vertexAttributeDescriptionScreen[1].offset = sizeof(glm::vec3);
+    //Existing pipelines no longer need the old modules
+    for(uint32_t i = 0; i < parts.shaderModules.size(); i++)
+    {
+        vkDestroyShaderModule(logicalDevice, parts.shaderModules[i], NULL);
+        parts.shaderModules[i] = fresh.shaderModules[i];
+        parts.stageCreateInfo[i].module = fresh.shaderModules[i];
+    }
+    parts.vertexAttributes = fresh.vertexAttributes;
+    parts.vertexInputStateCreateInfo.vertexAttributeDescriptionCount = parts.vertexAttributes.size();
+    parts.vertexInputStateCreateInfo.pVertexAttributeDescriptions = parts.vertexAttributes.data();
+    return true;
+}
 
-        screenShader.vertexInputStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-        screenShader.vertexInputStateCreateInfo.vertexBindingDescriptionCount = 1;
-        screenShader.vertexInputStateCreateInfo.pVertexBindingDescriptions = &vertexBindingDescription;
-        screenShader.vertexInputStateCreateInfo.vertexAttributeDescriptionCount = vertexAttributeDescriptionScreen.size();
-        screenShader.vertexInputStateCreateInfo.pVertexAttributeDescriptions = vertexAttributeDescriptionScreen.data();
+//Frame boundary, rebuilt pipelines are compiled in the background and swapped in by swapRebuilt()
+void hotReloadShaders()
+{
+    std::vector<ShaderHotReload::Rebuilt> rebuilt = shaderHotReload.takeRebuilt();
+    for(uint32_t i = 0; i < rebuilt.size(); i++)
+    {
+        reloadedShaders[rebuilt[i].spvPath] = rebuilt[i].cachedPath;
+        changedShaders.push_back(rebuilt[i].spvPath);
+    }
+    //Workers read the stages being swapped, so wait for them to finish
+    if(changedShaders.empty() || !pipelineManager.poll())
+        return;
+    PROFILE_ZONE("hotReloadShaders");
 
-        std::cout << "Screen shader parts created" << std::endl;
+    std::vector<uint32_t> pipelines;
+    if(usesShader(shader1, changedShaders) && reloadShaderParts(shader1, "Simple"))
+    {
+        std::vector<uint32_t> variants = sceneVariants.updateStages(shader1.stageCreateInfo);
+        pipelines.insert(pipelines.end(), variants.begin(), variants.end());
     }
+    if(normalpipeline != NO_PIPELINE && usesShader(normalLineShader, changedShaders) &&
+       reloadShaderParts(normalLineShader, "Normals"))
+        pipelines.push_back(normalpipeline);
+    if(bindlessScene.enabled && usesShader(bindlessShader, changedShaders) && reloadShaderParts(bindlessShader, "Bindless"))
+        pipelines.push_back(bindlessPipeline);
+    if(virtualTexture.enabled && usesShader(virtualShader, changedShaders) && reloadShaderParts(virtualShader, "Virtual"))
+        pipelines.push_back(virtualPipeline);
+    if(usesShader(screenShader, changedShaders) && reloadShaderParts(screenShader, "Screen"))
+        pipelines.push_back(screenpipeline);
+    changedShaders.clear();
 
-    return true;
+    for(uint32_t i = 0; i < pipelines.size(); i++)
+    {
+        pipelineManager.rebuild(pipelines[i]);
+    }
+    pipelineManager.compileAsync(0);
 }
 
-bool doDescriptors()
+//Mesh sets' image binding, again whenever the residency manager replaces a texture
+void writeMeshTextureDescriptors()
 {
-    //Descriptor pool
-    {
-        VkDescriptorPoolSize typeCounts[2];
-        typeCounts[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        typeCounts[0].descriptorCount = 10;
-        typeCounts[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        typeCounts[1].descriptorCount = 10;
-
-        VkDescriptorPoolCreateInfo descriptorPoolInfo = {};
-        descriptorPoolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-        descriptorPoolInfo.pNext = NULL;
-        descriptorPoolInfo.poolSizeCount = 2;
-        descriptorPoolInfo.pPoolSizes = typeCounts;
-        descriptorPoolInfo.maxSets = 20;
-
-        result = vkCreateDescriptorPool(logicalDevice, &descriptorPoolInfo, NULL, &descriptorPool);
-        if(result != VK_SUCCESS)
+    //Untextured variants never sample, but the binding still has to hold a valid image
+    int placeholder = -1;
+    for(uint32_t i = 0; i < meshes.size() && placeholder < 0; i++)
+    {
+        if(meshes[i].textured)
+            placeholder = i;
+    }
+
+    std::vector<VkDescriptorImageInfo> descriptorImageInfos(meshes.size());
+    for(uint32_t i = 0; i < meshes.size(); i++)
+    {
+        int source = meshes[i].textured ? (int)i : placeholder;
+        if(source >= 0)
         {
-            std::cout << "Descriptor pool creation failed (" << result << ")" << std::endl;
-            return false;
+            descriptorImageInfos[i].sampler = VK_NULL_HANDLE; //Immutable
+            descriptorImageInfos[i].imageView = meshes[source].tex->textureView;
+            descriptorImageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
         }
     }
 
-    //Meshes
+    std::vector<VkWriteDescriptorSet> writeDescriptorSets;
+    for(uint32_t i = 0; i < meshes.size() && placeholder >= 0; i++)
     {
-        std::vector<VkDescriptorSetLayoutBinding> descriptorlayoutBinding(2);
-        descriptorlayoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        descriptorlayoutBinding[0].binding = 0;
-        descriptorlayoutBinding[0].descriptorCount = 1;
-        descriptorlayoutBinding[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT;
-        descriptorlayoutBinding[0].pImmutableSamplers = NULL;
+        writeDescriptorSets.push_back(VkWriteDescriptorSet());
 
-        descriptorlayoutBinding[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        descriptorlayoutBinding[1].binding = 1;
-        descriptorlayoutBinding[1].descriptorCount = 1;
-        descriptorlayoutBinding[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        descriptorlayoutBinding[1].pImmutableSamplers = NULL;
+        // Binding 1 : Image sampler
+        writeDescriptorSets[i] = {};
+        writeDescriptorSets[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writeDescriptorSets[i].dstBinding = 1;
+        writeDescriptorSets[i].dstSet = descriptorSets[i];
+        writeDescriptorSets[i].descriptorCount = 1;
+        writeDescriptorSets[i].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writeDescriptorSets[i].pImageInfo = &descriptorImageInfos[i];
+    }
+    if(!writeDescriptorSets.empty())
+        vkUpdateDescriptorSets(logicalDevice, writeDescriptorSets.size(), writeDescriptorSets.data(), 0, NULL);
+}
 
-        VkDescriptorSetLayoutCreateInfo descriptorLayoutCreateInfo = {};
-        descriptorLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        descriptorLayoutCreateInfo.pNext = NULL;
-        descriptorLayoutCreateInfo.bindingCount = 2;
-        descriptorLayoutCreateInfo.pBindings = descriptorlayoutBinding.data();
+bool doDescriptors()
+{
+    PROFILE_ZONE("doDescriptors");
+    descriptorAllocator.layoutCache = &descriptorLayoutCache;
 
-        descriptorSetLayouts.resize(meshes.size());
-        for(int i = 0; i < meshes.size(); i++)
+    //Scene layouts are whatever the simple shader declares, every texture uses the same sampler so it lives in the layout
+    sceneReflection = shader1.reflection;
+    if(!sceneReflection.setImmutableSampler(1, 1, samplerCache, textureSamplerCreateInfo()) ||
+       !sceneReflection.createSetLayouts(descriptorLayoutCache, &sceneSetLayouts))
+        return false;
+    if(sceneSetLayouts.size() != 2 || sceneReflection.pushConstantRange.size != sizeof(ObjectData))
+    {
+        std::cout << "Scene shaders should use a camera set, a mesh set and ObjectData push constants" << std::endl;
+        return false;
+    }
+    cameraDescriptorSetLayout = sceneSetLayouts[0];
+    meshDescriptorSetLayout = sceneSetLayouts[1];
+
+    //Camera, set 0 for both scene paths
+    {
+        cameraDescriptorSets.resize(FRAMES_IN_FLIGHT);
+        for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
         {
-            result = vkCreateDescriptorSetLayout(logicalDevice, &descriptorLayoutCreateInfo, NULL, &descriptorSetLayouts[i]);
+            if(!descriptorAllocator.allocate(cameraDescriptorSetLayout, &cameraDescriptorSets[i]))
+                return false;
+
+            VkDescriptorBufferInfo cameraInfo = {cameraBuffers[i].buffer, 0, sizeof(CameraData)};
+
+            VkWriteDescriptorSet writeDescriptorSet = {};
+            writeDescriptorSet.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+            writeDescriptorSet.dstBinding = 0;
+            writeDescriptorSet.dstSet = cameraDescriptorSets[i];
+            writeDescriptorSet.descriptorCount = 1;
+            writeDescriptorSet.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+            writeDescriptorSet.pBufferInfo = &cameraInfo;
+            vkUpdateDescriptorSets(logicalDevice, 1, &writeDescriptorSet, 0, NULL);
         }
+    }
 
-        VkDescriptorSetAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = descriptorPool;
-        allocInfo.descriptorSetCount = 1;
-        allocInfo.pSetLayouts = descriptorSetLayouts.data();
-
+    //Meshes, set 1, transforms come through push constants
+    //Every mesh shares the one layout
+    {
         //std::vector<VkDescriptorSet> descriptorSets(meshes.size());
         descriptorSets.resize(meshes.size());
         for(int i = 0; i < meshes.size(); i++)
         {
-            result = vkAllocateDescriptorSets(logicalDevice, &allocInfo, &descriptorSets[i]);
-        }
-
-        std::vector<VkDescriptorBufferInfo> uniformDescriptorInfos(meshes.size());
-        for(int i = 0; i < meshes.size(); i++)
-        {
-            uniformDescriptorInfos[i].buffer = uniformBuffers[i].buffer;
-            uniformDescriptorInfos[i].offset = 0;
-            uniformDescriptorInfos[i].range = sizeof(UniformData);
+            if(!descriptorAllocator.allocate(meshDescriptorSetLayout, &descriptorSets[i]))
+                return false;
         }
 
-        std::vector<VkDescriptorImageInfo> descriptorImageInfos(meshes.size());
-        for(int i = 0; i < meshes.size(); i++)
-        {
-            if(meshes[i].textured)
-            {
-                descriptorImageInfos[i].sampler = meshes[i].tex.sampler;
-                descriptorImageInfos[i].imageView = meshes[i].tex.textureView;
-                descriptorImageInfos[i].imageLayout = VK_IMAGE_LAYOUT_GENERAL;
-            }
-        }
+        writeMeshTextureDescriptors();
+    }
 
-        std::vector<std::vector<VkWriteDescriptorSet> > writeDescriptorSets(meshes.size());
-        for(int i = 0; i < meshes.size(); i++)
+    //Bindless scene, falls back to the per-mesh sets above
+    if(bindlessShadersLoaded && BindlessScene::supported(physicalFeatures, meshes))
+    {
+        if(!bindlessShader.reflection.setImmutableSampler(1, 1, samplerCache, textureSamplerCreateInfo()) ||
+           !bindlessScene.create(meshes, sizeof(ObjectData), FRAMES_IN_FLIGHT, bindlessShader.reflection,
+                                 descriptorLayoutCache, descriptorAllocator))
         {
-            writeDescriptorSets[i].resize(2);
-            // Binding 0 : Uniform buffer
-            writeDescriptorSets[i][0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSets[i][0].dstBinding = 0;
-            writeDescriptorSets[i][0].dstSet = descriptorSets[i];
-            writeDescriptorSets[i][0].descriptorCount = 1;
-            writeDescriptorSets[i][0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-            writeDescriptorSets[i][0].pBufferInfo = &uniformDescriptorInfos[i];
-            // Binding 1 : Image sampler
-            writeDescriptorSets[i][1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-            writeDescriptorSets[i][1].dstBinding = 1;
-            writeDescriptorSets[i][1].dstSet = descriptorSets[i];
-            writeDescriptorSets[i][1].descriptorCount = 1;
-            writeDescriptorSets[i][1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-            writeDescriptorSets[i][1].pImageInfo = &descriptorImageInfos[i];
-            vkUpdateDescriptorSets(logicalDevice, 2, writeDescriptorSets[i].data(), 0, NULL);
+            bindlessScene.destroy();
+            std::cout << "Bindless scene creation failed, using per-mesh descriptor sets" << std::endl;
         }
     }
 
     //Screen quad
     {
-        std::vector<VkDescriptorSetLayoutBinding> screenQuadDescriptorlayoutBinding(2);
-        screenQuadDescriptorlayoutBinding[0].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-        screenQuadDescriptorlayoutBinding[0].binding = 0;
-        screenQuadDescriptorlayoutBinding[0].descriptorCount = 1;
-        screenQuadDescriptorlayoutBinding[0].stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_GEOMETRY_BIT;
-        screenQuadDescriptorlayoutBinding[0].pImmutableSamplers = NULL;
-
-        screenQuadDescriptorlayoutBinding[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-        screenQuadDescriptorlayoutBinding[1].binding = 1;
-        screenQuadDescriptorlayoutBinding[1].descriptorCount = 1;
-        screenQuadDescriptorlayoutBinding[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
-        screenQuadDescriptorlayoutBinding[1].pImmutableSamplers = NULL;
-
-        VkDescriptorSetLayoutCreateInfo screenQuadDescriptorLayoutCreateInfo = {};
-        screenQuadDescriptorLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
-        screenQuadDescriptorLayoutCreateInfo.pNext = NULL;
-        screenQuadDescriptorLayoutCreateInfo.bindingCount = 2;
-        screenQuadDescriptorLayoutCreateInfo.pBindings = screenQuadDescriptorlayoutBinding.data();
-
-        //VkDescriptorSetLayout screenQuadDescriptorSetLayout;
-        result = vkCreateDescriptorSetLayout(logicalDevice, &screenQuadDescriptorLayoutCreateInfo, NULL, &screenQuadDescriptorSetLayout);
-
-        VkDescriptorSetAllocateInfo allocInfo = {};
-        allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-        allocInfo.descriptorPool = descriptorPool;
-        allocInfo.descriptorSetCount = 1;
-        allocInfo.pSetLayouts = &screenQuadDescriptorSetLayout;
+        std::vector<VkDescriptorSetLayout> screenSetLayouts;
+        if(!screenShader.reflection.createSetLayouts(descriptorLayoutCache, &screenSetLayouts))
+            return false;
+        if(screenSetLayouts.size() != 1)
+        {
+            std::cout << "Screen shader should use a single descriptor set" << std::endl;
+            return false;
+        }
+        screenQuadDescriptorSetLayout = screenSetLayouts[0];
 
         //VkDescriptorSet screenQuadDescriptorSet;
-        result = vkAllocateDescriptorSets(logicalDevice, &allocInfo, &screenQuadDescriptorSet);
+        if(!descriptorAllocator.allocate(screenQuadDescriptorSetLayout, &screenQuadDescriptorSet))
+            return false;
 
         VkDescriptorBufferInfo screenQuadUniformDescriptorInfo;
         screenQuadUniformDescriptorInfo.buffer = screenQuadUniformMemory.buffer;
@@ -1544,202 +1964,135 @@ bool doDescriptors()
         vkUpdateDescriptorSets(logicalDevice, 2, writeDescriptorSet.data(), 0, NULL);
     }
 
+    std::cout << "Descriptor set layouts: " << descriptorLayoutCache.layouts.size()
+              << " (" << descriptorLayoutCache.hits << " reused)" << std::endl;
+    std::cout << "Samplers: " << samplerCache.samplers.size() << " (" << samplerCache.hits << " reused)" << std::endl;
+
     return true;
 }
 
+//Tiles the image into the texture cache directory the first time, then sets up the page cache and a ground plane to show it
+//Any failure just leaves the plane out
+void loadVirtualTexture()
+{
+    PROFILE_ZONE("loadVirtualTexture");
+    if(!virtualShadersLoaded)
+        return;
+    if(!physicalFeatures.fragmentStoresAndAtomics)
+    {
+        std::cout << "Virtual texture: no fragment shader stores for feedback, disabled" << std::endl;
+        return;
+    }
+    if(virtualShader.reflection.pushConstantRange.size != sizeof(ObjectData))
+    {
+        std::cout << "Virtual texture shaders should use ObjectData push constants" << std::endl;
+        return;
+    }
+
+    std::string name = virtualTextureImage;
+    size_t slash = name.find_last_of("/\\");
+    if(slash != std::string::npos)
+        name = name.substr(slash + 1);
+    std::string tiledPath = textureCacheDirectory + "/" + name + ".vtex";
+    std::ifstream tiled(tiledPath.c_str(), std::ios::binary);
+    if(!tiled.is_open() && !VirtualTexture::bake(virtualTextureImage, tiledPath))
+        return;
+    tiled.close();
+
+    if(!virtualTexture.create(tiledPath, swapchainExtent, FRAMES_IN_FLIGHT, virtualShader.reflection,
+                              descriptorLayoutCache, descriptorAllocator))
+    {
+        virtualTexture.destroy();
+        std::cout << "Virtual texture creation failed, disabled" << std::endl;
+        return;
+    }
+
+    //Both windings, so it shows from above and below
+    float extent = 30;
+    std::vector<glm::vec3> planeVertices;
+    planeVertices.push_back(glm::vec3(-extent,-3,-extent));
+    planeVertices.push_back(glm::vec3(extent,-3,-extent));
+    planeVertices.push_back(glm::vec3(extent,-3,extent));
+    planeVertices.push_back(glm::vec3(-extent,-3,extent));
+    std::vector<glm::vec2> planeUvs;
+    planeUvs.push_back(glm::vec2(0,0));
+    planeUvs.push_back(glm::vec2(1,0));
+    planeUvs.push_back(glm::vec2(1,1));
+    planeUvs.push_back(glm::vec2(0,1));
+    std::vector<glm::vec3> planeNormals(4, glm::vec3(0,1,0));
+    unsigned int indices[] = {0,1,2, 2,3,0, 0,2,1, 2,0,3};
+    std::vector<unsigned int> planeIndices(indices, indices + 12);
+    if(!virtualPlane.loadWithVectors(planeVertices, planeUvs, planeNormals, planeIndices))
+    {
+        virtualTexture.destroy();
+        std::cout << "Virtual texture plane failed to load" << std::endl;
+    }
+}
+
 bool createPipeline()
 {
-    VkPipelineLayoutCreateInfo layoutCreateInfo = {};
-    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    layoutCreateInfo.setLayoutCount = descriptorSetLayouts.size();
-    layoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
-    layoutCreateInfo.pushConstantRangeCount = 0;//1;
-    layoutCreateInfo.pPushConstantRanges = NULL;//&pushConstantRange;
-
-    result = vkCreatePipelineLayout(logicalDevice, &layoutCreateInfo, NULL, &pipelineLayout);
-    if(result != VK_SUCCESS)
-    {
-        std::cout << "Pipeline layout creation failed (" << result << ")" << std::endl;
-        return false;
-    }
-    // vertex topology config:
-    VkPipelineInputAssemblyStateCreateInfo inputAssemblyStateCreateInfo = {};
-    inputAssemblyStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-    inputAssemblyStateCreateInfo.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
-    inputAssemblyStateCreateInfo.primitiveRestartEnable = VK_FALSE;
-
-    VkViewport viewport = {};
-    viewport.x = 0;
-    viewport.y = 0;
-    viewport.width = swapchainExtent.width;
-    viewport.height = swapchainExtent.height;
-    viewport.minDepth = 0;
-    viewport.maxDepth = 1;
-
-    VkRect2D scissors = {};
-    scissors.offset = {0, 0};
-    scissors.extent = {swapchainExtent.width, swapchainExtent.height};
-
-    VkPipelineViewportStateCreateInfo viewportState = {};
-    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
-    viewportState.viewportCount = 1;
-    viewportState.pViewports = &viewport;
-    viewportState.scissorCount = 1;
-    viewportState.pScissors = &scissors;
-
-    VkPipelineRasterizationStateCreateInfo rasterizationState = {};
-    rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
-    rasterizationState.depthClampEnable = VK_FALSE;
-    rasterizationState.rasterizerDiscardEnable = VK_FALSE;
-    rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
-    rasterizationState.cullMode = VK_CULL_MODE_BACK_BIT;
-    rasterizationState.frontFace = VK_FRONT_FACE_CLOCKWISE;
-    rasterizationState.depthBiasEnable = VK_FALSE;
-    rasterizationState.depthBiasConstantFactor = 0;
-    rasterizationState.depthBiasClamp = 0;
-    rasterizationState.depthBiasSlopeFactor = 0;
-    rasterizationState.lineWidth = 1;
-
-    VkPipelineMultisampleStateCreateInfo multisampleState = {};
-    multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
-    multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
-    multisampleState.sampleShadingEnable = VK_FALSE;
-    multisampleState.minSampleShading = 0;
-    multisampleState.pSampleMask = NULL;
-    multisampleState.alphaToCoverageEnable = VK_FALSE;
-    multisampleState.alphaToOneEnable = VK_FALSE;
-
-    VkStencilOpState noOPStencilState = {};
-    noOPStencilState.failOp = VK_STENCIL_OP_KEEP;
-    noOPStencilState.passOp = VK_STENCIL_OP_KEEP;
-    noOPStencilState.depthFailOp = VK_STENCIL_OP_KEEP;
-    noOPStencilState.compareOp = VK_COMPARE_OP_ALWAYS;
-    noOPStencilState.compareMask = 0;
-    noOPStencilState.writeMask = 0;
-    noOPStencilState.reference = 0;
-
-    VkPipelineDepthStencilStateCreateInfo depthState = {};
-    depthState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
-    depthState.depthTestEnable = VK_TRUE;
-    depthState.depthWriteEnable = VK_TRUE;
-    depthState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
-    depthState.depthBoundsTestEnable = VK_FALSE;
-    depthState.stencilTestEnable = VK_FALSE;
-    depthState.front = noOPStencilState;
-    depthState.back = noOPStencilState;
-    depthState.minDepthBounds = 0;
-    depthState.maxDepthBounds = 0;
-
-    VkPipelineColorBlendAttachmentState colorBlendAttachmentState = {};
-    colorBlendAttachmentState.blendEnable = VK_FALSE;
-    colorBlendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_COLOR;
-    colorBlendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_DST_COLOR;
-    colorBlendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
-    colorBlendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
-    colorBlendAttachmentState.colorWriteMask = 0xf;
-
-    VkPipelineColorBlendStateCreateInfo colorBlendState = {};
-    colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
-    colorBlendState.logicOpEnable = VK_FALSE;
-    colorBlendState.logicOp = VK_LOGIC_OP_CLEAR;
-    colorBlendState.attachmentCount = 1;
-    colorBlendState.pAttachments = &colorBlendAttachmentState;
-    colorBlendState.blendConstants[0] = 0.0;
-    colorBlendState.blendConstants[1] = 0.0;
-    colorBlendState.blendConstants[2] = 0.0;
-    colorBlendState.blendConstants[3] = 0.0;
-
-    VkDynamicState dynamicState[2] = { VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR };
-    VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
-    dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-    dynamicStateCreateInfo.dynamicStateCount = 2;
-    dynamicStateCreateInfo.pDynamicStates = dynamicState;
-
-    VkGraphicsPipelineCreateInfo pipelineCreateInfo = {};
-    pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
-    pipelineCreateInfo.stageCount = shader1.shaderModules.size();
-    pipelineCreateInfo.pStages = shader1.stageCreateInfo.data();
-    pipelineCreateInfo.pVertexInputState = &shader1.vertexInputStateCreateInfo;
-    pipelineCreateInfo.pInputAssemblyState = &inputAssemblyStateCreateInfo;
-    pipelineCreateInfo.pTessellationState = NULL;
-    pipelineCreateInfo.pViewportState = &viewportState;
-    pipelineCreateInfo.pRasterizationState = &rasterizationState;
-    pipelineCreateInfo.pMultisampleState = &multisampleState;
-    pipelineCreateInfo.pDepthStencilState = &depthState;
-    pipelineCreateInfo.pColorBlendState = &colorBlendState;
-    pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
-    pipelineCreateInfo.layout = pipelineLayout;
-    pipelineCreateInfo.renderPass = renderPass;
-    pipelineCreateInfo.subpass = 0;
-    pipelineCreateInfo.basePipelineHandle = NULL;
-    pipelineCreateInfo.basePipelineIndex = 0;
-
-    result = vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL,
-                                       &simplepipeline);
-    if(result != VK_SUCCESS)
-    {
-        std::cout << "Simple pipeline creation failed (" << result << ")" << std::endl;
+    PROFILE_ZONE("createPipeline");
+    if(!sceneReflection.createPipelineLayout(sceneSetLayouts, &pipelineLayout))
         return false;
-    }
-    else
-    {
-        std::cout << "Simple pipeline created" << std::endl;
-    }
 
-    pipelineCreateInfo.stageCount = shader2.shaderModules.size();
-    pipelineCreateInfo.pStages = shader2.stageCreateInfo.data();
-    pipelineCreateInfo.pVertexInputState = &shader2.vertexInputStateCreateInfo;
-    result = vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL,
-                                       &normalpipeline);
-    if(result != VK_SUCCESS)
-    {
-        std::cout << "Normals pipeline creation failed (" << result << ")" << std::endl;
+    std::vector<VkDescriptorSetLayout> screenSetLayouts(1, screenQuadDescriptorSetLayout);
+    if(!screenShader.reflection.createPipelineLayout(screenSetLayouts, &screenpipelineLayout))
         return false;
-    }
-    else
-    {
-        std::cout << "Normals pipeline created" << std::endl;
-    }
 
-    VkPipelineLayoutCreateInfo screenlayoutCreateInfo = {};
-    screenlayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-    screenlayoutCreateInfo.setLayoutCount = 1;
-    screenlayoutCreateInfo.pSetLayouts = &screenQuadDescriptorSetLayout;
-    screenlayoutCreateInfo.pushConstantRangeCount = 0;//1;
-    screenlayoutCreateInfo.pPushConstantRanges = NULL;//&pushConstantRange;
+    if(!pipelineManager.create(renderPass, "pipeline_cache.bin", FRAMES_IN_FLIGHT))
+        return false;
 
-    result = vkCreatePipelineLayout(logicalDevice, &screenlayoutCreateInfo, NULL, &screenpipelineLayout);
-    if(result != VK_SUCCESS)
-    {
-        std::cout << "Pipeline layout creation failed (" << result << ")" << std::endl;
+    //Minimal set for the first frame
+    sceneVariants.create("Simple", shader1.stageCreateInfo, &shader1.vertexInputStateCreateInfo, pipelineLayout,
+                         VK_SHADER_STAGE_FRAGMENT_BIT);
+    simplepipeline = sceneVariants.get(pipelineManager, 0);
+    sceneVariants.fallback = simplepipeline;
+    screenpipeline = pipelineManager.add("Screen", screenShader.stageCreateInfo, &screenShader.vertexInputStateCreateInfo, screenpipelineLayout);
+    if(!pipelineManager.compileNow(simplepipeline) || !pipelineManager.compileNow(screenpipeline))
         return false;
-    }
 
-    pipelineCreateInfo.layout = screenpipelineLayout;
-    pipelineCreateInfo.stageCount = screenShader.shaderModules.size();
-    pipelineCreateInfo.pStages = screenShader.stageCreateInfo.data();
-    pipelineCreateInfo.pVertexInputState = &screenShader.vertexInputStateCreateInfo;
-    result = vkCreateGraphicsPipelines(logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, NULL,
-                                       &screenpipeline);
-    if(result != VK_SUCCESS)
+    //Everything else is drawn once it is ready
+    if(normalLinesModule != VK_NULL_HANDLE)
     {
-        std::cout << "Screen pipeline creation failed (" << result << ")" << std::endl;
-        return false;
+        std::vector<VkDescriptorSetLayout> normalLineSetLayouts;
+        if(normalOverlay.create(meshes, FRAMES_IN_FLIGHT, normalLinesModule, normalLinesReflection, pipelineManager.cache,
+                                descriptorLayoutCache, descriptorAllocator) &&
+           normalLineShader.reflection.createSetLayouts(descriptorLayoutCache, &normalLineSetLayouts) &&
+           normalLineShader.reflection.createPipelineLayout(normalLineSetLayouts, &normalLinePipelineLayout))
+        {
+            normalpipeline = pipelineManager.add("Normals", normalLineShader.stageCreateInfo, &normalLineShader.vertexInputStateCreateInfo,
+                                                 normalLinePipelineLayout, NO_PIPELINE, VK_PRIMITIVE_TOPOLOGY_LINE_LIST);
+        }
+        else
+        {
+            normalOverlay.destroy();
+            std::cout << "Normal overlay creation failed, overlay disabled" << std::endl;
+        }
+        //Pipeline holds what it needs
+        vkDestroyShaderModule(logicalDevice, normalLinesModule, NULL);
+        normalLinesModule = VK_NULL_HANDLE;
     }
-    else
+    if(bindlessScene.enabled)
+    {
+        bindlessPipeline = pipelineManager.add("Bindless", bindlessShader.stageCreateInfo,
+                                               &bindlessShader.vertexInputStateCreateInfo, bindlessScene.pipelineLayout);
+    }
+    if(virtualTexture.enabled)
     {
-        std::cout << "Screen pipeline created" << std::endl;
+        virtualPipeline = pipelineManager.add("Virtual", virtualShader.stageCreateInfo,
+                                              &virtualShader.vertexInputStateCreateInfo, virtualTexture.pipelineLayout);
     }
+    requestSceneVariants();
 
     return true;
 }
 
 bool loadFramebuffer()
 {
-    renderToFramebuffer.width = 640;
-    renderToFramebuffer.height = 480;
+    PROFILE_ZONE("loadFramebuffer");
+    //Allocated at full size, render scaling only shrinks the region drawn to
+    renderToFramebuffer.width = swapchainExtent.width;
+    renderToFramebuffer.height = swapchainExtent.height;
 
     VkFormat fbColourFormat = VK_FORMAT_B8G8R8A8_UNORM;
     VkFormat fbDepthFormat = VK_FORMAT_D32_SFLOAT_S8_UINT;
@@ -1758,7 +2111,8 @@ bool loadFramebuffer()
         colourImageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
         colourImageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
         // We will sample directly from the color attachment
-        colourImageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+        colourImageCreateInfo.usage = VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT |
+                                      VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
 
         result = vkCreateImage(logicalDevice, &colourImageCreateInfo, NULL, &renderToFramebuffer.colour.image);
         if(result != VK_SUCCESS)
@@ -1820,12 +2174,8 @@ bool loadFramebuffer()
 		colourSamplerCreateInfo.maxLod = 1.0f;
 		colourSamplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
 
-        result = vkCreateSampler(logicalDevice, &colourSamplerCreateInfo, NULL, &renderToFramebuffer.colourSampler);
-        if(result != VK_SUCCESS)
-        {
-            std::cout << "Colour image sampler could not be created (" << result << ")" << std::endl;
+        if(!samplerCache.get(colourSamplerCreateInfo, &renderToFramebuffer.colourSampler))
             return false;
-        }
     }
 
     //Depth attachment
@@ -1916,23 +2266,222 @@ bool loadFramebuffer()
     return true;
 }
 
-int main()
+void setObjectTransform(uint32_t index, const glm::mat4 &modelMatrix)
+{
+    if(index >= objectData.size())
+        return;
+    objectData[index].modelMatrix = modelMatrix;
+    objectData[index].normalMatrix = glm::mat4(glm::transpose(glm::inverse(glm::mat3(modelMatrix))));
+}
+
+void updateObjectTransforms(float time)
+{
+    PROFILE_ZONE("uniformUpdate");
+    glm::mat4 modelMatrix = glm::mat4();
+    modelMatrix = glm::rotate(modelMatrix, glm::radians(125.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    modelMatrix = glm::rotate(modelMatrix, glm::radians((glm::sin(time)+1)*45), glm::vec3(1.0f, 0.0f, 0.0f));
+    setObjectTransform(0, modelMatrix);
+
+    modelMatrix = glm::mat4();
+    modelMatrix = glm::translate(modelMatrix, glm::vec3(-15,0,0));
+    modelMatrix = glm::translate(modelMatrix, glm::vec3(5*glm::cos(time),0,5*glm::sin(time)));
+    modelMatrix = glm::rotate(modelMatrix, -time, glm::vec3(0.0f, 1.0f, 0.0f));
+    setObjectTransform(1, modelMatrix);
+
+    modelMatrix = glm::mat4();
+    modelMatrix = glm::translate(modelMatrix, glm::vec3(-5,0,2));
+    setObjectTransform(2, modelMatrix);
+}
+
+//Camera and transforms for a slot whose fence has been waited on, then its draws
+bool prepareFrame(uint32_t slot)
+{
+    void *mapped;
+    result = vkMapMemory(logicalDevice, cameraBuffers[slot].bufferMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Camera buffer mapping failed (" << result << ")" << std::endl;
+        return false;
+    }
+    memcpy(mapped, &cameraData, sizeof(CameraData));
+    vkUnmapMemory(logicalDevice, cameraBuffers[slot].bufferMemory);
+
+    if(bindlessScene.enabled)
+        bindlessScene.writeObjects(slot, objectData.data());
+    if(virtualTexture.enabled)
+        virtualTexture.update(slot);
+
+    return recordOffscreenCommandBuffer(slot);
+}
+
+//Offscreen pass only, frames are paced by the slot fences instead of presentation
+//The last frame is saved to outputFilename
+bool renderHeadless(uint32_t frames, std::vector<VkFence> &frameFences, std::string outputFilename)
+{
+    PROFILE_ZONE("renderHeadless");
+    std::chrono::steady_clock::time_point lastFrame = std::chrono::steady_clock::now();
+    for(uint32_t frame = 0; frame < frames; frame++)
+    {
+        PROFILE_ZONE("frame");
+        uint32_t frameSlot = frame % FRAMES_IN_FLIGHT;
+        {
+            PROFILE_ZONE("waitFence");
+            vkWaitForFences(logicalDevice, 1, &frameFences[frameSlot], VK_TRUE, std::numeric_limits<uint64_t>::max());
+            vkResetFences(logicalDevice, 1, &frameFences[frameSlot]);
+        }
+        readbackService.collect(frameSlot);
+        if(frame >= FRAMES_IN_FLIGHT)
+            gpuTimer.collect(frameSlot);
+        if(frame + 1 == frames)
+            readbackService.request(outputFilename, captureFormatFromPath(outputFilename));
+
+        //Fixed time step so every run renders the same frames
+        updateObjectTransforms(frame / 60.0f);
+        if(!prepareFrame(frameSlot))
+            return false;
+
+        {
+            PROFILE_ZONE("submit");
+            if(!submitOffscreen(frameSlot, VK_NULL_HANDLE, VK_NULL_HANDLE, frameFences[frameSlot]))
+            {
+                std::cout << "Headless frame could not be submitted" << std::endl;
+                return false;
+            }
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        frameStats.add(std::chrono::duration<float, std::milli>(now - lastFrame).count());
+        lastFrame = now;
+    }
+    vkQueueWaitIdle(presentQueue);
+    std::cout << "Headless frames rendered: " << frames << std::endl;
+    readbackService.collectAll();
+    readbackService.finish();
+    if(readbackService.failed > 0)
+        return false;
+
+    return true;
+}
+
+int main(int argc, char* argv[])
 {
+    //--trace [file] records CPU zones and writes them out on exit
+    //--stats file changes where the frame time summary goes
+    //--headless [frames] renders offscreen without a window, --output file picks the PPM or PNG it is saved to
+    //--no-hot-reload stops shaders/ being watched, --shader-compiler command replaces glslang for it
+    //--loader-dispatch keeps device functions on the loader trampolines, for comparing recording cost
+    //--device index overrides the scored device choice, --single-queue keeps uploads and compute on the graphics queue
+    //--no-texture-compression loads textures uncompressed, --bake-textures dir fills the texture cache and exits
+    //--virtual-texture image streams the image onto a ground plane through the page cache
+    //--texture-budget MB caps texture memory, mips are dropped from distant textures first
+    //--capture prefix saves every frame, --capture-format png, ppm or raw (one BGRA file for a video encoder)
+    //F12 saves a screenshot and F11 starts or stops a capture in the window
+    //--stream target sends every frame raw to - (stdout), shm:name or a FIFO, in place of --capture
+    //--stream-fps rate paces it, --stream-slots count sizes the shared memory ring
+    std::string traceFilename;
+    bool hotReload = true;
+#ifdef _WIN32
+    std::string shaderCompiler = "glslang";
+#else
+    std::string shaderCompiler = "glslangValidator";
+#endif
+    std::string statsFilename = "frame_stats.txt";
+    uint32_t headlessFrames = 100;
+    std::string outputFilename = "headless.ppm";
+    bool textureCompression = true;
+    uint64_t textureBudget = 0;
+    std::string capturePrefix;
+    CaptureFormat captureFormat = CAPTURE_PNG;
+    std::string streamTarget;
+    float streamFps = 0;
+    uint32_t streamSlots = 4;
+    for(int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if(arg == "--trace")
+        {
+            traceFilename = "trace.json";
+            if(i + 1 < argc && argv[i + 1][0] != '-')
+                traceFilename = argv[++i];
+        }
+        else if(arg == "--stats" && i + 1 < argc)
+            statsFilename = argv[++i];
+        else if(arg == "--headless")
+        {
+            headless = true;
+            if(i + 1 < argc && argv[i + 1][0] != '-')
+                headlessFrames = atoi(argv[++i]);
+        }
+        else if(arg == "--output" && i + 1 < argc)
+            outputFilename = argv[++i];
+        else if(arg == "--no-hot-reload")
+            hotReload = false;
+        else if(arg == "--loader-dispatch")
+            loaderDispatch = true;
+        else if(arg == "--shader-compiler" && i + 1 < argc)
+            shaderCompiler = argv[++i];
+        else if(arg == "--device" && i + 1 < argc)
+            forcedDevice = atoi(argv[++i]);
+        else if(arg == "--single-queue")
+            singleQueue = true;
+        else if(arg == "--no-texture-compression")
+            textureCompression = false;
+        else if(arg == "--bake-textures" && i + 1 < argc)
+        {
+            //Offline, no Vulkan needed
+            bakeTextures(argv[i + 1], textureCacheDirectory);
+            return 0;
+        }
+        else if(arg == "--virtual-texture" && i + 1 < argc)
+            virtualTextureImage = argv[++i];
+        else if(arg == "--texture-budget" && i + 1 < argc)
+            textureBudget = (uint64_t)atoi(argv[++i]) * 1024 * 1024;
+        else if(arg == "--capture" && i + 1 < argc)
+            capturePrefix = argv[++i];
+        else if(arg == "--capture-format" && i + 1 < argc)
+            captureFormat = captureFormatFromName(argv[++i]);
+        else if(arg == "--stream" && i + 1 < argc)
+            streamTarget = argv[++i];
+        else if(arg == "--stream-fps" && i + 1 < argc)
+            streamFps = atof(argv[++i]);
+        else if(arg == "--stream-slots" && i + 1 < argc)
+            streamSlots = atoi(argv[++i]);
+    }
+    //Streaming to stdout moves everything printed to stderr, so nothing is printed before this
+    if(!streamTarget.empty())
+        frameStream.configure(streamTarget, streamSlots, streamFps);
     std::cout << "First Line of Program" << std::endl;
-    if (!glfwInit())
+    profilerSetThreadName("main");
+    profilerEnable(!traceFilename.empty());
+
+    if(headless)
+    {
+        if(!loadVulkanLibrary())
+        {
+            std::cout << "Vulkan library could not be loaded" << std::endl;
+            return -1;
+        }
+    }
+    else if (!glfwInit())
         return -1;
 
     int fps = 0;
     double now = glfwGetTime();
     float delta = 0;
-    float lastFrame = glfwGetTime();
+    double lastFrame = glfwGetTime(); //Double so frame times stay precise on long runs
+    bool normalKeyHeld = false;
+    bool linesKeyHeld = false;
+    bool screenshotKeyHeld = false;
+    bool captureKeyHeld = false;
+    uint32_t screenshotCount = 0;
+    uint32_t captureCount = 0;
 
-    if (glfwVulkanSupported())
+    if (!headless && glfwVulkanSupported())
     {
         std::cout << "Vulkan Supported, continuing." << std::endl;
     }
 
-    loadFunctions();
+    loadFunctions(VK_NULL_HANDLE);
 
     #ifdef VULKAN_DEBUGGING
     if(!validationLayers())
@@ -1975,34 +2524,38 @@ int main()
     else{
         std::cout << "vkCreateInstance success" << std::endl;
     }
+    loadFunctions(vulkanInstance);
 
 #ifdef VULKAN_DEBUGGING
     if(!initDebugging())
         return false;
 #endif // VULKAN_DEBUGGING
 
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    window = glfwCreateWindow(640,480, "Vulkanisation", NULL, NULL);
-    if (!window)
-    {
-        std::cout << "Window creation failed" << std::endl;
-        return false;
-    }
-    else
+    if(!headless)
     {
-        std::cout << "Window created successfully" << std::endl;
-    }
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        window = glfwCreateWindow(640,480, "Vulkanisation", NULL, NULL);
+        if (!window)
+        {
+            std::cout << "Window creation failed" << std::endl;
+            return false;
+        }
+        else
+        {
+            std::cout << "Window created successfully" << std::endl;
+        }
 
-    //Create surfaces
-    result = glfwCreateWindowSurface(vulkanInstance, window, NULL, &vulkanSurface);
-    if(result != VK_SUCCESS)
-    {
-        std::cout << "Surface creation failed (" << result << ")" << std::endl;
-        return false;
-    }
-    else
-    {
-        std::cout << "Surface created successfully" << std::endl;
+        //Create surfaces
+        result = glfwCreateWindowSurface(vulkanInstance, window, NULL, &vulkanSurface);
+        if(result != VK_SUCCESS)
+        {
+            std::cout << "Surface creation failed (" << result << ")" << std::endl;
+            return false;
+        }
+        else
+        {
+            std::cout << "Surface created successfully" << std::endl;
+        }
     }
 
     if(!physicalDevice())
@@ -2019,15 +2572,18 @@ int main()
     std::cout << "1" << std::endl;
 
     VkPhysicalDeviceFeatures enabledFeatures = {};
-    enabledFeatures.geometryShader = VK_TRUE;
+    enabledFeatures.shaderSampledImageArrayDynamicIndexing = physicalFeatures.shaderSampledImageArrayDynamicIndexing; //Bindless texture table
+    enabledFeatures.textureCompressionBC = physicalFeatures.textureCompressionBC;
+    compressTextures = textureCompression && physicalFeatures.textureCompressionBC;
+    enabledFeatures.fragmentStoresAndAtomics = physicalFeatures.fragmentStoresAndAtomics && !virtualTextureImage.empty(); //Virtual texture feedback
     std::cout << "2" << std::endl;
 
     VkDeviceCreateInfo deviceInfo = {};
     deviceInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;       //VkStructureType
     deviceInfo.pNext = NULL;                                       //const void
     deviceInfo.flags = 0;                                          //VkDeviceCreateFlags
-    deviceInfo.queueCreateInfoCount = 1;                           //uint32_t
-    deviceInfo.pQueueCreateInfos = &queueInfo;                     //const VkDeviceQueueCreateInfo*
+    deviceInfo.queueCreateInfoCount = queueInfos.size();           //uint32_t
+    deviceInfo.pQueueCreateInfos = queueInfos.data();              //const VkDeviceQueueCreateInfo*
     deviceInfo.pEnabledFeatures = &enabledFeatures;                 //const VkPhysicalDeviceFeatures*
     deviceInfo.enabledExtensionCount = deviceExtensions.size();   //uint32_t
     deviceInfo.ppEnabledExtensionNames = deviceExtensions.data(); //const char* const* (array of char arrays/strings)
@@ -2049,53 +2605,84 @@ int main()
     {
         std::cout << "Logical device created successfully" << std::endl;
     }
+    loadDeviceFunctions(logicalDevice, loaderDispatch);
 
     vkGetDeviceQueue(logicalDevice, presentQueueId, 0, &presentQueue);
+    vkGetDeviceQueue(logicalDevice, transferQueueId, 0, &transferQueue);
+    vkGetDeviceQueue(logicalDevice, computeQueueId, 0, &computeQueue);
 
-    if(!surfaceFormats())
-        return false;
+    if(headless)
+    {
+        //Same format as the offscreen target, the render pass is shared
+        colourFormat = VK_FORMAT_B8G8R8A8_UNORM;
+        swapchainExtent.width = 640;
+        swapchainExtent.height = 480;
+    }
+    else
+    {
+        if(!surfaceFormats())
+            return false;
 
-    if(!createSwapchain())
-        return false;
+        if(!createSwapchain())
+            return false;
+    }
 
     if(!createCommandPool())
         return false;
 
-    if(!doSwapchainImages())
+    if(!uploadService.create(64 * 1024 * 1024))
         return false;
+    workerPool.start();
 
-    if(!doDepthImage())
-        return false;
+    if(!headless)
+    {
+        if(!doSwapchainImages())
+            return false;
+
+        if(!doDepthImage())
+            return false;
+    }
 
     if(!createRenderPass())
         return false;
 
-    if(!createFramebuffers())
+    if(!headless && !createFramebuffers())
         return false;
 
     if(!loadModels())
         return false;
+    textureCache.printStats();
+    textureResidency.create(&textureCache, textureBudget);
+    //Copies run on the transfer queue while shaders and pipelines are set up
+    uploadService.flush();
 
     if(!loadFramebuffer())
         return false;
+    VkExtent2D captureExtent = {(uint32_t)renderToFramebuffer.width, (uint32_t)renderToFramebuffer.height};
+    if(!readbackService.create(FRAMES_IN_FLIGHT, captureExtent))
+        return false;
+    //Offline sequences want every frame, the window would rather drop a capture than a frame
+    readbackService.blockWhenBehind = headless;
+    readbackService.stream = &frameStream;
+    if(!streamTarget.empty())
+        readbackService.startSequence(streamTarget, CAPTURE_STREAM, headless ? headlessFrames : 0);
+    else if(!capturePrefix.empty())
+        readbackService.startSequence(capturePrefix, captureFormat, headless ? headlessFrames : 0);
 
     if(!loadShaders())
         return false;
 
-    UniformData uniformData;
-    uniformData.projectionMatrix = glm::perspective(glm::radians(90.0f), (float)swapchainExtent.width/(float)swapchainExtent.height, 0.1f, 100.0f);
-    uniformData.viewMatrix = glm::lookAt(glm::vec3(0,0,-5), glm::vec3(0,0,0), glm::vec3(0,1,0));
-    uniformData.modelMatrix = glm::mat4();
-    uniformData.modelMatrix = glm::rotate(uniformData.modelMatrix, glm::radians(0.0f), glm::vec3(1.0f, 0.0f, 0.0f));
-    uniformData.modelMatrix = glm::rotate(uniformData.modelMatrix, glm::radians(0.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-    uniformData.modelMatrix = glm::rotate(uniformData.modelMatrix, glm::radians(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+    cameraData.projectionMatrix = glm::perspective(glm::radians(90.0f), (float)swapchainExtent.width/(float)swapchainExtent.height, 0.1f, 100.0f);
+    cameraData.viewMatrix = glm::lookAt(glm::vec3(0,0,-5), glm::vec3(0,0,0), glm::vec3(0,1,0));
 
-    uniformBuffers.resize(meshes.size());
-    for(int i = 0; i < meshes.size(); i++)
+    cameraBuffers.resize(FRAMES_IN_FLIGHT);
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
     {
-        createBuffer(sizeof(UniformData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &uniformData
-                        ,&uniformBuffers[i]);
+        if(!createBuffer(sizeof(CameraData), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT, &cameraData
+                        ,&cameraBuffers[i]))
+            return false;
     }
+    objectData.resize(meshes.size());
 
     //UniformData screenQuadUniformData;
     screenQuadUniformData.projectionMatrix = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f);
@@ -2106,133 +2693,249 @@ int main()
 
     if(!doDescriptors())
         return false;
+    loadVirtualTexture();
 
     if(!createPipeline())
         return false;
 
-    VkSemaphore imageAvailableSemaphore, offscreenRenderingCompleteSemaphore, renderingCompleteSemaphore;
+    std::vector<VkSemaphore> imageAvailableSemaphores(FRAMES_IN_FLIGHT);
+    std::vector<VkSemaphore> offscreenRenderingCompleteSemaphores(FRAMES_IN_FLIGHT);
+    std::vector<VkSemaphore> renderingCompleteSemaphores(FRAMES_IN_FLIGHT);
+    std::vector<VkFence> frameFences(FRAMES_IN_FLIGHT);
     VkSemaphoreCreateInfo semaphoreCreateInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, 0, 0};
-    vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, NULL, &imageAvailableSemaphore);
-    vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, NULL, &offscreenRenderingCompleteSemaphore);
-    vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, NULL, &renderingCompleteSemaphore);
+    VkFenceCreateInfo fenceCreateInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, 0, VK_FENCE_CREATE_SIGNALED_BIT};
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, NULL, &imageAvailableSemaphores[i]);
+        vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, NULL, &offscreenRenderingCompleteSemaphores[i]);
+        vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, NULL, &renderingCompleteSemaphores[i]);
+        vkCreateFence(logicalDevice, &fenceCreateInfo, NULL, &frameFences[i]);
+    }
 
-    if(!createCommandBuffers())
-        return false;
+    //Without timestamps the render scale just stays at full resolution
+    std::vector<std::string> gpuSectionNames(GPU_SECTION_COUNT);
+    gpuSectionNames[GPU_OFFSCREEN] = "offscreen";
+    gpuSectionNames[GPU_SCENE] = "scene";
+    gpuSectionNames[GPU_NORMALS] = "normals";
+    gpuSectionNames[GPU_COMPOSITE] = "composite";
+    if(gpuTimer.create(FRAMES_IN_FLIGHT, gpuSectionNames, 240))
+        gpuTimer.openReport("gpu_timings.csv");
 
-    if(!createOffscreenCommandBuffer())
+    if(!headless)
+    {
+        if(!createCompositeTimerCommandBuffers())
+            return false;
+
+        if(!createCommandBuffers())
+            return false;
+    }
+
+    if(!createOffscreenCommandBuffers())
         return false;
 
     float camPitch = 0, camYaw = 0;
     glm::vec3 camPos = glm::vec3(0,0,-5);
     glm::vec3 camForward, camRight, camUp;
+    uint64_t frameCount = 0;
+    frameStats.create(10000, 100, 1.0f);
+    //Everything loaded so far is drawn from the first frame
+    uploadService.waitAll();
 
-    while (!glfwWindowShouldClose(window) && glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS)
+    if(headless)
     {
-        delta = (glfwGetTime() - lastFrame);
-        lastFrame = glfwGetTime();
-
-        double x,y;
-        glfwGetCursorPos(window, &x, &y);
-        camYaw -= (x-640/2)/10*(3.14/180);
-        camPitch -= (y-480/2)/10*(3.14/180);
-        glfwSetCursorPos(window, 640/2, 480/2);
-        camForward = glm::vec3(cos(camPitch) * sin(camYaw),
-                                 sin(camPitch),
-                                 cos(camPitch) * cos(camYaw));
-        camRight = glm::vec3(sin(camYaw - 3.14f/2.0f),
-                    0,
-                    cos(camYaw - 3.14f/2.0f));
-        camUp = glm::cross(camRight, camForward);
-
-        if(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
-            camPos += camForward*delta*5.0f;
-        if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
-            camPos -= camForward*delta*5.0f;
-        if(glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
-            camPos -= camRight*delta*5.0f;
-        if(glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
-            camPos += camRight*delta*5.0f;
-        if(glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
-            camPos += camUp*delta*5.0f;
-        if(glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
-            camPos -= camUp*delta*5.0f;
-        uniformData.viewMatrix = glm::lookAt(camPos, camPos + camForward, camUp);
-
-        //Bind uniform buffer
-        uniformData.modelMatrix = glm::mat4();
-        uniformData.modelMatrix = glm::rotate(uniformData.modelMatrix, glm::radians(125.0f), glm::vec3(0.0f, 1.0f, 0.0f));
-        uniformData.modelMatrix = glm::rotate(uniformData.modelMatrix, glm::radians((float) (sin(glfwGetTime())+1)*45), glm::vec3(1.0f, 0.0f, 0.0f));
-            void *uniformmapped;
-            result = vkMapMemory(logicalDevice, uniformBuffers[0].bufferMemory, 0, VK_WHOLE_SIZE, 0, &uniformmapped);
-            memcpy(uniformmapped, &uniformData, sizeof(UniformData));
-            vkUnmapMemory(logicalDevice, uniformBuffers[0].bufferMemory);
-
-        uniformData.modelMatrix = glm::mat4();
-        float time = (float)glfwGetTime();
-        uniformData.modelMatrix = glm::translate(uniformData.modelMatrix, glm::vec3(-15,0,0));
-        uniformData.modelMatrix = glm::translate(uniformData.modelMatrix, glm::vec3(5*glm::cos(time),0,5*glm::sin(time)));
-        uniformData.modelMatrix = glm::rotate(uniformData.modelMatrix, -time, glm::vec3(0.0f, 1.0f, 0.0f));
-            //void *uniformmapped;
-            result = vkMapMemory(logicalDevice, uniformBuffers[1].bufferMemory, 0, VK_WHOLE_SIZE, 0, &uniformmapped);
-            memcpy(uniformmapped, &uniformData, sizeof(UniformData));
-            vkUnmapMemory(logicalDevice, uniformBuffers[1].bufferMemory);
-
-        uniformData.modelMatrix = glm::mat4();
-        uniformData.modelMatrix = glm::translate(uniformData.modelMatrix, glm::vec3(-5,0,2));
-            //void *uniformmapped;
-            result = vkMapMemory(logicalDevice, uniformBuffers[2].bufferMemory, 0, VK_WHOLE_SIZE, 0, &uniformmapped);
-            memcpy(uniformmapped, &uniformData, sizeof(UniformData));
-            vkUnmapMemory(logicalDevice, uniformBuffers[2].bufferMemory);
+        //Every frame should match between runs, so nothing is drawn with a fallback
+        pipelineManager.wait();
+        if(!renderHeadless(headlessFrames, frameFences, outputFilename))
+            return false;
+        //The consumer sees the end of the stream now rather than at shutdown
+        frameStream.close();
+        gpuTimer.writeReport(0);
+    }
+    else if(hotReload)
+        shaderHotReload.start("./shaders", shaderCompiler);
 
+    while (!headless && !glfwWindowShouldClose(window) && glfwGetKey(window, GLFW_KEY_ESCAPE) != GLFW_PRESS)
+    {
+        PROFILE_ZONE("frame");
+        uint32_t frameSlot = frameCount % FRAMES_IN_FLIGHT;
+        {
+            PROFILE_ZONE("waitFence");
+            vkWaitForFences(logicalDevice, 1, &frameFences[frameSlot], VK_TRUE, std::numeric_limits<uint64_t>::max());
+            vkResetFences(logicalDevice, 1, &frameFences[frameSlot]);
+        }
+        pipelineManager.poll();
+        uploadService.flush();
+        uploadService.poll();
+        {
+            //Composite buffers have the screen pipeline baked in
+            VkPipeline screen = pipelineManager.get(screenpipeline);
+            hotReloadShaders();
+            if(pipelineManager.swapRebuilt() && pipelineManager.get(screenpipeline) != screen)
+            {
+                vkQueueWaitIdle(presentQueue);
+                recordCommandBuffers();
+            }
+        }
+        readbackService.collect(frameSlot);
 
-        uint32_t nextImageIdx;
-        vkAcquireNextImageKHR(logicalDevice, swapchain, std::numeric_limits<uint64_t>::max(),
-                                imageAvailableSemaphore, VK_NULL_HANDLE, &nextImageIdx);
+        //Distances from where everything was last frame
+        for(uint32_t i = 0; i < meshes.size(); i++)
+        {
+            if(meshes[i].textured)
+                textureResidency.touch(meshes[i].tex, glm::distance(camPos, glm::vec3(objectData[i].modelMatrix[3])));
+        }
+        if(textureResidency.update())
+        {
+            PROFILE_ZONE("textureSwap");
+            //Replacements are rare, wait for everything in flight rather than tracking which sets it used
+            vkQueueWaitIdle(presentQueue);
+            textureResidency.swapReady();
+            writeMeshTextureDescriptors();
+            if(bindlessScene.enabled)
+                bindlessScene.writeTextures(meshes);
+        }
 
-        VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+        //Slot's last use has finished, so its timestamps are ready
+        //Every frame of a captured sequence has to be the same size, the scale is held while one runs
+        float gpuMs;
+        if(frameCount >= FRAMES_IN_FLIGHT && gpuTimer.collect(frameSlot) &&
+           gpuTimer.latest(GPU_OFFSCREEN, &gpuMs) && !readbackService.sequenceActive)
+        {
+            if(renderScale.update(gpuMs))
+            {
+                PROFILE_ZONE("rerecord");
+                //Scale changes are rare, wait for everything in flight rather than tracking each buffer
+                //Offscreen buffers pick the new extent up when they are next filled
+                vkQueueWaitIdle(presentQueue);
+                recordCommandBuffers();
+            }
+        }
 
-        VkSubmitInfo submitInfo;
-        submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-        submitInfo.waitSemaphoreCount = 1;
-        submitInfo.pWaitSemaphores = &imageAvailableSemaphore;
-        submitInfo.pWaitDstStageMask = waitStages;
-        submitInfo.commandBufferCount = 1;
-        submitInfo.pCommandBuffers = &offscreenCommandBuffer;
-        submitInfo.signalSemaphoreCount = 1;
-        submitInfo.pSignalSemaphores = &offscreenRenderingCompleteSemaphore;
-        submitInfo.pNext = NULL;
+        delta = (glfwGetTime() - lastFrame);
+        lastFrame = glfwGetTime();
+        //First delta includes startup
+        if(frameCount > 0)
+            frameStats.add(delta * 1000.0f);
 
-        result = vkQueueSubmit(presentQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        if(result != VK_SUCCESS)
         {
-            std::cout << "Draw queue could not be submitted" << std::endl;
-            return false;
+            PROFILE_ZONE("input");
+            double x,y;
+            glfwGetCursorPos(window, &x, &y);
+            camYaw -= (x-640/2)/10*(3.14/180);
+            camPitch -= (y-480/2)/10*(3.14/180);
+            glfwSetCursorPos(window, 640/2, 480/2);
+            camForward = glm::vec3(cos(camPitch) * sin(camYaw),
+                                     sin(camPitch),
+                                     cos(camPitch) * cos(camYaw));
+            camRight = glm::vec3(sin(camYaw - 3.14f/2.0f),
+                        0,
+                        cos(camYaw - 3.14f/2.0f));
+            camUp = glm::cross(camRight, camForward);
+
+            if(glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+                camPos += camForward*delta*5.0f;
+            if(glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+                camPos -= camForward*delta*5.0f;
+            if(glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+                camPos -= camRight*delta*5.0f;
+            if(glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+                camPos += camRight*delta*5.0f;
+            if(glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
+                camPos += camUp*delta*5.0f;
+            if(glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
+                camPos -= camUp*delta*5.0f;
+
+            //N toggles normal debug shading, its variant is compiled the first time
+            bool normalKey = glfwGetKey(window, GLFW_KEY_N) == GLFW_PRESS;
+            if(normalKey && !normalKeyHeld)
+            {
+                normalDebug = !normalDebug;
+                requestSceneVariants();
+            }
+            normalKeyHeld = normalKey;
+
+            //L toggles the normal line overlay
+            bool linesKey = glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS;
+            if(linesKey && !linesKeyHeld)
+                normalOverlay.setEnabled(!normalOverlay.enabled);
+            linesKeyHeld = linesKey;
+
+            //F12 saves the next frame, F11 starts or stops saving every frame
+            bool screenshotKey = glfwGetKey(window, GLFW_KEY_F12) == GLFW_PRESS;
+            if(screenshotKey && !screenshotKeyHeld)
+                readbackService.request("screenshot_" + std::to_string(screenshotCount++) + ".png", CAPTURE_PNG);
+            screenshotKeyHeld = screenshotKey;
+            bool captureKey = glfwGetKey(window, GLFW_KEY_F11) == GLFW_PRESS;
+            if(captureKey && !captureKeyHeld)
+            {
+                if(readbackService.sequenceActive)
+                    readbackService.stopSequence();
+                else
+                    readbackService.startSequence((capturePrefix.empty() ? "capture" : capturePrefix) + "_" +
+                                                  std::to_string(captureCount++), captureFormat);
+            }
+            captureKeyHeld = captureKey;
+            cameraData.viewMatrix = glm::lookAt(camPos, camPos + camForward, camUp);
         }
 
-        submitInfo.pCommandBuffers = &commandBuffers[nextImageIdx];
-        submitInfo.pWaitSemaphores = &offscreenRenderingCompleteSemaphore;
-        submitInfo.pSignalSemaphores = &renderingCompleteSemaphore;
-        result = vkQueueSubmit(presentQueue, 1, &submitInfo, VK_NULL_HANDLE);
-        if(result != VK_SUCCESS)
+        updateObjectTransforms((float)glfwGetTime());
+        if(!prepareFrame(frameSlot))
+            break;
+
+        uint32_t nextImageIdx;
         {
-            std::cout << "Draw queue could not be submitted" << std::endl;
-            return false;
+            PROFILE_ZONE("acquire");
+            vkAcquireNextImageKHR(logicalDevice, swapchain, std::numeric_limits<uint64_t>::max(),
+                                    imageAvailableSemaphores[frameSlot], VK_NULL_HANDLE, &nextImageIdx);
         }
 
-        VkPresentInfoKHR presentInfo = {};
-        presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
-        presentInfo.waitSemaphoreCount = 1;
-        presentInfo.pWaitSemaphores = &renderingCompleteSemaphore;
-        presentInfo.swapchainCount = 1;
-        presentInfo.pSwapchains = &swapchain;
-        presentInfo.pResults = NULL;
-        presentInfo.pImageIndices = &nextImageIdx;
+        {
+            PROFILE_ZONE("submit");
+            if(!submitOffscreen(frameSlot, imageAvailableSemaphores[frameSlot],
+                                offscreenRenderingCompleteSemaphores[frameSlot], VK_NULL_HANDLE))
+                return false;
+
+            VkPipelineStageFlags waitStages[] = {VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
+
+            VkSubmitInfo submitInfo;
+            submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+            submitInfo.waitSemaphoreCount = 1;
+            submitInfo.pWaitDstStageMask = waitStages;
+            submitInfo.signalSemaphoreCount = 1;
+            submitInfo.pNext = NULL;
+
+            VkCommandBuffer compositeCommandBuffers[] = {compositeTimerBeginCommandBuffers[frameSlot],
+                                                         commandBuffers[nextImageIdx],
+                                                         compositeTimerEndCommandBuffers[frameSlot]};
+            submitInfo.commandBufferCount = 3;
+            submitInfo.pCommandBuffers = compositeCommandBuffers;
+            submitInfo.pWaitSemaphores = &offscreenRenderingCompleteSemaphores[frameSlot];
+            submitInfo.pSignalSemaphores = &renderingCompleteSemaphores[frameSlot];
+            result = vkQueueSubmit(presentQueue, 1, &submitInfo, frameFences[frameSlot]);
+            if(result != VK_SUCCESS)
+            {
+                std::cout << "Draw queue could not be submitted" << std::endl;
+                return false;
+            }
+        }
 
-        result = vkQueuePresentKHR(presentQueue, &presentInfo);
-        if(result != VK_SUCCESS)
         {
-            std::cout << "Presenting failed" << std::endl;
-            return false;
+            PROFILE_ZONE("present");
+            VkPresentInfoKHR presentInfo = {};
+            presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
+            presentInfo.waitSemaphoreCount = 1;
+            presentInfo.pWaitSemaphores = &renderingCompleteSemaphores[frameSlot];
+            presentInfo.swapchainCount = 1;
+            presentInfo.pSwapchains = &swapchain;
+            presentInfo.pResults = NULL;
+            presentInfo.pImageIndices = &nextImageIdx;
+
+            result = vkQueuePresentKHR(presentQueue, &presentInfo);
+            if(result != VK_SUCCESS)
+            {
+                std::cout << "Presenting failed" << std::endl;
+                return false;
+            }
         }
         //else
         //    std::cout << "Presenting success" << std::endl;
@@ -2244,33 +2947,64 @@ int main()
         {
             std::string fpsString = "fps: ";
             fpsString += FloattoStr(fps);
+            fpsString += " scale: ";
+            fpsString += FloattoStr(renderScale.scale);
+            fpsString += frameStats.overlayText();
+            fpsString += gpuTimer.overlayText();
+            if(virtualTexture.enabled)
+                fpsString += virtualTexture.overlayText();
             glfwSetWindowTitle(window, fpsString.c_str());
+            gpuTimer.writeReport(glfwGetTime());
             //std::cout << "Frametime:" << 1000.0f/fps << " FPS:" << fps << std::endl;
             now = glfwGetTime();
             fps = 0;
         }
+        frameCount++;
     }
+    frameStats.writeSummary(statsFilename);
+    virtualTexture.printStats();
+    textureResidency.printStats();
+    if(recordedDraws > 0)
+        std::cout << "Offscreen recording: " << recordSeconds * 1000000.0 / recordedDraws << "us per draw over "
+                  << recordedDraws << " draws (" << (loaderDispatch ? "loader" : "device") << " dispatch)" << std::endl;
+    if(!traceFilename.empty())
+        profilerWriteTrace(traceFilename);
+
     //Wait for swapchains etc, to be idle before trying to delete
     //Deleting while in use causes error
+    shaderHotReload.stop();
+    workerPool.stop();
     vkDeviceWaitIdle(logicalDevice);
+    //Frames still in flight at exit are written too
+    readbackService.collectAll();
+    readbackService.destroy();
+    readbackService.printStats();
+    frameStream.close();
+    frameStream.printStats();
+    //Joins any workers still compiling before the shader modules go
+    pipelineManager.destroy();
+    sceneVariants.destroy();
+    uploadService.destroy();
 
     //Destruction
-    vkDestroySemaphore(logicalDevice, imageAvailableSemaphore, NULL);
-    vkDestroySemaphore(logicalDevice, offscreenRenderingCompleteSemaphore, NULL);
-    vkDestroySemaphore(logicalDevice, renderingCompleteSemaphore, NULL);
+    for(uint32_t i = 0; i < FRAMES_IN_FLIGHT; i++)
+    {
+        vkDestroySemaphore(logicalDevice, imageAvailableSemaphores[i], NULL);
+        vkDestroySemaphore(logicalDevice, offscreenRenderingCompleteSemaphores[i], NULL);
+        vkDestroySemaphore(logicalDevice, renderingCompleteSemaphores[i], NULL);
+        vkDestroyFence(logicalDevice, frameFences[i], NULL);
+    }
+    gpuTimer.destroy();
 
     screenMesh.deleteModel();
     for(int i = 0; i < screenShader.shaderModules.size(); i++)
     {
         vkDestroyShaderModule(logicalDevice, screenShader.shaderModules[i], NULL);
     }
-    vkDestroyPipeline(logicalDevice, screenpipeline, NULL);
     vkDestroyPipelineLayout(logicalDevice, screenpipelineLayout, NULL);
     screenQuadUniformMemory.destroy();
-    vkDestroyDescriptorSetLayout(logicalDevice, screenQuadDescriptorSetLayout, NULL);
 
     vkDestroyFramebuffer(logicalDevice, renderToFramebuffer.framebuffer, NULL);
-    vkDestroySampler(logicalDevice, renderToFramebuffer.colourSampler, NULL);
     vkDestroyImage(logicalDevice, renderToFramebuffer.colour.image, NULL);
     vkDestroyImageView(logicalDevice, renderToFramebuffer.colour.imageView, NULL);
     vkFreeMemory(logicalDevice, renderToFramebuffer.colour.memory, NULL);
@@ -2286,44 +3020,78 @@ int main()
     {
         vkDestroyFramebuffer(logicalDevice, frameBuffers[i], NULL);
     }
-    for(uint32_t i = 0; i < descriptorSetLayouts.size(); i++)
+    descriptorAllocator.destroy();
+    descriptorLayoutCache.destroy();
+    vkDestroyRenderPass(logicalDevice, renderPass, NULL);
+    bindlessScene.destroy();
+    for(uint32_t i = 0; i < bindlessShader.shaderModules.size(); i++)
     {
-        vkDestroyDescriptorSetLayout(logicalDevice, descriptorSetLayouts[i], NULL);
+        vkDestroyShaderModule(logicalDevice, bindlessShader.shaderModules[i], NULL);
+    }
+    virtualTexture.destroy();
+    virtualPlane.deleteModel();
+    for(uint32_t i = 0; i < virtualShader.shaderModules.size(); i++)
+    {
+        vkDestroyShaderModule(logicalDevice, virtualShader.shaderModules[i], NULL);
     }
-    vkDestroyDescriptorPool(logicalDevice, descriptorPool, NULL);
-    vkDestroyRenderPass(logicalDevice, renderPass, NULL);
-    vkDestroyPipeline(logicalDevice, simplepipeline, NULL);
-    vkDestroyPipeline(logicalDevice, normalpipeline, NULL);
     vkDestroyPipelineLayout(logicalDevice, pipelineLayout, NULL);
     for(int i = 0; i < shader1.shaderModules.size(); i++)
     {
         vkDestroyShaderModule(logicalDevice, shader1.shaderModules[i], NULL);
     }
-    for(int i = 0; i < shader2.shaderModules.size(); i++)
+    normalOverlay.destroy();
+    vkDestroyPipelineLayout(logicalDevice, normalLinePipelineLayout, NULL);
+    for(uint32_t i = 0; i < normalLineShader.shaderModules.size(); i++)
     {
-        vkDestroyShaderModule(logicalDevice, shader2.shaderModules[i], NULL);
+        vkDestroyShaderModule(logicalDevice, normalLineShader.shaderModules[i], NULL);
     }
     vkDestroyImage(logicalDevice, depthImage, NULL);
     vkDestroyImageView(logicalDevice, depthImageView, NULL);
-    for(int i = 0; i < uniformBuffers.size(); i++)
+    for(uint32_t i = 0; i < cameraBuffers.size(); i++)
+    {
+        cameraBuffers[i].destroy();
+    }
+    if(!headless)
     {
-        uniformBuffers[i].destroy();
+        vkFreeCommandBuffers(logicalDevice, commandPool, commandBuffers.size(), commandBuffers.data());
+        vkFreeCommandBuffers(logicalDevice, commandPool, compositeTimerBeginCommandBuffers.size(), compositeTimerBeginCommandBuffers.data());
+        vkFreeCommandBuffers(logicalDevice, commandPool, compositeTimerEndCommandBuffers.size(), compositeTimerEndCommandBuffers.data());
     }
-    vkFreeCommandBuffers(logicalDevice, commandPool, commandBuffers.size(), commandBuffers.data());
+    vkFreeCommandBuffers(logicalDevice, commandPool, offscreenCommandBuffers.size(), offscreenCommandBuffers.data());
     for(int i = 0; i < meshes.size(); i++)
     {
         meshes[i].deleteModel();
     }
+    textureResidency.destroy();
+    textureCache.destroy();
+    //After every layout and texture using them
+    samplerCache.destroy();
     vkFreeMemory(logicalDevice, depthImageMemory, NULL);
+    if(asyncCompute)
+    {
+        for(uint32_t i = 0; i < computeCompleteSemaphores.size(); i++)
+        {
+            vkDestroySemaphore(logicalDevice, computeCompleteSemaphores[i], NULL);
+        }
+        vkDestroyCommandPool(logicalDevice, computeCommandPool, NULL);
+    }
+    if(transferCommandPool != commandPool)
+        vkDestroyCommandPool(logicalDevice, transferCommandPool, NULL);
     vkDestroyCommandPool(logicalDevice, commandPool, NULL);
-    vkDestroySwapchainKHR(logicalDevice, swapchain, NULL);
-    vkDestroySurfaceKHR(vulkanInstance, vulkanSurface, NULL);
+    if(!headless)
+    {
+        vkDestroySwapchainKHR(logicalDevice, swapchain, NULL);
+        vkDestroySurfaceKHR(vulkanInstance, vulkanSurface, NULL);
+    }
     vkDestroyDevice(logicalDevice, NULL);
 #ifdef VULKAN_DEBUGGING
     destroyDebugging();
 #endif // VULKAN_DEBUGGING
     vkDestroyInstance(vulkanInstance, NULL);
-    glfwDestroyWindow(window);
-    glfwTerminate();
+    if(!headless)
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
     return 0;
 }
@@ -7,43 +7,93 @@
 
 #include "vulkanDefinitions.h"
 #include "assorted.h"
+#include "cpuProfiler.h"
+#include "uploadService.h"
+#include "textureCache.h"
+#include <cstddef> //offsetof
+
+extern UploadService uploadService;
+extern TextureCache textureCache;
+
+std::vector<VertexField> vertexFields()
+{
+    std::vector<VertexField> fields;
+    fields.push_back({"inPos", offsetof(Vertex, pos)});
+    fields.push_back({"inUV", offsetof(Vertex, uv)});
+    fields.push_back({"inNorm", offsetof(Vertex, normal)});
+    fields.push_back({"inMaterialIndex", offsetof(Vertex, materialIndex)});
+    fields.push_back({"inColour", offsetof(Vertex, colour)});
+    fields.push_back({"inUVRect", offsetof(Vertex, uvRect)});
+    fields.push_back({"inTextureLayer", offsetof(Vertex, textureLayer)});
+    return fields;
+}
 
 void Mesh::deleteModel()
 {
+    vertexUpload.wait();
+    indexUpload.wait();
     vertexBuffer.destroy();
     indexBuffer.destroy();
     if(textured)
-        tex.destroy();
+        textureCache.release(tex);
 }
 
 bool Mesh::vulkan()
 {
-    if(!createBuffer(sizeof(Vertex) * collated.size(), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, collated.data()
-                    ,&vertexBuffer))
+    PROFILE_ZONE("Mesh::vulkan");
+    //Only ever read by the GPU, so it lives in device memory and streams in
+    if(!createDeviceLocalBuffer(sizeof(uint32_t) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, &indexBuffer))
     {
         return false;
     }
-
-    if(!createBuffer(sizeof(uint32_t) * indices.size(), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, indices.data()
-                    ,&indexBuffer))
+    indexUpload = uploadService.uploadBuffer(indexBuffer.buffer, 0, indices.data(), sizeof(uint32_t) * indices.size());
+    if(indexUpload.service == NULL)
     {
         return false;
     }
 
     std::vector<std::string> texPaths;
+    std::vector<int> materialTexture(materials.size(), -1);
     for(int i = 0; i < materials.size(); i++)
     {
         if(materials[i].texturePath.find_first_not_of(' ') != std::string::npos)
         {
             std::string backslashFixed = materials[i].texturePath;
             std::replace(backslashFixed.begin(), backslashFixed.end(), '\\', '/');
+            materialTexture[i] = texPaths.size();
             texPaths.push_back(backslashFixed);
         }
     }
     if(texPaths.size() > 0)
     {
-        textured = true;
-        tex.loadTextureArray(texPaths);
+        tex = textureCache.acquire(texPaths);
+        textured = tex != NULL;
+        //Images are packed several to a layer, point each vertex at its material's
+        for(uint32_t i = 0; i < collated.size() && textured; i++)
+        {
+            int material = collated[i].materialIndex;
+            if(material >= 0 && (size_t)material < materialTexture.size() && materialTexture[material] >= 0 &&
+               (size_t)materialTexture[material] < tex->regions.size())
+            {
+                collated[i].textureLayer = tex->regions[materialTexture[material]].layer;
+                collated[i].uvRect = tex->regions[materialTexture[material]].uvRect;
+            }
+        }
+    }
+
+    //Device local like the indices
+    //Storage too, the normal overlay reads vertices from compute, possibly on the async compute queue
+    if(!createDeviceLocalBuffer(sizeof(Vertex) * collated.size(),
+                                VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                                &vertexBuffer, true))
+    {
+        return false;
+    }
+    vertexUpload = uploadService.uploadBuffer(vertexBuffer.buffer, 0, collated.data(), sizeof(Vertex) * collated.size(),
+                                              true);
+    if(vertexUpload.service == NULL)
+    {
+        return false;
     }
 
     return true;
@@ -51,6 +101,7 @@ bool Mesh::vulkan()
 
 bool Mesh::loadModel(std::string filepath)
 {
+    PROFILE_ZONE("Mesh::loadModel");
     Assimp::Importer importer;
     const aiScene* scene = importer.ReadFile(filepath.c_str(),
                                              aiProcess_CalcTangentSpace |
@@ -120,14 +171,31 @@ bool Mesh::loadModel(std::string filepath)
             glm::vec2 glmUv = glm::vec2(uv.x,uv.y);
             uvs.push_back(glmUv);
 
-            aiVector3D normal = assimpMesh->mNormals[j];
-            glm::vec3 glmNormal = glm::vec3(normal.x,normal.y,normal.z);
+            glm::vec3 glmNormal = glm::vec3(0,0,0);
+            if(assimpMesh->HasNormals())
+            {
+                aiVector3D normal = assimpMesh->mNormals[j];
+                glmNormal = glm::vec3(normal.x,normal.y,normal.z);
+            }
+            else
+                lit = false;
             normals.push_back(glmNormal);
 
+            glm::vec3 glmColour = glm::vec3(1,1,1);
+            if(assimpMesh->HasVertexColors(0))
+            {
+                aiColor4D colour = assimpMesh->mColors[0][j];
+                glmColour = glm::vec3(colour.r,colour.g,colour.b);
+                vertexColoured = true;
+            }
+
             Vertex collatedVertex;
             collatedVertex.pos = glmVert;
             collatedVertex.uv = glmUv;
             collatedVertex.normal = glmNormal;
+            collatedVertex.colour = glmColour;
+            collatedVertex.uvRect = glm::vec4(1, 1, 0, 0);
+            collatedVertex.textureLayer = 0;
             //obj material index starts at 1
             if(filepath.find("obj") != std::string::npos)
                 collatedVertex.materialIndex = assimpMesh->mMaterialIndex-1;
@@ -138,7 +206,15 @@ bool Mesh::loadModel(std::string filepath)
         indexOffset += assimpMesh->mNumVertices;
     }
 
-    return vulkan();
+    if(!vulkan())
+        return false;
+    if(textured)
+    {
+        std::cout << filepath << ": " << tex->regions.size() << " textures packed into " << tex->layerCount
+                  << " texture layers, " << tex->packedBytes / 1024 << " KiB instead of " << tex->unpackedBytes / 1024
+                  << " KiB (" << ((int64_t)tex->unpackedBytes - (int64_t)tex->packedBytes) / 1024 << " KiB saved)" << std::endl;
+    }
+    return true;
 }
 
 bool Mesh::loadWithVectors(std::vector<glm::vec3> inVertices, std::vector<glm::vec2> inUvs, std::vector<glm::vec3> inNormals, std::vector<unsigned int> inIndices)
@@ -154,6 +230,10 @@ bool Mesh::loadWithVectors(std::vector<glm::vec3> inVertices, std::vector<glm::v
         collatedVertex.pos = vertices[i];
         collatedVertex.uv = uvs[i];
         collatedVertex.normal = normals[i];
+        collatedVertex.materialIndex = 0;
+        collatedVertex.colour = glm::vec3(1,1,1);
+        collatedVertex.uvRect = glm::vec4(1, 1, 0, 0);
+        collatedVertex.textureLayer = 0;
         collated.push_back(collatedVertex);
     }
 
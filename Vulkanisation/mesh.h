@@ -9,7 +9,8 @@
 #include <string>
 
 #include "assorted.h" //MemoryBuffer
-#include "texture.h" //Texture
+#include "textureCache.h" //Texture
+#include "shaderReflection.h" //VertexField
 
 struct Vertex
 {
@@ -17,7 +18,12 @@ struct Vertex
     glm::vec2 uv;
     glm::vec3 normal;
     int materialIndex;
+    glm::vec3 colour; //White unless the model has vertex colours
+    glm::vec4 uvRect; //Material's image within its texture layer, xy scale, zw offset
+    int textureLayer;
 };
+//Shader input names for each Vertex member
+std::vector<VertexField> vertexFields();
 
 struct MaterialBuffer
 {
@@ -38,8 +44,12 @@ class Mesh
     public:
         MemoryBuffer vertexBuffer;
         MemoryBuffer indexBuffer;
-        Texture tex;
+        UploadTicket vertexUpload;
+        UploadTicket indexUpload;
+        Texture *tex = NULL; //Shared through the texture cache
         bool textured = false;
+        bool vertexColoured = false;
+        bool lit = true; //False when the model has no normals
 
         std::vector<Vertex> collated;
         std::vector<uint32_t> indices;
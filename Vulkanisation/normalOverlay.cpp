@@ -0,0 +1,179 @@
+#include "normalOverlay.h"
+
+#include <iostream>
+#include <cstring>
+#include <cstddef> //offsetof
+#include "vulkanDefinitions.h"
+
+extern VkDevice logicalDevice;
+
+const uint32_t NORMAL_LINES_GROUP_SIZE = 64; //local_size_x in normalLines.comp
+
+std::vector<VertexField> NormalOverlay::vertexFields()
+{
+    std::vector<VertexField> fields;
+    fields.push_back({"inPos", offsetof(NormalLineVertex, pos)});
+    fields.push_back({"inNorm", offsetof(NormalLineVertex, normal)});
+    return fields;
+}
+
+bool NormalOverlay::create(const std::vector<Mesh> &meshes, uint32_t frameSlots, VkShaderModule computeModule,
+                           const ShaderReflection &reflection, VkPipelineCache cache,
+                           DescriptorLayoutCache &layoutCache, DescriptorAllocator &allocator)
+{
+    if(reflection.stages != VK_SHADER_STAGE_COMPUTE_BIT || reflection.sets.size() != 2 ||
+       reflection.pushConstantRange.size != sizeof(NormalLineConstants))
+    {
+        std::cout << "Normal line shader does not match the overlay" << std::endl;
+        return false;
+    }
+
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    if(!reflection.createSetLayouts(layoutCache, &setLayouts) ||
+       !reflection.createPipelineLayout(setLayouts, &computeLayout))
+        return false;
+
+    //Vertex is read as floats
+    uint32_t vertexLayout[2] = {sizeof(Vertex) / sizeof(float), offsetof(Vertex, normal) / sizeof(float)};
+    VkSpecializationMapEntry specializationEntries[2] = {{0, 0, sizeof(uint32_t)}, {1, sizeof(uint32_t), sizeof(uint32_t)}};
+    VkSpecializationInfo specializationInfo = {2, specializationEntries, sizeof(vertexLayout), vertexLayout};
+
+    VkComputePipelineCreateInfo pipelineInfo = {};
+    pipelineInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+    pipelineInfo.stage.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+    pipelineInfo.stage.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+    pipelineInfo.stage.module = computeModule;
+    pipelineInfo.stage.pName = "main";
+    pipelineInfo.stage.pSpecializationInfo = &specializationInfo;
+    pipelineInfo.layout = computeLayout;
+    pipelineInfo.basePipelineIndex = -1;
+
+    VkResult result = vkCreateComputePipelines(logicalDevice, cache, 1, &pipelineInfo, NULL, &computePipeline);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Normal line pipeline creation failed (" << result << ")" << std::endl;
+        return false;
+    }
+
+    //Two line vertices per mesh vertex, meshes packed one after another
+    meshSets.resize(meshes.size());
+    meshVertexCounts.resize(meshes.size());
+    firstLineVertex.resize(meshes.size());
+    lineVertexCount = 0;
+    for(uint32_t i = 0; i < meshes.size(); i++)
+    {
+        if(!allocator.allocate(setLayouts[0], &meshSets[i]))
+            return false;
+        meshVertexCounts[i] = meshes[i].collated.size();
+        firstLineVertex[i] = lineVertexCount;
+        lineVertexCount += meshVertexCounts[i] * 2;
+
+        VkDescriptorBufferInfo vertexInfo = {meshes[i].vertexBuffer.buffer, 0, VK_WHOLE_SIZE};
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = meshSets[i];
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &vertexInfo;
+        vkUpdateDescriptorSets(logicalDevice, 1, &write, 0, NULL);
+    }
+    if(lineVertexCount == 0)
+        return false;
+
+    slots.resize(frameSlots);
+    for(uint32_t i = 0; i < slots.size(); i++)
+    {
+        if(!createBuffer(sizeof(NormalLineVertex) * lineVertexCount,
+                         (VkBufferUsageFlagBits)(VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT),
+                         NULL, &slots[i].lines, true))
+            return false;
+        if(!allocator.allocate(setLayouts[1], &slots[i].set))
+            return false;
+        slots[i].builtWith.resize(meshes.size());
+        slots[i].built.assign(meshes.size(), false);
+
+        VkDescriptorBufferInfo linesInfo = {slots[i].lines.buffer, 0, VK_WHOLE_SIZE};
+        VkWriteDescriptorSet write = {};
+        write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        write.dstSet = slots[i].set;
+        write.dstBinding = 0;
+        write.descriptorCount = 1;
+        write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        write.pBufferInfo = &linesInfo;
+        vkUpdateDescriptorSets(logicalDevice, 1, &write, 0, NULL);
+    }
+
+    enabled = true;
+    std::cout << "Normal overlay: " << lineVertexCount / 2 << " lines" << std::endl;
+    return true;
+}
+
+void NormalOverlay::setEnabled(bool enable)
+{
+    enabled = enable && computePipeline != VK_NULL_HANDLE;
+}
+
+bool NormalOverlay::cmdGenerate(VkCommandBuffer cmd, uint32_t slot, uint32_t mesh, const glm::mat4 &modelMatrix,
+                                const glm::mat4 &normalMatrix)
+{
+    Slot &target = slots[slot];
+    if(!enabled || mesh >= target.built.size() || meshVertexCounts[mesh] == 0)
+        return false;
+    if(target.built[mesh] && memcmp(&target.builtWith[mesh], &modelMatrix, sizeof(glm::mat4)) == 0)
+        return false;
+
+    NormalLineConstants constants;
+    constants.modelMatrix = modelMatrix;
+    for(uint32_t i = 0; i < 3; i++)
+    {
+        constants.normalMatrix[i] = normalMatrix[i];
+    }
+    constants.vertexCount = meshVertexCounts[mesh];
+    constants.firstLineVertex = firstLineVertex[mesh];
+
+    VkDescriptorSet sets[] = {meshSets[mesh], target.set};
+    vkCmdBindPipeline(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, computePipeline);
+    vkCmdBindDescriptorSets(cmd, VK_PIPELINE_BIND_POINT_COMPUTE, computeLayout, 0, 2, sets, 0, NULL);
+    vkCmdPushConstants(cmd, computeLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(NormalLineConstants), &constants);
+    vkCmdDispatch(cmd, (constants.vertexCount + NORMAL_LINES_GROUP_SIZE - 1) / NORMAL_LINES_GROUP_SIZE, 1, 1);
+
+    target.builtWith[mesh] = modelMatrix;
+    target.built[mesh] = true;
+    return true;
+}
+
+void NormalOverlay::cmdFinishGenerate(VkCommandBuffer cmd)
+{
+    VkMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_VERTEX_ATTRIBUTE_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_VERTEX_INPUT_BIT, 0,
+                         1, &barrier, 0, NULL, 0, NULL);
+}
+
+void NormalOverlay::cmdDraw(VkCommandBuffer cmd, uint32_t slot)
+{
+    if(!enabled)
+        return;
+    VkDeviceSize offset = 0;
+    vkCmdBindVertexBuffers(cmd, 0, 1, &slots[slot].lines.buffer, &offset);
+    vkCmdDraw(cmd, lineVertexCount, 1, 0, 0);
+}
+
+//Also cleans up after a partial create, the sets go with the allocator and the layouts with the cache
+void NormalOverlay::destroy()
+{
+    for(uint32_t i = 0; i < slots.size(); i++)
+    {
+        if(slots[i].lines.buffer != VK_NULL_HANDLE)
+            slots[i].lines.destroy();
+    }
+    slots.clear();
+    vkDestroyPipeline(logicalDevice, computePipeline, NULL);
+    vkDestroyPipelineLayout(logicalDevice, computeLayout, NULL);
+    computePipeline = VK_NULL_HANDLE;
+    computeLayout = VK_NULL_HANDLE;
+    enabled = false;
+}
@@ -0,0 +1,70 @@
+#ifndef NORMALOVERLAY_H_INCLUDED
+#define NORMALOVERLAY_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "mesh.h"
+#include "assorted.h" //MemoryBuffer
+#include "descriptors.h"
+#include "shaderReflection.h"
+
+//Line list vertex written by normalLines.comp
+struct NormalLineVertex
+{
+    glm::vec4 pos; //World space
+    glm::vec4 normal;
+};
+
+//Must match LineConstants in normalLines.comp, fits the 128 byte push constant minimum
+struct NormalLineConstants
+{
+    glm::mat4 modelMatrix;
+    glm::vec4 normalMatrix[3];
+    uint32_t vertexCount;
+    uint32_t firstLineVertex;
+};
+
+//Normal debug lines built by a compute pass rather than a geometry shader
+//Each frame slot has its own line buffer, a mesh's lines are only rebuilt when its transform differs from
+//the one that slot last built them with. The whole overlay is then one line list draw
+//While disabled nothing is dispatched or drawn
+struct NormalOverlay
+{
+    struct Slot
+    {
+        MemoryBuffer lines = {};
+        VkDescriptorSet set = VK_NULL_HANDLE;
+        std::vector<glm::mat4> builtWith; //Per mesh
+        std::vector<bool> built;
+    };
+
+    bool enabled = false; //Set by create
+    VkPipelineLayout computeLayout = VK_NULL_HANDLE;
+    VkPipeline computePipeline = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> meshSets; //Source vertices, set 0
+    std::vector<uint32_t> meshVertexCounts;
+    std::vector<uint32_t> firstLineVertex; //Per mesh, same in every slot
+    uint32_t lineVertexCount = 0;
+    std::vector<Slot> slots;
+
+    //Compute stage and its reflection are owned by the caller, the module can go once this returns
+    bool create(const std::vector<Mesh> &meshes, uint32_t frameSlots, VkShaderModule computeModule,
+                const ShaderReflection &reflection, VkPipelineCache cache,
+                DescriptorLayoutCache &layoutCache, DescriptorAllocator &allocator);
+    void setEnabled(bool enable);
+
+    //Outside a render pass. True when anything was dispatched, cmdFinishGenerate must then follow
+    bool cmdGenerate(VkCommandBuffer cmd, uint32_t slot, uint32_t mesh, const glm::mat4 &modelMatrix,
+                     const glm::mat4 &normalMatrix);
+    void cmdFinishGenerate(VkCommandBuffer cmd);
+    //Line pipeline and camera set are bound by the caller
+    void cmdDraw(VkCommandBuffer cmd, uint32_t slot);
+
+    static std::vector<VertexField> vertexFields();
+    void destroy();
+};
+
+#endif // NORMALOVERLAY_H_INCLUDED
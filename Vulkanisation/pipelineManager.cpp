@@ -0,0 +1,410 @@
+#include "pipelineManager.h"
+
+#include <iostream>
+#include <fstream>
+#include <iterator>
+#include "vulkanDefinitions.h"
+#include "cpuProfiler.h"
+
+extern VkDevice logicalDevice;
+
+static std::vector<char> getCacheData(VkPipelineCache cache)
+{
+    std::vector<char> data;
+    size_t size = 0;
+    if(vkGetPipelineCacheData(logicalDevice, cache, &size, NULL) != VK_SUCCESS || size == 0)
+        return data;
+    data.resize(size);
+    if(vkGetPipelineCacheData(logicalDevice, cache, &size, data.data()) != VK_SUCCESS)
+        data.clear();
+    data.resize(size);
+    return data;
+}
+
+static VkPipelineCache createCache(const std::vector<char> &initialData)
+{
+    VkPipelineCacheCreateInfo cacheCreateInfo = {};
+    cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+    cacheCreateInfo.initialDataSize = initialData.size();
+    cacheCreateInfo.pInitialData = initialData.empty() ? NULL : initialData.data();
+
+    VkPipelineCache cache = VK_NULL_HANDLE;
+    VkResult result = vkCreatePipelineCache(logicalDevice, &cacheCreateInfo, NULL, &cache);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Pipeline cache creation failed (" << result << ")" << std::endl;
+        return VK_NULL_HANDLE;
+    }
+    return cache;
+}
+
+bool PipelineManager::create(VkRenderPass pass, std::string cacheFile, uint32_t framesInFlight)
+{
+    renderPass = pass;
+    cacheFilename = cacheFile;
+    retireFrames = framesInFlight;
+    nextQueued = 0;
+    workersRunning = 0;
+
+    inputAssemblyState = {};
+    inputAssemblyState.sType = VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
+    inputAssemblyState.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+    inputAssemblyState.primitiveRestartEnable = VK_FALSE;
+
+    viewportState = {};
+    viewportState.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
+    viewportState.viewportCount = 1;
+    viewportState.pViewports = NULL;
+    viewportState.scissorCount = 1;
+    viewportState.pScissors = NULL;
+
+    rasterizationState = {};
+    rasterizationState.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
+    rasterizationState.depthClampEnable = VK_FALSE;
+    rasterizationState.rasterizerDiscardEnable = VK_FALSE;
+    rasterizationState.polygonMode = VK_POLYGON_MODE_FILL;
+    rasterizationState.cullMode = VK_CULL_MODE_BACK_BIT;
+    rasterizationState.frontFace = VK_FRONT_FACE_CLOCKWISE;
+    rasterizationState.depthBiasEnable = VK_FALSE;
+    rasterizationState.lineWidth = 1;
+
+    multisampleState = {};
+    multisampleState.sType = VK_STRUCTURE_TYPE_PIPELINE_MULTISAMPLE_STATE_CREATE_INFO;
+    multisampleState.rasterizationSamples = VK_SAMPLE_COUNT_1_BIT;
+    multisampleState.sampleShadingEnable = VK_FALSE;
+    multisampleState.pSampleMask = NULL;
+    multisampleState.alphaToCoverageEnable = VK_FALSE;
+    multisampleState.alphaToOneEnable = VK_FALSE;
+
+    VkStencilOpState noOPStencilState = {};
+    noOPStencilState.failOp = VK_STENCIL_OP_KEEP;
+    noOPStencilState.passOp = VK_STENCIL_OP_KEEP;
+    noOPStencilState.depthFailOp = VK_STENCIL_OP_KEEP;
+    noOPStencilState.compareOp = VK_COMPARE_OP_ALWAYS;
+
+    depthState = {};
+    depthState.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO;
+    depthState.depthTestEnable = VK_TRUE;
+    depthState.depthWriteEnable = VK_TRUE;
+    depthState.depthCompareOp = VK_COMPARE_OP_LESS_OR_EQUAL;
+    depthState.depthBoundsTestEnable = VK_FALSE;
+    depthState.stencilTestEnable = VK_FALSE;
+    depthState.front = noOPStencilState;
+    depthState.back = noOPStencilState;
+
+    colorBlendAttachmentState = {};
+    colorBlendAttachmentState.blendEnable = VK_FALSE;
+    colorBlendAttachmentState.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_COLOR;
+    colorBlendAttachmentState.dstColorBlendFactor = VK_BLEND_FACTOR_ONE_MINUS_DST_COLOR;
+    colorBlendAttachmentState.colorBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachmentState.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachmentState.dstAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachmentState.alphaBlendOp = VK_BLEND_OP_ADD;
+    colorBlendAttachmentState.colorWriteMask = 0xf;
+
+    colorBlendState = {};
+    colorBlendState.sType = VK_STRUCTURE_TYPE_PIPELINE_COLOR_BLEND_STATE_CREATE_INFO;
+    colorBlendState.logicOpEnable = VK_FALSE;
+    colorBlendState.logicOp = VK_LOGIC_OP_CLEAR;
+    colorBlendState.attachmentCount = 1;
+    colorBlendState.pAttachments = &colorBlendAttachmentState;
+
+    dynamicStates[0] = VK_DYNAMIC_STATE_VIEWPORT;
+    dynamicStates[1] = VK_DYNAMIC_STATE_SCISSOR;
+    dynamicState = {};
+    dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+    dynamicState.dynamicStateCount = 2;
+    dynamicState.pDynamicStates = dynamicStates;
+
+    //Last run's cache, the driver ignores it if it came from a different device or driver
+    std::vector<char> initialData;
+    std::ifstream cacheStream(cacheFilename.c_str(), std::ios::binary);
+    if(cacheStream.is_open())
+        initialData.assign(std::istreambuf_iterator<char>(cacheStream), std::istreambuf_iterator<char>());
+
+    cache = createCache(initialData);
+    if(cache == VK_NULL_HANDLE)
+        return false;
+    std::cout << "Pipeline cache loaded: " << initialData.size() << " bytes" << std::endl;
+
+    return true;
+}
+
+uint32_t PipelineManager::add(std::string name, const std::vector<VkPipelineShaderStageCreateInfo> &stages,
+                              const VkPipelineVertexInputStateCreateInfo *vertexInput, VkPipelineLayout layout,
+                              uint32_t fallback, VkPrimitiveTopology topology)
+{
+    Request *request = new Request();
+    request->name = name;
+    request->fallback = fallback;
+    request->status = PIPELINE_PENDING;
+    request->inputAssemblyState = inputAssemblyState;
+    request->inputAssemblyState.topology = topology;
+
+    VkGraphicsPipelineCreateInfo &info = request->createInfo;
+    info = {};
+    info.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
+    info.stageCount = stages.size();
+    info.pStages = stages.data();
+    info.pVertexInputState = vertexInput;
+    info.pInputAssemblyState = &request->inputAssemblyState;
+    info.pTessellationState = NULL;
+    info.pViewportState = &viewportState;
+    info.pRasterizationState = &rasterizationState;
+    info.pMultisampleState = &multisampleState;
+    info.pDepthStencilState = &depthState;
+    info.pColorBlendState = &colorBlendState;
+    info.pDynamicState = &dynamicState;
+    info.layout = layout;
+    info.renderPass = renderPass;
+    info.subpass = 0;
+    info.basePipelineHandle = VK_NULL_HANDLE;
+    info.basePipelineIndex = -1;
+
+    std::lock_guard<std::mutex> lock(requestsMutex);
+    requests.push_back(request);
+    return requests.size() - 1;
+}
+
+bool PipelineManager::compile(Request *request, VkPipelineCache targetCache)
+{
+    PROFILE_ZONE("compilePipeline");
+    VkPipeline pipeline;
+    VkResult result = vkCreateGraphicsPipelines(logicalDevice, targetCache, 1, &request->createInfo, NULL, &pipeline);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << request->name << " pipeline creation failed (" << result << ")" << std::endl;
+        request->status = PIPELINE_FAILED;
+        return false;
+    }
+    request->pipeline = pipeline;
+    request->status = PIPELINE_READY;
+    return true;
+}
+
+bool PipelineManager::compileNow(uint32_t id)
+{
+    Request *request;
+    {
+        std::lock_guard<std::mutex> lock(requestsMutex);
+        request = requests[id];
+    }
+    if(request->status != PIPELINE_PENDING)
+        return request->status == PIPELINE_READY;
+    if(!compile(request, cache))
+        return false;
+    std::cout << request->name << " pipeline created" << std::endl;
+    return true;
+}
+
+void PipelineManager::workerMain(uint32_t worker, std::vector<char> initialData)
+{
+    std::string threadName = "pipeline worker " + std::to_string(worker);
+    profilerSetThreadName(threadName.c_str());
+
+    VkPipelineCache localCache = createCache(initialData);
+    while(true)
+    {
+        uint32_t next = nextQueued++;
+        if(next >= queue.size())
+            break;
+        Request *request;
+        {
+            std::lock_guard<std::mutex> lock(requestsMutex);
+            request = requests[queue[next]];
+        }
+        compile(request, localCache);
+    }
+    workerCaches[worker] = localCache;
+    workersRunning--;
+}
+
+void PipelineManager::compileAsync(uint32_t threadCount)
+{
+    wait();
+
+    queue.clear();
+    {
+        std::lock_guard<std::mutex> lock(requestsMutex);
+        for(uint32_t i = 0; i < requests.size(); i++)
+        {
+            if(requests[i]->status == PIPELINE_PENDING)
+                queue.push_back(i);
+        }
+    }
+    if(queue.empty())
+        return;
+
+    if(threadCount == 0)
+    {
+        //Leave a core for the render loop
+        threadCount = std::thread::hardware_concurrency();
+        threadCount = threadCount > 1 ? threadCount - 1 : 1;
+    }
+    if(threadCount > queue.size())
+        threadCount = queue.size();
+
+    //Workers start from what the main cache already knows
+    std::vector<char> initialData = getCacheData(cache);
+
+    asyncStart = std::chrono::steady_clock::now();
+    nextQueued = 0;
+    workersRunning = threadCount;
+    workerCaches.assign(threadCount, VK_NULL_HANDLE);
+    for(uint32_t i = 0; i < threadCount; i++)
+    {
+        workers.push_back(std::thread(&PipelineManager::workerMain, this, i, initialData));
+    }
+    std::cout << "Compiling " << queue.size() << " pipelines on " << threadCount << " threads" << std::endl;
+}
+
+bool PipelineManager::poll()
+{
+    if(workers.empty())
+        return true;
+    if(workersRunning > 0)
+        return false;
+
+    for(uint32_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+    workers.clear();
+
+    std::vector<VkPipelineCache> merged;
+    for(uint32_t i = 0; i < workerCaches.size(); i++)
+    {
+        if(workerCaches[i] != VK_NULL_HANDLE)
+            merged.push_back(workerCaches[i]);
+    }
+    if(!merged.empty())
+    {
+        VkResult result = vkMergePipelineCaches(logicalDevice, cache, merged.size(), merged.data());
+        if(result != VK_SUCCESS)
+            std::cout << "Pipeline cache merge failed (" << result << ")" << std::endl;
+    }
+    for(uint32_t i = 0; i < merged.size(); i++)
+    {
+        vkDestroyPipelineCache(logicalDevice, merged[i], NULL);
+    }
+    workerCaches.clear();
+
+    float ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - asyncStart).count();
+    std::cout << "Background pipelines finished in " << ms << "ms, " << merged.size() << " caches merged" << std::endl;
+    return true;
+}
+
+void PipelineManager::wait()
+{
+    while(!poll())
+    {
+        std::this_thread::yield();
+    }
+}
+
+uint32_t PipelineManager::rebuild(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(requestsMutex);
+    if(id >= requests.size())
+        return NO_PIPELINE;
+
+    Request *request = new Request();
+    request->name = requests[id]->name;
+    request->createInfo = requests[id]->createInfo;
+    request->inputAssemblyState = requests[id]->inputAssemblyState;
+    request->createInfo.pInputAssemblyState = &request->inputAssemblyState;
+    request->fallback = NO_PIPELINE;
+    request->replaces = id;
+    request->status = PIPELINE_PENDING;
+    requests.push_back(request);
+    return requests.size() - 1;
+}
+
+bool PipelineManager::swapRebuilt()
+{
+    std::lock_guard<std::mutex> lock(requestsMutex);
+    for(uint32_t i = 0; i < retired.size();)
+    {
+        if(--retired[i].framesLeft == 0)
+        {
+            vkDestroyPipeline(logicalDevice, retired[i].pipeline, NULL);
+            retired.erase(retired.begin() + i);
+        }
+        else
+            i++;
+    }
+
+    bool swapped = false;
+    for(uint32_t i = 0; i < requests.size(); i++)
+    {
+        Request *rebuilt = requests[i];
+        if(rebuilt->replaces == NO_PIPELINE || rebuilt->status == PIPELINE_PENDING)
+            continue;
+
+        if(rebuilt->status == PIPELINE_READY)
+        {
+            Request *original = requests[rebuilt->replaces];
+            if(original->status == PIPELINE_READY)
+                retired.push_back({original->pipeline, retireFrames + 1});
+            original->pipeline = rebuilt->pipeline;
+            original->status = PIPELINE_READY;
+            rebuilt->pipeline = VK_NULL_HANDLE;
+            rebuilt->status = PIPELINE_SWAPPED;
+            std::cout << original->name << " pipeline reloaded" << std::endl;
+            swapped = true;
+        }
+        rebuilt->replaces = NO_PIPELINE;
+    }
+    return swapped;
+}
+
+bool PipelineManager::ready(uint32_t id)
+{
+    if(id == NO_PIPELINE)
+        return false;
+    std::lock_guard<std::mutex> lock(requestsMutex);
+    return id < requests.size() && requests[id]->status == PIPELINE_READY;
+}
+
+VkPipeline PipelineManager::get(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(requestsMutex);
+    while(id != NO_PIPELINE && id < requests.size())
+    {
+        if(requests[id]->status == PIPELINE_READY)
+            return requests[id]->pipeline;
+        id = requests[id]->fallback;
+    }
+    return VK_NULL_HANDLE;
+}
+
+void PipelineManager::destroy()
+{
+    wait();
+
+    if(cache != VK_NULL_HANDLE && !cacheFilename.empty())
+    {
+        std::vector<char> data = getCacheData(cache);
+        std::ofstream cacheStream(cacheFilename.c_str(), std::ios::binary);
+        if(cacheStream.is_open() && !data.empty())
+        {
+            cacheStream.write(data.data(), data.size());
+            std::cout << "Pipeline cache saved: " << data.size() << " bytes" << std::endl;
+        }
+    }
+
+    for(uint32_t i = 0; i < retired.size(); i++)
+    {
+        vkDestroyPipeline(logicalDevice, retired[i].pipeline, NULL);
+    }
+    retired.clear();
+    for(uint32_t i = 0; i < requests.size(); i++)
+    {
+        if(requests[i]->status == PIPELINE_READY)
+            vkDestroyPipeline(logicalDevice, requests[i]->pipeline, NULL);
+        delete requests[i];
+    }
+    requests.clear();
+    vkDestroyPipelineCache(logicalDevice, cache, NULL);
+    cache = VK_NULL_HANDLE;
+}
@@ -0,0 +1,101 @@
+#ifndef PIPELINEMANAGER_H_INCLUDED
+#define PIPELINEMANAGER_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+
+const uint32_t NO_PIPELINE = 0xFFFFFFFF;
+
+//Graphics pipelines for the offscreen pass, compiled either straight away or on worker threads
+//Each worker fills its own VkPipelineCache, they are merged into the main cache once every worker is done
+//Stages, vertex input and layout passed to add() must stay alive until the pipeline is ready
+struct PipelineManager
+{
+    enum Status
+    {
+        PIPELINE_PENDING,
+        PIPELINE_READY,
+        PIPELINE_FAILED,
+        PIPELINE_SWAPPED //Rebuild whose pipeline was moved into the request it replaces
+    };
+
+    struct Request
+    {
+        std::string name;
+        VkGraphicsPipelineCreateInfo createInfo;
+        VkPipelineInputAssemblyStateCreateInfo inputAssemblyState;
+        uint32_t fallback; //Must share the layout, used until this one is ready
+        uint32_t replaces = NO_PIPELINE; //Set for rebuilds
+        VkPipeline pipeline = VK_NULL_HANDLE;
+        std::atomic<int> status; //pipeline is only read once this is READY
+    };
+
+    //Fixed function state every pipeline shares apart from topology, viewport and scissor are dynamic
+    VkPipelineInputAssemblyStateCreateInfo inputAssemblyState;
+    VkPipelineViewportStateCreateInfo viewportState;
+    VkPipelineRasterizationStateCreateInfo rasterizationState;
+    VkPipelineMultisampleStateCreateInfo multisampleState;
+    VkPipelineDepthStencilStateCreateInfo depthState;
+    VkPipelineColorBlendAttachmentState colorBlendAttachmentState;
+    VkPipelineColorBlendStateCreateInfo colorBlendState;
+    VkDynamicState dynamicStates[2];
+    VkPipelineDynamicStateCreateInfo dynamicState;
+    VkRenderPass renderPass = VK_NULL_HANDLE;
+
+    VkPipelineCache cache = VK_NULL_HANDLE; //Main thread only
+    std::string cacheFilename;
+
+    std::mutex requestsMutex;
+    std::vector<Request*> requests;
+
+    std::vector<std::thread> workers;
+    std::vector<VkPipelineCache> workerCaches;
+    std::vector<uint32_t> queue; //Fixed while workers run
+    std::atomic<uint32_t> nextQueued;
+    std::atomic<uint32_t> workersRunning;
+    std::chrono::steady_clock::time_point asyncStart;
+
+    //Pipelines replaced by a rebuild, destroyed once no frame in flight can still use them
+    struct Retired
+    {
+        VkPipeline pipeline;
+        uint32_t framesLeft;
+    };
+    std::vector<Retired> retired;
+    uint32_t retireFrames = 1;
+
+    bool create(VkRenderPass pass, std::string cacheFile, uint32_t framesInFlight);
+    uint32_t add(std::string name, const std::vector<VkPipelineShaderStageCreateInfo> &stages,
+                 const VkPipelineVertexInputStateCreateInfo *vertexInput, VkPipelineLayout layout,
+                 uint32_t fallback = NO_PIPELINE, VkPrimitiveTopology topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST);
+
+    //Blocks, for the minimal set the first frame needs
+    bool compileNow(uint32_t id);
+    //Everything still pending, 0 threads picks from the hardware
+    void compileAsync(uint32_t threadCount);
+    //Merges the worker caches once they have all finished, true when nothing is left compiling
+    bool poll();
+    void wait();
+
+    //Queues a fresh compile of id from its create info, so stages it points at can be changed first
+    //Only while nothing is compiling. The id keeps working, swapRebuilt() moves the new pipeline in
+    uint32_t rebuild(uint32_t id);
+    //Once per frame, before recording. True when any pipeline was swapped
+    bool swapRebuilt();
+
+    bool ready(uint32_t id);
+    //Falls back along the chain until something is ready, VK_NULL_HANDLE if nothing is
+    VkPipeline get(uint32_t id);
+    void destroy();
+
+    bool compile(Request *request, VkPipelineCache targetCache);
+    void workerMain(uint32_t worker, std::vector<char> initialData);
+};
+
+#endif // PIPELINEMANAGER_H_INCLUDED
@@ -0,0 +1,312 @@
+#include "readback.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstring>
+#include <algorithm> //min
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <SOIL2/stb_image_write.h>
+
+#include "vulkanDefinitions.h"
+#include "cpuProfiler.h"
+
+extern VkDevice logicalDevice;
+
+CaptureFormat captureFormatFromPath(std::string path)
+{
+    std::string::size_type dot = path.find_last_of('.');
+    return captureFormatFromName(dot == std::string::npos ? "" : path.substr(dot + 1));
+}
+
+CaptureFormat captureFormatFromName(std::string name)
+{
+    if(name == "png")
+        return CAPTURE_PNG;
+    if(name == "raw" || name == "bgra")
+        return CAPTURE_RAW;
+    return CAPTURE_PPM;
+}
+
+bool ReadbackService::create(uint32_t frameSlots, VkExtent2D extent)
+{
+    maxExtent = extent;
+    VkDeviceSize size = (VkDeviceSize)maxExtent.width * maxExtent.height * 4;
+    slots.resize(frameSlots);
+    for(uint32_t i = 0; i < frameSlots; i++)
+    {
+        if(!createBuffer(size, VK_BUFFER_USAGE_TRANSFER_DST_BIT, NULL, &slots[i].buffer))
+            return false;
+        void *mapped;
+        VkResult result = vkMapMemory(logicalDevice, slots[i].buffer.bufferMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+        if(result != VK_SUCCESS)
+        {
+            std::cout << "Readback buffer could not be mapped (" << result << ")" << std::endl;
+            return false;
+        }
+        slots[i].mapped = (unsigned char*)mapped;
+    }
+
+    encoderStopping = false;
+    encoder = std::thread(&ReadbackService::encoderMain, this);
+    return true;
+}
+
+void ReadbackService::request(std::string path, CaptureFormat format)
+{
+    Request wanted;
+    wanted.path = path;
+    wanted.format = format;
+    wanted.sequence = false;
+    requests.push_back(wanted);
+}
+
+void ReadbackService::startSequence(std::string prefix, CaptureFormat format, uint32_t count)
+{
+    sequencePrefix = prefix;
+    sequenceFormat = format;
+    sequenceActive = true;
+    sequenceRemaining = count;
+    sequenceIndex = 0;
+    if(format != CAPTURE_STREAM)
+        std::cout << "Capturing to " << prefix << (format == CAPTURE_RAW ? ".bgra" : "_*") << std::endl;
+}
+
+void ReadbackService::stopSequence()
+{
+    if(sequenceActive)
+        std::cout << "Capture stopped after " << sequenceIndex << " frames" << std::endl;
+    sequenceActive = false;
+}
+
+void ReadbackService::cmdCapture(VkCommandBuffer cmd, uint32_t slot, VkImage image, VkImageLayout layout, VkExtent2D extent)
+{
+    Slot &target = slots[slot];
+    if(target.pending || (requests.empty() && !sequenceActive))
+        return;
+    target.requests.assign(requests.begin(), requests.end());
+    requests.clear();
+    if(sequenceActive)
+    {
+        Request next;
+        next.format = sequenceFormat;
+        next.sequence = true;
+        if(sequenceFormat == CAPTURE_STREAM)
+            next.path = sequencePrefix;
+        else if(sequenceFormat == CAPTURE_RAW)
+            next.path = sequencePrefix + ".bgra";
+        else
+        {
+            std::stringstream name;
+            name << sequencePrefix << "_" << std::setw(6) << std::setfill('0') << sequenceIndex
+                 << (sequenceFormat == CAPTURE_PNG ? ".png" : ".ppm");
+            next.path = name.str();
+        }
+        target.requests.push_back(next);
+        sequenceIndex++;
+        if(sequenceRemaining > 0 && --sequenceRemaining == 0)
+            stopSequence();
+    }
+    target.extent = {std::min(extent.width, maxExtent.width), std::min(extent.height, maxExtent.height)};
+    target.pending = true;
+
+    VkImageMemoryBarrier imageBarrier = {};
+    imageBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    imageBarrier.srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+    imageBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imageBarrier.oldLayout = layout;
+    imageBarrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    imageBarrier.image = image;
+    imageBarrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         0, 0, NULL, 0, NULL, 1, &imageBarrier);
+
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = {target.extent.width, target.extent.height, 1};
+    vkCmdCopyImageToBuffer(cmd, image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, target.buffer.buffer, 1, &region);
+
+    //Back how the next user expects it
+    imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    imageBarrier.dstAccessMask = 0;
+    imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    imageBarrier.newLayout = layout;
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                         0, 1, &memoryBarrier, 0, NULL, layout == VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL ? 0 : 1, &imageBarrier);
+}
+
+void ReadbackService::collect(uint32_t slot)
+{
+    Slot &source = slots[slot];
+    if(!source.pending)
+        return;
+    PROFILE_ZONE("ReadbackService::collect");
+    source.pending = false;
+    captured++;
+
+    std::unique_lock<std::mutex> lock(encoderMutex);
+    if(jobs.size() >= maxQueued)
+    {
+        if(!blockWhenBehind)
+        {
+            dropped++;
+            source.requests.clear();
+            return;
+        }
+        encoderDone.wait(lock, [this]{ return jobs.size() < maxQueued; });
+    }
+    lock.unlock();
+
+    //Memory is only guaranteed host visible, not coherent
+    VkMappedMemoryRange range = {VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, NULL, source.buffer.bufferMemory, 0, VK_WHOLE_SIZE};
+    vkInvalidateMappedMemoryRanges(logicalDevice, 1, &range);
+    //Copied out so the slot can be used again straight away
+    Job job;
+    job.extent = source.extent;
+    job.requests.swap(source.requests);
+    job.pixels.assign(source.mapped, source.mapped + (size_t)source.extent.width * source.extent.height * 4);
+
+    lock.lock();
+    jobs.push_back(std::move(job));
+    lock.unlock();
+    encoderWake.notify_one();
+}
+
+void ReadbackService::collectAll()
+{
+    for(uint32_t i = 0; i < slots.size(); i++)
+    {
+        collect(i);
+    }
+}
+
+void ReadbackService::finish()
+{
+    std::unique_lock<std::mutex> lock(encoderMutex);
+    encoderDone.wait(lock, [this]{ return jobs.empty() && !encoding; });
+}
+
+void ReadbackService::printStats() const
+{
+    if(captured == 0)
+        return;
+    std::cout << "Readback: " << captured << " captured, " << written << " written, "
+              << dropped << " dropped, " << failed << " failed" << std::endl;
+}
+
+void ReadbackService::destroy()
+{
+    if(encoder.joinable())
+    {
+        finish();
+        {
+            std::lock_guard<std::mutex> lock(encoderMutex);
+            encoderStopping = true;
+        }
+        encoderWake.notify_all();
+        encoder.join();
+    }
+    rawFile.close();
+    for(uint32_t i = 0; i < slots.size(); i++)
+    {
+        if(slots[i].mapped != NULL)
+            vkUnmapMemory(logicalDevice, slots[i].buffer.bufferMemory);
+        slots[i].buffer.destroy();
+    }
+    slots.clear();
+    requests.clear();
+    sequenceActive = false;
+}
+
+//Encoder thread
+bool ReadbackService::encode(const Job &job, const Request &request)
+{
+    PROFILE_ZONE("ReadbackService::encode");
+    uint32_t width = job.extent.width;
+    uint32_t height = job.extent.height;
+    if(request.format == CAPTURE_STREAM)
+        return stream != NULL && stream->write(job.pixels.data(), job.extent);
+    if(request.format == CAPTURE_RAW && request.sequence)
+    {
+        //Kept open until a sequence to another path starts
+        if(!rawFile.is_open() || rawPath != request.path)
+        {
+            rawFile.close();
+            rawFile.open(request.path.c_str(), std::ios::binary | std::ios::trunc);
+            rawPath = request.path;
+        }
+        rawFile.write((const char*)job.pixels.data(), job.pixels.size());
+        return rawFile.good();
+    }
+    if(request.format == CAPTURE_RAW)
+    {
+        std::ofstream file(request.path.c_str(), std::ios::binary);
+        file.write((const char*)job.pixels.data(), job.pixels.size());
+        return file.good();
+    }
+
+    //Offscreen target is BGRA, both formats want RGB
+    std::vector<unsigned char> rgb((size_t)width * height * 3);
+    for(size_t i = 0; i < (size_t)width * height; i++)
+    {
+        rgb[i * 3 + 0] = job.pixels[i * 4 + 2];
+        rgb[i * 3 + 1] = job.pixels[i * 4 + 1];
+        rgb[i * 3 + 2] = job.pixels[i * 4 + 0];
+    }
+    if(request.format == CAPTURE_PNG)
+        return stbi_write_png(request.path.c_str(), width, height, 3, rgb.data(), width * 3) != 0;
+
+    std::ofstream file(request.path.c_str(), std::ios::binary);
+    if(!file.is_open())
+        return false;
+    file << "P6\n" << width << " " << height << "\n255\n";
+    file.write((const char*)rgb.data(), rgb.size());
+    return file.good();
+}
+
+void ReadbackService::encoderMain()
+{
+    profilerSetThreadName("readback");
+    while(true)
+    {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(encoderMutex);
+            encoderWake.wait(lock, [this]{ return encoderStopping || !jobs.empty(); });
+            if(jobs.empty())
+                return;
+            job = std::move(jobs.front());
+            jobs.pop_front();
+            encoding = true;
+        }
+
+        uint32_t succeeded = 0;
+        for(uint32_t i = 0; i < job.requests.size(); i++)
+        {
+            const Request &request = job.requests[i];
+            if(!encode(job, request))
+                std::cout << "Capture could not be written: " << request.path << std::endl;
+            else
+            {
+                succeeded++;
+                if(!request.sequence)
+                    std::cout << "Frame written: " << request.path << std::endl;
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(encoderMutex);
+            encoding = false;
+            written += succeeded;
+            failed += job.requests.size() - succeeded;
+        }
+        encoderDone.notify_all();
+    }
+}
@@ -0,0 +1,107 @@
+#ifndef READBACK_H_INCLUDED
+#define READBACK_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "assorted.h" //MemoryBuffer
+#include "frameStream.h"
+
+enum CaptureFormat
+{
+    CAPTURE_PNG,
+    CAPTURE_PPM,
+    CAPTURE_RAW, //BGRA8 rows, every frame of a sequence appended to one file
+    CAPTURE_STREAM //Handed to the frame stream, the path is unused
+};
+
+//.png and .ppm by name, .raw or .bgra as raw frames
+CaptureFormat captureFormatFromPath(std::string path);
+CaptureFormat captureFormatFromName(std::string name);
+
+//Copies of a render target without waiting on the GPU
+//The copy is recorded into a frame slot's command buffer after its pass and read once that slot's fence has been
+//waited on, the frames in flight later. Pixels are taken out of the slot's buffer straight away and encoded on
+//a thread of their own, so neither the copy nor the file system holds the frame up
+struct ReadbackService
+{
+    struct Request
+    {
+        std::string path;
+        CaptureFormat format;
+        bool sequence; //Quiet, one of many
+    };
+    struct Slot
+    {
+        MemoryBuffer buffer = {};
+        unsigned char *mapped = NULL;
+        bool pending = false;
+        VkExtent2D extent = {0, 0};
+        std::vector<Request> requests; //Everything wanting the frame, it is only copied once
+    };
+    struct Job
+    {
+        std::vector<unsigned char> pixels;
+        VkExtent2D extent;
+        std::vector<Request> requests;
+    };
+
+    std::vector<Slot> slots; //One per frame slot
+    VkExtent2D maxExtent = {0, 0};
+    std::deque<Request> requests; //Waiting for a frame to be recorded
+
+    //Every frame recorded while remaining is above 0, unlimited when started with a count of 0
+    std::string sequencePrefix;
+    CaptureFormat sequenceFormat = CAPTURE_PNG;
+    bool sequenceActive = false;
+    uint32_t sequenceRemaining = 0;
+    uint32_t sequenceIndex = 0;
+
+    //Encoder thread
+    std::thread encoder;
+    std::mutex encoderMutex;
+    std::condition_variable encoderWake;
+    std::condition_variable encoderDone;
+    std::deque<Job> jobs;
+    bool encoding = false;
+    bool encoderStopping = false;
+    uint32_t maxQueued = 8;
+    bool blockWhenBehind = false; //Waits for the encoder instead of dropping, for sequences that need every frame
+    std::ofstream rawFile; //Encoder only
+    std::string rawPath;
+    FrameStream *stream = NULL; //Where CAPTURE_STREAM frames go
+
+    uint64_t captured = 0;
+    uint64_t written = 0;
+    uint64_t dropped = 0;
+    uint64_t failed = 0;
+
+    bool create(uint32_t frameSlots, VkExtent2D maxExtent);
+    //The next frame recorded is saved to path
+    void request(std::string path, CaptureFormat format);
+    //prefix_000000.png and on for png and ppm, prefix.bgra for raw, the frame stream for stream
+    void startSequence(std::string prefix, CaptureFormat format, uint32_t count = 0);
+    void stopSequence();
+    //After the slot's pass, image is left in layout. Does nothing unless a capture is wanted
+    void cmdCapture(VkCommandBuffer cmd, uint32_t slot, VkImage image, VkImageLayout layout, VkExtent2D extent);
+    //Once the slot's fence has been waited on, before it is recorded again
+    void collect(uint32_t slot);
+    //Once the device is idle
+    void collectAll();
+    //Blocks until everything collected has been encoded
+    void finish();
+    void printStats() const;
+    void destroy();
+
+    bool encode(const Job &job, const Request &request);
+    void encoderMain();
+};
+
+#endif // READBACK_H_INCLUDED
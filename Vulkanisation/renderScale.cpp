@@ -0,0 +1,41 @@
+#include "renderScale.h"
+
+#include <algorithm> //min, max
+
+//Returns true when the scale changed and the offscreen pass needs re-recording
+bool RenderScale::update(float gpuMs)
+{
+    if(smoothedMs == 0)
+        smoothedMs = gpuMs;
+    smoothedMs = smoothedMs*0.9f + gpuMs*0.1f;
+
+    //Give the new resolution time to show up in the average before moving again
+    if(settleFrames > 0)
+    {
+        settleFrames--;
+        return false;
+    }
+
+    float newScale = scale;
+    if(smoothedMs > targetMs)
+        newScale = std::max(minScale, scale - step);
+    else if(smoothedMs < targetMs*0.75f)
+        newScale = std::min(maxScale, scale + step);
+
+    if(newScale == scale)
+        return false;
+
+    //Cost is roughly proportional to pixel count, predict the average at the new scale
+    smoothedMs *= (newScale*newScale)/(scale*scale);
+    scale = newScale;
+    settleFrames = 30;
+    return true;
+}
+
+VkExtent2D RenderScale::scaledExtent(VkExtent2D fullExtent)
+{
+    VkExtent2D extent;
+    extent.width = std::max(1u, (uint32_t)(fullExtent.width * scale));
+    extent.height = std::max(1u, (uint32_t)(fullExtent.height * scale));
+    return extent;
+}
@@ -0,0 +1,24 @@
+#ifndef RENDERSCALE_H_INCLUDED
+#define RENDERSCALE_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+
+//Picks the offscreen render resolution from measured GPU frame time
+//Scale is per axis, the offscreen target stays allocated at full size
+struct RenderScale
+{
+    float targetMs = 1000.0f/60.0f;
+    float scale = 1.0f;
+    float minScale = 0.5f;
+    float maxScale = 1.0f;
+    float step = 0.05f;
+
+    float smoothedMs = 0;
+    int settleFrames = 0;
+
+    bool update(float gpuMs);
+    VkExtent2D scaledExtent(VkExtent2D fullExtent);
+};
+
+#endif // RENDERSCALE_H_INCLUDED
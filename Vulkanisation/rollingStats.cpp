@@ -0,0 +1,74 @@
+#include "rollingStats.h"
+
+#include <algorithm> //sort, min_element, max_element
+#include <cmath> //ceil
+
+void RollingStats::resize(uint32_t capacity)
+{
+    samples.assign(capacity, 0);
+    next = 0;
+    count = 0;
+}
+
+void RollingStats::add(float sample)
+{
+    if(samples.empty())
+        return;
+    samples[next] = sample;
+    next = (next + 1) % samples.size();
+    if(count < samples.size())
+        count++;
+}
+
+void RollingStats::clear()
+{
+    next = 0;
+    count = 0;
+}
+
+float RollingStats::min() const
+{
+    if(count == 0)
+        return 0;
+    return *std::min_element(samples.begin(), samples.begin() + count);
+}
+
+float RollingStats::max() const
+{
+    if(count == 0)
+        return 0;
+    return *std::max_element(samples.begin(), samples.begin() + count);
+}
+
+float RollingStats::mean() const
+{
+    if(count == 0)
+        return 0;
+    double total = 0;
+    for(uint32_t i = 0; i < count; i++)
+    {
+        total += samples[i];
+    }
+    return (float)(total / count);
+}
+
+float RollingStats::percentile(float p) const
+{
+    if(count == 0)
+        return 0;
+    std::vector<float> ordered = sorted();
+    uint32_t rank = (uint32_t)std::ceil(p / 100.0f * count);
+    if(rank < 1)
+        rank = 1;
+    if(rank > count)
+        rank = count;
+    return ordered[rank - 1];
+}
+
+//Order doesn't matter once the ring is full, so the first count entries are always the live ones
+std::vector<float> RollingStats::sorted() const
+{
+    std::vector<float> ordered(samples.begin(), samples.begin() + count);
+    std::sort(ordered.begin(), ordered.end());
+    return ordered;
+}
@@ -0,0 +1,26 @@
+#ifndef ROLLINGSTATS_H_INCLUDED
+#define ROLLINGSTATS_H_INCLUDED
+
+#include <vector>
+#include <cstdint>
+
+//Fixed size ring of the most recent samples
+struct RollingStats
+{
+    std::vector<float> samples;
+    uint32_t next = 0;
+    uint32_t count = 0;
+
+    void resize(uint32_t capacity);
+    void add(float sample);
+    void clear();
+
+    float min() const;
+    float max() const;
+    float mean() const;
+    //p in 0-100, nearest rank
+    float percentile(float p) const;
+    std::vector<float> sorted() const;
+};
+
+#endif // ROLLINGSTATS_H_INCLUDED
@@ -0,0 +1,88 @@
+#include "samplerCache.h"
+
+#include <iostream>
+#include "vulkanDefinitions.h"
+
+extern VkDevice logicalDevice;
+
+bool SamplerCache::InfoLess::operator()(const VkSamplerCreateInfo &a, const VkSamplerCreateInfo &b) const
+{
+    if(a.flags != b.flags)
+        return a.flags < b.flags;
+    if(a.magFilter != b.magFilter)
+        return a.magFilter < b.magFilter;
+    if(a.minFilter != b.minFilter)
+        return a.minFilter < b.minFilter;
+    if(a.mipmapMode != b.mipmapMode)
+        return a.mipmapMode < b.mipmapMode;
+    if(a.addressModeU != b.addressModeU)
+        return a.addressModeU < b.addressModeU;
+    if(a.addressModeV != b.addressModeV)
+        return a.addressModeV < b.addressModeV;
+    if(a.addressModeW != b.addressModeW)
+        return a.addressModeW < b.addressModeW;
+    if(a.mipLodBias != b.mipLodBias)
+        return a.mipLodBias < b.mipLodBias;
+    if(a.anisotropyEnable != b.anisotropyEnable)
+        return a.anisotropyEnable < b.anisotropyEnable;
+    //Only means something with anisotropy on
+    if(a.anisotropyEnable && a.maxAnisotropy != b.maxAnisotropy)
+        return a.maxAnisotropy < b.maxAnisotropy;
+    if(a.compareEnable != b.compareEnable)
+        return a.compareEnable < b.compareEnable;
+    if(a.compareEnable && a.compareOp != b.compareOp)
+        return a.compareOp < b.compareOp;
+    if(a.minLod != b.minLod)
+        return a.minLod < b.minLod;
+    if(a.maxLod != b.maxLod)
+        return a.maxLod < b.maxLod;
+    if(a.borderColor != b.borderColor)
+        return a.borderColor < b.borderColor;
+    return a.unnormalizedCoordinates < b.unnormalizedCoordinates;
+}
+
+bool SamplerCache::get(const VkSamplerCreateInfo &createInfo, VkSampler *sampler)
+{
+    std::map<VkSamplerCreateInfo, VkSampler, InfoLess>::iterator found = samplers.find(createInfo);
+    if(found != samplers.end())
+    {
+        hits++;
+        *sampler = found->second;
+        return true;
+    }
+
+    VkSamplerCreateInfo key = createInfo;
+    key.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    key.pNext = NULL;
+    VkResult result = vkCreateSampler(logicalDevice, &key, NULL, sampler);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Sampler creation failed (" << result << ")" << std::endl;
+        return false;
+    }
+    samplers[key] = *sampler;
+
+    return true;
+}
+
+const VkSampler *SamplerCache::immutable(const VkSamplerCreateInfo &createInfo, uint32_t count)
+{
+    VkSampler sampler;
+    if(!get(createInfo, &sampler))
+        return NULL;
+    std::vector<VkSampler> &array = immutableArrays[std::make_pair(sampler, count)];
+    if(array.empty())
+        array.assign(count, sampler);
+    return array.data();
+}
+
+void SamplerCache::destroy()
+{
+    std::map<VkSamplerCreateInfo, VkSampler, InfoLess>::iterator it;
+    for(it = samplers.begin(); it != samplers.end(); it++)
+    {
+        vkDestroySampler(logicalDevice, it->second, NULL);
+    }
+    samplers.clear();
+    immutableArrays.clear();
+}
@@ -0,0 +1,28 @@
+#ifndef SAMPLERCACHE_H_INCLUDED
+#define SAMPLERCACHE_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <map>
+
+//Samplers keyed by their create info, everything asking for the same settings shares one handle
+//Handles belong to the cache, callers never destroy them. pNext chains are not supported
+struct SamplerCache
+{
+    struct InfoLess
+    {
+        bool operator()(const VkSamplerCreateInfo &a, const VkSamplerCreateInfo &b) const;
+    };
+    std::map<VkSamplerCreateInfo, VkSampler, InfoLess> samplers;
+    //Arrays of one sampler repeated, for pImmutableSamplers. Never changed once made, so pointers stay valid
+    std::map<std::pair<VkSampler, uint32_t>, std::vector<VkSampler> > immutableArrays;
+    uint32_t hits = 0;
+
+    bool get(const VkSamplerCreateInfo &createInfo, VkSampler *sampler);
+    //count copies of the sampler for a layout binding, NULL if it could not be created
+    const VkSampler *immutable(const VkSamplerCreateInfo &createInfo, uint32_t count);
+    void destroy();
+};
+
+#endif // SAMPLERCACHE_H_INCLUDED
@@ -0,0 +1,244 @@
+#include "shaderHotReload.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <set>
+#include <algorithm> //max
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+#ifdef _WIN32
+#include <direct.h>
+#endif
+
+#include "cpuProfiler.h"
+
+static bool isShaderSource(const std::string &name)
+{
+    size_t dot = name.rfind('.');
+    if(dot == std::string::npos)
+        return false;
+    std::string extension = name.substr(dot);
+    return extension == ".vert" || extension == ".frag" || extension == ".geom" || extension == ".comp";
+}
+
+static bool readFile(std::string path, std::string *contents)
+{
+    std::ifstream stream(path.c_str(), std::ios::binary);
+    if(!stream.is_open())
+        return false;
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    *contents = buffer.str();
+    return true;
+}
+
+//FNV-1a
+static uint64_t hashBytes(const std::string &data, uint64_t hash = 14695981039346656037ULL)
+{
+    for(size_t i = 0; i < data.size(); i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static int64_t modifiedTime(std::string path)
+{
+    struct stat info;
+    if(stat(path.c_str(), &info) != 0)
+        return -1;
+    return info.st_mtime;
+}
+
+//Hashes the file and, depth first, every #include "file" in it, relative to the including file
+//A missing include adds nothing, the compiler reports it
+static void hashSource(std::string path, ShaderHotReload::Source *source, std::set<std::string> &seen)
+{
+    if(!seen.insert(path).second)
+        return;
+    //Everything after the source itself is an include, watched even while it is missing
+    if(seen.size() > 1)
+        source->includes.push_back(path);
+    std::string code;
+    if(!readFile(path, &code))
+        return;
+    source->hash = hashBytes(code, source->hash);
+    source->modified = std::max(source->modified, modifiedTime(path));
+
+    std::string base = path.substr(0, path.rfind('/') + 1);
+    std::stringstream lines(code);
+    std::string line;
+    while(std::getline(lines, line))
+    {
+        size_t start = line.find_first_not_of(" \t");
+        if(start == std::string::npos || line.compare(start, 8, "#include") != 0)
+            continue;
+        size_t open = line.find('"', start + 8);
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if(close != std::string::npos)
+            hashSource(base + line.substr(open + 1, close - open - 1), source, seen);
+    }
+}
+
+bool ShaderHotReload::start(std::string shaderDirectory, std::string compilerCommand)
+{
+    directory = shaderDirectory;
+    cacheDirectory = shaderDirectory + "/cache";
+    compiler = compilerCommand;
+#ifdef _WIN32
+    _mkdir(cacheDirectory.c_str());
+#else
+    mkdir(cacheDirectory.c_str(), 0755);
+#endif
+
+    //What is on disk now was built offline, only later edits are compiled
+    scan(false, true);
+
+#ifdef __linux__
+    notifyFd = inotify_init1(IN_NONBLOCK);
+    if(notifyFd >= 0 && inotify_add_watch(notifyFd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        close(notifyFd);
+        notifyFd = -1;
+    }
+    if(notifyFd < 0)
+        std::cout << "inotify unavailable, polling shader modification times" << std::endl;
+#endif
+
+    running = true;
+    watcher = std::thread(&ShaderHotReload::watch, this);
+    std::cout << "Watching " << directory << " for shader changes" << std::endl;
+    return true;
+}
+
+void ShaderHotReload::stop()
+{
+    if(!watcher.joinable())
+        return;
+    running = false;
+    watcher.join();
+#ifdef __linux__
+    if(notifyFd >= 0)
+        close(notifyFd);
+    notifyFd = -1;
+#endif
+}
+
+std::vector<ShaderHotReload::Rebuilt> ShaderHotReload::takeRebuilt()
+{
+    std::vector<Rebuilt> files;
+    std::lock_guard<std::mutex> lock(rebuiltMutex);
+    files.swap(rebuilt);
+    return files;
+}
+
+void ShaderHotReload::watch()
+{
+    profilerSetThreadName("shader watcher");
+    while(running)
+    {
+#ifdef __linux__
+        if(notifyFd >= 0)
+        {
+            pollfd notifyPoll = {notifyFd, POLLIN, 0};
+            if(poll(&notifyPoll, 1, 250) <= 0)
+                continue;
+            //Editors can write a file several times per save, let it settle then rescan everything
+            char events[4096];
+            while(read(notifyFd, events, sizeof(events)) > 0);
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            while(read(notifyFd, events, sizeof(events)) > 0);
+            scan(true, true);
+            continue;
+        }
+#endif
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        scan(true, false);
+    }
+}
+
+//Only sources whose modification time, or an include's, moved are read unless hashAll
+//The hash decides what is compiled
+void ShaderHotReload::scan(bool compileChanges, bool hashAll)
+{
+    std::vector<std::string> names;
+    DIR *dir = opendir(directory.c_str());
+    if(!dir)
+        return;
+    while(dirent *entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        if(isShaderSource(name))
+            names.push_back(name);
+    }
+    closedir(dir);
+
+    for(uint32_t i = 0; i < names.size(); i++)
+    {
+        std::string path = directory + "/" + names[i];
+        std::map<std::string, Source>::iterator known = sources.find(names[i]);
+        if(known != sources.end() && !hashAll)
+        {
+            int64_t modified = modifiedTime(path);
+            for(uint32_t j = 0; j < known->second.includes.size(); j++)
+            {
+                modified = std::max(modified, modifiedTime(known->second.includes[j]));
+            }
+            if(known->second.modified == modified)
+                continue;
+        }
+
+        Source source;
+        source.hash = 14695981039346656037ULL;
+        source.modified = -1;
+        std::set<std::string> seen;
+        hashSource(path, &source, seen);
+        if(source.modified < 0)
+            continue;
+        bool changed = known == sources.end() || known->second.hash != source.hash;
+
+        sources[names[i]] = source;
+        if(changed && compileChanges)
+            compile(names[i], source.hash);
+    }
+}
+
+bool ShaderHotReload::compile(std::string name, uint64_t hash)
+{
+    PROFILE_ZONE("compileShader");
+    //Compiler is part of the key so switching it does not pick up old output
+    char key[17];
+    snprintf(key, sizeof(key), "%016llx", (unsigned long long)hashBytes(compiler, hash));
+    std::string cached = cacheDirectory + "/" + name + "." + key + ".spv";
+    std::string spvPath = directory + "/" + name + ".spv";
+
+    if(modifiedTime(cached) < 0)
+    {
+        //Compiler output goes to stderr, stdout may be carrying a frame stream
+        std::string command = compiler + " -V \"" + directory + "/" + name + "\" -o \"" + cached + "\" 1>&2";
+        int status = std::system(command.c_str());
+        if(status != 0 || modifiedTime(cached) < 0)
+        {
+            std::cout << "Shader compile failed: " << name << " (" << status << ")" << std::endl;
+            std::remove(cached.c_str());
+            return false;
+        }
+    }
+    else
+        std::cout << name << " found in shader cache" << std::endl;
+
+    Rebuilt shader = {spvPath, cached};
+    std::lock_guard<std::mutex> lock(rebuiltMutex);
+    rebuilt.push_back(shader);
+    return true;
+}
@@ -0,0 +1,53 @@
+#ifndef SHADERHOTRELOAD_H_INCLUDED
+#define SHADERHOTRELOAD_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <map>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <cstdint>
+
+//Watches a shader directory and rebuilds X.vert when it changes
+//Compiles run on the watcher thread with the same glslang the .bat files use, keyed by a hash of the
+//source and everything it #includes, so an unchanged or reverted file reuses what is in the cache directory
+//Output stays in the cache directory, the checked in X.vert.spv is never written
+//Linux is notified through inotify, elsewhere modification times are polled
+struct ShaderHotReload
+{
+    struct Source
+    {
+        uint64_t hash;
+        int64_t modified; //Newest of the file and its includes
+        std::vector<std::string> includes; //Paths, as of the last read
+    };
+    struct Rebuilt
+    {
+        std::string spvPath; //As loadShaders names it
+        std::string cachedPath; //Where the new SPIR-V is
+    };
+
+    std::string directory;
+    std::string cacheDirectory;
+    std::string compiler;
+    std::map<std::string, Source> sources; //Watcher thread only, keyed by file name
+
+    std::thread watcher;
+    std::atomic<bool> running;
+    int notifyFd = -1;
+
+    std::mutex rebuiltMutex;
+    std::vector<Rebuilt> rebuilt;
+
+    bool start(std::string shaderDirectory, std::string compilerCommand);
+    void stop();
+    //Main thread, SPIR-V rebuilt since the last call
+    std::vector<Rebuilt> takeRebuilt();
+
+    void watch();
+    void scan(bool compileChanges, bool hashAll);
+    bool compile(std::string name, uint64_t hash);
+};
+
+#endif // SHADERHOTRELOAD_H_INCLUDED
@@ -0,0 +1,510 @@
+#include "shaderReflection.h"
+
+#include <iostream>
+#include <algorithm>
+#include <map>
+#include "vulkanDefinitions.h"
+
+extern VkDevice logicalDevice;
+
+//Only the parts of the SPIR-V spec the reflection reads
+enum SpirvOp
+{
+    SPV_OP_NAME = 5,
+    SPV_OP_ENTRY_POINT = 15,
+    SPV_OP_TYPE_INT = 21,
+    SPV_OP_TYPE_FLOAT = 22,
+    SPV_OP_TYPE_VECTOR = 23,
+    SPV_OP_TYPE_MATRIX = 24,
+    SPV_OP_TYPE_IMAGE = 25,
+    SPV_OP_TYPE_SAMPLER = 26,
+    SPV_OP_TYPE_SAMPLED_IMAGE = 27,
+    SPV_OP_TYPE_ARRAY = 28,
+    SPV_OP_TYPE_RUNTIME_ARRAY = 29,
+    SPV_OP_TYPE_STRUCT = 30,
+    SPV_OP_TYPE_POINTER = 32,
+    SPV_OP_CONSTANT = 43,
+    SPV_OP_VARIABLE = 59,
+    SPV_OP_DECORATE = 71,
+    SPV_OP_MEMBER_DECORATE = 72
+};
+
+enum SpirvDecoration
+{
+    SPV_DECORATION_BLOCK = 2,
+    SPV_DECORATION_BUFFER_BLOCK = 3,
+    SPV_DECORATION_ARRAY_STRIDE = 6,
+    SPV_DECORATION_MATRIX_STRIDE = 7,
+    SPV_DECORATION_BUILT_IN = 11,
+    SPV_DECORATION_LOCATION = 30,
+    SPV_DECORATION_BINDING = 33,
+    SPV_DECORATION_DESCRIPTOR_SET = 34,
+    SPV_DECORATION_OFFSET = 35
+};
+
+enum SpirvStorageClass
+{
+    SPV_STORAGE_UNIFORM_CONSTANT = 0,
+    SPV_STORAGE_INPUT = 1,
+    SPV_STORAGE_UNIFORM = 2,
+    SPV_STORAGE_PUSH_CONSTANT = 9,
+    SPV_STORAGE_STORAGE_BUFFER = 12
+};
+
+const uint32_t SPV_MAGIC = 0x07230203;
+const uint32_t SPV_DIM_BUFFER = 5;
+const uint32_t SPV_DIM_SUBPASS_DATA = 6;
+
+//Everything known about one result id
+struct SpirvId
+{
+    uint32_t op = 0;
+    std::vector<uint32_t> operands; //Words after the result id
+    std::string name;
+
+    bool hasSet = false, hasBinding = false, hasLocation = false;
+    uint32_t set = 0, binding = 0, location = 0;
+    bool builtIn = false;
+    bool block = false, bufferBlock = false;
+    uint32_t arrayStride = 0;
+    std::map<uint32_t, uint32_t> memberOffsets;
+    std::map<uint32_t, uint32_t> memberMatrixStrides;
+};
+
+static uint32_t typeSize(const std::vector<SpirvId> &ids, uint32_t type, uint32_t matrixStride)
+{
+    const SpirvId &id = ids[type];
+    switch(id.op)
+    {
+        case SPV_OP_TYPE_INT:
+        case SPV_OP_TYPE_FLOAT:
+            return id.operands[0] / 8;
+        case SPV_OP_TYPE_VECTOR:
+            return typeSize(ids, id.operands[0], 0) * id.operands[1];
+        case SPV_OP_TYPE_MATRIX:
+        {
+            uint32_t columnSize = typeSize(ids, id.operands[0], 0);
+            if(matrixStride == 0)
+                matrixStride = (columnSize + 15) & ~15;
+            return matrixStride * id.operands[1];
+        }
+        case SPV_OP_TYPE_ARRAY:
+        {
+            uint32_t stride = id.arrayStride;
+            if(stride == 0)
+                stride = typeSize(ids, id.operands[0], matrixStride);
+            return stride * ids[id.operands[1]].operands[1];
+        }
+        case SPV_OP_TYPE_STRUCT:
+        {
+            uint32_t size = 0;
+            for(uint32_t i = 0; i < id.operands.size(); i++)
+            {
+                std::map<uint32_t, uint32_t>::const_iterator offset = id.memberOffsets.find(i);
+                std::map<uint32_t, uint32_t>::const_iterator stride = id.memberMatrixStrides.find(i);
+                uint32_t end = (offset != id.memberOffsets.end() ? offset->second : size) +
+                               typeSize(ids, id.operands[i], stride != id.memberMatrixStrides.end() ? stride->second : 0);
+                size = std::max(size, end);
+            }
+            return size;
+        }
+        default:
+            return 0;
+    }
+}
+
+static VkFormat inputFormat(const std::vector<SpirvId> &ids, uint32_t type)
+{
+    const SpirvId &id = ids[type];
+    uint32_t count = 1;
+    const SpirvId *component = &id;
+    if(id.op == SPV_OP_TYPE_VECTOR)
+    {
+        component = &ids[id.operands[0]];
+        count = id.operands[1];
+    }
+    if(count < 1 || count > 4 || component->operands.empty() || component->operands[0] != 32)
+        return VK_FORMAT_UNDEFINED;
+
+    static const VkFormat floatFormats[] = {VK_FORMAT_R32_SFLOAT, VK_FORMAT_R32G32_SFLOAT,
+                                            VK_FORMAT_R32G32B32_SFLOAT, VK_FORMAT_R32G32B32A32_SFLOAT};
+    static const VkFormat intFormats[] = {VK_FORMAT_R32_SINT, VK_FORMAT_R32G32_SINT,
+                                          VK_FORMAT_R32G32B32_SINT, VK_FORMAT_R32G32B32A32_SINT};
+    static const VkFormat uintFormats[] = {VK_FORMAT_R32_UINT, VK_FORMAT_R32G32_UINT,
+                                           VK_FORMAT_R32G32B32_UINT, VK_FORMAT_R32G32B32A32_UINT};
+    if(component->op == SPV_OP_TYPE_FLOAT)
+        return floatFormats[count-1];
+    if(component->op == SPV_OP_TYPE_INT)
+        return component->operands[1] ? intFormats[count-1] : uintFormats[count-1];
+    return VK_FORMAT_UNDEFINED;
+}
+
+static bool descriptorType(const std::vector<SpirvId> &ids, uint32_t storageClass, uint32_t type, VkDescriptorType *descriptor)
+{
+    const SpirvId &id = ids[type];
+    if(storageClass == SPV_STORAGE_STORAGE_BUFFER)
+    {
+        *descriptor = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        return true;
+    }
+    if(storageClass == SPV_STORAGE_UNIFORM)
+    {
+        *descriptor = id.bufferBlock ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+        return true;
+    }
+    switch(id.op)
+    {
+        case SPV_OP_TYPE_SAMPLED_IMAGE:
+            *descriptor = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+            return true;
+        case SPV_OP_TYPE_SAMPLER:
+            *descriptor = VK_DESCRIPTOR_TYPE_SAMPLER;
+            return true;
+        case SPV_OP_TYPE_IMAGE:
+        {
+            uint32_t dim = id.operands[1];
+            bool storage = id.operands[5] == 2;
+            if(dim == SPV_DIM_SUBPASS_DATA)
+                *descriptor = VK_DESCRIPTOR_TYPE_INPUT_ATTACHMENT;
+            else if(dim == SPV_DIM_BUFFER)
+                *descriptor = storage ? VK_DESCRIPTOR_TYPE_STORAGE_TEXEL_BUFFER : VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER;
+            else
+                *descriptor = storage ? VK_DESCRIPTOR_TYPE_STORAGE_IMAGE : VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE;
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+static bool bindingLess(const VkDescriptorSetLayoutBinding &a, const VkDescriptorSetLayoutBinding &b)
+{
+    return a.binding < b.binding;
+}
+
+static bool inputLess(const ReflectedInput &a, const ReflectedInput &b)
+{
+    return a.location < b.location;
+}
+
+bool ShaderReflection::parse(const uint32_t *code, size_t wordCount)
+{
+    if(wordCount < 5 || code[0] != SPV_MAGIC)
+    {
+        std::cout << "Reflection: not a SPIR-V module" << std::endl;
+        return false;
+    }
+
+    std::vector<SpirvId> ids(code[3]);
+    std::vector<uint32_t> variables;
+    VkShaderStageFlags stage = 0;
+
+    //Gather ids and decorations, every instruction is length << 16 | opcode
+    size_t i = 5;
+    while(i < wordCount)
+    {
+        uint32_t length = code[i] >> 16;
+        uint32_t op = code[i] & 0xFFFF;
+        if(length == 0 || i + length > wordCount)
+        {
+            std::cout << "Reflection: truncated instruction at word " << i << std::endl;
+            return false;
+        }
+        const uint32_t *words = &code[i+1];
+        uint32_t operandCount = length - 1;
+
+        switch(op)
+        {
+            case SPV_OP_NAME:
+                if(words[0] < ids.size())
+                    ids[words[0]].name = std::string((const char *)&words[1], (operandCount - 1) * 4).c_str();
+                break;
+            case SPV_OP_ENTRY_POINT:
+            {
+                static const VkShaderStageFlags models[] = {VK_SHADER_STAGE_VERTEX_BIT, VK_SHADER_STAGE_TESSELLATION_CONTROL_BIT,
+                                                            VK_SHADER_STAGE_TESSELLATION_EVALUATION_BIT, VK_SHADER_STAGE_GEOMETRY_BIT,
+                                                            VK_SHADER_STAGE_FRAGMENT_BIT, VK_SHADER_STAGE_COMPUTE_BIT};
+                if(words[0] < 6)
+                    stage = models[words[0]];
+                break;
+            }
+            case SPV_OP_TYPE_INT:
+            case SPV_OP_TYPE_FLOAT:
+            case SPV_OP_TYPE_VECTOR:
+            case SPV_OP_TYPE_MATRIX:
+            case SPV_OP_TYPE_IMAGE:
+            case SPV_OP_TYPE_SAMPLER:
+            case SPV_OP_TYPE_SAMPLED_IMAGE:
+            case SPV_OP_TYPE_ARRAY:
+            case SPV_OP_TYPE_RUNTIME_ARRAY:
+            case SPV_OP_TYPE_STRUCT:
+            case SPV_OP_TYPE_POINTER:
+                if(words[0] < ids.size())
+                {
+                    ids[words[0]].op = op;
+                    ids[words[0]].operands.assign(words + 1, words + operandCount);
+                }
+                break;
+            case SPV_OP_CONSTANT:
+            case SPV_OP_VARIABLE:
+                if(words[1] < ids.size())
+                {
+                    ids[words[1]].op = op;
+                    //Type followed by the value or storage class
+                    ids[words[1]].operands.assign(1, words[0]);
+                    ids[words[1]].operands.push_back(words[2]);
+                    if(op == SPV_OP_VARIABLE)
+                        variables.push_back(words[1]);
+                }
+                break;
+            case SPV_OP_DECORATE:
+                if(words[0] < ids.size())
+                {
+                    SpirvId &target = ids[words[0]];
+                    uint32_t value = operandCount > 2 ? words[2] : 0;
+                    switch(words[1])
+                    {
+                        case SPV_DECORATION_BLOCK: target.block = true; break;
+                        case SPV_DECORATION_BUFFER_BLOCK: target.bufferBlock = true; break;
+                        case SPV_DECORATION_ARRAY_STRIDE: target.arrayStride = value; break;
+                        case SPV_DECORATION_BUILT_IN: target.builtIn = true; break;
+                        case SPV_DECORATION_LOCATION: target.hasLocation = true; target.location = value; break;
+                        case SPV_DECORATION_BINDING: target.hasBinding = true; target.binding = value; break;
+                        case SPV_DECORATION_DESCRIPTOR_SET: target.hasSet = true; target.set = value; break;
+                    }
+                }
+                break;
+            case SPV_OP_MEMBER_DECORATE:
+                if(words[0] < ids.size() && operandCount > 3)
+                {
+                    if(words[2] == SPV_DECORATION_OFFSET)
+                        ids[words[0]].memberOffsets[words[1]] = words[3];
+                    else if(words[2] == SPV_DECORATION_MATRIX_STRIDE)
+                        ids[words[0]].memberMatrixStrides[words[1]] = words[3];
+                }
+                break;
+        }
+        i += length;
+    }
+
+    if(stage == 0)
+    {
+        std::cout << "Reflection: no entry point" << std::endl;
+        return false;
+    }
+    stages = stage;
+
+    //Variables are the interface
+    for(uint32_t v = 0; v < variables.size(); v++)
+    {
+        const SpirvId &variable = ids[variables[v]];
+        const SpirvId &pointer = ids[variable.operands[0]];
+        if(pointer.op != SPV_OP_TYPE_POINTER)
+            continue;
+        uint32_t storageClass = variable.operands[1];
+        uint32_t type = pointer.operands[1];
+
+        if(storageClass == SPV_STORAGE_INPUT)
+        {
+            if(stage != VK_SHADER_STAGE_VERTEX_BIT || variable.builtIn || !variable.hasLocation)
+                continue;
+            ReflectedInput input;
+            input.location = variable.location;
+            input.format = inputFormat(ids, type);
+            input.name = variable.name;
+            if(input.format == VK_FORMAT_UNDEFINED)
+            {
+                std::cout << "Reflection: unsupported vertex input type for " << input.name << std::endl;
+                return false;
+            }
+            vertexInputs.push_back(input);
+        }
+        else if(storageClass == SPV_STORAGE_PUSH_CONSTANT)
+        {
+            pushConstantRange.stageFlags = stage;
+            pushConstantRange.offset = 0;
+            pushConstantRange.size = std::max(pushConstantRange.size, typeSize(ids, type, 0));
+        }
+        else if(storageClass == SPV_STORAGE_UNIFORM_CONSTANT || storageClass == SPV_STORAGE_UNIFORM ||
+                storageClass == SPV_STORAGE_STORAGE_BUFFER)
+        {
+            if(!variable.hasBinding)
+                continue;
+
+            VkDescriptorSetLayoutBinding binding = {};
+            binding.binding = variable.binding;
+            binding.descriptorCount = 1;
+            binding.stageFlags = stage;
+            binding.pImmutableSamplers = NULL;
+            if(ids[type].op == SPV_OP_TYPE_ARRAY)
+            {
+                binding.descriptorCount = ids[ids[type].operands[1]].operands[1];
+                type = ids[type].operands[0];
+            }
+            if(!descriptorType(ids, storageClass, type, &binding.descriptorType))
+            {
+                std::cout << "Reflection: unsupported descriptor " << variable.name << std::endl;
+                return false;
+            }
+
+            if(sets.size() <= variable.set)
+                sets.resize(variable.set + 1);
+            sets[variable.set].push_back(binding);
+        }
+    }
+
+    for(uint32_t s = 0; s < sets.size(); s++)
+    {
+        std::sort(sets[s].begin(), sets[s].end(), bindingLess);
+    }
+    std::sort(vertexInputs.begin(), vertexInputs.end(), inputLess);
+
+    return true;
+}
+
+bool ShaderReflection::merge(const ShaderReflection &other)
+{
+    stages |= other.stages;
+
+    if(sets.size() < other.sets.size())
+        sets.resize(other.sets.size());
+    for(uint32_t s = 0; s < other.sets.size(); s++)
+    {
+        for(uint32_t b = 0; b < other.sets[s].size(); b++)
+        {
+            const VkDescriptorSetLayoutBinding &incoming = other.sets[s][b];
+            bool found = false;
+            for(uint32_t e = 0; e < sets[s].size(); e++)
+            {
+                VkDescriptorSetLayoutBinding &existing = sets[s][e];
+                if(existing.binding != incoming.binding)
+                    continue;
+                if(existing.descriptorType != incoming.descriptorType)
+                {
+                    std::cout << "Reflection: set " << s << " binding " << incoming.binding
+                              << " has different types between stages" << std::endl;
+                    return false;
+                }
+                existing.stageFlags |= incoming.stageFlags;
+                existing.descriptorCount = std::max(existing.descriptorCount, incoming.descriptorCount);
+                found = true;
+            }
+            if(!found)
+                sets[s].push_back(incoming);
+        }
+        std::sort(sets[s].begin(), sets[s].end(), bindingLess);
+    }
+
+    //One range shared by every stage that declares a block
+    if(other.pushConstantRange.size > 0)
+    {
+        pushConstantRange.stageFlags |= other.pushConstantRange.stageFlags;
+        pushConstantRange.size = std::max(pushConstantRange.size, other.pushConstantRange.size);
+    }
+
+    if(vertexInputs.empty())
+        vertexInputs = other.vertexInputs;
+
+    return true;
+}
+
+bool ShaderReflection::fitsLayout(const ShaderReflection &layout) const
+{
+    for(uint32_t s = 0; s < sets.size(); s++)
+    {
+        for(uint32_t b = 0; b < sets[s].size(); b++)
+        {
+            const VkDescriptorSetLayoutBinding &binding = sets[s][b];
+            bool found = false;
+            for(uint32_t e = 0; s < layout.sets.size() && e < layout.sets[s].size(); e++)
+            {
+                const VkDescriptorSetLayoutBinding &existing = layout.sets[s][e];
+                if(existing.binding == binding.binding &&
+                   existing.descriptorType == binding.descriptorType &&
+                   existing.descriptorCount >= binding.descriptorCount &&
+                   (existing.stageFlags & binding.stageFlags) == binding.stageFlags)
+                    found = true;
+            }
+            if(!found)
+                return false;
+        }
+    }
+
+    if(pushConstantRange.size > 0 &&
+       (pushConstantRange.size > layout.pushConstantRange.size ||
+        (layout.pushConstantRange.stageFlags & pushConstantRange.stageFlags) != pushConstantRange.stageFlags))
+        return false;
+    return true;
+}
+
+bool ShaderReflection::setImmutableSampler(uint32_t set, uint32_t binding, SamplerCache &samplerCache,
+                                           const VkSamplerCreateInfo &createInfo)
+{
+    for(uint32_t b = 0; set < sets.size() && b < sets[set].size(); b++)
+    {
+        VkDescriptorSetLayoutBinding &layoutBinding = sets[set][b];
+        if(layoutBinding.binding != binding)
+            continue;
+        if(layoutBinding.descriptorType != VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER &&
+           layoutBinding.descriptorType != VK_DESCRIPTOR_TYPE_SAMPLER)
+            break;
+        layoutBinding.pImmutableSamplers = samplerCache.immutable(createInfo, layoutBinding.descriptorCount);
+        return layoutBinding.pImmutableSamplers != NULL;
+    }
+    std::cout << "No sampler at set " << set << " binding " << binding << " to make immutable" << std::endl;
+    return false;
+}
+
+bool ShaderReflection::createSetLayouts(DescriptorLayoutCache &layoutCache, std::vector<VkDescriptorSetLayout> *layouts) const
+{
+    layouts->resize(sets.size());
+    for(uint32_t s = 0; s < sets.size(); s++)
+    {
+        if(!layoutCache.get(sets[s], &(*layouts)[s]))
+            return false;
+    }
+    return true;
+}
+
+bool ShaderReflection::createPipelineLayout(const std::vector<VkDescriptorSetLayout> &layouts, VkPipelineLayout *pipelineLayout) const
+{
+    VkPipelineLayoutCreateInfo layoutCreateInfo = {};
+    layoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+    layoutCreateInfo.setLayoutCount = layouts.size();
+    layoutCreateInfo.pSetLayouts = layouts.data();
+    layoutCreateInfo.pushConstantRangeCount = pushConstantRange.size > 0 ? 1 : 0;
+    layoutCreateInfo.pPushConstantRanges = &pushConstantRange;
+
+    VkResult result = vkCreatePipelineLayout(logicalDevice, &layoutCreateInfo, NULL, pipelineLayout);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Reflected pipeline layout creation failed (" << result << ")" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool ShaderReflection::vertexAttributes(const std::vector<VertexField> &fields, uint32_t binding,
+                                        std::vector<VkVertexInputAttributeDescription> *attributes) const
+{
+    attributes->resize(vertexInputs.size());
+    for(uint32_t i = 0; i < vertexInputs.size(); i++)
+    {
+        uint32_t f = 0;
+        while(f < fields.size() && vertexInputs[i].name != fields[f].name)
+        {
+            f++;
+        }
+        if(f == fields.size())
+        {
+            std::cout << "Reflection: vertex input " << vertexInputs[i].name << " has no matching vertex field" << std::endl;
+            return false;
+        }
+
+        (*attributes)[i].location = vertexInputs[i].location;
+        (*attributes)[i].binding = binding;
+        (*attributes)[i].format = vertexInputs[i].format;
+        (*attributes)[i].offset = fields[f].offset;
+    }
+    return true;
+}
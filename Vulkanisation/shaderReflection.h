@@ -0,0 +1,49 @@
+#ifndef SHADERREFLECTION_H_INCLUDED
+#define SHADERREFLECTION_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+
+#include "descriptors.h"
+#include "samplerCache.h"
+
+struct ReflectedInput
+{
+    uint32_t location;
+    VkFormat format;
+    std::string name;
+};
+
+//Vertex member a shader input of the same name reads from
+struct VertexField
+{
+    const char *name;
+    uint32_t offset;
+};
+
+//Resource interface of one or more shader stages, read straight from the SPIR-V
+//parse() fills a single stage, merge() combines stages into what a pipeline needs
+struct ShaderReflection
+{
+    VkShaderStageFlags stages = 0;
+    std::vector<std::vector<VkDescriptorSetLayoutBinding> > sets; //Indexed by set number, sorted by binding
+    VkPushConstantRange pushConstantRange = {};
+    std::vector<ReflectedInput> vertexInputs; //Sorted by location
+
+    bool parse(const uint32_t *code, size_t wordCount);
+    bool merge(const ShaderReflection &other);
+    //True when every binding and push constant used here is already covered by layout
+    bool fitsLayout(const ShaderReflection &layout) const;
+
+    //Bakes a cached sampler into a sampler binding, so writes to it only need the image view
+    bool setImmutableSampler(uint32_t set, uint32_t binding, SamplerCache &samplerCache, const VkSamplerCreateInfo &createInfo);
+    //One layout per set number, gaps get an empty layout so numbering is kept
+    bool createSetLayouts(DescriptorLayoutCache &layoutCache, std::vector<VkDescriptorSetLayout> *layouts) const;
+    bool createPipelineLayout(const std::vector<VkDescriptorSetLayout> &layouts, VkPipelineLayout *pipelineLayout) const;
+    bool vertexAttributes(const std::vector<VertexField> &fields, uint32_t binding,
+                          std::vector<VkVertexInputAttributeDescription> *attributes) const;
+};
+
+#endif // SHADERREFLECTION_H_INCLUDED
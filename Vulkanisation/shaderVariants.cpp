@@ -0,0 +1,89 @@
+#include "shaderVariants.h"
+
+#include <iostream>
+
+std::string featureName(uint32_t features)
+{
+    static const char *names[FEATURE_COUNT] = {"textured", "vertex colour", "lit", "normal debug"};
+    std::string name;
+    for(uint32_t i = 0; i < FEATURE_COUNT; i++)
+    {
+        if(features & (1 << i))
+        {
+            if(!name.empty())
+                name += ", ";
+            name += names[i];
+        }
+    }
+    return name.empty() ? "flat" : name;
+}
+
+void ShaderVariants::create(std::string variantName, const std::vector<VkPipelineShaderStageCreateInfo> &stages,
+                            const VkPipelineVertexInputStateCreateInfo *vertexInputState, VkPipelineLayout pipelineLayout,
+                            VkShaderStageFlags stagesToSpecialize)
+{
+    name = variantName;
+    baseStages = stages;
+    vertexInput = vertexInputState;
+    layout = pipelineLayout;
+    specializedStages = stagesToSpecialize;
+}
+
+uint32_t ShaderVariants::get(PipelineManager &manager, uint32_t features)
+{
+    std::map<uint32_t, Variant*>::iterator found = variants.find(features);
+    if(found != variants.end())
+        return found->second->pipeline;
+
+    Variant *variant = new Variant();
+    for(uint32_t i = 0; i < FEATURE_COUNT; i++)
+    {
+        variant->values[i] = (features & (1 << i)) ? VK_TRUE : VK_FALSE;
+        variant->entries[i].constantID = i;
+        variant->entries[i].offset = i * sizeof(VkBool32);
+        variant->entries[i].size = sizeof(VkBool32);
+    }
+    variant->specializationInfo.mapEntryCount = FEATURE_COUNT;
+    variant->specializationInfo.pMapEntries = variant->entries;
+    variant->specializationInfo.dataSize = sizeof(variant->values);
+    variant->specializationInfo.pData = variant->values;
+
+    variant->stages = baseStages;
+    for(uint32_t i = 0; i < variant->stages.size(); i++)
+    {
+        if(variant->stages[i].stage & specializedStages)
+            variant->stages[i].pSpecializationInfo = &variant->specializationInfo;
+    }
+
+    variant->pipeline = manager.add(name + " (" + featureName(features) + ")", variant->stages, vertexInput, layout, fallback);
+    variants[features] = variant;
+    return variant->pipeline;
+}
+
+std::vector<uint32_t> ShaderVariants::updateStages(const std::vector<VkPipelineShaderStageCreateInfo> &stages)
+{
+    //Stage vectors keep their size so the manager's pointers into them stay valid
+    std::vector<uint32_t> pipelines;
+    for(uint32_t i = 0; i < baseStages.size() && i < stages.size(); i++)
+    {
+        baseStages[i].module = stages[i].module;
+    }
+    for(std::map<uint32_t, Variant*>::iterator it = variants.begin(); it != variants.end(); ++it)
+    {
+        for(uint32_t i = 0; i < it->second->stages.size() && i < stages.size(); i++)
+        {
+            it->second->stages[i].module = stages[i].module;
+        }
+        pipelines.push_back(it->second->pipeline);
+    }
+    return pipelines;
+}
+
+void ShaderVariants::destroy()
+{
+    for(std::map<uint32_t, Variant*>::iterator it = variants.begin(); it != variants.end(); ++it)
+    {
+        delete it->second;
+    }
+    variants.clear();
+}
@@ -0,0 +1,56 @@
+#ifndef SHADERVARIANTS_H_INCLUDED
+#define SHADERVARIANTS_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+#include <map>
+
+#include "pipelineManager.h"
+
+//Bit N is specialization constant_id N in the shader
+enum ShaderFeature
+{
+    FEATURE_TEXTURED = 1 << 0,
+    FEATURE_VERTEX_COLOUR = 1 << 1,
+    FEATURE_LIT = 1 << 2,
+    FEATURE_NORMAL_DEBUG = 1 << 3,
+    FEATURE_COUNT = 4
+};
+
+std::string featureName(uint32_t features);
+
+//One shader compiled into a pipeline per feature key, features are specialization constants
+//so the variant has no runtime branches for them. Each key is only ever added once
+struct ShaderVariants
+{
+    struct Variant
+    {
+        VkBool32 values[FEATURE_COUNT];
+        VkSpecializationMapEntry entries[FEATURE_COUNT];
+        VkSpecializationInfo specializationInfo;
+        std::vector<VkPipelineShaderStageCreateInfo> stages;
+        uint32_t pipeline;
+    };
+
+    std::string name;
+    std::vector<VkPipelineShaderStageCreateInfo> baseStages;
+    const VkPipelineVertexInputStateCreateInfo *vertexInput = NULL;
+    VkPipelineLayout layout = VK_NULL_HANDLE;
+    VkShaderStageFlags specializedStages = 0;
+    uint32_t fallback = NO_PIPELINE; //Variants added after this is set fall back to it while compiling
+
+    std::map<uint32_t, Variant*> variants; //Heap allocated, the manager keeps pointers into them
+
+    void create(std::string variantName, const std::vector<VkPipelineShaderStageCreateInfo> &stages,
+                const VkPipelineVertexInputStateCreateInfo *vertexInputState, VkPipelineLayout pipelineLayout,
+                VkShaderStageFlags stagesToSpecialize);
+    //Pipeline id for the key, adds a pending request the first time a key is seen
+    uint32_t get(PipelineManager &manager, uint32_t features);
+    //Swaps in new modules for the same stages, returns the pipelines that need rebuilding
+    std::vector<uint32_t> updateStages(const std::vector<VkPipelineShaderStageCreateInfo> &stages);
+    void destroy();
+};
+
+#endif // SHADERVARIANTS_H_INCLUDED
@@ -0,0 +1,3 @@
+@echo off
+glslang -V bindless.vert -o bindless.vert.spv
+glslang -V bindless.frag -o bindless.frag.spv
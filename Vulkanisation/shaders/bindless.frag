@@ -0,0 +1,52 @@
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_shader_storage_buffer_object : enable
+
+//Must match MAX_BINDLESS_TEXTURES
+#define MAX_TEXTURES 16
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec2 inUV;
+layout (location = 2) in vec3 inNorm;
+layout (location = 3) in flat int inMaterialIndex;
+layout (location = 4) in flat vec4 inUVRect; //xy scale, zw offset of the material's image in its layer
+layout (location = 5) in flat int inTextureLayer;
+
+layout (set = 1, binding = 1) uniform sampler2DArray textures[MAX_TEXTURES];
+
+struct MaterialData
+{
+    vec4 diffuseColour;
+    vec4 specularColour; //w is shininess
+};
+
+layout (std430, set = 1, binding = 2) readonly buffer MaterialTable
+{
+    MaterialData materials[];
+} materialTable;
+
+layout (push_constant) uniform DrawConstants
+{
+	int objectIndex;
+	int textureIndex;
+	int materialBase;
+} draw;
+
+layout (location = 0) out vec4 uFragColour;
+
+void main()
+{
+    float intensity = dot(normalize(vec3(-1,1,-1)), inNorm);
+    vec4 colour;
+    //Push constant index is uniform across the draw, core dynamic indexing is enough
+    if(draw.textureIndex >= 0)
+    {
+        vec2 halfTexel = 0.5 / vec2(textureSize(textures[draw.textureIndex], 0).xy);
+        vec2 uv = clamp(inUV * inUVRect.xy + inUVRect.zw, inUVRect.zw + halfTexel, inUVRect.zw + inUVRect.xy - halfTexel);
+        colour = texture(textures[draw.textureIndex], vec3(uv, inTextureLayer));
+    }
+    else
+        colour = materialTable.materials[draw.materialBase + max(inMaterialIndex, 0)].diffuseColour;
+    uFragColour = intensity * colour;
+}
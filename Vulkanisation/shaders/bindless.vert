@@ -0,0 +1,58 @@
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_shader_storage_buffer_object : enable
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec2 inUV;
+layout (location = 2) in vec3 inNorm;
+layout (location = 3) in int inMaterialIndex;
+layout (location = 4) in vec4 inUVRect;
+layout (location = 5) in int inTextureLayer;
+
+layout (location = 0) out vec3 outPos;
+layout (location = 1) out vec2 outUV;
+layout (location = 2) out vec3 outNorm;
+layout (location = 3) out int outMaterialIndex;
+layout (location = 4) out vec4 outUVRect;
+layout (location = 5) out int outTextureLayer;
+
+layout (set = 0, binding = 0) uniform CameraBuffer
+{
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+} camera;
+
+struct ObjectData
+{
+	mat4 modelMatrix;
+	mat4 normalMatrix;
+};
+
+layout (std430, set = 1, binding = 0) readonly buffer ObjectBuffer
+{
+	ObjectData objects[];
+} objectBuffer;
+
+layout (push_constant) uniform DrawConstants
+{
+	int objectIndex;
+	int textureIndex;
+	int materialBase;
+} draw;
+
+void main()
+{
+    ObjectData object = objectBuffer.objects[draw.objectIndex];
+    outPos = (object.modelMatrix * vec4(inPos, 1.0)).xyz;
+    outUV = vec2(inUV.x, 1-inUV.y);
+    outNorm = normalize(mat3(object.normalMatrix) * inNorm);
+    outMaterialIndex = inMaterialIndex;
+    outUVRect = inUVRect;
+    outTextureLayer = inTextureLayer;
+
+    gl_Position = camera.projectionMatrix *
+                  camera.viewMatrix *
+                  object.modelMatrix *
+                  vec4(inPos, 1.0);
+}
@@ -0,0 +1,21 @@
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+//Line list written by normalLines.comp, already in world space
+layout (location = 0) in vec4 inPos;
+layout (location = 1) in vec4 inNorm;
+
+layout (location = 0) out vec3 outNorm;
+
+layout (set = 0, binding = 0) uniform CameraBuffer
+{
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+} camera;
+
+void main()
+{
+    outNorm = inNorm.xyz;
+    gl_Position = camera.projectionMatrix * camera.viewMatrix * inPos;
+}
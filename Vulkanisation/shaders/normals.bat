@@ -1,4 +1,4 @@
 @echo off
-glslang -V normal.vert -o normal.vert.spv
-glslang -V normal.geom -o normal.geom.spv
+glslang -V normalLine.vert -o normalLine.vert.spv
+glslang -V normalLines.comp -o normalLines.comp.spv
 glslang -V normal.frag -o normal.frag.spv
\ No newline at end of file
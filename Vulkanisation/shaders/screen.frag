@@ -7,9 +7,17 @@ layout (location = 1) in vec2 inUV;
 
 layout (binding = 1) uniform sampler2D textureSampler;
 
+layout (push_constant) uniform PushConstants
+{
+	vec2 uvScale;
+	vec2 uvMax;
+} pushConstants;
+
 layout (location = 0) out vec4 uFragColour;
 
 void main()
 {
-    uFragColour = texture(textureSampler, vec2(inUV.x , inUV.y));
+    //Bilinear taps past the last rendered texel would pick up stale contents
+    vec2 uv = min(inUV, pushConstants.uvMax);
+    uFragColour = texture(textureSampler, uv);
 }
@@ -15,9 +15,16 @@ layout (binding = 0) uniform UniformBuffer
 	mat4 modelMatrix;
 } uniformBuffer;
 
+layout (push_constant) uniform PushConstants
+{
+	vec2 uvScale;
+	vec2 uvMax;
+} pushConstants;
+
 void main()
 {
-    outUV = vec2(inUV.x, 1-inUV.y);
+    //Only the scaled region of the offscreen target holds the scene
+    outUV = vec2(inUV.x, 1-inUV.y) * pushConstants.uvScale;
 
     outPos = uniformBuffer.projectionMatrix *
                   vec4(inPos, 1.0);
@@ -6,9 +6,18 @@ layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec2 inUV;
 layout (location = 2) in vec3 inNorm;
 layout (location = 3) in flat int inMaterialIndex;
+layout (location = 4) in vec3 inColour;
+layout (location = 5) in flat vec4 inUVRect; //xy scale, zw offset of the material's image in its layer
+layout (location = 6) in flat int inTextureLayer;
 
-layout (binding = 1) uniform sampler2DArray textureSamplerArray;
-layout (binding = 2) uniform Material
+//Set per pipeline variant, ids match ShaderFeature bits in shaderVariants.h
+layout (constant_id = 0) const bool TEXTURED = true;
+layout (constant_id = 1) const bool VERTEX_COLOUR = false;
+layout (constant_id = 2) const bool LIT = true;
+layout (constant_id = 3) const bool NORMAL_DEBUG = false;
+
+layout (set = 1, binding = 1) uniform sampler2DArray textureSamplerArray;
+layout (set = 1, binding = 2) uniform Material
 {
     vec3 diffuseColour;
     vec3 specularColour;
@@ -19,6 +28,23 @@ layout (location = 0) out vec4 uFragColour;
 
 void main()
 {
-    float intensity = dot(normalize(vec3(-1,1,-1)), inNorm);
-    uFragColour = intensity * texture(textureSamplerArray, vec3(inUV, inMaterialIndex));
+    if(NORMAL_DEBUG)
+    {
+        uFragColour = vec4((inNorm + 1) / 2, 1);
+        return;
+    }
+
+    vec4 colour = vec4(1);
+    if(TEXTURED)
+    {
+        //Kept half a texel inside the image so filtering doesn't pick up its neighbours
+        vec2 halfTexel = 0.5 / vec2(textureSize(textureSamplerArray, 0).xy);
+        vec2 uv = clamp(inUV * inUVRect.xy + inUVRect.zw, inUVRect.zw + halfTexel, inUVRect.zw + inUVRect.xy - halfTexel);
+        colour = texture(textureSamplerArray, vec3(uv, inTextureLayer));
+    }
+    if(VERTEX_COLOUR)
+        colour.rgb *= inColour;
+    if(LIT)
+        colour *= dot(normalize(vec3(-1,1,-1)), inNorm);
+    uFragColour = colour;
 }
@@ -6,28 +6,42 @@ layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec2 inUV;
 layout (location = 2) in vec3 inNorm;
 layout (location = 3) in int inMaterialIndex;
+layout (location = 4) in vec3 inColour;
+layout (location = 5) in vec4 inUVRect;
+layout (location = 6) in int inTextureLayer;
 
 layout (location = 0) out vec3 outPos;
 layout (location = 1) out vec2 outUV;
 layout (location = 2) out vec3 outNorm;
 layout (location = 3) out int outMaterialIndex;
+layout (location = 4) out vec3 outColour;
+layout (location = 5) out vec4 outUVRect;
+layout (location = 6) out int outTextureLayer;
 
-layout (binding = 0) uniform UniformBuffer
+layout (set = 0, binding = 0) uniform CameraBuffer
 {
 	mat4 projectionMatrix;
 	mat4 viewMatrix;
+} camera;
+
+layout (push_constant) uniform ObjectConstants
+{
 	mat4 modelMatrix;
-} uniformBuffer;
+	mat4 normalMatrix;
+} object;
 
 void main()
 {
-    outPos = (uniformBuffer.modelMatrix * vec4(inPos, 1.0)).xyz;
+    outPos = (object.modelMatrix * vec4(inPos, 1.0)).xyz;
     outUV = vec2(inUV.x, 1-inUV.y);
-    outNorm = normalize(inNorm * (inverse(mat3(uniformBuffer.modelMatrix))));
+    outNorm = normalize(mat3(object.normalMatrix) * inNorm);
     outMaterialIndex = inMaterialIndex;
+    outColour = inColour;
+    outUVRect = inUVRect;
+    outTextureLayer = inTextureLayer;
 
-    gl_Position = uniformBuffer.projectionMatrix *
-                  uniformBuffer.viewMatrix *
-                  uniformBuffer.modelMatrix *
+    gl_Position = camera.projectionMatrix *
+                  camera.viewMatrix *
+                  object.modelMatrix *
                   vec4(inPos, 1.0);
 }
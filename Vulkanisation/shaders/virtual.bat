@@ -0,0 +1,3 @@
+@echo off
+glslang -V virtual.vert -o virtual.vert.spv
+glslang -V virtual.frag -o virtual.frag.spv
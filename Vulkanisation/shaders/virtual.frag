@@ -0,0 +1,84 @@
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+#extension GL_ARB_shader_storage_buffer_object : enable
+
+//Must match virtualTexture.h
+#define MAX_LEVELS 16
+#define FEEDBACK_SCALE 8
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec2 inUV;
+layout (location = 2) in vec3 inNorm;
+
+layout (std430, set = 1, binding = 0) readonly buffer PageTable
+{
+    uint width;
+    uint height;
+    uint levels;
+    uint pageSize;
+    uint border;
+    uint physicalPages;
+    uint feedbackWidth;
+    uint feedbackHeight;
+    uint frameIndex;
+    uint padding0;
+    uint padding1;
+    uint padding2;
+    uvec4 levelPages[MAX_LEVELS]; //x,y pages across, z first entry
+    uint entries[]; //level << 16 | y << 8 | x of the physical page standing in
+} table;
+
+layout (set = 1, binding = 1) uniform sampler2D physicalPages;
+
+//level << 24 | y << 12 | x of the page wanted, one per block of pixels
+layout (std430, set = 1, binding = 2) writeonly buffer Feedback
+{
+    uint requests[];
+} feedback;
+
+layout (location = 0) out vec4 uFragColour;
+
+ivec2 levelSize(uint level)
+{
+    return max(ivec2(table.width, table.height) >> int(level), ivec2(1));
+}
+
+ivec2 pageOf(vec2 uv, uint level)
+{
+    ivec2 texel = ivec2(uv * vec2(levelSize(level)));
+    return min(texel / int(table.pageSize), ivec2(table.levelPages[level].xy) - 1);
+}
+
+void main()
+{
+    vec2 uv = clamp(inUV, 0.0, 1.0);
+    //Level a full mip chain would have been sampled at
+    vec2 texels = inUV * vec2(table.width, table.height);
+    vec2 dx = dFdx(texels);
+    vec2 dy = dFdy(texels);
+    float lod = 0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8));
+    uint level = uint(clamp(floor(lod), 0.0, float(table.levels - 1)));
+    ivec2 page = pageOf(uv, level);
+
+    //One pixel of each block reports, a different one each frame
+    ivec2 pixel = ivec2(gl_FragCoord.xy);
+    ivec2 block = pixel / FEEDBACK_SCALE;
+    int pick = int(table.frameIndex % uint(FEEDBACK_SCALE * FEEDBACK_SCALE));
+    if(pixel % FEEDBACK_SCALE == ivec2(pick % FEEDBACK_SCALE, pick / FEEDBACK_SCALE) &&
+       block.x < int(table.feedbackWidth) && block.y < int(table.feedbackHeight))
+        feedback.requests[block.y * int(table.feedbackWidth) + block.x] = level << 24 | uint(page.y) << 12 | uint(page.x);
+
+    //Whatever is resident, possibly a coarser level than asked for
+    uvec4 pages = table.levelPages[level];
+    uint entry = table.entries[pages.z + uint(page.y) * pages.x + uint(page.x)];
+    uint residentLevel = entry >> 16;
+    vec2 physicalPage = vec2(entry & 0xFFu, (entry >> 8) & 0xFFu);
+    vec2 within = uv * vec2(levelSize(residentLevel)) - vec2(pageOf(uv, residentLevel) * int(table.pageSize));
+    float stride = float(table.pageSize + 2u * table.border);
+    vec2 physicalUV = (physicalPage * stride + float(table.border) + within) / (stride * float(table.physicalPages));
+    vec4 colour = textureLod(physicalPages, physicalUV, 0.0);
+
+    float intensity = dot(normalize(vec3(-1,1,-1)), inNorm);
+    uFragColour = intensity * colour;
+}
@@ -0,0 +1,35 @@
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+layout (location = 0) in vec3 inPos;
+layout (location = 1) in vec2 inUV;
+layout (location = 2) in vec3 inNorm;
+
+layout (location = 0) out vec3 outPos;
+layout (location = 1) out vec2 outUV;
+layout (location = 2) out vec3 outNorm;
+
+layout (set = 0, binding = 0) uniform CameraBuffer
+{
+	mat4 projectionMatrix;
+	mat4 viewMatrix;
+} camera;
+
+layout (push_constant) uniform ObjectConstants
+{
+	mat4 modelMatrix;
+	mat4 normalMatrix;
+} object;
+
+void main()
+{
+    outPos = (object.modelMatrix * vec4(inPos, 1.0)).xyz;
+    outUV = inUV;
+    outNorm = normalize(mat3(object.normalMatrix) * inNorm);
+
+    gl_Position = camera.projectionMatrix *
+                  camera.viewMatrix *
+                  object.modelMatrix *
+                  vec4(inPos, 1.0);
+}
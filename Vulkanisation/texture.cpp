@@ -5,32 +5,91 @@
 #include <limits>
 #include <algorithm>
 #include <iostream>
+#include <cstring>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
 
 #include "vulkanDefinitions.h"
 #include "assorted.h"
+#include "uploadService.h"
+#include "textureCompression.h"
+#include "workerPool.h"
+#include "samplerCache.h"
+#include "cpuProfiler.h"
 
 extern VkDevice logicalDevice;
-extern VkPhysicalDeviceMemoryProperties memoryProperties;
-extern VkCommandPool commandPool;
-extern VkQueue presentQueue;
+extern UploadService uploadService;
+extern bool compressTextures;
+extern std::string textureCacheDirectory;
+extern WorkerPool workerPool;
+extern SamplerCache samplerCache;
+
+//8 bit unorm to float, 16 values a step
+static void unormToFloat(const unsigned char *source, float *destination, size_t count)
+{
+    size_t i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128 scale = _mm_set1_ps(1.0f / 255.0f);
+    for(; i + 16 <= count; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i*)(source + i));
+        __m128i low = _mm_unpacklo_epi8(bytes, zero);
+        __m128i high = _mm_unpackhi_epi8(bytes, zero);
+        _mm_storeu_ps(destination + i, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(low, zero)), scale));
+        _mm_storeu_ps(destination + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(low, zero)), scale));
+        _mm_storeu_ps(destination + i + 8, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpacklo_epi16(high, zero)), scale));
+        _mm_storeu_ps(destination + i + 12, _mm_mul_ps(_mm_cvtepi32_ps(_mm_unpackhi_epi16(high, zero)), scale));
+    }
+#endif
+    for(; i < count; i++)
+    {
+        destination[i] = source[i] * (1.0f / 255.0f);
+    }
+}
+
+//The view's mip count does the clamping, so single images and arrays of any depth share one sampler
+VkSamplerCreateInfo textureSamplerCreateInfo()
+{
+    VkSamplerCreateInfo samplerCreateInfo = {};
+    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+    samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.mipLodBias = 0;
+    samplerCreateInfo.anisotropyEnable = VK_FALSE;
+    samplerCreateInfo.minLod = 0;
+    samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+    samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
+    return samplerCreateInfo;
+}
 
 void Texture::destroy()
 {
+    upload.wait();
     vkDestroyImage(logicalDevice, textureImage, NULL);
     vkDestroyImageView(logicalDevice, textureView, NULL);
-    vkDestroySampler(logicalDevice, sampler, NULL);
     vkFreeMemory(logicalDevice, textureImageMemory, NULL);
 }
 
 bool Texture::loadTexture(std::string filename)
 {
+    PROFILE_ZONE("Texture::loadTexture");
     int width,height,channels;
     unsigned char *preloadedImage = stbi_load(filename.c_str(),&width,&height,&channels,STBI_rgb);
-    std::vector<float> loadedImage(width * height * 3);
-    for(int i = 0; i < width * height * 3; i++)
+    if(preloadedImage == NULL)
     {
-        loadedImage[i] = (float) preloadedImage[i]/255;
+        std::cout << "Texture could not be loaded: " << filename << std::endl;
+        return false;
     }
+    std::vector<float> loadedImage(width * height * 3);
+    unormToFloat(preloadedImage, loadedImage.data(), loadedImage.size());
+    stbi_image_free(preloadedImage);
 
     VkImageCreateInfo textureCreateInfo = {};
     textureCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
@@ -40,10 +99,10 @@ bool Texture::loadTexture(std::string filename)
     textureCreateInfo.mipLevels = 1;
     textureCreateInfo.arrayLayers = 1;
     textureCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
-    textureCreateInfo.tiling = VK_IMAGE_TILING_LINEAR;
-    textureCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT;
+    textureCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    textureCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     textureCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    textureCreateInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+    textureCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
     VkResult result = vkCreateImage(logicalDevice, &textureCreateInfo, NULL, &textureImage);
 
@@ -53,72 +112,26 @@ bool Texture::loadTexture(std::string filename)
     VkMemoryAllocateInfo textureImageAllocateInfo = {};
     textureImageAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
     textureImageAllocateInfo.allocationSize = textureMemoryRequirements.size;
-
-    uint32_t textureMemoryTypeBits = textureMemoryRequirements.memoryTypeBits;
-    VkMemoryPropertyFlags tDesiredMemoryFlags = VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT;
-    for( uint32_t i = 0; i < 32; ++i)
-    {
-        VkMemoryType memoryType = memoryProperties.memoryTypes[i];
-        if(textureMemoryTypeBits & 1)
-        {
-            if((memoryType.propertyFlags & tDesiredMemoryFlags) == tDesiredMemoryFlags)
-            {
-                textureImageAllocateInfo.memoryTypeIndex = i;
-                break;
-            }
-        }
-        textureMemoryTypeBits = textureMemoryTypeBits >> 1;
-    }
+    textureImageAllocateInfo.memoryTypeIndex = getMemoryTypeIndex(textureMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     result = vkAllocateMemory(logicalDevice, &textureImageAllocateInfo, NULL, &textureImageMemory);
     result = vkBindImageMemory(logicalDevice, textureImage, textureImageMemory, 0);
 
-    void *imageMapped;
-    result = vkMapMemory(logicalDevice, textureImageMemory, 0, VK_WHOLE_SIZE, 0, &imageMapped );
-
-    memcpy(imageMapped, loadedImage.data(), sizeof(float) * width * height * 3);
-
-    VkMappedMemoryRange memoryRange = {};
-    memoryRange.sType = VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE;
-    memoryRange.memory = textureImageMemory;
-    memoryRange.offset = 0;
-    memoryRange.size = VK_WHOLE_SIZE;
-    result = vkFlushMappedMemoryRanges(logicalDevice, 1, &memoryRange);
-
-    vkUnmapMemory(logicalDevice, textureImageMemory);
-
-
-    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
-    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferAllocateInfo.commandPool = commandPool;
-    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferAllocateInfo.commandBufferCount = 1;
-
-    VkCommandBuffer copyCmd;
-    vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocateInfo, &copyCmd);
-
-	VkCommandBufferBeginInfo cmdBufferBeginInfo = {};
-    cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    vkBeginCommandBuffer(copyCmd, &cmdBufferBeginInfo);
-
+    //Streams in through the staging ring, the view and sampler don't need to wait for it
     VkImageSubresourceRange subresourceRange = {};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     subresourceRange.baseMipLevel = 0;
     subresourceRange.levelCount = 1;
     subresourceRange.layerCount = 1;
-    setImageLayout(copyCmd, textureImage, VK_IMAGE_ASPECT_COLOR_BIT,
-                   VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                   subresourceRange);
-
-    vkEndCommandBuffer(copyCmd);
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &copyCmd;
-    vkQueueSubmit(presentQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(presentQueue);
-    vkFreeCommandBuffers(logicalDevice, commandPool, 1, &copyCmd);
-
+    VkBufferImageCopy region = {};
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageExtent = textureCreateInfo.extent;
+    upload = uploadService.uploadImage(textureImage, subresourceRange, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                       loadedImage.data(), sizeof(float) * loadedImage.size(), sizeof(float) * 3,
+                                       std::vector<VkBufferImageCopy>(1, region));
+    if(upload.service == NULL)
+        return false;
 
     VkImageViewCreateInfo textureImageViewCreateInfo = {};
     textureImageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -137,106 +150,331 @@ bool Texture::loadTexture(std::string filename)
 
     result = vkCreateImageView(logicalDevice, &textureImageViewCreateInfo, NULL, &textureView);
 
-    VkSamplerCreateInfo samplerCreateInfo = {};
-    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
-    samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
-    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerCreateInfo.mipLodBias = 0;
-    samplerCreateInfo.anisotropyEnable = VK_FALSE;
-    samplerCreateInfo.minLod = 0;
-    samplerCreateInfo.maxLod = 5;
-    samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_TRANSPARENT_BLACK;
-    samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
-
-    result = vkCreateSampler(logicalDevice, &samplerCreateInfo, NULL, &sampler);
+    if(!samplerCache.get(textureSamplerCreateInfo(), &sampler))
+        return false;
 
     return true;
 }
 
-bool Texture::loadTextureArray(std::vector<std::string> filenames)
+static uint32_t roundUpPow2(uint32_t value)
+{
+    uint32_t rounded = 1;
+    while(rounded < value)
+    {
+        rounded *= 2;
+    }
+    return rounded;
+}
+
+//Shelf packs images into as few layers as possible, tallest first. Returns the layer count
+//With blockAligned every image gets a power of two slot of at least one block placed at a multiple of its
+//own size, so each of its mips stays block aligned for as long as the slot is a block or more across
+static uint32_t packLayers(const std::vector<VkExtent2D> &sizes, bool blockAligned, VkExtent2D *layerSize,
+                           std::vector<TextureRegion> *placed, std::vector<VkOffset2D> *offsets, uint32_t *smallestSlot)
+{
+    std::vector<VkExtent2D> slots(sizes.size());
+    std::vector<uint32_t> order(sizes.size());
+    *layerSize = {1, 1};
+    for(uint32_t i = 0; i < sizes.size(); i++)
+    {
+        slots[i] = sizes[i];
+        if(blockAligned)
+            slots[i] = {roundUpPow2(std::max(4u, sizes[i].width)), roundUpPow2(std::max(4u, sizes[i].height))};
+        layerSize->width = std::max(layerSize->width, slots[i].width);
+        layerSize->height = std::max(layerSize->height, slots[i].height);
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&slots](uint32_t a, uint32_t b)
+    {
+        if(slots[a].height != slots[b].height)
+            return slots[a].height > slots[b].height;
+        return slots[a].width > slots[b].width;
+    });
+
+    placed->resize(sizes.size());
+    offsets->resize(sizes.size());
+    *smallestSlot = std::numeric_limits<uint32_t>::max();
+    uint32_t layer = 0, x = 0, shelfY = 0, shelfHeight = 0;
+    for(uint32_t o = 0; o < order.size(); o++)
+    {
+        uint32_t i = order[o];
+        if(blockAligned)
+            x = (x + slots[i].width - 1) / slots[i].width * slots[i].width;
+        if(x + slots[i].width > layerSize->width)
+        {
+            shelfY += shelfHeight;
+            x = 0;
+            shelfHeight = 0;
+        }
+        if(shelfY + slots[i].height > layerSize->height)
+        {
+            layer++;
+            shelfY = 0;
+            x = 0;
+            shelfHeight = 0;
+        }
+        (*offsets)[i] = {(int32_t)x, (int32_t)shelfY};
+        (*placed)[i].layer = layer;
+        (*placed)[i].uvRect = glm::vec4((float)sizes[i].width / layerSize->width, (float)sizes[i].height / layerSize->height,
+                                        (float)x / layerSize->width, (float)shelfY / layerSize->height);
+        //An image alone in its layer keeps every mip
+        if(slots[i].width != layerSize->width || slots[i].height != layerSize->height)
+            *smallestSlot = std::min(*smallestSlot, std::min(slots[i].width, slots[i].height));
+        x += slots[i].width;
+        shelfHeight = std::max(shelfHeight, slots[i].height);
+    }
+    return layer + 1;
+}
+
+//Bytes for a layer with this many mips
+static uint64_t layerBytes(VkFormat format, uint32_t width, uint32_t height, uint32_t levels)
+{
+    uint64_t bytes = 0;
+    for(uint32_t i = 0; i < levels; i++)
+    {
+        uint32_t levelWidth = std::max(1u, width >> i);
+        uint32_t levelHeight = std::max(1u, height >> i);
+        if(format == VK_FORMAT_R32G32B32_SFLOAT)
+            bytes += (uint64_t)levelWidth * levelHeight * sizeof(float) * 3;
+        else
+            bytes += (uint64_t)(levelWidth + 3) / 4 * ((levelHeight + 3) / 4) * (format == VK_FORMAT_BC3_UNORM_BLOCK ? 16 : 8);
+    }
+    return bytes;
+}
+
+uint64_t Texture::bytesWithout(uint32_t dropMips) const
 {
-    std::vector<float> loadedImages;
-    std::vector<int> widths(filenames.size());
-    std::vector<int> heights(filenames.size());
-    int totalSize = 0;
-    for(int j = 0; j < filenames.size(); j++)
+    uint32_t fullLevels = mipLevels + droppedMips;
+    dropMips = std::min(dropMips, fullLevels - 1);
+    return layerCount * layerBytes(format, std::max(1u, fullExtent.width >> dropMips), std::max(1u, fullExtent.height >> dropMips),
+                                   fullLevels - dropMips);
+}
+
+//Every image block compressed with a full mip chain through the KTX2 cache, then packed into layers
+//Images with fewer mips than the array repeat their own last level in the levels they don't have
+bool Texture::compressLayers(std::vector<std::string> filenames, VkFormat *format, uint32_t *mipLevels,
+                             VkExtent3D *extent, std::vector<unsigned char> *data, std::vector<VkBufferImageCopy> *bufferCopyRegions)
+{
+    //Images encode on the worker pool, a cache miss is far slower than a hit
+    std::vector<Ktx2Image> images(filenames.size());
+    std::vector<TextureReport> reports(filenames.size());
+    std::vector<char> compressed(filenames.size());
+    workerPool.parallelFor(filenames.size(), [&](uint32_t i)
+    {
+        compressed[i] = compressTexture(filenames[i], BLOCK_AUTO, textureCacheDirectory, &images[i], &reports[i]);
+    });
+    bool alpha = false;
+    for(uint32_t i = 0; i < filenames.size(); i++)
     {
-        int width,height,channels;
-        unsigned char *preloadedImage = stbi_load(filenames[j].c_str(),&width,&height,&channels,STBI_rgb);
-        widths[j] = width;
-        heights[j] = height;
-        for(int i = 0; i < width * height * 3; i++)
+        if(!compressed[i])
+            return false;
+        reports[i].print();
+        alpha = alpha || images[i].format == VK_FORMAT_BC3_UNORM_BLOCK;
+    }
+    //One format for the whole array, images without alpha are redone as BC3 if any image has it
+    if(alpha)
+    {
+        workerPool.parallelFor(filenames.size(), [&](uint32_t i)
+        {
+            if(images[i].format != VK_FORMAT_BC3_UNORM_BLOCK)
+                compressed[i] = compressTexture(filenames[i], BLOCK_BC3, textureCacheDirectory, &images[i], &reports[i]);
+        });
+        for(uint32_t i = 0; i < filenames.size(); i++)
         {
-            loadedImages.push_back((float) preloadedImage[i]/255);
+            if(!compressed[i])
+                return false;
         }
-        totalSize += width*height*3;
     }
+    *format = alpha ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    uint32_t blockBytes = alpha ? 16 : 8;
 
+    std::vector<VkExtent2D> sizes(images.size());
+    for(uint32_t i = 0; i < images.size(); i++)
+    {
+        sizes[i] = {images[i].width, images[i].height};
+    }
+    VkExtent2D layerSize;
+    std::vector<VkOffset2D> offsets;
+    uint32_t smallestSlot;
+    layerCount = packLayers(sizes, true, &layerSize, &regions, &offsets, &smallestSlot);
+    *extent = {layerSize.width, layerSize.height, 1};
+    *mipLevels = mipLevelCount(layerSize.width, layerSize.height);
+    //Past this, slots shrink below a block and neighbours would share blocks
+    if(smallestSlot != std::numeric_limits<uint32_t>::max())
+        *mipLevels = std::min(*mipLevels, mipLevelCount(smallestSlot, smallestSlot) - 2);
+
+    for(uint32_t level = 0; level < *mipLevels; level++)
+    {
+        uint32_t levelWidth = std::max(1u, extent->width >> level);
+        uint32_t levelHeight = std::max(1u, extent->height >> level);
+        for(uint32_t i = 0; i < images.size(); i++)
+        {
+            uint32_t source = std::min<uint32_t>(level, images[i].levels.size() - 1);
+            uint32_t width = std::max(1u, images[i].width >> source);
+            uint32_t height = std::max(1u, images[i].height >> source);
+
+            //Buffer rows cover whole blocks, the extent may only run past the edge of the image by a partial block
+            VkBufferImageCopy region = {};
+            region.bufferOffset = data->size();
+            region.bufferRowLength = (width + 3) / 4 * 4;
+            region.bufferImageHeight = (height + 3) / 4 * 4;
+            region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            region.imageSubresource.mipLevel = level;
+            region.imageSubresource.baseArrayLayer = regions[i].layer;
+            region.imageSubresource.layerCount = 1;
+            region.imageOffset.x = offsets[i].x >> level;
+            region.imageOffset.y = offsets[i].y >> level;
+            region.imageExtent.width = std::min(region.bufferRowLength, levelWidth - region.imageOffset.x);
+            region.imageExtent.height = std::min(region.bufferImageHeight, levelHeight - region.imageOffset.y);
+            region.imageExtent.depth = 1;
+            bufferCopyRegions->push_back(region);
+
+            const std::vector<unsigned char> &blocks = images[i].levels[source];
+            data->insert(data->end(), blocks.begin(), blocks.end());
+            data->resize((data->size() + blockBytes - 1) / blockBytes * blockBytes);
+        }
+    }
 
-    VkMemoryAllocateInfo stagingMemoryAllocateInfo = {};
-    stagingMemoryAllocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
-    VkMemoryRequirements stagingMemoryRequirements;
+    uint32_t maxWidth = 0, maxHeight = 0;
+    for(uint32_t i = 0; i < images.size(); i++)
+    {
+        maxWidth = std::max(maxWidth, images[i].width);
+        maxHeight = std::max(maxHeight, images[i].height);
+    }
+    unpackedBytes = images.size() * layerBytes(*format, maxWidth, maxHeight, mipLevelCount(maxWidth, maxHeight));
+    return true;
+}
 
-    VkBuffer stagingBuffer;
-    VkDeviceMemory stagingMemory;
+bool Texture::loadTextureArray(std::vector<std::string> filenames, uint32_t dropMips)
+{
+    PROFILE_ZONE("Texture::loadTextureArray");
+    TextureArrayData prepared;
+    if(!prepareTextureArray(filenames, dropMips, &prepared))
+        return false;
+    return createTextureArray(prepared);
+}
 
-	VkBufferCreateInfo bufferCreateInfo = {};
-    bufferCreateInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-    bufferCreateInfo.size = sizeof(float) * totalSize;
-    bufferCreateInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
-    bufferCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    VkResult result = vkCreateBuffer(logicalDevice, &bufferCreateInfo, NULL, &stagingBuffer);
+bool Texture::prepareTextureArray(std::vector<std::string> filenames, uint32_t dropMips, TextureArrayData *prepared)
+{
+    PROFILE_ZONE("Texture::prepareTextureArray");
+    this->filenames = filenames;
+    format = VK_FORMAT_R32G32B32_SFLOAT;
+    mipLevels = 1;
+    droppedMips = 0;
+    VkExtent3D extent;
+    std::vector<VkBufferImageCopy> &bufferCopyRegions = prepared->bufferCopyRegions;
+    if(compressTextures && compressLayers(filenames, &format, &mipLevels, &extent, &prepared->data, &bufferCopyRegions))
+    {
+        prepared->dataSize = prepared->data.size();
+        prepared->texelBytes = format == VK_FORMAT_BC3_UNORM_BLOCK ? 16 : 8;
+    }
+    else
+    {
+        format = VK_FORMAT_R32G32B32_SFLOAT;
+        mipLevels = 1;
+        prepared->data.clear();
+        bufferCopyRegions.clear();
+
+        //Only headers for now, so staging can be sized before anything is decoded
+        std::vector<VkExtent2D> sizes(filenames.size());
+        for(uint32_t j = 0; j < filenames.size(); j++)
+        {
+            int width,height,channels;
+            if(!stbi_info(filenames[j].c_str(),&width,&height,&channels))
+            {
+                std::cout << "Texture could not be loaded: " << filenames[j] << std::endl;
+                return false;
+            }
+            sizes[j] = {(uint32_t)width, (uint32_t)height};
+        }
 
-    vkGetBufferMemoryRequirements(logicalDevice, stagingBuffer, &stagingMemoryRequirements);
-    stagingMemoryAllocateInfo.allocationSize = stagingMemoryRequirements.size;
-    stagingMemoryAllocateInfo.memoryTypeIndex = getMemoryTypeIndex(stagingMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT);
+        VkExtent2D layerSize;
+        std::vector<VkOffset2D> offsets;
+        uint32_t smallestSlot;
+        layerCount = packLayers(sizes, false, &layerSize, &regions, &offsets, &smallestSlot);
+        extent = {layerSize.width, layerSize.height, 1};
 
-    result = vkAllocateMemory(logicalDevice, &stagingMemoryAllocateInfo, NULL, &stagingMemory);
-    result = vkBindBufferMemory(logicalDevice, stagingBuffer, stagingMemory, 0);
+        VkDeviceSize offset = 0;
+        uint32_t maxWidth = 0, maxHeight = 0;
+        for(uint32_t i = 0; i < filenames.size(); i++)
+        {
+            VkBufferImageCopy bufferCopyRegion = {};
+            bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+            bufferCopyRegion.imageSubresource.mipLevel = 0;
+            bufferCopyRegion.imageSubresource.baseArrayLayer = regions[i].layer;
+            bufferCopyRegion.imageSubresource.layerCount = 1;
+            bufferCopyRegion.imageOffset.x = offsets[i].x;
+            bufferCopyRegion.imageOffset.y = offsets[i].y;
+            bufferCopyRegion.imageExtent.width = sizes[i].width;
+            bufferCopyRegion.imageExtent.height = sizes[i].height;
+            bufferCopyRegion.imageExtent.depth = 1;
+            bufferCopyRegion.bufferOffset = offset;
+            bufferCopyRegions.push_back(bufferCopyRegion);
+
+            offset += sizeof(float) * sizes[i].width * sizes[i].height * 3;
+            maxWidth = std::max(maxWidth, sizes[i].width);
+            maxHeight = std::max(maxHeight, sizes[i].height);
+        }
+        prepared->dataSize = offset;
+        prepared->texelBytes = sizeof(float) * 3;
+        unpackedBytes = filenames.size() * layerBytes(format, maxWidth, maxHeight, 1);
+    }
 
-    void* stagingMapped;
-    result = vkMapMemory(logicalDevice, stagingMemory, 0, stagingMemoryRequirements.size, 0, &stagingMapped);
-    memcpy(stagingMapped, loadedImages.data(), sizeof(float) * totalSize);
-    vkUnmapMemory(logicalDevice, stagingMemory);
+    fullExtent = extent;
+    dropLevels(dropMips, prepared);
+    return true;
+}
 
-    std::vector<VkBufferImageCopy> bufferCopyRegions;
-    int offset = 0;
-    for(int i = 0; i < filenames.size(); i++)
+void Texture::dropLevels(uint32_t dropMips, TextureArrayData *prepared)
+{
+    //Largest levels left out, each region's blocks run up to the next region's
+    uint32_t fullLevels = mipLevels + droppedMips;
+    dropMips = std::min(dropMips, fullLevels - 1);
+    if(dropMips <= droppedMips)
+        return;
+    uint32_t dropping = dropMips - droppedMips;
+    std::vector<unsigned char> kept;
+    std::vector<VkBufferImageCopy> keptRegions;
+    for(uint32_t i = 0; i < prepared->bufferCopyRegions.size(); i++)
     {
-        VkBufferImageCopy bufferCopyRegion = {};
-        bufferCopyRegion.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
-        bufferCopyRegion.imageSubresource.mipLevel = 0;
-        bufferCopyRegion.imageSubresource.baseArrayLayer = i;
-        bufferCopyRegion.imageSubresource.layerCount = 1;
-        bufferCopyRegion.imageExtent.width = widths[i];
-        bufferCopyRegion.imageExtent.height = heights[i];
-        bufferCopyRegion.imageExtent.depth = 1;
-        bufferCopyRegion.bufferOffset = offset;
-        bufferCopyRegions.push_back(bufferCopyRegion);
-
-        offset += sizeof(float) * widths[i] * heights[i] * 3;
+        VkBufferImageCopy region = prepared->bufferCopyRegions[i];
+        if(region.imageSubresource.mipLevel < dropping)
+            continue;
+        VkDeviceSize end = i + 1 < prepared->bufferCopyRegions.size() ? prepared->bufferCopyRegions[i + 1].bufferOffset
+                                                                       : prepared->data.size();
+        region.imageSubresource.mipLevel -= dropping;
+        region.bufferOffset = kept.size();
+        kept.insert(kept.end(), prepared->data.begin() + prepared->bufferCopyRegions[i].bufferOffset, prepared->data.begin() + end);
+        keptRegions.push_back(region);
     }
+    prepared->data.swap(kept);
+    prepared->bufferCopyRegions.swap(keptRegions);
+    prepared->dataSize = prepared->data.size();
+    mipLevels -= dropping;
+    droppedMips = dropMips;
+}
 
+bool Texture::createTextureArray(TextureArrayData &prepared)
+{
+    PROFILE_ZONE("Texture::createTextureArray");
+    VkExtent3D extent = {std::max(1u, fullExtent.width >> droppedMips), std::max(1u, fullExtent.height >> droppedMips), 1};
+    packedBytes = layerCount * layerBytes(format, extent.width, extent.height, mipLevels);
+    std::vector<VkBufferImageCopy> &bufferCopyRegions = prepared.bufferCopyRegions;
 
     VkImageCreateInfo textureCreateInfo = {};
     textureCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
     textureCreateInfo.imageType = VK_IMAGE_TYPE_2D;
-    textureCreateInfo.format = VK_FORMAT_R32G32B32_SFLOAT;
-    textureCreateInfo.extent = {*std::max_element(widths.begin(), widths.end()),
-                                *std::max_element(heights.begin(), heights.end()), 1};
-    textureCreateInfo.mipLevels = 1;
-    textureCreateInfo.arrayLayers = filenames.size();
+    textureCreateInfo.format = format;
+    textureCreateInfo.extent = extent;
+    textureCreateInfo.mipLevels = mipLevels;
+    textureCreateInfo.arrayLayers = layerCount;
     textureCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
     textureCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
     textureCreateInfo.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
     textureCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
-    textureCreateInfo.initialLayout = VK_IMAGE_LAYOUT_PREINITIALIZED;
+    textureCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
 
-    result = vkCreateImage(logicalDevice, &textureCreateInfo, NULL, &textureImage);
+    VkResult result = vkCreateImage(logicalDevice, &textureCreateInfo, NULL, &textureImage);
 
     VkMemoryRequirements textureMemoryRequirements = {};
     vkGetImageMemoryRequirements(logicalDevice, textureImage, &textureMemoryRequirements);
@@ -247,85 +485,88 @@ bool Texture::loadTextureArray(std::vector<std::string> filenames)
     textureImageAllocateInfo.memoryTypeIndex = getMemoryTypeIndex(textureMemoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
     result = vkAllocateMemory(logicalDevice, &textureImageAllocateInfo, NULL, &textureImageMemory);
+    if(result != VK_SUCCESS)
+    {
+        vkDestroyImage(logicalDevice, textureImage, NULL);
+        textureImage = VK_NULL_HANDLE;
+        textureImageMemory = VK_NULL_HANDLE;
+        //Smaller is better than nothing
+        if(result == VK_ERROR_OUT_OF_DEVICE_MEMORY && mipLevels > 1)
+        {
+            std::cout << "Texture array out of device memory, trying without " << droppedMips + 1 << " mips" << std::endl;
+            dropLevels(droppedMips + 1, &prepared);
+            return createTextureArray(prepared);
+        }
+        std::cout << "Texture array memory allocation failed (" << result << ")" << std::endl;
+        return false;
+    }
     result = vkBindImageMemory(logicalDevice, textureImage, textureImageMemory, 0);
 
-
-	VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
-    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-    commandBufferAllocateInfo.commandPool = commandPool;
-    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-    commandBufferAllocateInfo.commandBufferCount = 1;
-
-    VkCommandBuffer copyCmd;
-    vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocateInfo, &copyCmd);
-
-	VkCommandBufferBeginInfo cmdBufferBeginInfo = {};
-    cmdBufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
-    vkBeginCommandBuffer(copyCmd, &cmdBufferBeginInfo);
-
+    //Copied on the transfer queue and handed to graphics for sampling, nothing here waits for it
     VkImageSubresourceRange subresourceRange = {};
     subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     subresourceRange.baseMipLevel = 0;
-    subresourceRange.levelCount = 1;
-    subresourceRange.layerCount = filenames.size();
-    setImageLayout(copyCmd, textureImage, VK_IMAGE_ASPECT_COLOR_BIT,
-                   VK_IMAGE_LAYOUT_PREINITIALIZED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                   subresourceRange);
-
-    vkCmdCopyBufferToImage(copyCmd, stagingBuffer, textureImage,
-                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
-                           bufferCopyRegions.size(), bufferCopyRegions.data());
-
-    setImageLayout(copyCmd, textureImage, VK_IMAGE_ASPECT_COLOR_BIT,
-                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-                   subresourceRange);
-
-    vkEndCommandBuffer(copyCmd);
-	VkSubmitInfo submitInfo = {};
-	submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
-	submitInfo.commandBufferCount = 1;
-    submitInfo.pCommandBuffers = &copyCmd;
-    vkQueueSubmit(presentQueue, 1, &submitInfo, VK_NULL_HANDLE);
-    vkQueueWaitIdle(presentQueue);
-    vkFreeCommandBuffers(logicalDevice, commandPool, 1, &copyCmd);
-
+    subresourceRange.levelCount = mipLevels;
+    subresourceRange.layerCount = layerCount;
+    if(!prepared.data.empty())
+    {
+        upload = uploadService.uploadImage(textureImage, subresourceRange, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                           prepared.data.data(), prepared.dataSize, prepared.texelBytes, bufferCopyRegions);
+        if(upload.service == NULL)
+            return false;
+    }
+    else
+    {
+        unsigned char *staging;
+        upload = uploadService.reserveImage(textureImage, subresourceRange, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+                                            prepared.dataSize, prepared.texelBytes, bufferCopyRegions, &staging);
+        if(upload.service == NULL)
+            return false;
+        //Each image decodes on the pool straight into its own slice, the 8 bit copy is freed as soon as it is converted
+        std::vector<char> decoded(filenames.size(), 0); //Not vector<bool>, every thread writes its own element
+        workerPool.parallelFor(filenames.size(), [&](uint32_t i)
+        {
+            const VkBufferImageCopy &region = bufferCopyRegions[i];
+            float *slice = (float*)(staging + region.bufferOffset);
+            size_t count = (size_t)region.imageExtent.width * region.imageExtent.height * 3;
+            int width,height,channels;
+            unsigned char *preloadedImage = stbi_load(filenames[i].c_str(),&width,&height,&channels,STBI_rgb);
+            if(preloadedImage == NULL || (uint32_t)width != region.imageExtent.width || (uint32_t)height != region.imageExtent.height)
+            {
+                std::cout << "Texture could not be decoded: " << filenames[i] << std::endl;
+                //Still copied once reserved, so it is not left as whatever the ring held
+                memset(slice, 0, count * sizeof(float));
+            }
+            else
+            {
+                unormToFloat(preloadedImage, slice, count);
+                decoded[i] = 1;
+            }
+            stbi_image_free(preloadedImage);
+        });
+        if(std::find(decoded.begin(), decoded.end(), 0) != decoded.end())
+            return false;
+    }
 
     VkImageViewCreateInfo textureImageViewCreateInfo = {};
     textureImageViewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
     textureImageViewCreateInfo.image = textureImage;
     textureImageViewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D_ARRAY;
-    textureImageViewCreateInfo.format = VK_FORMAT_R32G32B32_SFLOAT;
+    textureImageViewCreateInfo.format = format;
     textureImageViewCreateInfo.components = { VK_COMPONENT_SWIZZLE_R,
                                               VK_COMPONENT_SWIZZLE_G,
                                               VK_COMPONENT_SWIZZLE_B,
                                               VK_COMPONENT_SWIZZLE_A };
     textureImageViewCreateInfo.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
     textureImageViewCreateInfo.subresourceRange.baseMipLevel = 0;
-    textureImageViewCreateInfo.subresourceRange.levelCount = 1;
+    textureImageViewCreateInfo.subresourceRange.levelCount = mipLevels;
     textureImageViewCreateInfo.subresourceRange.baseArrayLayer = 0;
-    textureImageViewCreateInfo.subresourceRange.layerCount = filenames.size();
+    textureImageViewCreateInfo.subresourceRange.layerCount = layerCount;
 
     result = vkCreateImageView(logicalDevice, &textureImageViewCreateInfo, NULL, &textureView);
 
-    VkSamplerCreateInfo samplerCreateInfo = {};
-    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
-    samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
-    samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
-    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
-    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
-    samplerCreateInfo.mipLodBias = 0;
-    samplerCreateInfo.anisotropyEnable = VK_FALSE;
-    samplerCreateInfo.minLod = 0;
-    samplerCreateInfo.maxLod = 5;
-    samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
-    samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
-
-    result = vkCreateSampler(logicalDevice, &samplerCreateInfo, NULL, &sampler);
-
-    vkFreeMemory(logicalDevice, stagingMemory, NULL);
-    vkDestroyBuffer(logicalDevice, stagingBuffer, NULL);
+    if(!samplerCache.get(textureSamplerCreateInfo(), &sampler))
+        return false;
 
     return true;
 }
@@ -3,19 +3,65 @@
 
 #define VK_NO_PROTOTYPES
 #include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
 #include <vector>
 #include <string>
 
+#include "uploadService.h"
+
+//Where one image of an array ended up
+struct TextureRegion
+{
+    uint32_t layer;
+    glm::vec4 uvRect; //xy scale, zw offset within the layer
+};
+
+//What a texture array is uploaded from, worked out before anything touches Vulkan
+struct TextureArrayData
+{
+    std::vector<unsigned char> data; //Empty when images are decoded straight into staging memory
+    VkDeviceSize dataSize = 0;
+    uint32_t texelBytes = 0;
+    std::vector<VkBufferImageCopy> bufferCopyRegions;
+};
+
+//What every Texture is sampled with
+VkSamplerCreateInfo textureSamplerCreateInfo();
+
 struct Texture
 {
-    VkImage textureImage;
-    VkDeviceMemory textureImageMemory;
-    VkImageView textureView;
-    VkSampler sampler;
+    VkImage textureImage = VK_NULL_HANDLE;
+    VkDeviceMemory textureImageMemory = VK_NULL_HANDLE;
+    VkImageView textureView = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE; //Shared through the sampler cache
+    UploadTicket upload; //Sample only once this is ready
+
+    //Arrays pack several images into each layer, one region per filename
+    std::vector<TextureRegion> regions;
+    uint32_t layerCount = 1;
+    uint64_t packedBytes = 0; //Mips that are resident
+    uint64_t unpackedBytes = 0; //Every image in its own layer the size of the largest
+
+    //What it was loaded from and at, for the residency manager to reload it with more or fewer mips
+    std::vector<std::string> filenames;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    VkExtent3D fullExtent = {0, 0, 0};
+    uint32_t mipLevels = 1; //Resident, the top droppedMips of the full chain are left out
+    uint32_t droppedMips = 0;
 
     void destroy();
     bool loadTexture(std::string filename);
-    bool loadTextureArray(std::vector<std::string> filenames);
+    //dropMips leaves the largest levels out, more are dropped if device memory runs out
+    bool loadTextureArray(std::vector<std::string> filenames, uint32_t dropMips = 0);
+    //loadTextureArray in two halves. Preparing only touches this texture and the pool, so it can run on a worker,
+    //creating and uploading is main thread only
+    bool prepareTextureArray(std::vector<std::string> filenames, uint32_t dropMips, TextureArrayData *prepared);
+    bool createTextureArray(TextureArrayData &prepared);
+    void dropLevels(uint32_t dropMips, TextureArrayData *prepared);
+    //Device memory the image would take with dropMips left out
+    uint64_t bytesWithout(uint32_t dropMips) const;
+    bool compressLayers(std::vector<std::string> filenames, VkFormat *format, uint32_t *mipLevels,
+                        VkExtent3D *extent, std::vector<unsigned char> *data, std::vector<VkBufferImageCopy> *bufferCopyRegions);
 };
 
 #endif // TEXTURE_H_INCLUDED
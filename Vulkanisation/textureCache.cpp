@@ -0,0 +1,127 @@
+#include "textureCache.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdlib>
+#include <climits>
+
+#include "cpuProfiler.h"
+
+static bool readFile(std::string path, std::string *contents)
+{
+    std::ifstream stream(path.c_str(), std::ios::binary);
+    if(!stream.is_open())
+        return false;
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    *contents = buffer.str();
+    return true;
+}
+
+//FNV-1a
+static uint64_t hashBytes(const std::string &data, uint64_t hash = 14695981039346656037ULL)
+{
+    for(size_t i = 0; i < data.size(); i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static std::string canonicalPath(std::string path)
+{
+#ifdef _WIN32
+    char resolved[_MAX_PATH];
+    if(_fullpath(resolved, path.c_str(), _MAX_PATH) != NULL)
+        return resolved;
+#else
+    char resolved[PATH_MAX];
+    if(realpath(path.c_str(), resolved) != NULL)
+        return resolved;
+#endif
+    return path;
+}
+
+std::string TextureCache::contentKey(std::string filename)
+{
+    std::string path = canonicalPath(filename);
+    std::map<std::string, std::string>::iterator known = contentKeys.find(path);
+    if(known != contentKeys.end())
+        return known->second;
+
+    //Unreadable files keep their path, loading them fails the same way it always did
+    std::string contents;
+    std::string key = "missing:" + path;
+    if(readFile(path, &contents))
+    {
+        char hash[24];
+        snprintf(hash, sizeof(hash), "%016llx", (unsigned long long)hashBytes(contents));
+        key = hash;
+    }
+    contentKeys[path] = key;
+    return key;
+}
+
+Texture *TextureCache::acquire(std::vector<std::string> filenames)
+{
+    PROFILE_ZONE("TextureCache::acquire");
+    std::string key;
+    for(uint32_t i = 0; i < filenames.size(); i++)
+    {
+        key += contentKey(filenames[i]) + "|";
+    }
+
+    std::map<std::string, Entry>::iterator found = entries.find(key);
+    if(found != entries.end())
+    {
+        hits++;
+        found->second.references++;
+        return &found->second.texture;
+    }
+
+    misses++;
+    Entry &entry = entries[key];
+    if(!entry.texture.loadTextureArray(filenames))
+    {
+        std::cout << "Texture array could not be loaded" << std::endl;
+        entry.texture.destroy();
+        entries.erase(key);
+        return NULL;
+    }
+    entry.references = 1;
+    return &entry.texture;
+}
+
+void TextureCache::release(Texture *texture)
+{
+    for(std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        if(&it->second.texture != texture)
+            continue;
+        if(--it->second.references == 0)
+        {
+            it->second.texture.destroy();
+            entries.erase(it);
+        }
+        return;
+    }
+}
+
+void TextureCache::printStats() const
+{
+    std::cout << "Texture cache: " << hits << " hits, " << misses << " misses, "
+              << entries.size() << " arrays resident" << std::endl;
+}
+
+void TextureCache::destroy()
+{
+    for(std::map<std::string, Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+    {
+        it->second.texture.destroy();
+    }
+    entries.clear();
+    contentKeys.clear();
+}
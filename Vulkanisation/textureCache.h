@@ -0,0 +1,36 @@
+#ifndef TEXTURECACHE_H_INCLUDED
+#define TEXTURECACHE_H_INCLUDED
+
+#include <vector>
+#include <string>
+#include <map>
+
+#include "texture.h"
+
+//Texture arrays shared between every mesh asking for the same images
+//Keyed by the contents of each file, so one image reached through two paths or copied to two places is one entry
+//Handles are reference counted, the array is destroyed when the last mesh releases it
+struct TextureCache
+{
+    struct Entry
+    {
+        Texture texture;
+        uint32_t references = 0;
+    };
+
+    std::map<std::string, Entry> entries;
+    std::map<std::string, std::string> contentKeys; //Canonical path to content hash, each file is only hashed once
+    uint32_t hits = 0;
+    uint32_t misses = 0;
+
+    //Loads on a miss, NULL if the array could not be loaded
+    Texture *acquire(std::vector<std::string> filenames);
+    void release(Texture *texture);
+    void printStats() const;
+    //Whatever is still referenced
+    void destroy();
+
+    std::string contentKey(std::string filename);
+};
+
+#endif // TEXTURECACHE_H_INCLUDED
@@ -0,0 +1,597 @@
+#include "textureCompression.h"
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <cctype>
+#include <sys/stat.h>
+#include <dirent.h>
+#ifdef _WIN32
+#include <direct.h>
+#endif
+#include <stb_image.h>
+
+#include "cpuProfiler.h"
+
+//Bumped whenever the encoder's output changes, so older cache files are no longer picked up
+static const uint64_t ENCODER_VERSION = 1;
+
+static bool readFile(std::string path, std::string *contents)
+{
+    std::ifstream stream(path.c_str(), std::ios::binary);
+    if(!stream.is_open())
+        return false;
+    std::stringstream buffer;
+    buffer << stream.rdbuf();
+    *contents = buffer.str();
+    return true;
+}
+
+//FNV-1a
+static uint64_t hashBytes(const std::string &data, uint64_t hash = 14695981039346656037ULL)
+{
+    for(size_t i = 0; i < data.size(); i++)
+    {
+        hash ^= (unsigned char)data[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint16_t pack565(const float *colour)
+{
+    int r = std::min(31, std::max(0, (int)floorf(colour[0] * 31.0f / 255.0f + 0.5f)));
+    int g = std::min(63, std::max(0, (int)floorf(colour[1] * 63.0f / 255.0f + 0.5f)));
+    int b = std::min(31, std::max(0, (int)floorf(colour[2] * 31.0f / 255.0f + 0.5f)));
+    return (r << 11) | (g << 5) | b;
+}
+
+static void unpack565(uint16_t packed, int *colour)
+{
+    int r = packed >> 11;
+    int g = (packed >> 5) & 63;
+    int b = packed & 31;
+    colour[0] = (r << 3) | (r >> 2);
+    colour[1] = (g << 2) | (g >> 4);
+    colour[2] = (b << 3) | (b >> 2);
+}
+
+//Four colour mode needs c0 > c1, swapping the endpoints only changes the indices
+//Returns the squared error of the block
+static uint32_t fitColourIndices(const unsigned char *rgba, uint16_t *c0, uint16_t *c1, uint32_t *indices)
+{
+    if(*c0 < *c1)
+        std::swap(*c0, *c1);
+
+    int palette[4][3];
+    unpack565(*c0, palette[0]);
+    unpack565(*c1, palette[1]);
+    for(uint32_t c = 0; c < 3; c++)
+    {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    uint32_t candidates = *c0 == *c1 ? 1 : 4;
+
+    *indices = 0;
+    uint32_t error = 0;
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        uint32_t best = 0;
+        uint32_t bestDistance = 0xFFFFFFFF;
+        for(uint32_t k = 0; k < candidates; k++)
+        {
+            uint32_t distance = 0;
+            for(uint32_t c = 0; c < 3; c++)
+            {
+                int d = rgba[i * 4 + c] - palette[k][c];
+                distance += d * d;
+            }
+            if(distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = k;
+            }
+        }
+        *indices |= best << (i * 2);
+        error += bestDistance;
+    }
+    return error;
+}
+
+//Endpoints along the principal axis of the block's colours, then one least squares pass for the chosen indices
+static void encodeColourBlock(const unsigned char *rgba, unsigned char *out)
+{
+    float mean[3] = {0, 0, 0};
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        for(uint32_t c = 0; c < 3; c++)
+        {
+            mean[c] += rgba[i * 4 + c] / 16.0f;
+        }
+    }
+    float covariance[3][3] = {};
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        float d[3];
+        for(uint32_t c = 0; c < 3; c++)
+        {
+            d[c] = rgba[i * 4 + c] - mean[c];
+        }
+        for(uint32_t a = 0; a < 3; a++)
+        {
+            for(uint32_t b = 0; b < 3; b++)
+            {
+                covariance[a][b] += d[a] * d[b];
+            }
+        }
+    }
+    float axis[3] = {1, 1, 1};
+    for(uint32_t iteration = 0; iteration < 8; iteration++)
+    {
+        float next[3];
+        float largest = 0;
+        for(uint32_t a = 0; a < 3; a++)
+        {
+            next[a] = covariance[a][0] * axis[0] + covariance[a][1] * axis[1] + covariance[a][2] * axis[2];
+            largest = std::max(largest, fabsf(next[a]));
+        }
+        if(largest == 0)
+            break;
+        for(uint32_t a = 0; a < 3; a++)
+        {
+            axis[a] = next[a] / largest;
+        }
+    }
+    float length = sqrtf(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+    for(uint32_t a = 0; a < 3; a++)
+    {
+        axis[a] /= length;
+    }
+
+    float lowest = 0, highest = 0;
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        float t = 0;
+        for(uint32_t c = 0; c < 3; c++)
+        {
+            t += (rgba[i * 4 + c] - mean[c]) * axis[c];
+        }
+        lowest = std::min(lowest, t);
+        highest = std::max(highest, t);
+    }
+    float end0[3], end1[3];
+    for(uint32_t c = 0; c < 3; c++)
+    {
+        end0[c] = mean[c] + axis[c] * highest;
+        end1[c] = mean[c] + axis[c] * lowest;
+    }
+    uint16_t c0 = pack565(end0);
+    uint16_t c1 = pack565(end1);
+    uint32_t indices;
+    uint32_t error = fitColourIndices(rgba, &c0, &c1, &indices);
+
+    //Weight of c0 for each index
+    if(c0 != c1)
+    {
+        const float weights[4] = {1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f};
+        float aa = 0, ab = 0, bb = 0;
+        float ax[3] = {0, 0, 0}, bx[3] = {0, 0, 0};
+        for(uint32_t i = 0; i < 16; i++)
+        {
+            float a = weights[(indices >> (i * 2)) & 3];
+            float b = 1.0f - a;
+            aa += a * a;
+            ab += a * b;
+            bb += b * b;
+            for(uint32_t c = 0; c < 3; c++)
+            {
+                ax[c] += a * rgba[i * 4 + c];
+                bx[c] += b * rgba[i * 4 + c];
+            }
+        }
+        float determinant = aa * bb - ab * ab;
+        if(fabsf(determinant) > 1e-6f)
+        {
+            for(uint32_t c = 0; c < 3; c++)
+            {
+                end0[c] = (ax[c] * bb - bx[c] * ab) / determinant;
+                end1[c] = (bx[c] * aa - ax[c] * ab) / determinant;
+            }
+            uint16_t refined0 = pack565(end0);
+            uint16_t refined1 = pack565(end1);
+            uint32_t refinedIndices;
+            uint32_t refinedError = fitColourIndices(rgba, &refined0, &refined1, &refinedIndices);
+            if(refinedError < error)
+            {
+                c0 = refined0;
+                c1 = refined1;
+                indices = refinedIndices;
+            }
+        }
+    }
+
+    out[0] = c0 & 0xFF;
+    out[1] = c0 >> 8;
+    out[2] = c1 & 0xFF;
+    out[3] = c1 >> 8;
+    for(uint32_t i = 0; i < 4; i++)
+    {
+        out[4 + i] = (indices >> (i * 8)) & 0xFF;
+    }
+}
+
+//Eight value mode, a0 > a1
+static void encodeAlphaBlock(const unsigned char *rgba, unsigned char *out)
+{
+    int lowest = 255, highest = 0;
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        lowest = std::min(lowest, (int)rgba[i * 4 + 3]);
+        highest = std::max(highest, (int)rgba[i * 4 + 3]);
+    }
+    int palette[8];
+    palette[0] = highest;
+    palette[1] = lowest;
+    for(uint32_t i = 1; i < 7; i++)
+    {
+        palette[i + 1] = ((7 - i) * highest + i * lowest) / 7;
+    }
+    uint32_t candidates = highest == lowest ? 1 : 8;
+
+    uint64_t bits = 0;
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        uint64_t best = 0;
+        int bestDistance = 256;
+        for(uint32_t k = 0; k < candidates; k++)
+        {
+            int distance = abs(rgba[i * 4 + 3] - palette[k]);
+            if(distance < bestDistance)
+            {
+                bestDistance = distance;
+                best = k;
+            }
+        }
+        bits |= best << (i * 3);
+    }
+    out[0] = highest;
+    out[1] = lowest;
+    for(uint32_t i = 0; i < 6; i++)
+    {
+        out[2 + i] = (bits >> (i * 8)) & 0xFF;
+    }
+}
+
+static void decodeColourBlock(const unsigned char *block, unsigned char *rgba, bool alwaysFourColour)
+{
+    uint16_t c0 = block[0] | (block[1] << 8);
+    uint16_t c1 = block[2] | (block[3] << 8);
+    uint32_t indices = block[4] | (block[5] << 8) | (block[6] << 16) | ((uint32_t)block[7] << 24);
+    int palette[4][4];
+    unpack565(c0, palette[0]);
+    unpack565(c1, palette[1]);
+    palette[0][3] = palette[1][3] = palette[2][3] = palette[3][3] = 255;
+    for(uint32_t c = 0; c < 3; c++)
+    {
+        if(c0 > c1 || alwaysFourColour)
+        {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        else
+        {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    if(c0 <= c1 && !alwaysFourColour)
+        palette[3][3] = 0;
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        uint32_t index = (indices >> (i * 2)) & 3;
+        for(uint32_t c = 0; c < 4; c++)
+        {
+            rgba[i * 4 + c] = palette[index][c];
+        }
+    }
+}
+
+void encodeBC1Block(const unsigned char *rgba, unsigned char *out)
+{
+    encodeColourBlock(rgba, out);
+}
+
+void encodeBC3Block(const unsigned char *rgba, unsigned char *out)
+{
+    encodeAlphaBlock(rgba, out);
+    encodeColourBlock(rgba, out + 8);
+}
+
+void decodeBC1Block(const unsigned char *block, unsigned char *rgba)
+{
+    decodeColourBlock(block, rgba, false);
+}
+
+void decodeBC3Block(const unsigned char *block, unsigned char *rgba)
+{
+    decodeColourBlock(block + 8, rgba, true);
+    int palette[8];
+    palette[0] = block[0];
+    palette[1] = block[1];
+    for(uint32_t i = 1; i < 7; i++)
+    {
+        if(palette[0] > palette[1])
+            palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7;
+        else if(i < 5)
+            palette[i + 1] = ((5 - i) * palette[0] + i * palette[1]) / 5;
+        else
+            palette[i + 1] = i == 5 ? 0 : 255;
+    }
+    uint64_t bits = 0;
+    for(uint32_t i = 0; i < 6; i++)
+    {
+        bits |= (uint64_t)block[2 + i] << (i * 8);
+    }
+    for(uint32_t i = 0; i < 16; i++)
+    {
+        rgba[i * 4 + 3] = palette[(bits >> (i * 3)) & 7];
+    }
+}
+
+uint32_t mipLevelCount(uint32_t width, uint32_t height)
+{
+    uint32_t levels = 1;
+    while((width >> levels) > 0 || (height >> levels) > 0)
+    {
+        levels++;
+    }
+    return levels;
+}
+
+std::vector<std::vector<unsigned char> > generateMips(const unsigned char *rgba, uint32_t width, uint32_t height)
+{
+    std::vector<std::vector<unsigned char> > levels(1);
+    levels[0].assign(rgba, rgba + width * height * 4);
+    while(width > 1 || height > 1)
+    {
+        uint32_t nextWidth = std::max(1u, width / 2);
+        uint32_t nextHeight = std::max(1u, height / 2);
+        const std::vector<unsigned char> &source = levels.back();
+        std::vector<unsigned char> next(nextWidth * nextHeight * 4);
+        for(uint32_t y = 0; y < nextHeight; y++)
+        {
+            uint32_t y0 = std::min(y * 2, height - 1);
+            uint32_t y1 = std::min(y * 2 + 1, height - 1);
+            for(uint32_t x = 0; x < nextWidth; x++)
+            {
+                uint32_t x0 = std::min(x * 2, width - 1);
+                uint32_t x1 = std::min(x * 2 + 1, width - 1);
+                for(uint32_t c = 0; c < 4; c++)
+                {
+                    uint32_t sum = source[(y0 * width + x0) * 4 + c] + source[(y0 * width + x1) * 4 + c] +
+                                   source[(y1 * width + x0) * 4 + c] + source[(y1 * width + x1) * 4 + c];
+                    next[(y * nextWidth + x) * 4 + c] = (sum + 2) / 4;
+                }
+            }
+        }
+        levels.push_back(next);
+        width = nextWidth;
+        height = nextHeight;
+    }
+    return levels;
+}
+
+std::vector<unsigned char> compressImage(BlockFormat format, const unsigned char *rgba, uint32_t width, uint32_t height)
+{
+    uint32_t blockBytes = format == BLOCK_BC3 ? 16 : 8;
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    std::vector<unsigned char> out(blocksX * blocksY * blockBytes);
+    unsigned char texels[64];
+    for(uint32_t by = 0; by < blocksY; by++)
+    {
+        for(uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            for(uint32_t i = 0; i < 16; i++)
+            {
+                uint32_t x = std::min(bx * 4 + i % 4, width - 1);
+                uint32_t y = std::min(by * 4 + i / 4, height - 1);
+                memcpy(&texels[i * 4], &rgba[(y * width + x) * 4], 4);
+            }
+            unsigned char *block = &out[(by * blocksX + bx) * blockBytes];
+            if(format == BLOCK_BC3)
+                encodeBC3Block(texels, block);
+            else
+                encodeBC1Block(texels, block);
+        }
+    }
+    return out;
+}
+
+//Peak signal to noise ratio of the decoded top level, alpha only counts for BC3
+static double measurePsnr(BlockFormat format, const std::vector<unsigned char> &compressed, const unsigned char *rgba,
+                          uint32_t width, uint32_t height)
+{
+    uint32_t blockBytes = format == BLOCK_BC3 ? 16 : 8;
+    uint32_t channels = format == BLOCK_BC3 ? 4 : 3;
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    double squaredError = 0;
+    unsigned char texels[64];
+    for(uint32_t by = 0; by < blocksY; by++)
+    {
+        for(uint32_t bx = 0; bx < blocksX; bx++)
+        {
+            const unsigned char *block = &compressed[(by * blocksX + bx) * blockBytes];
+            if(format == BLOCK_BC3)
+                decodeBC3Block(block, texels);
+            else
+                decodeBC1Block(block, texels);
+            for(uint32_t i = 0; i < 16; i++)
+            {
+                uint32_t x = bx * 4 + i % 4;
+                uint32_t y = by * 4 + i / 4;
+                if(x >= width || y >= height)
+                    continue;
+                for(uint32_t c = 0; c < channels; c++)
+                {
+                    double d = (double)texels[i * 4 + c] - rgba[(y * width + x) * 4 + c];
+                    squaredError += d * d;
+                }
+            }
+        }
+    }
+    double meanError = squaredError / ((double)width * height * channels);
+    if(meanError == 0)
+        return 99.0;
+    return 10.0 * log10(255.0 * 255.0 / meanError);
+}
+
+static void fillReport(const Ktx2Image &image, TextureReport *report)
+{
+    report->format = image.format;
+    report->width = image.width;
+    report->height = image.height;
+    report->levels = image.levels.size();
+    report->compressedBytes = 0;
+    report->rgbaBytes = 0;
+    for(uint32_t i = 0; i < image.levels.size(); i++)
+    {
+        report->compressedBytes += image.levels[i].size();
+        report->rgbaBytes += (uint64_t)std::max(1u, image.width >> i) * std::max(1u, image.height >> i) * 4;
+    }
+    std::map<std::string, std::string>::const_iterator psnr = image.keyValues.find("Vulkanisation.psnr");
+    report->psnr = psnr != image.keyValues.end() ? atof(psnr->second.c_str()) : 0;
+}
+
+void TextureReport::print() const
+{
+    std::cout << "Texture " << path << ": " << (format == VK_FORMAT_BC3_UNORM_BLOCK ? "BC3 " : "BC1 ")
+              << width << "x" << height << ", " << levels << " mips, "
+              << compressedBytes / 1024 << " KiB (RGBA8 " << rgbaBytes / 1024 << " KiB, "
+              << std::fixed << std::setprecision(1) << (double)rgbaBytes / std::max<uint64_t>(1, compressedBytes)
+              << "x smaller), PSNR " << std::setprecision(2) << psnr << " dB, ";
+    if(cached)
+        std::cout << "cached";
+    else
+        std::cout << "encoded in " << std::setprecision(1) << encodeMs << " ms";
+    std::cout << std::defaultfloat << std::endl;
+}
+
+bool compressTexture(std::string path, BlockFormat format, std::string cacheDirectory, Ktx2Image *image, TextureReport *report)
+{
+    PROFILE_ZONE("compressTexture");
+    std::string source;
+    if(!readFile(path, &source))
+    {
+        std::cout << "Texture could not be read: " << path << std::endl;
+        return false;
+    }
+#ifdef _WIN32
+    _mkdir(cacheDirectory.c_str());
+#else
+    mkdir(cacheDirectory.c_str(), 0755);
+#endif
+
+    //Keyed by content, so the same image under two paths shares an entry
+    std::ostringstream base;
+    size_t slash = path.find_last_of("/\\");
+    base << cacheDirectory << "/" << (slash == std::string::npos ? path : path.substr(slash + 1)) << "."
+         << std::hex << (hashBytes(source) ^ ENCODER_VERSION);
+    std::string bc1Path = base.str() + ".bc1.ktx2";
+    std::string bc3Path = base.str() + ".bc3.ktx2";
+
+    *report = TextureReport();
+    report->path = path;
+    if((format != BLOCK_BC3 && readKtx2(bc1Path, image)) || (format != BLOCK_BC1 && readKtx2(bc3Path, image)))
+    {
+        fillReport(*image, report);
+        report->cached = true;
+        return true;
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    int width, height, channels;
+    unsigned char *pixels = stbi_load_from_memory((const stbi_uc*)source.data(), source.size(), &width, &height, &channels, STBI_rgb_alpha);
+    if(pixels == NULL)
+    {
+        std::cout << "Texture could not be decoded: " << path << std::endl;
+        return false;
+    }
+    if(format == BLOCK_AUTO)
+    {
+        format = BLOCK_BC1;
+        for(int i = 0; i < width * height && (channels == 2 || channels == 4); i++)
+        {
+            if(pixels[i * 4 + 3] != 255)
+            {
+                format = BLOCK_BC3;
+                break;
+            }
+        }
+    }
+    std::vector<std::vector<unsigned char> > mips = generateMips(pixels, width, height);
+    stbi_image_free(pixels);
+
+    image->format = format == BLOCK_BC3 ? VK_FORMAT_BC3_UNORM_BLOCK : VK_FORMAT_BC1_RGB_UNORM_BLOCK;
+    image->width = width;
+    image->height = height;
+    image->levels.resize(mips.size());
+    for(uint32_t i = 0; i < mips.size(); i++)
+    {
+        image->levels[i] = compressImage(format, mips[i].data(), std::max(1, width >> i), std::max(1, height >> i));
+    }
+    std::ostringstream psnr;
+    psnr << measurePsnr(format, image->levels[0], mips[0].data(), width, height);
+    image->keyValues.clear();
+    image->keyValues["Vulkanisation.psnr"] = psnr.str();
+
+    fillReport(*image, report);
+    report->encodeMs = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    //Still usable when the cache can't be written
+    writeKtx2(format == BLOCK_BC3 ? bc3Path : bc1Path, *image);
+    return true;
+}
+
+uint32_t bakeTextures(std::string directory, std::string cacheDirectory)
+{
+    DIR *dir = opendir(directory.c_str());
+    if(dir == NULL)
+    {
+        std::cout << "Texture directory could not be opened: " << directory << std::endl;
+        return 0;
+    }
+    uint32_t baked = 0;
+    uint64_t compressedTotal = 0, rgbaTotal = 0;
+    while(dirent *entry = readdir(dir))
+    {
+        std::string name = entry->d_name;
+        size_t dot = name.rfind('.');
+        if(dot == std::string::npos)
+            continue;
+        std::string extension = name.substr(dot);
+        std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+        if(extension != ".png" && extension != ".jpg" && extension != ".jpeg" && extension != ".tga" && extension != ".bmp")
+            continue;
+
+        Ktx2Image image;
+        TextureReport report;
+        if(!compressTexture(directory + "/" + name, BLOCK_AUTO, cacheDirectory, &image, &report))
+            continue;
+        report.print();
+        compressedTotal += report.compressedBytes;
+        rgbaTotal += report.rgbaBytes;
+        baked++;
+    }
+    closedir(dir);
+    std::cout << "Baked " << baked << " textures, " << compressedTotal / 1024 << " KiB against "
+              << rgbaTotal / 1024 << " KiB as RGBA8" << std::endl;
+    return baked;
+}
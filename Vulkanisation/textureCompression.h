@@ -0,0 +1,53 @@
+#ifndef TEXTURECOMPRESSION_H_INCLUDED
+#define TEXTURECOMPRESSION_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <string>
+
+#include "ktx2.h"
+
+enum BlockFormat
+{
+    BLOCK_AUTO, //BC3 when the source has alpha, otherwise BC1
+    BLOCK_BC1,
+    BLOCK_BC3
+};
+
+//What compressing or loading one texture came to
+struct TextureReport
+{
+    std::string path;
+    VkFormat format = VK_FORMAT_UNDEFINED;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levels = 0;
+    uint64_t compressedBytes = 0; //Whole mip chain
+    uint64_t rgbaBytes = 0; //Same chain as RGBA8
+    double psnr = 0; //Top level against the source, in dB
+    double encodeMs = 0; //0 when it came from the cache
+    bool cached = false;
+
+    void print() const;
+};
+
+//Encodes 4x4 RGBA8 blocks, rgba holds 16 texels in rows
+void encodeBC1Block(const unsigned char *rgba, unsigned char *out);
+void encodeBC3Block(const unsigned char *rgba, unsigned char *out);
+void decodeBC1Block(const unsigned char *block, unsigned char *rgba);
+void decodeBC3Block(const unsigned char *block, unsigned char *rgba);
+
+//Full mip chain down to 1x1 with a box filter, level 0 is a copy of rgba
+std::vector<std::vector<unsigned char> > generateMips(const unsigned char *rgba, uint32_t width, uint32_t height);
+//Edge texels are repeated to fill partial blocks
+std::vector<unsigned char> compressImage(BlockFormat format, const unsigned char *rgba, uint32_t width, uint32_t height);
+uint32_t mipLevelCount(uint32_t width, uint32_t height);
+
+//Block compressed copy of an image file with every mip, encoded on first use and then read straight from
+//a KTX2 file in cacheDirectory keyed by a hash of the source file. BLOCK_AUTO takes whichever format is cached
+bool compressTexture(std::string path, BlockFormat format, std::string cacheDirectory, Ktx2Image *image, TextureReport *report);
+//Offline, every image in directory into the cache. Returns how many were done
+uint32_t bakeTextures(std::string directory, std::string cacheDirectory);
+
+#endif // TEXTURECOMPRESSION_H_INCLUDED
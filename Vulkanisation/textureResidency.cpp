@@ -0,0 +1,205 @@
+#include "textureResidency.h"
+
+#include <iostream>
+#include <vector>
+#include <algorithm> //min, max, sort
+#include <cmath>
+
+#include "workerPool.h"
+#include "cpuProfiler.h"
+
+extern VkPhysicalDeviceMemoryProperties memoryProperties;
+extern WorkerPool workerPool;
+
+void TextureResidency::create(TextureCache *textureCache, uint64_t budgetBytes)
+{
+    cache = textureCache;
+    frame = 1; //0 is never used
+    prepared = false;
+    budget = budgetBytes;
+    if(budget == 0)
+    {
+        //No memory budget query in core 1.0, the heap size is all there is to go on
+        for(uint32_t i = 0; i < memoryProperties.memoryHeapCount; i++)
+        {
+            if(memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+                budget = std::max(budget, (uint64_t)memoryProperties.memoryHeaps[i].size / 2);
+        }
+    }
+    std::cout << "Texture budget: " << budget / 1024 << " KiB, " << residentBytes() / 1024 << " KiB resident" << std::endl;
+}
+
+void TextureResidency::touch(Texture *texture, float distance)
+{
+    State &state = states[texture];
+    if(state.lastUsed != frame)
+        state.distance = distance;
+    else
+        state.distance = std::min(state.distance, distance);
+    state.lastUsed = frame;
+}
+
+bool TextureResidency::update()
+{
+    PROFILE_ZONE("TextureResidency::update");
+    //What the distances ask for
+    std::vector<Texture*> textures;
+    std::vector<uint32_t> wanted;
+    uint64_t total = 0;
+    for(std::map<std::string, TextureCache::Entry>::iterator it = cache->entries.begin(); it != cache->entries.end(); ++it)
+    {
+        Texture *texture = &it->second.texture;
+        State &state = states[texture];
+        uint32_t fullLevels = texture->mipLevels + texture->droppedMips;
+        uint32_t want = 0;
+        if(frame - state.lastUsed > unusedFrames)
+            want = fullLevels - 1;
+        else if(state.distance > fullDetailDistance)
+            want = (uint32_t)std::floor(std::log2(state.distance / fullDetailDistance));
+        want = std::min(std::max(want, state.minimumDrop), fullLevels - 1);
+
+        textures.push_back(texture);
+        wanted.push_back(want);
+        total += texture->bytesWithout(want);
+    }
+
+    //Over budget, least recently used and then furthest away give up a level each until it fits
+    std::vector<uint32_t> order(textures.size());
+    for(uint32_t i = 0; i < order.size(); i++)
+    {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b)
+    {
+        const State &first = states[textures[a]];
+        const State &second = states[textures[b]];
+        if(first.lastUsed != second.lastUsed)
+            return first.lastUsed < second.lastUsed;
+        return first.distance > second.distance;
+    });
+    bool dropped = true;
+    while(total > budget && dropped)
+    {
+        dropped = false;
+        for(uint32_t i = 0; i < order.size() && total > budget; i++)
+        {
+            Texture *texture = textures[order[i]];
+            uint32_t &want = wanted[order[i]];
+            if(want + 1 >= texture->mipLevels + texture->droppedMips)
+                continue;
+            total -= texture->bytesWithout(want);
+            want++;
+            total += texture->bytesWithout(want);
+            dropped = true;
+        }
+    }
+    //Arrays without mips, uncompressed ones always, have nothing to give up
+    if(total > budget && !overBudget)
+        std::cout << "Texture residency: " << total / 1024 << " KiB with every texture down to its last mip, over the "
+                  << budget / 1024 << " KiB budget" << std::endl;
+    overBudget = total > budget;
+
+    if(loading != NULL && !created && prepared.load(std::memory_order_acquire))
+        createPrepared();
+
+    //Only reload once the answer has stopped changing, one at a time
+    for(uint32_t i = 0; i < textures.size(); i++)
+    {
+        State &state = states[textures[i]];
+        if(wanted[i] != state.target)
+        {
+            state.target = wanted[i];
+            state.settled = 0;
+        }
+        else
+            state.settled++;
+
+        if(loading == NULL && state.settled >= settleFrames && state.target != textures[i]->droppedMips)
+        {
+            //Compressing can take seconds on a cache miss, the frame only waits for the upload
+            loading = textures[i];
+            created = false;
+            preparedOk = false;
+            prepared.store(false, std::memory_order_relaxed);
+            preparedData = TextureArrayData();
+            Texture *replacement = &state.replacement;
+            std::vector<std::string> filenames = textures[i]->filenames;
+            uint32_t target = state.target;
+            workerPool.submit([this, replacement, filenames, target]
+            {
+                preparedOk = replacement->prepareTextureArray(filenames, target, &preparedData);
+                prepared.store(true, std::memory_order_release);
+            });
+        }
+    }
+    frame++;
+
+    return loading != NULL && created && states[loading].replacement.upload.ready();
+}
+
+void TextureResidency::createPrepared()
+{
+    State &state = states[loading];
+    created = preparedOk && state.replacement.createTextureArray(preparedData);
+    preparedData = TextureArrayData();
+    if(created)
+        return;
+    //Keep what is there rather than trying again every few frames
+    state.replacement.destroy();
+    state.replacement = Texture();
+    state.minimumDrop = loading->droppedMips;
+    failures++;
+    loading = NULL;
+}
+
+void TextureResidency::swapReady()
+{
+    if(loading == NULL)
+        return;
+    State &state = states[loading];
+    uint32_t before = loading->droppedMips;
+    created = false;
+    loading->destroy();
+    *loading = state.replacement;
+    state.replacement = Texture();
+    if(loading->droppedMips > before)
+        drops++;
+    else
+        restores++;
+    //Ran out of device memory on the way, no point asking for more again
+    if(loading->droppedMips > state.target)
+        state.minimumDrop = loading->droppedMips;
+
+    std::cout << "Texture residency: " << loading->filenames[0] << " now "
+              << std::max(1u, loading->fullExtent.width >> loading->droppedMips) << "x"
+              << std::max(1u, loading->fullExtent.height >> loading->droppedMips) << ", "
+              << residentBytes() / 1024 << " KiB resident" << std::endl;
+    loading = NULL;
+}
+
+uint64_t TextureResidency::residentBytes() const
+{
+    uint64_t total = 0;
+    for(std::map<std::string, TextureCache::Entry>::const_iterator it = cache->entries.begin(); it != cache->entries.end(); ++it)
+    {
+        total += it->second.texture.packedBytes;
+    }
+    return total;
+}
+
+void TextureResidency::printStats() const
+{
+    std::cout << "Texture residency: " << residentBytes() / 1024 << " KiB of " << budget / 1024 << " KiB budget, "
+              << drops << " drops, " << restores << " restores, " << failures << " failed reloads" << std::endl;
+}
+
+void TextureResidency::destroy()
+{
+    //A replacement still being prepared has nothing on the device yet
+    if(loading != NULL)
+        states[loading].replacement.destroy();
+    loading = NULL;
+    created = false;
+    preparedData = TextureArrayData();
+    states.clear();
+}
@@ -0,0 +1,64 @@
+#ifndef TEXTURERESIDENCY_H_INCLUDED
+#define TEXTURERESIDENCY_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <map>
+#include <atomic>
+
+#include "texture.h"
+#include "textureCache.h"
+
+//Keeps the texture cache under a device memory budget by leaving the largest mips out
+//Each frame the meshes say how far away they are, every mip level is worth one doubling of distance.
+//Anything unseen for a while keeps only its last level. Over budget, the least recently used and then
+//the furthest away lose levels first. A new level count has to hold for a while before anything is reloaded,
+//then one replacement at a time is prepared on the worker pool, created beside the old texture on the main thread
+//and swapped in once its upload is ready
+struct TextureResidency
+{
+    struct State
+    {
+        float distance = 0; //Nearest user in the frame it was last used
+        uint64_t lastUsed = 0;
+        uint32_t target = 0; //Mips to drop
+        uint32_t settled = 0; //Frames target has held
+        uint32_t minimumDrop = 0; //Raised when a reload ran out of device memory
+        Texture replacement;
+    };
+
+    TextureCache *cache = NULL;
+    std::map<Texture*, State> states;
+    Texture *loading = NULL;
+    //Set by the worker once the replacement is prepared, until then only the worker touches it
+    std::atomic<bool> prepared;
+    bool preparedOk = false;
+    bool created = false;
+    TextureArrayData preparedData;
+    bool overBudget = false; //Already reported
+    uint64_t budget = 0;
+    uint64_t frame = 0;
+    float fullDetailDistance = 10.0f;
+    uint32_t unusedFrames = 300;
+    uint32_t settleFrames = 30;
+
+    uint32_t drops = 0;
+    uint32_t restores = 0;
+    uint32_t failures = 0;
+
+    //Budget of 0 takes half the largest device local heap
+    void create(TextureCache *textureCache, uint64_t budgetBytes);
+    void touch(Texture *texture, float distance);
+    //Once per frame after the touches, returns true when a replacement is ready to be swapped in
+    bool update();
+    //Main thread half of a reload, once the worker has prepared it
+    void createPrepared();
+    //Only once nothing in flight samples the old texture, descriptors have to be written again after
+    void swapReady();
+    uint64_t residentBytes() const;
+    void printStats() const;
+    //After the worker pool has stopped
+    void destroy();
+};
+
+#endif // TEXTURERESIDENCY_H_INCLUDED
@@ -0,0 +1,148 @@
+//Reads the shared memory ring of --stream shm:name and checks nothing was lost on the way
+//Every frame has to follow the last by exactly 1, frames per second are printed once a second
+//Build from tools/: g++ -std=c++11 -O2 -I.. -I../../libraries/include frameStreamConsumer.cpp -o frameStreamConsumer -lrt
+//Usage: frameStreamConsumer name [wait seconds], started before or after the renderer
+#include <iostream>
+#include <thread>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "frameStream.h"
+
+//Whole ring mapped read write, read is written back through it
+static unsigned char *mapRing(std::string name, double waitSeconds)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    while(true)
+    {
+        //The renderer only creates it once the first frame is read back, and writes the magic last
+#ifdef _WIN32
+        HANDLE handle = OpenFileMappingA(FILE_MAP_ALL_ACCESS, FALSE, name.c_str());
+        if(handle != NULL)
+        {
+            FrameStreamHeader *header = (FrameStreamHeader*)MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, sizeof(FrameStreamHeader));
+            if(header != NULL && memcmp(header->magic, "VKFS", 4) == 0)
+            {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                size_t bytes = header->headerSize + header->slotStride * header->slotCount;
+                UnmapViewOfFile(header);
+                return (unsigned char*)MapViewOfFile(handle, FILE_MAP_ALL_ACCESS, 0, 0, bytes);
+            }
+            if(header != NULL)
+                UnmapViewOfFile(header);
+            CloseHandle(handle);
+        }
+#else
+        int fd = shm_open(("/" + name).c_str(), O_RDWR, 0);
+        struct stat info;
+        if(fd >= 0 && fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(FrameStreamHeader))
+        {
+            void *mapped = mmap(NULL, info.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if(mapped != MAP_FAILED && memcmp(((FrameStreamHeader*)mapped)->magic, "VKFS", 4) == 0)
+            {
+                std::atomic_thread_fence(std::memory_order_acquire);
+                return (unsigned char*)mapped;
+            }
+            if(mapped != MAP_FAILED)
+                munmap(mapped, info.st_size);
+        }
+        else if(fd >= 0)
+            close(fd);
+#endif
+        if(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() > waitSeconds)
+            return NULL;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if(argc < 2)
+    {
+        std::cout << "Usage: " << argv[0] << " name [wait seconds]" << std::endl;
+        return 1;
+    }
+    std::string name = argv[1];
+    if(name.compare(0, 4, "shm:") == 0)
+        name = name.substr(4);
+    double waitSeconds = argc > 2 ? atof(argv[2]) : 30;
+
+    unsigned char *ring = mapRing(name, waitSeconds);
+    if(ring == NULL)
+    {
+        std::cout << "No frame stream called " << name << std::endl;
+        return 1;
+    }
+    FrameStreamHeader *header = (FrameStreamHeader*)ring;
+    std::cout << "Reading " << header->width << "x" << header->height << " frames, " << header->slotCount << " slots" << std::endl;
+
+    size_t frameBytes = (size_t)header->width * header->height * 4;
+    uint64_t next = header->read.load(std::memory_order_relaxed);
+    uint64_t frames = 0, errors = 0, lastFrame = 0;
+    uint64_t firstNs = 0, lastNs = 0;
+    uint32_t checksum = 0; //Touches the pixels the way a real consumer would
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    std::chrono::steady_clock::time_point reported = start;
+    uint64_t reportedFrames = 0;
+    while(true)
+    {
+        uint64_t written = header->written.load(std::memory_order_acquire);
+        if(next == written)
+        {
+            if(header->closed.load(std::memory_order_acquire) && header->written.load(std::memory_order_acquire) == next)
+                break;
+            std::this_thread::sleep_for(std::chrono::microseconds(200));
+            continue;
+        }
+        for(; next < written; next++)
+        {
+            const unsigned char *slot = ring + header->headerSize + (next % header->slotCount) * header->slotStride;
+            FrameStreamSlot slotHeader;
+            memcpy(&slotHeader, slot, sizeof(slotHeader));
+            if(frames > 0 && slotHeader.frame != lastFrame + 1)
+            {
+                if(errors < 10)
+                    std::cout << "Frame " << slotHeader.frame << " after " << lastFrame << std::endl;
+                errors++;
+            }
+            if(frames == 0)
+                firstNs = slotHeader.timeNs;
+            lastFrame = slotHeader.frame;
+            lastNs = slotHeader.timeNs;
+            const unsigned char *pixels = slot + sizeof(FrameStreamSlot);
+            for(size_t i = 0; i < frameBytes; i += 4096)
+            {
+                checksum = checksum * 31 + pixels[i];
+            }
+            frames++;
+            //Slot is the renderer's again
+            header->read.store(next + 1, std::memory_order_release);
+        }
+
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        double sinceReport = std::chrono::duration<double>(now - reported).count();
+        if(sinceReport >= 1.0)
+        {
+            std::cout << (frames - reportedFrames) / sinceReport << " fps, " << frames << " frames" << std::endl;
+            reported = now;
+            reportedFrames = frames;
+        }
+    }
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    std::cout << frames << " frames in " << seconds << "s, " << (seconds > 0 ? frames / seconds : 0) << " fps read, ";
+    if(lastNs > firstNs)
+        std::cout << (frames - 1) / ((lastNs - firstNs) / 1e9) << " fps rendered, ";
+    std::cout << errors << " out of order (checksum " << checksum << ")" << std::endl;
+    return errors == 0 ? 0 : 2;
+}
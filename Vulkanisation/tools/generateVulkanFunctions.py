@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+#Writes vulkanFunctions.inl, the X-macro list vulkanDefinitions expands into its dispatch table
+#Every Vulkan command the sources call is sorted into a tier by how it has to be loaded:
+#  global   - vkGetInstanceProcAddr(NULL, ...)
+#  instance - vkGetInstanceProcAddr(instance, ...)
+#  device   - vkGetDeviceProcAddr(device, ...), skips the loader trampoline
+#Commands come from vk.xml when given, otherwise from the PFN typedefs in vulkan.h
+#
+#usage: generateVulkanFunctions.py [--registry vk.xml | --header vulkan.h] [--sources dir] [--output file]
+
+import argparse
+import os
+import re
+import sys
+import xml.etree.ElementTree as ElementTree
+
+GLOBAL_COMMANDS = {"vkCreateInstance", "vkEnumerateInstanceExtensionProperties", "vkEnumerateInstanceLayerProperties"}
+DEVICE_HANDLES = {"VkDevice", "VkQueue", "VkCommandBuffer"}
+#vkGetDeviceProcAddr loads the device tier so it has to come from the instance
+INSTANCE_ALWAYS = {"vkGetDeviceProcAddr"}
+#Come from the loader itself, or are loaded next to where they are used
+SKIPPED = {"vkGetInstanceProcAddr", "vkCreateDebugReportCallbackEXT", "vkDebugReportMessageEXT",
+           "vkDestroyDebugReportCallbackEXT"}
+GENERATED_FILES = {"vulkanDefinitions.h", "vulkanDefinitions.cpp", "vulkanFunctions.inl"}
+
+
+def commandsFromRegistry(path):
+    commands = {}
+    root = ElementTree.parse(path).getroot()
+    aliases = {}
+    for command in root.iter("command"):
+        if command.get("alias"):
+            aliases[command.get("name")] = command.get("alias")
+            continue
+        proto = command.find("proto")
+        if proto is None:
+            continue
+        name = proto.find("name").text
+        params = command.findall("param")
+        firstType = params[0].find("type").text if params else ""
+        commands[name] = firstType
+    for name, target in aliases.items():
+        if target in commands:
+            commands[name] = commands[target]
+    return commands
+
+
+def commandsFromHeader(path):
+    commands = {}
+    pattern = re.compile(r"typedef\s+[\w\s\*]+\(VKAPI_PTR\s*\*PFN_(vk\w+)\)\(\s*(?:const\s+)?(\w+)")
+    with open(path) as header:
+        for match in pattern.finditer(header.read()):
+            commands[match.group(1)] = match.group(2)
+    return commands
+
+
+def usedNames(directory):
+    used = set()
+    pattern = re.compile(r"\bvk[A-Z]\w*")
+    for name in sorted(os.listdir(directory)):
+        if not name.endswith((".cpp", ".h")) or name in GENERATED_FILES or name.startswith("main_pre"):
+            continue
+        with open(os.path.join(directory, name), errors="ignore") as source:
+            used.update(pattern.findall(source.read()))
+    return used
+
+
+def tier(name, firstType):
+    if name in GLOBAL_COMMANDS:
+        return "GLOBAL"
+    if name in INSTANCE_ALWAYS or firstType not in DEVICE_HANDLES:
+        return "INSTANCE"
+    return "DEVICE"
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--registry")
+    parser.add_argument("--header", default=os.path.join(here, "..", "..", "libraries", "include", "vulkan", "vulkan.h"))
+    parser.add_argument("--sources", default=os.path.join(here, ".."))
+    parser.add_argument("--output", default=os.path.join(here, "..", "vulkanFunctions.inl"))
+    args = parser.parse_args()
+
+    if args.registry:
+        commands = commandsFromRegistry(args.registry)
+        origin = os.path.basename(args.registry)
+    else:
+        commands = commandsFromHeader(args.header)
+        origin = os.path.basename(args.header)
+
+    used = (usedNames(args.sources) & set(commands)) | INSTANCE_ALWAYS
+    used -= SKIPPED
+    tiers = {"GLOBAL": [], "INSTANCE": [], "DEVICE": []}
+    for name in sorted(used):
+        tiers[tier(name, commands[name])].append(name)
+
+    lines = ["//Generated by tools/generateVulkanFunctions.py from " + origin + ", rerun it rather than editing",
+             "//Define VK_GLOBAL_FUNCTION, VK_INSTANCE_FUNCTION and VK_DEVICE_FUNCTION before including"]
+    for key in ["GLOBAL", "INSTANCE", "DEVICE"]:
+        lines.append("")
+        for name in tiers[key]:
+            lines.append("VK_%s_FUNCTION(%s)" % (key, name))
+    with open(args.output, "w", newline="\r\n") as output:
+        output.write("\n".join(lines) + "\n")
+    print("%d global, %d instance, %d device functions written to %s" %
+          (len(tiers["GLOBAL"]), len(tiers["INSTANCE"]), len(tiers["DEVICE"]), args.output))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,548 @@
+#include "uploadService.h"
+
+#include <iostream>
+#include <cstring> //memcpy
+#include <limits>
+#include "vulkanDefinitions.h"
+#include "cpuProfiler.h"
+
+extern VkDevice logicalDevice;
+extern VkCommandPool commandPool;
+extern VkCommandPool transferCommandPool;
+extern VkQueue presentQueue;
+extern VkQueue transferQueue;
+extern uint32_t presentQueueId;
+extern uint32_t transferQueueId;
+
+bool UploadTicket::ready() const
+{
+    return service == NULL || service->ready(value);
+}
+
+void UploadTicket::wait() const
+{
+    if(service != NULL)
+        service->wait(value);
+}
+
+bool UploadService::create(VkDeviceSize stagingSize)
+{
+    ringSize = stagingSize;
+    ringHead = 0;
+    ringTail = 0;
+    handOver = transferQueueId != presentQueueId;
+
+    VkBufferCreateInfo bufferInfo = {};
+    bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+    bufferInfo.size = ringSize;
+    bufferInfo.usage = VK_BUFFER_USAGE_TRANSFER_SRC_BIT;
+    bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    VkResult result = vkCreateBuffer(logicalDevice, &bufferInfo, NULL, &ring.buffer);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Staging ring creation failed (" << result << ")" << std::endl;
+        return false;
+    }
+
+    //Coherent, so nothing written through the mapping needs flushing before a submit
+    VkMemoryRequirements memoryRequirements = {};
+    vkGetBufferMemoryRequirements(logicalDevice, ring.buffer, &memoryRequirements);
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = memoryRequirements.size;
+    allocateInfo.memoryTypeIndex = getMemoryTypeIndex(memoryRequirements.memoryTypeBits,
+                                                      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+    result = vkAllocateMemory(logicalDevice, &allocateInfo, NULL, &ring.bufferMemory);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Staging ring allocation failed (" << result << ")" << std::endl;
+        return false;
+    }
+    result = vkBindBufferMemory(logicalDevice, ring.buffer, ring.bufferMemory, 0);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Staging ring bind failed (" << result << ")" << std::endl;
+        return false;
+    }
+    void *mapped;
+    result = vkMapMemory(logicalDevice, ring.bufferMemory, 0, VK_WHOLE_SIZE, 0, &mapped);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Staging ring mapping failed (" << result << ")" << std::endl;
+        return false;
+    }
+    ringMapped = (unsigned char*) mapped;
+
+    return true;
+}
+
+bool UploadService::allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset)
+{
+    while(true)
+    {
+        //Aligned within the ring, anything that would run off the end starts the next lap
+        uint64_t lapStart = ringHead - ringHead % ringSize;
+        uint64_t start = lapStart + (ringHead % ringSize + alignment - 1) / alignment * alignment;
+        if(start - lapStart + size > ringSize)
+            start = lapStart + ringSize;
+        if(start + size - ringTail <= ringSize)
+        {
+            *offset = start % ringSize;
+            ringHead = start + size;
+            return true;
+        }
+
+        //Full, pending uploads go out first, then the oldest copy still reading the ring is waited on
+        if(!pendingImages.empty() || !pendingBuffers.empty())
+        {
+            if(!flush())
+                return false;
+            continue;
+        }
+        Batch *oldest = NULL;
+        for(uint32_t i = 0; i < inFlight.size() && oldest == NULL; i++)
+        {
+            if(!inFlight[i].transferDone)
+                oldest = &inFlight[i];
+        }
+        if(oldest == NULL)
+        {
+            //Nothing reads the ring, so it can start over at the top
+            ringHead = lapStart + ringSize;
+            ringTail = ringHead;
+            continue;
+        }
+        PROFILE_ZONE("UploadService::waitRing");
+        VkResult result = vkWaitForFences(logicalDevice, 1, &oldest->transferFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+        if(result != VK_SUCCESS)
+        {
+            std::cout << "Staging ring wait failed (" << result << ")" << std::endl;
+            return false;
+        }
+        poll();
+    }
+}
+
+unsigned char *UploadService::reserve(VkDeviceSize size, VkDeviceSize alignment, VkBuffer *source, VkDeviceSize *offset)
+{
+    unsigned char *destination;
+    if(size <= ringSize)
+    {
+        if(!allocate(size, alignment, offset))
+            return NULL;
+        destination = ringMapped + *offset;
+        *source = ring.buffer;
+    }
+    else
+    {
+        //Would never fit, gets a buffer of its own that goes with the batch, unmapped when it is freed
+        MemoryBuffer dedicated = {};
+        if(!createBuffer(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, NULL, &dedicated))
+            return NULL;
+        void *mapped;
+        VkResult result = vkMapMemory(logicalDevice, dedicated.bufferMemory, 0, size, 0, &mapped);
+        if(result != VK_SUCCESS)
+        {
+            std::cout << "Dedicated staging mapping failed (" << result << ")" << std::endl;
+            dedicated.destroy();
+            return NULL;
+        }
+        pendingDedicated.push_back(dedicated);
+        destination = (unsigned char*) mapped;
+        *source = dedicated.buffer;
+        *offset = 0;
+    }
+
+    //Large loads get going on the transfer queue while the rest is still being read
+    pendingBytes += size;
+    return destination;
+}
+
+bool UploadService::stage(const void *data, VkDeviceSize size, VkDeviceSize alignment, VkBuffer *source, VkDeviceSize *offset)
+{
+    unsigned char *destination = reserve(size, alignment, source, offset);
+    if(destination == NULL)
+        return false;
+    memcpy(destination, data, size);
+    return true;
+}
+
+UploadTicket UploadService::uploadImage(VkImage image, VkImageSubresourceRange range, VkImageLayout finalLayout,
+                                        const void *data, VkDeviceSize size, uint32_t texelBytes,
+                                        std::vector<VkBufferImageCopy> regions)
+{
+    PROFILE_ZONE("UploadService::uploadImage");
+    unsigned char *destination;
+    UploadTicket ticket = reserveImage(image, range, finalLayout, size, texelBytes, regions, &destination);
+    if(ticket.service == NULL)
+        return ticket;
+    memcpy(destination, data, size);
+
+    if(pendingBytes >= ringSize / 4)
+        flush();
+    return ticket;
+}
+
+UploadTicket UploadService::reserveImage(VkImage image, VkImageSubresourceRange range, VkImageLayout finalLayout,
+                                         VkDeviceSize size, uint32_t texelBytes, std::vector<VkBufferImageCopy> regions,
+                                         unsigned char **destination)
+{
+    UploadTicket ticket;
+    //Copy offsets have to be a multiple of the texel size and of 4
+    VkDeviceSize alignment = 16;
+    while(alignment % texelBytes != 0)
+    {
+        alignment += 16;
+    }
+
+    PendingImage pending;
+    VkDeviceSize offset;
+    *destination = reserve(size, alignment, &pending.source, &offset);
+    if(*destination == NULL)
+        return ticket;
+    pending.image = image;
+    pending.range = range;
+    pending.finalLayout = finalLayout;
+    pending.regions = regions;
+    for(uint32_t i = 0; i < pending.regions.size(); i++)
+    {
+        pending.regions[i].bufferOffset += offset;
+    }
+    pendingImages.push_back(pending);
+
+    ticket.service = this;
+    ticket.value = nextValue;
+    return ticket;
+}
+
+UploadTicket UploadService::uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size,
+                                        bool concurrent)
+{
+    PROFILE_ZONE("UploadService::uploadBuffer");
+    UploadTicket ticket;
+    PendingBuffer pending;
+    VkDeviceSize sourceOffset;
+    if(!stage(data, size, 16, &pending.source, &sourceOffset))
+        return ticket;
+    pending.destination = buffer;
+    pending.region.srcOffset = sourceOffset;
+    pending.region.dstOffset = offset;
+    pending.region.size = size;
+    pending.concurrent = concurrent;
+    pendingBuffers.push_back(pending);
+
+    ticket.service = this;
+    ticket.value = nextValue;
+    if(pendingBytes >= ringSize / 4)
+        flush();
+    return ticket;
+}
+
+bool UploadService::flush()
+{
+    if(pendingImages.empty() && pendingBuffers.empty())
+        return true;
+    PROFILE_ZONE("UploadService::flush");
+
+    Batch batch;
+    batch.value = nextValue;
+
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.commandPool = transferCommandPool;
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocateInfo.commandBufferCount = 1;
+    VkResult result = vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocateInfo, &batch.transferCmd);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Upload command buffer allocation failed (" << result << ")" << std::endl;
+        return false;
+    }
+    VkFenceCreateInfo fenceCreateInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, 0, 0};
+    result = vkCreateFence(logicalDevice, &fenceCreateInfo, NULL, &batch.transferFence);
+    if(result == VK_SUCCESS && handOver)
+    {
+        VkSemaphoreCreateInfo semaphoreCreateInfo = {VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO, 0, 0};
+        result = vkCreateSemaphore(logicalDevice, &semaphoreCreateInfo, NULL, &batch.released);
+    }
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Upload sync object creation failed (" << result << ")" << std::endl;
+        release(batch);
+        return false;
+    }
+
+    VkCommandBuffer cmd = batch.transferCmd;
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(cmd, &beginInfo);
+
+    //Every image into transfer destination with one barrier
+    std::vector<VkImageMemoryBarrier> imageBarriers(pendingImages.size());
+    for(uint32_t i = 0; i < pendingImages.size(); i++)
+    {
+        imageBarriers[i] = {};
+        imageBarriers[i].sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+        imageBarriers[i].srcAccessMask = 0;
+        imageBarriers[i].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageBarriers[i].oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+        imageBarriers[i].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarriers[i].srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarriers[i].dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        imageBarriers[i].image = pendingImages[i].image;
+        imageBarriers[i].subresourceRange = pendingImages[i].range;
+    }
+    if(!imageBarriers.empty())
+    {
+        vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+                             0, NULL, 0, NULL, imageBarriers.size(), imageBarriers.data());
+    }
+
+    for(uint32_t i = 0; i < pendingImages.size(); i++)
+    {
+        vkCmdCopyBufferToImage(cmd, pendingImages[i].source, pendingImages[i].image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               pendingImages[i].regions.size(), pendingImages[i].regions.data());
+    }
+    //Neighbouring copies between the same buffers go in one call
+    std::vector<VkBufferCopy> regions;
+    for(uint32_t i = 0; i < pendingBuffers.size(); i++)
+    {
+        regions.push_back(pendingBuffers[i].region);
+        bool last = i + 1 == pendingBuffers.size() ||
+                    pendingBuffers[i + 1].source != pendingBuffers[i].source ||
+                    pendingBuffers[i + 1].destination != pendingBuffers[i].destination;
+        if(last)
+        {
+            vkCmdCopyBuffer(cmd, pendingBuffers[i].source, pendingBuffers[i].destination, regions.size(), regions.data());
+            regions.clear();
+        }
+    }
+
+    //Straight to the final layout, or the release half of the handover
+    for(uint32_t i = 0; i < pendingImages.size(); i++)
+    {
+        imageBarriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        imageBarriers[i].dstAccessMask = handOver ? 0 : VK_ACCESS_SHADER_READ_BIT;
+        imageBarriers[i].oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        imageBarriers[i].newLayout = pendingImages[i].finalLayout;
+        imageBarriers[i].srcQueueFamilyIndex = handOver ? transferQueueId : VK_QUEUE_FAMILY_IGNORED;
+        imageBarriers[i].dstQueueFamilyIndex = handOver ? presentQueueId : VK_QUEUE_FAMILY_IGNORED;
+    }
+    std::vector<VkBufferMemoryBarrier> bufferBarriers(pendingBuffers.size());
+    for(uint32_t i = 0; i < pendingBuffers.size(); i++)
+    {
+        bufferBarriers[i] = {};
+        bufferBarriers[i].sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+        bufferBarriers[i].srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        bufferBarriers[i].dstAccessMask = handOver ? 0 : VK_ACCESS_MEMORY_READ_BIT;
+        bufferBarriers[i].srcQueueFamilyIndex = handOver && !pendingBuffers[i].concurrent ? transferQueueId : VK_QUEUE_FAMILY_IGNORED;
+        bufferBarriers[i].dstQueueFamilyIndex = handOver && !pendingBuffers[i].concurrent ? presentQueueId : VK_QUEUE_FAMILY_IGNORED;
+        bufferBarriers[i].buffer = pendingBuffers[i].destination;
+        bufferBarriers[i].offset = pendingBuffers[i].region.dstOffset;
+        bufferBarriers[i].size = pendingBuffers[i].region.size;
+    }
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         handOver ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         0, NULL, bufferBarriers.size(), bufferBarriers.data(), imageBarriers.size(), imageBarriers.data());
+    vkEndCommandBuffer(cmd);
+
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &cmd;
+    submitInfo.signalSemaphoreCount = handOver ? 1 : 0;
+    submitInfo.pSignalSemaphores = &batch.released;
+    result = vkQueueSubmit(transferQueue, 1, &submitInfo, batch.transferFence);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Upload could not be submitted (" << result << ")" << std::endl;
+        release(batch);
+        return false;
+    }
+
+    //The acquire repeats the release with the access moved to the graphics side
+    if(handOver)
+    {
+        for(uint32_t i = 0; i < imageBarriers.size(); i++)
+        {
+            imageBarriers[i].srcAccessMask = 0;
+            imageBarriers[i].dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        }
+        for(uint32_t i = 0; i < bufferBarriers.size(); i++)
+        {
+            bufferBarriers[i].srcAccessMask = 0;
+            bufferBarriers[i].dstAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+        }
+        batch.imageAcquires.swap(imageBarriers);
+        batch.bufferAcquires.swap(bufferBarriers);
+    }
+    else
+    {
+        //Same queue as the frames, anything submitted after this is ordered behind the copy
+        readyValue = batch.value;
+    }
+
+    batch.ringEnd = ringHead;
+    batch.dedicated.swap(pendingDedicated);
+    inFlight.push_back(batch);
+    pendingImages.clear();
+    pendingBuffers.clear();
+    pendingBytes = 0;
+    nextValue++;
+
+    return true;
+}
+
+bool UploadService::submitAcquire(Batch &batch)
+{
+    VkCommandBufferAllocateInfo commandBufferAllocateInfo = {};
+    commandBufferAllocateInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    commandBufferAllocateInfo.commandPool = commandPool;
+    commandBufferAllocateInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    commandBufferAllocateInfo.commandBufferCount = 1;
+    VkResult result = vkAllocateCommandBuffers(logicalDevice, &commandBufferAllocateInfo, &batch.acquireCmd);
+    if(result == VK_SUCCESS)
+    {
+        VkFenceCreateInfo fenceCreateInfo = {VK_STRUCTURE_TYPE_FENCE_CREATE_INFO, 0, 0};
+        result = vkCreateFence(logicalDevice, &fenceCreateInfo, NULL, &batch.acquireFence);
+    }
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Upload acquire creation failed (" << result << ")" << std::endl;
+        return false;
+    }
+
+    VkCommandBufferBeginInfo beginInfo = {};
+    beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+    beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+    vkBeginCommandBuffer(batch.acquireCmd, &beginInfo);
+    vkCmdPipelineBarrier(batch.acquireCmd, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT, 0,
+                         0, NULL, batch.bufferAcquires.size(), batch.bufferAcquires.data(),
+                         batch.imageAcquires.size(), batch.imageAcquires.data());
+    vkEndCommandBuffer(batch.acquireCmd);
+
+    //Already signalled by now, the wait only carries the memory dependency across queues
+    VkPipelineStageFlags waitStage = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+    VkSubmitInfo submitInfo = {};
+    submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &batch.released;
+    submitInfo.pWaitDstStageMask = &waitStage;
+    submitInfo.commandBufferCount = 1;
+    submitInfo.pCommandBuffers = &batch.acquireCmd;
+    result = vkQueueSubmit(presentQueue, 1, &submitInfo, batch.acquireFence);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Upload acquire could not be submitted (" << result << ")" << std::endl;
+        return false;
+    }
+
+    readyValue = batch.value;
+    return true;
+}
+
+void UploadService::poll()
+{
+    //Copies finish in submission order
+    for(uint32_t i = 0; i < inFlight.size(); i++)
+    {
+        Batch &batch = inFlight[i];
+        if(batch.transferDone)
+            continue;
+        if(vkGetFenceStatus(logicalDevice, batch.transferFence) != VK_SUCCESS)
+            break;
+
+        batch.transferDone = true;
+        ringTail = batch.ringEnd;
+        for(uint32_t j = 0; j < batch.dedicated.size(); j++)
+        {
+            batch.dedicated[j].destroy();
+        }
+        batch.dedicated.clear();
+        if(handOver && !submitAcquire(batch))
+        {
+            //Nothing else will release the semaphore, so the batch is dropped as it is
+            vkDeviceWaitIdle(logicalDevice);
+            readyValue = batch.value;
+        }
+    }
+
+    while(!inFlight.empty() && inFlight.front().transferDone)
+    {
+        Batch &batch = inFlight.front();
+        if(batch.acquireFence != VK_NULL_HANDLE && vkGetFenceStatus(logicalDevice, batch.acquireFence) != VK_SUCCESS)
+            break;
+        release(batch);
+        inFlight.pop_front();
+    }
+}
+
+bool UploadService::ready(uint64_t value)
+{
+    return value <= readyValue;
+}
+
+void UploadService::wait(uint64_t value)
+{
+    if(value >= nextValue)
+        flush();
+    while(readyValue < value && !inFlight.empty())
+    {
+        PROFILE_ZONE("UploadService::wait");
+        for(uint32_t i = 0; i < inFlight.size(); i++)
+        {
+            if(!inFlight[i].transferDone)
+            {
+                vkWaitForFences(logicalDevice, 1, &inFlight[i].transferFence, VK_TRUE, std::numeric_limits<uint64_t>::max());
+                break;
+            }
+        }
+        poll();
+    }
+}
+
+void UploadService::waitAll()
+{
+    flush();
+    wait(nextValue - 1);
+}
+
+void UploadService::release(Batch &batch)
+{
+    if(batch.transferCmd != VK_NULL_HANDLE)
+        vkFreeCommandBuffers(logicalDevice, transferCommandPool, 1, &batch.transferCmd);
+    if(batch.acquireCmd != VK_NULL_HANDLE)
+        vkFreeCommandBuffers(logicalDevice, commandPool, 1, &batch.acquireCmd);
+    vkDestroyFence(logicalDevice, batch.transferFence, NULL);
+    vkDestroyFence(logicalDevice, batch.acquireFence, NULL);
+    vkDestroySemaphore(logicalDevice, batch.released, NULL);
+    for(uint32_t i = 0; i < batch.dedicated.size(); i++)
+    {
+        batch.dedicated[i].destroy();
+    }
+}
+
+void UploadService::destroy()
+{
+    waitAll();
+    vkDeviceWaitIdle(logicalDevice);
+    poll();
+    for(uint32_t i = 0; i < inFlight.size(); i++)
+    {
+        release(inFlight[i]);
+    }
+    inFlight.clear();
+    for(uint32_t i = 0; i < pendingDedicated.size(); i++)
+    {
+        pendingDedicated[i].destroy();
+    }
+    pendingDedicated.clear();
+    if(ring.buffer != VK_NULL_HANDLE)
+    {
+        vkUnmapMemory(logicalDevice, ring.bufferMemory);
+        ring.destroy();
+        ring = {};
+    }
+    ringMapped = NULL;
+}
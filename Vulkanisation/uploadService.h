@@ -0,0 +1,112 @@
+#ifndef UPLOADSERVICE_H_INCLUDED
+#define UPLOADSERVICE_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <vector>
+#include <deque>
+
+#include "assorted.h" //MemoryBuffer
+
+struct UploadService;
+
+//Future-like handle for one upload. A default ticket is always ready, failed uploads hand one back
+struct UploadTicket
+{
+    UploadService *service = NULL;
+    uint64_t value = 0;
+
+    //Work submitted to the graphics queue from now on sees the data
+    bool ready() const;
+    //Flushes if needed and blocks until ready
+    void wait() const;
+};
+
+//Streams data into device local images and buffers through one persistently mapped staging ring
+//Uploads gather into a batch, flush() records the whole batch into one transfer command buffer
+//Each batch takes the next value of a counter, with fences standing in for a timeline semaphore
+//With a separate transfer family the graphics side acquire is only submitted once the copy has finished,
+//so frames never queue up behind a copy
+//Main thread only, it shares the graphics queue with frame submission
+struct UploadService
+{
+    struct PendingImage
+    {
+        VkImage image;
+        VkImageSubresourceRange range;
+        VkImageLayout finalLayout;
+        VkBuffer source;
+        std::vector<VkBufferImageCopy> regions; //Offsets into source
+    };
+    struct PendingBuffer
+    {
+        VkBuffer source;
+        VkBuffer destination;
+        VkBufferCopy region;
+        bool concurrent;
+    };
+    struct Batch
+    {
+        uint64_t value;
+        VkCommandBuffer transferCmd = VK_NULL_HANDLE;
+        VkCommandBuffer acquireCmd = VK_NULL_HANDLE;
+        VkFence transferFence = VK_NULL_HANDLE;
+        VkFence acquireFence = VK_NULL_HANDLE;
+        VkSemaphore released = VK_NULL_HANDLE;
+        bool transferDone = false;
+        uint64_t ringEnd; //Ring space up to here is free once the copy has finished
+        std::vector<MemoryBuffer> dedicated;
+        std::vector<VkImageMemoryBarrier> imageAcquires;
+        std::vector<VkBufferMemoryBarrier> bufferAcquires;
+    };
+
+    MemoryBuffer ring = {};
+    unsigned char *ringMapped = NULL;
+    VkDeviceSize ringSize = 0;
+    //Absolute byte positions, the offset in the ring is position % ringSize
+    uint64_t ringHead = 0;
+    uint64_t ringTail = 0;
+    bool handOver = false; //Transfer and graphics are different families
+
+    std::vector<PendingImage> pendingImages;
+    std::vector<PendingBuffer> pendingBuffers;
+    std::vector<MemoryBuffer> pendingDedicated; //Uploads too big for the ring
+    VkDeviceSize pendingBytes = 0;
+    std::deque<Batch> inFlight;
+    uint64_t nextValue = 1; //Value the pending uploads will get
+    uint64_t readyValue = 0;
+
+    bool create(VkDeviceSize stagingSize);
+    //Every region of the image is written, whatever it held before is discarded
+    //Region buffer offsets are relative to data, texelBytes keeps them aligned in the ring
+    UploadTicket uploadImage(VkImage image, VkImageSubresourceRange range, VkImageLayout finalLayout,
+                             const void *data, VkDeviceSize size, uint32_t texelBytes,
+                             std::vector<VkBufferImageCopy> regions);
+    //Same as uploadImage, but hands back staging memory for the caller to fill in place
+    //Any thread can write it, all writes must be done before the next call into the service
+    UploadTicket reserveImage(VkImage image, VkImageSubresourceRange range, VkImageLayout finalLayout,
+                              VkDeviceSize size, uint32_t texelBytes, std::vector<VkBufferImageCopy> regions,
+                              unsigned char **destination);
+    //Exclusive buffers must belong to the graphics family, ownership is handed over like an image's
+    //Concurrent ones have nothing to hand over, but the graphics side still only sees them once the copy has finished
+    UploadTicket uploadBuffer(VkBuffer buffer, VkDeviceSize offset, const void *data, VkDeviceSize size,
+                              bool concurrent = false);
+
+    //Submits everything pending as one batch
+    bool flush();
+    //Once per frame, never blocks
+    void poll();
+    bool ready(uint64_t value);
+    void wait(uint64_t value);
+    //Blocks until everything uploaded so far is ready
+    void waitAll();
+    void destroy();
+
+    unsigned char *reserve(VkDeviceSize size, VkDeviceSize alignment, VkBuffer *source, VkDeviceSize *offset);
+    bool stage(const void *data, VkDeviceSize size, VkDeviceSize alignment, VkBuffer *source, VkDeviceSize *offset);
+    bool allocate(VkDeviceSize size, VkDeviceSize alignment, VkDeviceSize *offset);
+    bool submitAcquire(Batch &batch);
+    void release(Batch &batch);
+};
+
+#endif // UPLOADSERVICE_H_INCLUDED
@@ -0,0 +1,647 @@
+#include "virtualTexture.h"
+
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+#include <stb_image.h>
+
+#include "vulkanDefinitions.h"
+#include "textureCompression.h" //generateMips
+#include "samplerCache.h"
+#include "cpuProfiler.h"
+
+extern VkDevice logicalDevice;
+extern SamplerCache samplerCache;
+
+//Start of a .vtex file, native byte order like the rest of the caches
+struct VirtualFileHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint32_t width;
+    uint32_t height;
+    uint32_t pageSize;
+    uint32_t border;
+    uint32_t levels;
+};
+static const uint32_t VIRTUAL_FILE_VERSION = 1;
+
+static const uint32_t PAGE_STRIDE = VIRTUAL_PAGE_SIZE + 2 * VIRTUAL_PAGE_BORDER;
+static const uint32_t PAGE_BYTES = PAGE_STRIDE * PAGE_STRIDE * 4;
+static const uint32_t NO_PAGE = 0xFFFFFFFF;
+
+static uint32_t pageKey(uint32_t level, uint32_t x, uint32_t y)
+{
+    return level << 24 | y << 12 | x;
+}
+
+static uint32_t keyLevel(uint32_t key)
+{
+    return key >> 24;
+}
+
+//Level sizes and page counts, coarsest level is the first to fit in one page
+static uint32_t levelLayout(uint32_t width, uint32_t height, std::vector<glm::uvec4> *levelPages)
+{
+    levelPages->clear();
+    uint32_t first = 0;
+    for(uint32_t level = 0; level < VIRTUAL_MAX_LEVELS; level++)
+    {
+        uint32_t levelWidth = std::max(1u, width >> level);
+        uint32_t levelHeight = std::max(1u, height >> level);
+        glm::uvec4 pages((levelWidth + VIRTUAL_PAGE_SIZE - 1) / VIRTUAL_PAGE_SIZE,
+                         (levelHeight + VIRTUAL_PAGE_SIZE - 1) / VIRTUAL_PAGE_SIZE, first, 0);
+        levelPages->push_back(pages);
+        first += pages.x * pages.y;
+        if(levelWidth <= VIRTUAL_PAGE_SIZE && levelHeight <= VIRTUAL_PAGE_SIZE)
+            break;
+    }
+    return levelPages->size();
+}
+
+bool VirtualTexture::bake(std::string imagePath, std::string tiledPath)
+{
+    PROFILE_ZONE("bakeVirtualTexture");
+    int imageWidth, imageHeight, channels;
+    unsigned char *rgba = stbi_load(imagePath.c_str(), &imageWidth, &imageHeight, &channels, 4);
+    if(rgba == NULL)
+    {
+        std::cout << "Virtual texture image could not be read: " << imagePath << std::endl;
+        return false;
+    }
+    std::vector<glm::uvec4> levelPages;
+    uint32_t levels = levelLayout(imageWidth, imageHeight, &levelPages);
+    glm::uvec4 coarsest = levelPages[levels - 1];
+    //Page coordinates get 12 bits in the feedback
+    if(coarsest.x != 1 || coarsest.y != 1 || levelPages[0].x > 4096 || levelPages[0].y > 4096)
+    {
+        std::cout << "Virtual texture image too large: " << imagePath << std::endl;
+        stbi_image_free(rgba);
+        return false;
+    }
+    std::vector<std::vector<unsigned char> > mips = generateMips(rgba, imageWidth, imageHeight);
+    stbi_image_free(rgba);
+
+    std::string partial = tiledPath + ".partial";
+    {
+        std::ofstream file(partial.c_str(), std::ios::binary);
+        if(!file.is_open())
+        {
+            std::cout << "Virtual texture file could not be opened: " << partial << std::endl;
+            return false;
+        }
+        VirtualFileHeader header = {{'V', 'T', 'E', 'X'}, VIRTUAL_FILE_VERSION, (uint32_t)imageWidth, (uint32_t)imageHeight,
+                                    VIRTUAL_PAGE_SIZE, VIRTUAL_PAGE_BORDER, levels};
+        file.write((const char*)&header, sizeof(header));
+
+        //Border texels come from the neighbouring pages, clamped at the image edge
+        std::vector<unsigned char> page(PAGE_BYTES);
+        for(uint32_t level = 0; level < levels; level++)
+        {
+            int levelWidth = std::max(1, imageWidth >> level);
+            int levelHeight = std::max(1, imageHeight >> level);
+            const unsigned char *source = mips[level].data();
+            for(uint32_t y = 0; y < levelPages[level].y; y++)
+            {
+                for(uint32_t x = 0; x < levelPages[level].x; x++)
+                {
+                    for(uint32_t row = 0; row < PAGE_STRIDE; row++)
+                    {
+                        int sourceY = std::min(std::max((int)(y * VIRTUAL_PAGE_SIZE + row) - (int)VIRTUAL_PAGE_BORDER, 0), levelHeight - 1);
+                        for(uint32_t column = 0; column < PAGE_STRIDE; column++)
+                        {
+                            int sourceX = std::min(std::max((int)(x * VIRTUAL_PAGE_SIZE + column) - (int)VIRTUAL_PAGE_BORDER, 0), levelWidth - 1);
+                            memcpy(&page[(row * PAGE_STRIDE + column) * 4], &source[((size_t)sourceY * levelWidth + sourceX) * 4], 4);
+                        }
+                    }
+                    file.write((const char*)page.data(), page.size());
+                }
+            }
+        }
+        if(!file.good())
+        {
+            std::cout << "Virtual texture file could not be written: " << partial << std::endl;
+            return false;
+        }
+    }
+    std::remove(tiledPath.c_str());
+    if(std::rename(partial.c_str(), tiledPath.c_str()) != 0)
+    {
+        std::cout << "Virtual texture file could not be renamed: " << tiledPath << std::endl;
+        return false;
+    }
+
+    std::cout << "Virtual texture baked: " << tiledPath << " (" << imageWidth << "x" << imageHeight << ", "
+              << levels << " levels, " << levelPages[levels - 1].z + 1 << " pages)" << std::endl;
+    return true;
+}
+
+bool VirtualTexture::create(std::string tiledPath, VkExtent2D screenExtent, uint32_t frameSlots,
+                            const ShaderReflection &reflection, DescriptorLayoutCache &layoutCache, DescriptorAllocator &allocator)
+{
+    if(reflection.sets.size() != 2 || reflection.sets[1].size() != 3)
+    {
+        std::cout << "Virtual texture shaders do not match the page table" << std::endl;
+        return false;
+    }
+
+    path = tiledPath;
+    std::ifstream file(path.c_str(), std::ios::binary);
+    VirtualFileHeader header;
+    if(!file.read((char*)&header, sizeof(header)) || memcmp(header.magic, "VTEX", 4) != 0 ||
+       header.version != VIRTUAL_FILE_VERSION)
+    {
+        std::cout << "Not a virtual texture file: " << path << std::endl;
+        return false;
+    }
+    width = header.width;
+    height = header.height;
+    levels = levelLayout(width, height, &levelPages);
+    if(header.pageSize != VIRTUAL_PAGE_SIZE || header.border != VIRTUAL_PAGE_BORDER || header.levels != levels)
+    {
+        std::cout << "Virtual texture file was tiled differently, rebake it: " << path << std::endl;
+        return false;
+    }
+    fileHeaderSize = sizeof(header);
+
+    //Page cache, one level since each page carries its own mips as separate pages
+    uint32_t physicalSize = VIRTUAL_PHYSICAL_PAGES * PAGE_STRIDE;
+    VkImageCreateInfo imageCreateInfo = {};
+    imageCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+    imageCreateInfo.imageType = VK_IMAGE_TYPE_2D;
+    imageCreateInfo.format = VK_FORMAT_R8G8B8A8_UNORM;
+    imageCreateInfo.extent = {physicalSize, physicalSize, 1};
+    imageCreateInfo.mipLevels = 1;
+    imageCreateInfo.arrayLayers = 1;
+    imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+    imageCreateInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+    imageCreateInfo.usage = VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT;
+    imageCreateInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+    imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+    VkResult result = vkCreateImage(logicalDevice, &imageCreateInfo, NULL, &physicalImage);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Virtual texture page cache creation failed (" << result << ")" << std::endl;
+        return false;
+    }
+
+    VkMemoryRequirements memoryRequirements;
+    vkGetImageMemoryRequirements(logicalDevice, physicalImage, &memoryRequirements);
+    VkMemoryAllocateInfo allocateInfo = {};
+    allocateInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+    allocateInfo.allocationSize = memoryRequirements.size;
+    allocateInfo.memoryTypeIndex = getMemoryTypeIndex(memoryRequirements.memoryTypeBits, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    result = vkAllocateMemory(logicalDevice, &allocateInfo, NULL, &physicalMemory);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Virtual texture page cache allocation failed (" << result << ")" << std::endl;
+        return false;
+    }
+    vkBindImageMemory(logicalDevice, physicalImage, physicalMemory, 0);
+
+    VkImageViewCreateInfo viewCreateInfo = {};
+    viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+    viewCreateInfo.image = physicalImage;
+    viewCreateInfo.viewType = VK_IMAGE_VIEW_TYPE_2D;
+    viewCreateInfo.format = imageCreateInfo.format;
+    viewCreateInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    result = vkCreateImageView(logicalDevice, &viewCreateInfo, NULL, &physicalView);
+    if(result != VK_SUCCESS)
+    {
+        std::cout << "Virtual texture view creation failed (" << result << ")" << std::endl;
+        return false;
+    }
+
+    //Borders cover bilinear, there is nothing to blend between levels with
+    VkSamplerCreateInfo samplerCreateInfo = {};
+    samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+    samplerCreateInfo.magFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.minFilter = VK_FILTER_LINEAR;
+    samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+    samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+    samplerCreateInfo.maxLod = 0;
+    samplerCreateInfo.borderColor = VK_BORDER_COLOR_FLOAT_OPAQUE_WHITE;
+    if(!samplerCache.get(samplerCreateInfo, &sampler))
+        return false;
+    physical.assign(VIRTUAL_PHYSICAL_PAGES * VIRTUAL_PHYSICAL_PAGES, PhysicalPage());
+
+    //Per slot buffers, the feedback starts out asking for nothing
+    feedbackWidth = (screenExtent.width + VIRTUAL_FEEDBACK_SCALE - 1) / VIRTUAL_FEEDBACK_SCALE;
+    feedbackHeight = (screenExtent.height + VIRTUAL_FEEDBACK_SCALE - 1) / VIRTUAL_FEEDBACK_SCALE;
+    std::vector<uint32_t> emptyFeedback(feedbackWidth * feedbackHeight, NO_PAGE);
+    uint32_t entryCount = levelPages[levels - 1].z + 1;
+    tableBuffers.resize(frameSlots, MemoryBuffer());
+    feedbackBuffers.resize(frameSlots, MemoryBuffer());
+    stagingBuffers.resize(frameSlots, MemoryBuffer());
+    tableVersions.assign(frameSlots, 0);
+    copies.resize(frameSlots);
+    for(uint32_t i = 0; i < frameSlots; i++)
+    {
+        if(!createBuffer(sizeof(VirtualTableHeader) + sizeof(uint32_t) * entryCount, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                         NULL, &tableBuffers[i]) ||
+           !createBuffer(sizeof(uint32_t) * emptyFeedback.size(), VK_BUFFER_USAGE_STORAGE_BUFFER_BIT,
+                         emptyFeedback.data(), &feedbackBuffers[i]) ||
+           !createBuffer(PAGE_BYTES * VIRTUAL_UPLOADS_PER_FRAME, VK_BUFFER_USAGE_TRANSFER_SRC_BIT, NULL, &stagingBuffers[i]))
+            return false;
+    }
+
+    //Layout and sets
+    std::vector<VkDescriptorSetLayout> setLayouts;
+    if(!reflection.createSetLayouts(layoutCache, &setLayouts))
+        return false;
+    layout = setLayouts[1];
+    sets.resize(frameSlots);
+    for(uint32_t i = 0; i < frameSlots; i++)
+    {
+        if(!allocator.allocate(layout, &sets[i]))
+            return false;
+
+        VkDescriptorBufferInfo tableInfo = {tableBuffers[i].buffer, 0, VK_WHOLE_SIZE};
+        VkDescriptorImageInfo imageInfo = {sampler, physicalView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL};
+        VkDescriptorBufferInfo feedbackInfo = {feedbackBuffers[i].buffer, 0, VK_WHOLE_SIZE};
+
+        VkWriteDescriptorSet writes[3] = {};
+        writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[0].dstSet = sets[i];
+        writes[0].dstBinding = 0;
+        writes[0].descriptorCount = 1;
+        writes[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[0].pBufferInfo = &tableInfo;
+
+        writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[1].dstSet = sets[i];
+        writes[1].dstBinding = 1;
+        writes[1].descriptorCount = 1;
+        writes[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+        writes[1].pImageInfo = &imageInfo;
+
+        writes[2].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+        writes[2].dstSet = sets[i];
+        writes[2].dstBinding = 2;
+        writes[2].descriptorCount = 1;
+        writes[2].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+        writes[2].pBufferInfo = &feedbackInfo;
+        vkUpdateDescriptorSets(logicalDevice, 3, writes, 0, NULL);
+    }
+    if(!reflection.createPipelineLayout(setLayouts, &pipelineLayout))
+        return false;
+
+    //Coarsest page is read now and never evicted, it goes in with the first pass
+    LoadedPage coarsest;
+    coarsest.key = pageKey(levels - 1, 0, 0);
+    if(!readPage(file, coarsest.key, &coarsest.pixels) || !stagePage(0, coarsest))
+    {
+        std::cout << "Virtual texture coarsest page could not be read: " << path << std::endl;
+        return false;
+    }
+    physical[resident[coarsest.key]].pinned = true;
+
+    loaderStopping = false;
+    loader = std::thread(&VirtualTexture::loaderMain, this);
+    enabled = true;
+    std::cout << "Virtual texture: " << path << " (" << width << "x" << height << ", " << levels << " levels, "
+              << entryCount << " pages, " << physical.size() << " page cache)" << std::endl;
+
+    return true;
+}
+
+uint64_t VirtualTexture::pageOffset(uint32_t key) const
+{
+    const glm::uvec4 &pages = levelPages[keyLevel(key)];
+    uint32_t x = key & 0xFFF;
+    uint32_t y = (key >> 12) & 0xFFF;
+    return fileHeaderSize + (uint64_t)(pages.z + y * pages.x + x) * PAGE_BYTES;
+}
+
+bool VirtualTexture::readPage(std::ifstream &file, uint32_t key, std::vector<unsigned char> *pixels) const
+{
+    pixels->resize(PAGE_BYTES);
+    file.clear();
+    file.seekg(pageOffset(key));
+    return (bool)file.read((char*)pixels->data(), PAGE_BYTES);
+}
+
+//Into a free page, or the least recently used one nothing has asked for this frame
+bool VirtualTexture::stagePage(uint32_t slot, const LoadedPage &page)
+{
+    if(copies[slot].size() >= VIRTUAL_UPLOADS_PER_FRAME)
+        return false;
+
+    uint32_t chosen = NO_PAGE;
+    for(uint32_t i = 0; i < physical.size(); i++)
+    {
+        if(physical[i].key == NO_PAGE)
+        {
+            chosen = i;
+            break;
+        }
+        if(!physical[i].pinned && physical[i].lastUsed < frames &&
+           (chosen == NO_PAGE || physical[i].lastUsed < physical[chosen].lastUsed))
+            chosen = i;
+    }
+    if(chosen == NO_PAGE)
+        return false;
+
+    if(physical[chosen].key != NO_PAGE)
+    {
+        resident.erase(physical[chosen].key);
+        pagesEvicted++;
+    }
+    physical[chosen].key = page.key;
+    physical[chosen].lastUsed = frames;
+    physical[chosen].pinned = false;
+    resident[page.key] = chosen;
+    residentVersion++;
+
+    VkDeviceSize offset = copies[slot].size() * PAGE_BYTES;
+    void *mapped;
+    vkMapMemory(logicalDevice, stagingBuffers[slot].bufferMemory, offset, PAGE_BYTES, 0, &mapped);
+    memcpy(mapped, page.pixels.data(), PAGE_BYTES);
+    VkMappedMemoryRange range = {VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, NULL, stagingBuffers[slot].bufferMemory, offset, PAGE_BYTES};
+    vkFlushMappedMemoryRanges(logicalDevice, 1, &range);
+    vkUnmapMemory(logicalDevice, stagingBuffers[slot].bufferMemory);
+
+    VkBufferImageCopy region = {};
+    region.bufferOffset = offset;
+    region.imageSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+    region.imageSubresource.layerCount = 1;
+    region.imageOffset = {(int32_t)((chosen % VIRTUAL_PHYSICAL_PAGES) * PAGE_STRIDE),
+                          (int32_t)((chosen / VIRTUAL_PHYSICAL_PAGES) * PAGE_STRIDE), 0};
+    region.imageExtent = {PAGE_STRIDE, PAGE_STRIDE, 1};
+    copies[slot].push_back(region);
+    pagesLoaded++;
+    return true;
+}
+
+//Coarsest first, so a missing page takes whatever its parent resolved to
+void VirtualTexture::buildEntries()
+{
+    entries.resize(levelPages[levels - 1].z + 1);
+    for(int level = levels - 1; level >= 0; level--)
+    {
+        const glm::uvec4 &pages = levelPages[level];
+        for(uint32_t y = 0; y < pages.y; y++)
+        {
+            for(uint32_t x = 0; x < pages.x; x++)
+            {
+                uint32_t &entry = entries[pages.z + y * pages.x + x];
+                std::map<uint32_t, uint32_t>::const_iterator it = resident.find(pageKey(level, x, y));
+                if(it != resident.end())
+                    entry = (it->second % VIRTUAL_PHYSICAL_PAGES) | (it->second / VIRTUAL_PHYSICAL_PAGES) << 8 | level << 16;
+                else
+                {
+                    const glm::uvec4 &parent = levelPages[level + 1];
+                    entry = entries[parent.z + std::min(y / 2, parent.y - 1) * parent.x + std::min(x / 2, parent.x - 1)];
+                }
+            }
+        }
+    }
+    entriesVersion = residentVersion;
+}
+
+void VirtualTexture::update(uint32_t slot)
+{
+    PROFILE_ZONE("virtualTexture");
+    frames++;
+
+    //What the slot's last pass asked for, then cleared for its next one
+    std::set<uint32_t> wanted;
+    {
+        MemoryBuffer &feedback = feedbackBuffers[slot];
+        VkDeviceSize size = sizeof(uint32_t) * feedbackWidth * feedbackHeight;
+        void *mapped;
+        vkMapMemory(logicalDevice, feedback.bufferMemory, 0, size, 0, &mapped);
+        VkMappedMemoryRange range = {VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, NULL, feedback.bufferMemory, 0, VK_WHOLE_SIZE};
+        vkInvalidateMappedMemoryRanges(logicalDevice, 1, &range);
+        const uint32_t *requested = (const uint32_t*)mapped;
+        for(uint32_t i = 0; i < feedbackWidth * feedbackHeight; i++)
+        {
+            uint32_t key = requested[i];
+            if(key == NO_PAGE || keyLevel(key) >= levels)
+                continue;
+            const glm::uvec4 &pages = levelPages[keyLevel(key)];
+            if((key & 0xFFF) < pages.x && ((key >> 12) & 0xFFF) < pages.y)
+                wanted.insert(key);
+        }
+        memset(mapped, 0xFF, size);
+        vkFlushMappedMemoryRanges(logicalDevice, 1, &range);
+        vkUnmapMemory(logicalDevice, feedback.bufferMemory);
+    }
+
+    //Faults ask for every missing page between them and the resident one standing in
+    std::vector<uint32_t> newRequests;
+    for(std::set<uint32_t>::iterator it = wanted.begin(); it != wanted.end(); ++it)
+    {
+        pagesRequested++;
+        uint32_t key = *it;
+        std::map<uint32_t, uint32_t>::iterator found = resident.find(key);
+        if(found == resident.end())
+        {
+            pageFaults++;
+            faultsSinceOverlay++;
+        }
+        while(found == resident.end())
+        {
+            if(pending.insert(key).second)
+                newRequests.push_back(key);
+            uint32_t level = keyLevel(key) + 1;
+            const glm::uvec4 &parent = levelPages[level];
+            key = pageKey(level, std::min((key & 0xFFF) / 2, parent.x - 1), std::min(((key >> 12) & 0xFFF) / 2, parent.y - 1));
+            found = resident.find(key);
+        }
+        physical[found->second].lastUsed = frames;
+    }
+    framesSinceOverlay++;
+
+    //Take finished loads, whatever doesn't fit this frame waits for the next
+    std::vector<LoadedPage> arrived;
+    {
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        std::sort(newRequests.begin(), newRequests.end(), [](uint32_t a, uint32_t b){ return keyLevel(a) > keyLevel(b); });
+        requests.insert(requests.end(), newRequests.begin(), newRequests.end());
+        size_t count = std::min(loaded.size(), (size_t)VIRTUAL_UPLOADS_PER_FRAME - copies[slot].size());
+        arrived.assign(std::make_move_iterator(loaded.begin()), std::make_move_iterator(loaded.begin() + count));
+        loaded.erase(loaded.begin(), loaded.begin() + count);
+    }
+    if(!newRequests.empty())
+        loaderWake.notify_one();
+    for(uint32_t i = 0; i < arrived.size(); i++)
+    {
+        //A page that can't be placed is dropped, it is asked for again if it is still wanted
+        pending.erase(arrived[i].key);
+        if(!arrived[i].pixels.empty() && resident.find(arrived[i].key) == resident.end())
+            stagePage(slot, arrived[i]);
+    }
+
+    //Header every frame for the feedback pixel, entries only when the slot's copy is stale
+    frameIndex++;
+    MemoryBuffer &table = tableBuffers[slot];
+    bool stale = tableVersions[slot] != residentVersion;
+    if(stale && entriesVersion != residentVersion)
+        buildEntries();
+    VkDeviceSize size = sizeof(VirtualTableHeader) + (stale ? sizeof(uint32_t) * entries.size() : 0);
+    void *mapped;
+    vkMapMemory(logicalDevice, table.bufferMemory, 0, size, 0, &mapped);
+    VirtualTableHeader header = {};
+    header.width = width;
+    header.height = height;
+    header.levels = levels;
+    header.pageSize = VIRTUAL_PAGE_SIZE;
+    header.border = VIRTUAL_PAGE_BORDER;
+    header.physicalPages = VIRTUAL_PHYSICAL_PAGES;
+    header.feedbackWidth = feedbackWidth;
+    header.feedbackHeight = feedbackHeight;
+    header.frameIndex = frameIndex;
+    for(uint32_t i = 0; i < levels; i++)
+    {
+        header.levelPages[i] = levelPages[i];
+    }
+    memcpy(mapped, &header, sizeof(header));
+    if(stale)
+        memcpy((char*)mapped + sizeof(header), entries.data(), sizeof(uint32_t) * entries.size());
+    VkMappedMemoryRange range = {VK_STRUCTURE_TYPE_MAPPED_MEMORY_RANGE, NULL, table.bufferMemory, 0, VK_WHOLE_SIZE};
+    vkFlushMappedMemoryRanges(logicalDevice, 1, &range);
+    vkUnmapMemory(logicalDevice, table.bufferMemory);
+    tableVersions[slot] = residentVersion;
+}
+
+//Graphics queue, the barrier also keeps earlier passes' reads of a reused page ahead of the copy
+void VirtualTexture::cmdUpload(VkCommandBuffer cmd, uint32_t slot)
+{
+    if(copies[slot].empty() && physicalInitialised)
+        return;
+
+    VkImageMemoryBarrier barrier = {};
+    barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+    barrier.srcAccessMask = physicalInitialised ? VK_ACCESS_SHADER_READ_BIT : 0;
+    barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.oldLayout = physicalInitialised ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED;
+    barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+    barrier.image = physicalImage;
+    barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+    vkCmdPipelineBarrier(cmd, physicalInitialised ? VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, NULL, 0, NULL, 1, &barrier);
+
+    if(!copies[slot].empty())
+        vkCmdCopyBufferToImage(cmd, stagingBuffers[slot].buffer, physicalImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+                               copies[slot].size(), copies[slot].data());
+
+    barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+    barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+                         0, 0, NULL, 0, NULL, 1, &barrier);
+    physicalInitialised = true;
+    //Staging is reused once the slot's fence has been waited on
+    copies[slot].clear();
+}
+
+void VirtualTexture::cmdFinishFeedback(VkCommandBuffer cmd)
+{
+    VkMemoryBarrier memoryBarrier = {};
+    memoryBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+    memoryBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+    memoryBarrier.dstAccessMask = VK_ACCESS_HOST_READ_BIT;
+    vkCmdPipelineBarrier(cmd, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+                         0, 1, &memoryBarrier, 0, NULL, 0, NULL);
+}
+
+std::string VirtualTexture::overlayText()
+{
+    std::stringstream ss;
+    ss << std::fixed << std::setprecision(1);
+    ss << " | vt " << 100.0 * resident.size() / physical.size() << "% cache, "
+       << (framesSinceOverlay > 0 ? (double)faultsSinceOverlay / framesSinceOverlay : 0.0) << " faults/frame";
+    faultsSinceOverlay = 0;
+    framesSinceOverlay = 0;
+    return ss.str();
+}
+
+void VirtualTexture::printStats() const
+{
+    if(!enabled)
+        return;
+    std::cout << std::fixed << std::setprecision(1);
+    std::cout << "Virtual texture: " << resident.size() << " of " << physical.size() << " cache pages resident ("
+              << 100.0 * resident.size() / (levelPages[levels - 1].z + 1) << "% of the texture), "
+              << pagesLoaded << " loaded, " << pagesEvicted << " evicted" << std::endl;
+    std::cout << "Virtual texture faults: " << pageFaults << " of " << pagesRequested << " requested pages ("
+              << (pagesRequested > 0 ? 100.0 * pageFaults / pagesRequested : 0.0) << "%), "
+              << (frames > 0 ? (double)pageFaults / frames : 0.0) << " per frame over " << frames << " frames" << std::endl;
+    std::cout.unsetf(std::ios::floatfield);
+}
+
+void VirtualTexture::loaderMain()
+{
+    profilerSetThreadName("virtualTexture");
+    std::ifstream file(path.c_str(), std::ios::binary);
+    while(true)
+    {
+        uint32_t key;
+        {
+            std::unique_lock<std::mutex> lock(loaderMutex);
+            loaderWake.wait(lock, [this]{ return loaderStopping || !requests.empty(); });
+            if(loaderStopping)
+                return;
+            key = requests.front();
+            requests.pop_front();
+        }
+
+        //Empty pixels tell the main thread to forget the request
+        LoadedPage page;
+        page.key = key;
+        if(!readPage(file, key, &page.pixels))
+        {
+            std::cout << "Virtual texture page could not be read: " << key << std::endl;
+            page.pixels.clear();
+        }
+        std::lock_guard<std::mutex> lock(loaderMutex);
+        loaded.push_back(std::move(page));
+    }
+}
+
+//Also cleans up after a partial create, the set layout belongs to the cache
+void VirtualTexture::destroy()
+{
+    if(loader.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(loaderMutex);
+            loaderStopping = true;
+        }
+        loaderWake.notify_all();
+        loader.join();
+    }
+    requests.clear();
+    loaded.clear();
+    pending.clear();
+
+    vkDestroyPipelineLayout(logicalDevice, pipelineLayout, NULL);
+    for(uint32_t i = 0; i < tableBuffers.size(); i++)
+    {
+        tableBuffers[i].destroy();
+        feedbackBuffers[i].destroy();
+        stagingBuffers[i].destroy();
+    }
+    vkDestroyImageView(logicalDevice, physicalView, NULL);
+    vkDestroyImage(logicalDevice, physicalImage, NULL);
+    vkFreeMemory(logicalDevice, physicalMemory, NULL);
+    pipelineLayout = VK_NULL_HANDLE;
+    sampler = VK_NULL_HANDLE;
+    physicalView = VK_NULL_HANDLE;
+    physicalImage = VK_NULL_HANDLE;
+    physicalMemory = VK_NULL_HANDLE;
+    tableBuffers.clear();
+    feedbackBuffers.clear();
+    stagingBuffers.clear();
+    enabled = false;
+}
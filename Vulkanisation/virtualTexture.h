@@ -0,0 +1,138 @@
+#ifndef VIRTUALTEXTURE_H_INCLUDED
+#define VIRTUALTEXTURE_H_INCLUDED
+
+#define VK_NO_PROTOTYPES
+#include <vulkan/vulkan.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <deque>
+#include <map>
+#include <set>
+#include <string>
+#include <fstream>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "assorted.h" //MemoryBuffer
+#include "descriptors.h"
+#include "shaderReflection.h"
+
+//Must match virtual.frag
+const uint32_t VIRTUAL_PAGE_SIZE = 128;
+const uint32_t VIRTUAL_PAGE_BORDER = 4; //Texels repeated from the neighbours each side, enough for bilinear
+const uint32_t VIRTUAL_MAX_LEVELS = 16;
+const uint32_t VIRTUAL_FEEDBACK_SCALE = 8; //Screen pixels per feedback texel, each way
+const uint32_t VIRTUAL_PHYSICAL_PAGES = 16; //Page cache is this many pages each way
+const uint32_t VIRTUAL_UPLOADS_PER_FRAME = 8;
+
+//std430 start of the indirection buffer, the page table entries follow
+struct VirtualTableHeader
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t levels;
+    uint32_t pageSize;
+    uint32_t border;
+    uint32_t physicalPages;
+    uint32_t feedbackWidth;
+    uint32_t feedbackHeight;
+    uint32_t frameIndex; //Picks which pixel of each feedback block writes
+    uint32_t padding[3];
+    glm::uvec4 levelPages[VIRTUAL_MAX_LEVELS]; //x,y pages across, z first entry
+};
+
+//Image far bigger than would fit as a Texture, sampled through a fixed cache of pages
+//Pages come from a pre-tiled .vtex file: a header then every level's pages in rows, each page with its border
+//The offscreen pass writes the page and level each block of pixels wants into a feedback buffer, which is read
+//once the slot comes back round. Missing pages are read on a loader thread and copied into the cache before the
+//next pass, until then the table points at the nearest resident coarser page. The coarsest level is one page and
+//always resident, so every lookup lands somewhere
+//Entries and feedback share an encoding: level << 24 | y << 12 | x for a virtual page,
+//level << 16 | y << 8 | x for the physical page holding it
+struct VirtualTexture
+{
+    struct PhysicalPage
+    {
+        uint32_t key = 0xFFFFFFFF; //Virtual page held, all ones when free
+        uint64_t lastUsed = 0;
+        bool pinned = false;
+    };
+    struct LoadedPage
+    {
+        uint32_t key;
+        std::vector<unsigned char> pixels;
+    };
+
+    bool enabled = false;
+    std::string path;
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t levels = 0;
+    std::vector<glm::uvec4> levelPages;
+    uint64_t fileHeaderSize = 0;
+
+    VkImage physicalImage = VK_NULL_HANDLE;
+    VkDeviceMemory physicalMemory = VK_NULL_HANDLE;
+    VkImageView physicalView = VK_NULL_HANDLE;
+    VkSampler sampler = VK_NULL_HANDLE; //Sampler cache owns it
+    bool physicalInitialised = false;
+    std::vector<PhysicalPage> physical;
+    std::map<uint32_t, uint32_t> resident; //Virtual page to physical index
+    uint64_t residentVersion = 1; //Bumped whenever a page comes or goes
+    std::vector<uint32_t> entries; //Page table for residentVersion
+    uint64_t entriesVersion = 0;
+
+    //One of each per frame slot
+    VkDescriptorSetLayout layout = VK_NULL_HANDLE;
+    VkPipelineLayout pipelineLayout = VK_NULL_HANDLE;
+    std::vector<VkDescriptorSet> sets;
+    std::vector<MemoryBuffer> tableBuffers;
+    std::vector<uint64_t> tableVersions;
+    std::vector<MemoryBuffer> feedbackBuffers;
+    std::vector<MemoryBuffer> stagingBuffers;
+    std::vector<std::vector<VkBufferImageCopy> > copies; //Staged for the slot's next pass
+    uint32_t feedbackWidth = 0;
+    uint32_t feedbackHeight = 0;
+    uint32_t frameIndex = 0;
+
+    //Loader thread, reads requested pages from the file
+    std::thread loader;
+    std::mutex loaderMutex;
+    std::condition_variable loaderWake;
+    std::deque<uint32_t> requests;
+    std::vector<LoadedPage> loaded;
+    bool loaderStopping = false;
+    std::set<uint32_t> pending; //Main thread, requested and not yet in the cache
+
+    uint64_t frames = 0;
+    uint64_t pagesRequested = 0; //Distinct pages the feedback asked for, summed over frames
+    uint64_t pageFaults = 0; //Of those, ones that were not resident
+    uint64_t pagesLoaded = 0;
+    uint64_t pagesEvicted = 0;
+    uint64_t faultsSinceOverlay = 0;
+    uint64_t framesSinceOverlay = 0;
+
+    //Offline, tiles an image file into tiledPath
+    static bool bake(std::string imagePath, std::string tiledPath);
+    //Layouts come from the reflected virtual shaders: set 0 camera, set 1 table, page cache and feedback
+    bool create(std::string tiledPath, VkExtent2D screenExtent, uint32_t frameSlots,
+                const ShaderReflection &reflection, DescriptorLayoutCache &layoutCache, DescriptorAllocator &allocator);
+    //Once the slot's fence has been waited on: reads its feedback, takes finished loads and rewrites its table
+    void update(uint32_t slot);
+    //Before the render pass, copies the pages staged for the slot into the cache
+    void cmdUpload(VkCommandBuffer cmd, uint32_t slot);
+    //After the render pass, so the feedback can be read once the slot's fence signals
+    void cmdFinishFeedback(VkCommandBuffer cmd);
+    std::string overlayText();
+    void printStats() const;
+    void destroy();
+
+    uint64_t pageOffset(uint32_t key) const;
+    bool readPage(std::ifstream &file, uint32_t key, std::vector<unsigned char> *pixels) const;
+    bool stagePage(uint32_t slot, const LoadedPage &page);
+    void buildEntries();
+    void loaderMain();
+};
+
+#endif // VIRTUALTEXTURE_H_INCLUDED
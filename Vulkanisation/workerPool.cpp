@@ -0,0 +1,116 @@
+#include "workerPool.h"
+
+#include <atomic>
+#include <algorithm>
+#include <memory>
+
+#include "cpuProfiler.h"
+
+void WorkerPool::start(uint32_t threadCount)
+{
+    if(threadCount == 0)
+    {
+        threadCount = std::thread::hardware_concurrency();
+        threadCount = threadCount > 1 ? threadCount - 1 : 1;
+    }
+    stopping = false;
+    for(uint32_t i = 0; i < threadCount; i++)
+    {
+        threads.push_back(std::thread(&WorkerPool::workerMain, this));
+    }
+}
+
+void WorkerPool::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    for(uint32_t i = 0; i < threads.size(); i++)
+    {
+        threads[i].join();
+    }
+    threads.clear();
+    jobs.clear();
+}
+
+void WorkerPool::workerMain()
+{
+    profilerSetThreadName("worker");
+    while(true)
+    {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this]{ return stopping || !jobs.empty(); });
+            if(stopping)
+                return;
+            job = jobs.front();
+            jobs.pop_front();
+        }
+        job();
+    }
+}
+
+void WorkerPool::submit(std::function<void()> job)
+{
+    if(threads.empty())
+    {
+        job();
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        jobs.push_back(job);
+    }
+    wake.notify_one();
+}
+
+//Shared with the helpers, so one that only starts after everything is done finds nothing left and touches nothing else
+struct ParallelLoop
+{
+    std::atomic<uint32_t> next;
+    uint32_t count;
+    uint32_t completed;
+    std::function<void(uint32_t)> *job;
+};
+
+void WorkerPool::parallelFor(uint32_t count, std::function<void(uint32_t)> job)
+{
+    //Indices are taken one at a time, so uneven jobs still spread out
+    std::shared_ptr<ParallelLoop> loop = std::make_shared<ParallelLoop>();
+    loop->next = 0;
+    loop->count = count;
+    loop->completed = 0;
+    loop->job = &job;
+    std::function<void()> drain = [this, loop]
+    {
+        uint32_t ran = 0;
+        for(uint32_t i = loop->next++; i < loop->count; i = loop->next++)
+        {
+            (*loop->job)(i);
+            ran++;
+        }
+        if(ran == 0)
+            return;
+        std::lock_guard<std::mutex> lock(mutex);
+        loop->completed += ran;
+        done.notify_all();
+    };
+
+    uint32_t helpers = std::min<uint32_t>(threads.size(), count > 0 ? count - 1 : 0);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for(uint32_t i = 0; i < helpers; i++)
+        {
+            jobs.push_back(drain);
+        }
+    }
+    wake.notify_all();
+    drain();
+
+    //Waits on the indices rather than the helpers, a pool busy with long jobs or a call from a job never holds this up
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&loop, count]{ return loop->completed == count; });
+}
@@ -0,0 +1,35 @@
+#ifndef WORKERPOOL_H_INCLUDED
+#define WORKERPOOL_H_INCLUDED
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+//Long lived threads for CPU work the main thread hands out while loading
+//Jobs must not touch Vulkan objects the main thread is using
+struct WorkerPool
+{
+    std::vector<std::thread> threads;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    std::deque<std::function<void()> > jobs;
+    bool stopping = false;
+
+    //0 picks from the hardware, leaving a core for the main thread
+    void start(uint32_t threadCount = 0);
+    void stop();
+    //Calls job(i) for every i below count across the pool and the calling thread, returns once all have finished
+    //Runs everything on the calling thread when the pool has not been started. Safe to call from inside a job
+    void parallelFor(uint32_t count, std::function<void(uint32_t)> job);
+    //Runs job on the pool without waiting for it, or straight away when the pool has not been started
+    //Jobs not yet started when the pool stops are dropped
+    void submit(std::function<void()> job);
+
+    void workerMain();
+};
+
+#endif // WORKERPOOL_H_INCLUDED